@@ -63,5 +63,23 @@ int kprobe_fault_handler(struct pt_regs *regs, unsigned int fsr);
 int kprobe_exceptions_notify(struct notifier_block *self,
 			     unsigned long val, void *data);
 
+/* optinsn template addresses */
+extern kprobe_opcode_t optprobe_template_entry;
+extern kprobe_opcode_t optprobe_template_val;
+extern kprobe_opcode_t optprobe_template_call;
+extern kprobe_opcode_t optprobe_template_end;
+
+#define MAX_OPTINSN_SIZE				\
+	(((unsigned long)&optprobe_template_end -	\
+	  (unsigned long)&optprobe_template_entry) /	\
+	 sizeof(kprobe_opcode_t))
+
+/* Only a single ARM instruction is replaced by the relative branch */
+#define RELATIVEJUMP_SIZE	4
+
+struct arch_optimized_insn {
+	/* copy of the detour template, NULL if not prepared */
+	kprobe_opcode_t *insn;
+};
 
 #endif /* _ARM_KPROBES_H */
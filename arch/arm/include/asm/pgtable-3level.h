@@ -104,6 +104,20 @@
  */
 #define L_PGD_SWAPPER		(_AT(pgdval_t, 1) << 55)	/* swapper_pg_dir entry */
 
+/*
+ * Software PMD flags for block (section) mappings of user pages. As with
+ * the PTEs, bits 55 and above are ignored by the hardware.
+ */
+#define PMD_SECT_DIRTY		(_AT(pmdval_t, 1) << 55)
+#define PMD_SECT_SPLITTING	(_AT(pmdval_t, 1) << 56)
+
+/*
+ * A huge page is mapped by a single level 2 block entry.
+ */
+#define HPAGE_SHIFT		PMD_SHIFT
+#define HPAGE_SIZE		(_AC(1, UL) << HPAGE_SHIFT)
+#define HPAGE_MASK		(~(HPAGE_SIZE - 1))
+
 #ifndef __ASSEMBLY__
 
 #define pud_none(pud)		(!pud_val(pud))
@@ -150,6 +164,63 @@ static inline pmd_t *pmd_offset(pud_t *pud, unsigned long addr)
 
 #define set_pte_ext(ptep,pte,ext) cpu_set_pte_ext(ptep,__pte(pte_val(pte)|(ext)))
 
+#ifdef CONFIG_TRANSPARENT_HUGEPAGE
+/*
+ * Transparent huge pages are mapped with level 2 block entries. The
+ * pgprot_t values used for PTEs have the same layout for the attribute,
+ * access permission and access flag bits, so a huge pmd is built from
+ * vma->vm_page_prot by clearing the table bit.
+ */
+#define pmd_trans_huge(pmd)	(pmd_val(pmd) && !(pmd_val(pmd) & PMD_TABLE_BIT))
+#define pmd_trans_splitting(pmd) (pmd_val(pmd) & PMD_SECT_SPLITTING)
+
+#define pmd_young(pmd)		(pmd_val(pmd) & PMD_SECT_AF)
+#define pmd_write(pmd)		(!(pmd_val(pmd) & PMD_SECT_RDONLY))
+#define __HAVE_ARCH_PMD_WRITE
+
+#define PMD_BIT_FUNC(fn,op) \
+static inline pmd_t pmd_##fn(pmd_t pmd) { pmd_val(pmd) op; return pmd; }
+
+PMD_BIT_FUNC(wrprotect,	  |= PMD_SECT_RDONLY);
+PMD_BIT_FUNC(mkwrite,	  &= ~PMD_SECT_RDONLY);
+PMD_BIT_FUNC(mkdirty,	  |= PMD_SECT_DIRTY);
+PMD_BIT_FUNC(mkold,	  &= ~PMD_SECT_AF);
+PMD_BIT_FUNC(mkyoung,	  |= PMD_SECT_AF);
+PMD_BIT_FUNC(mksplitting, |= PMD_SECT_SPLITTING);
+PMD_BIT_FUNC(mkhuge,	  &= ~PMD_TABLE_BIT);
+PMD_BIT_FUNC(mknotpresent, &= ~PMD_TYPE_MASK);
+
+#define pmd_pfn(pmd)		((pmd_val(pmd) & PHYS_MASK & (s32)PMD_MASK) >> PAGE_SHIFT)
+#define pfn_pmd(pfn,prot)	__pmd(((phys_addr_t)(pfn) << PAGE_SHIFT) | pgprot_val(prot))
+#define mk_pmd(page,prot)	pfn_pmd(page_to_pfn(page), prot)
+
+static inline pmd_t pmd_modify(pmd_t pmd, pgprot_t newprot)
+{
+	const pmdval_t mask = PMD_SECT_USER | PMD_SECT_XN | PMD_SECT_RDONLY;
+	pmd_val(pmd) = (pmd_val(pmd) & ~mask) | (pgprot_val(newprot) & mask);
+	return pmd;
+}
+
+#define set_pmd_at(mm,addr,pmdp,pmd)				\
+	do {							\
+		BUG_ON((addr) >= TASK_SIZE);			\
+		*(pmdp) = __pmd(pmd_val(pmd) | PMD_SECT_nG);	\
+		flush_pmd_entry(pmdp);				\
+	} while (0)
+
+/*
+ * Huge pages only back anonymous memory, which is written through the
+ * kernel's cacheable mapping, and LPAE capable cores have no D-cache
+ * aliasing, so there is no cache maintenance to do here.
+ */
+#define update_mmu_cache_pmd(vma,addr,pmd)	do { } while (0)
+
+static inline int has_transparent_hugepage(void)
+{
+	return 1;
+}
+#endif /* CONFIG_TRANSPARENT_HUGEPAGE */
+
 #endif /* __ASSEMBLY__ */
 
 #endif /* _ASM_PGTABLE_3LEVEL_H */
@@ -0,0 +1,233 @@
+/*
+ * arch/arm/kernel/kprobes-opt-arm.c
+ *
+ * Kprobe jump optimization for ARM
+ *
+ * A probe on an unconditional ARM instruction is optimized by replacing
+ * the instruction with a relative branch to a per-probe detour buffer.
+ * The buffer saves the register state, calls the probe handlers and
+ * simulates the original instruction before returning to the next one,
+ * so the probe hit no longer goes through the undefined instruction
+ * exception path.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ */
+
+#include <linux/kernel.h>
+#include <linux/kprobes.h>
+#include <linux/stddef.h>
+#include <linux/stringify.h>
+#include <asm/cacheflush.h>
+
+#include "kprobes.h"
+#include "insn.h"
+#include "patch.h"
+
+/*
+ * Size of the stack frame built by the detour buffer: a struct pt_regs
+ * followed by a 64 byte gap, as in svc_entry, so that a simulated store
+ * below the probed function's stack pointer can't clobber the frame.
+ */
+#define OPTPROBE_FRAME_SIZE	136
+
+/*
+ * The detour buffer template. It is copied into a kprobe_optinsn slot
+ * for each optimized probe, and the two literal words at the end are
+ * patched with the probe's optimized_kprobe and optimized_callback().
+ */
+asm (
+	"	.text\n"
+	"	.arm\n"
+	"	.align	2\n"
+	"	.global	optprobe_template_entry\n"
+	"optprobe_template_entry:\n"
+	"	sub	sp, sp, #" __stringify(OPTPROBE_FRAME_SIZE) "\n"
+	"	stmia	sp, {r0 - r14}\n"
+	"	add	r3, sp, #" __stringify(OPTPROBE_FRAME_SIZE) "\n"
+	"	str	r3, [sp, #52]\n"
+	"	mrs	r4, cpsr\n"
+	"	str	r4, [sp, #64]\n"
+	"	mov	r1, sp\n"
+	"	ldr	r0, 1f\n"
+	"	ldr	r2, 2f\n"
+	/* r4 is callee saved: use it to keep the stack 8 byte aligned */
+	"	and	r4, sp, #4\n"
+	"	sub	sp, sp, r4\n"
+#if __LINUX_ARM_ARCH__ >= 5
+	"	blx	r2\n"
+#else
+	"	mov	lr, pc\n"
+	"	mov	pc, r2\n"
+#endif
+	"	add	sp, sp, r4\n"
+	"	ldr	r1, [sp, #64]\n"
+	"	msr	cpsr_cxsf, r1\n"
+	"	ldmia	sp, {r0 - r15}\n"
+	"	.global	optprobe_template_val\n"
+	"optprobe_template_val:\n"
+	"1:	.long	0\n"
+	"	.global	optprobe_template_call\n"
+	"optprobe_template_call:\n"
+	"2:	.long	0\n"
+	"	.global	optprobe_template_end\n"
+	"optprobe_template_end:\n");
+
+#define TMPL_VAL_IDX \
+	((kprobe_opcode_t *)&optprobe_template_val - \
+	 (kprobe_opcode_t *)&optprobe_template_entry)
+#define TMPL_CALL_IDX \
+	((kprobe_opcode_t *)&optprobe_template_call - \
+	 (kprobe_opcode_t *)&optprobe_template_entry)
+
+int arch_prepared_optinsn(struct arch_optimized_insn *optinsn)
+{
+	return optinsn->insn != NULL;
+}
+
+/*
+ * Only one instruction is replaced, so there can't be another kprobe
+ * inside the optimized region.
+ */
+int arch_check_optimized_kprobe(struct optimized_kprobe *op)
+{
+	return 0;
+}
+
+static void __kprobes
+optimized_callback(struct optimized_kprobe *op, struct pt_regs *regs)
+{
+	unsigned long flags;
+	struct kprobe *p = &op->kp;
+	struct kprobe_ctlblk *kcb = get_kprobe_ctlblk();
+
+	/* The template can't know where it was branched from */
+	regs->ARM_pc = (unsigned long)p->addr;
+	regs->ARM_ORIG_r0 = ~0UL;
+
+	local_irq_save(flags);
+
+	if (kprobe_running()) {
+		kprobes_inc_nmissed_count(p);
+	} else {
+		__get_cpu_var(current_kprobe) = p;
+		kcb->kprobe_status = KPROBE_HIT_ACTIVE;
+		opt_pre_handler(p, regs);
+		__get_cpu_var(current_kprobe) = NULL;
+	}
+
+	/* Simulate the replaced instruction, this also advances ARM_pc */
+	p->ainsn.insn_singlestep(p, regs);
+
+	local_irq_restore(flags);
+}
+
+int arch_prepare_optimized_kprobe(struct optimized_kprobe *op)
+{
+	kprobe_opcode_t *code;
+	unsigned long rel_chk;
+	struct kprobe *orig;
+
+	BUILD_BUG_ON(sizeof(struct pt_regs) + 64 != OPTPROBE_FRAME_SIZE);
+	BUILD_BUG_ON(offsetof(struct pt_regs, ARM_sp) != 52);
+	BUILD_BUG_ON(offsetof(struct pt_regs, ARM_cpsr) != 64);
+
+	/*
+	 * The branch replacing the probed instruction is unconditional,
+	 * so a conditional instruction has to keep using the breakpoint
+	 * which copies its condition.  op->kp isn't initialized yet and
+	 * the text already holds the breakpoint, so take the instruction
+	 * from the registered probe at this address (kprobe_mutex is held).
+	 */
+	orig = get_kprobe(op->kp.addr);
+	if (!orig || (orig->opcode >> 28) != 0xe)
+		return -EILSEQ;
+
+	code = get_optinsn_slot();
+	if (!code)
+		return -ENOMEM;
+
+	/*
+	 * The detour buffer must be reachable with a single B instruction
+	 * from the probe address, i.e. within +/-32MB.
+	 */
+	rel_chk = arm_gen_branch((unsigned long)op->kp.addr,
+				 (unsigned long)code);
+	if (!rel_chk) {
+		free_optinsn_slot(code, 0);
+		return -ERANGE;
+	}
+
+	memcpy(code, &optprobe_template_entry,
+	       MAX_OPTINSN_SIZE * sizeof(kprobe_opcode_t));
+
+	code[TMPL_VAL_IDX] = (unsigned long)op;
+	code[TMPL_CALL_IDX] = (unsigned long)optimized_callback;
+
+	flush_icache_range((unsigned long)code,
+			   (unsigned long)(&code[MAX_OPTINSN_SIZE]));
+
+	op->optinsn.insn = code;
+	return 0;
+}
+
+void __kprobes arch_optimize_kprobes(struct list_head *oplist)
+{
+	struct optimized_kprobe *op, *tmp;
+
+	list_for_each_entry_safe(op, tmp, oplist, list) {
+		unsigned long insn;
+
+		WARN_ON(kprobe_disabled(&op->kp));
+
+		insn = arm_gen_branch((unsigned long)op->kp.addr,
+				      (unsigned long)op->optinsn.insn);
+		BUG_ON(!insn);
+
+		/* The breakpoint and the branch are both a single word */
+		patch_text(op->kp.addr, insn);
+
+		list_del_init(&op->list);
+	}
+}
+
+void arch_unoptimize_kprobe(struct optimized_kprobe *op)
+{
+	arch_arm_kprobe(&op->kp);
+}
+
+/*
+ * Recover original instructions and breakpoints from relative jumps.
+ * Caller must hold kprobe_mutex.
+ */
+void arch_unoptimize_kprobes(struct list_head *oplist,
+			     struct list_head *done_list)
+{
+	struct optimized_kprobe *op, *tmp;
+
+	list_for_each_entry_safe(op, tmp, oplist, list) {
+		arch_unoptimize_kprobe(op);
+		list_move(&op->list, done_list);
+	}
+}
+
+int arch_within_optimized_kprobe(struct optimized_kprobe *op,
+				 unsigned long addr)
+{
+	return ((unsigned long)op->kp.addr <= addr &&
+		(unsigned long)op->kp.addr + RELATIVEJUMP_SIZE > addr);
+}
+
+void arch_remove_optimized_kprobe(struct optimized_kprobe *op)
+{
+	if (op->optinsn.insn) {
+		free_optinsn_slot(op->optinsn.insn, 0);
+		op->optinsn.insn = NULL;
+	}
+}
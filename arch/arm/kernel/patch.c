@@ -0,0 +1,59 @@
+#include <linux/kernel.h>
+#include <linux/kprobes.h>
+#include <linux/stop_machine.h>
+
+#include <asm/cacheflush.h>
+
+#include "patch.h"
+
+struct patch {
+	void *addr;
+	unsigned int insn;
+};
+
+/*
+ * Write a single 32-bit instruction, given in memory order (see insn.h).
+ * A Thumb-2 instruction which is only halfword aligned straddles two
+ * words and can't be written with one store, so callers which may race
+ * with other CPUs executing the code must go through patch_text().
+ */
+void __kprobes __patch_text(void *addr, unsigned int insn)
+{
+#ifdef CONFIG_THUMB2_KERNEL
+	if ((uintptr_t)addr & 2) {
+		u16 *addrh = addr;
+
+		addrh[0] = insn & 0xffff;
+		addrh[1] = insn >> 16;
+	} else
+#endif
+		*(u32 *)addr = insn;
+
+	flush_icache_range((uintptr_t)(addr),
+			   (uintptr_t)(addr) + sizeof(u32));
+}
+
+static int __kprobes patch_text_stop_machine(void *data)
+{
+	struct patch *patch = data;
+
+	__patch_text(patch->addr, patch->insn);
+
+	return 0;
+}
+
+/*
+ * As for kprobes, the modification is done under stop_machine so that
+ * no CPU can be executing the instruction while it is being rewritten,
+ * and so that the I-cache invalidation is seen everywhere on SMP
+ * systems whose cache operations are not broadcast in hardware.
+ */
+void __kprobes patch_text(void *addr, unsigned int insn)
+{
+	struct patch patch = {
+		.addr = addr,
+		.insn = insn,
+	};
+
+	stop_machine(patch_text_stop_machine, &patch, cpu_online_mask);
+}
@@ -24,6 +24,8 @@
 #include <linux/wait.h>
 #include <linux/async.h>
 #include <linux/pm_runtime.h>
+#include <linux/ktime.h>
+#include <linux/string.h>
 
 #include "base.h"
 #include "power/power.h"
@@ -162,6 +164,27 @@ done:
 	return ret;
 }
 
+/*
+ * With initcall_debug, time every probe. The output is picked up by
+ * scripts/bootgraph.pl to chart probe durations per thread, including
+ * the asynchronous ones.
+ */
+static int really_probe_debug(struct device *dev, struct device_driver *drv)
+{
+	ktime_t calltime, delta, rettime;
+	int ret;
+
+	printk(KERN_DEBUG "probing %s with %s @ %i\n", dev_name(dev),
+	       drv->name, task_pid_nr(current));
+	calltime = ktime_get();
+	ret = really_probe(dev, drv);
+	rettime = ktime_get();
+	delta = ktime_sub(rettime, calltime);
+	printk(KERN_DEBUG "probe of %s returned %d after %lld usecs\n",
+	       dev_name(dev), ret, (long long)ktime_to_ns(delta) >> 10);
+	return ret;
+}
+
 /**
  * driver_probe_done
  * Determine if the probe sequence is finished or not.
@@ -212,37 +235,139 @@ int driver_probe_device(struct device_driver *drv, struct device *dev)
 
 	pm_runtime_get_noresume(dev);
 	pm_runtime_barrier(dev);
-	ret = really_probe(dev, drv);
+	if (initcall_debug)
+		ret = really_probe_debug(dev, drv);
+	else
+		ret = really_probe(dev, drv);
 	pm_runtime_put_sync(dev);
 
 	return ret;
 }
 
-static int __device_attach(struct device_driver *drv, void *data)
+#define ASYNC_DRV_NAMES_MAX_LEN	256
+static char async_probe_drv_names[ASYNC_DRV_NAMES_MAX_LEN];
+
+static int __init save_async_options(char *buf)
 {
-	struct device *dev = data;
+	if (strlen(buf) >= ASYNC_DRV_NAMES_MAX_LEN)
+		printk(KERN_WARNING
+		       "Too long list of driver names for 'driver_async_probe'!\n");
 
-	if (!driver_match_device(drv, dev))
-		return 0;
+	strlcpy(async_probe_drv_names, buf, ASYNC_DRV_NAMES_MAX_LEN);
+	return 1;
+}
+__setup("driver_async_probe=", save_async_options);
 
-	return driver_probe_device(drv, dev);
+/* Is @name in the comma separated driver_async_probe= list? */
+static bool driver_async_probe_requested(const char *name)
+{
+	const char *p = async_probe_drv_names;
+	size_t len = strlen(name);
+
+	while (*p) {
+		size_t n = strcspn(p, ",");
+
+		if (n == len && !strncmp(p, name, len))
+			return true;
+		p += n;
+		if (*p)
+			p++;
+	}
+	return false;
 }
 
 /**
- * device_attach - try to attach device to a driver.
- * @dev: device.
- *
- * Walk the list of drivers that the bus has and call
- * driver_probe_device() for each pair. If a compatible
- * pair is found, break out and return.
+ * driver_allows_async_probing - may @drv be probed from the async domain
+ * @drv: driver
  *
- * Returns 1 if the device was bound to a driver;
- * 0 if no matching driver was found;
- * -ENODEV if the device is not registered.
- *
- * When called for a USB interface, @dev->parent lock must be held.
+ * A driver opts in with PROBE_PREFER_ASYNCHRONOUS in its probe_type, or
+ * by being named in the driver_async_probe= boot parameter. Drivers with
+ * PROBE_FORCE_SYNCHRONOUS are always probed synchronously.
  */
-int device_attach(struct device *dev)
+bool driver_allows_async_probing(struct device_driver *drv)
+{
+	switch (drv->probe_type) {
+	case PROBE_PREFER_ASYNCHRONOUS:
+		return true;
+
+	case PROBE_FORCE_SYNCHRONOUS:
+		return false;
+
+	default:
+		return driver_async_probe_requested(drv->name);
+	}
+}
+
+struct device_attach_data {
+	struct device *dev;
+
+	/*
+	 * Only the initial probe after the device is registered may be
+	 * asynchronous; binding requested from userspace is always done
+	 * synchronously.
+	 */
+	bool check_async;
+
+	/*
+	 * When asynchronous probing is allowed the drivers are walked
+	 * twice: first trying only the synchronous ones, then, from the
+	 * async domain, the asynchronous ones. The async probe can't be
+	 * scheduled from inside bus_for_each_drv() since the driver isn't
+	 * guaranteed to stay around once the walk moves on.
+	 */
+	bool want_async;
+
+	/* Set if a matching driver that allows async probing was seen */
+	bool have_async;
+};
+
+static int __device_attach_driver(struct device_driver *drv, void *_data)
+{
+	struct device_attach_data *data = _data;
+	struct device *dev = data->dev;
+	bool async_allowed;
+
+	if (!driver_match_device(drv, dev))
+		return 0;
+
+	async_allowed = driver_allows_async_probing(drv);
+
+	if (async_allowed)
+		data->have_async = true;
+
+	if (data->check_async && async_allowed != data->want_async)
+		return 0;
+
+	return driver_probe_device(drv, dev);
+}
+
+static void __device_attach_async_helper(void *_dev, async_cookie_t cookie)
+{
+	struct device *dev = _dev;
+	struct device_attach_data data = {
+		.dev		= dev,
+		.check_async	= true,
+		.want_async	= true,
+	};
+
+	device_lock(dev);
+
+	/* The device may have been bound or removed in the meantime */
+	if (!dev->driver && device_is_registered(dev)) {
+		pm_runtime_get_noresume(dev);
+		bus_for_each_drv(dev->bus, NULL, &data,
+				 __device_attach_driver);
+		pm_runtime_put_sync(dev);
+	}
+
+	dev_dbg(dev, "async probe completed\n");
+
+	device_unlock(dev);
+
+	put_device(dev);
+}
+
+static int __device_attach(struct device *dev, bool allow_async)
 {
 	int ret = 0;
 
@@ -260,16 +385,64 @@ int device_attach(struct device *dev)
 			ret = 0;
 		}
 	} else {
+		struct device_attach_data data = {
+			.dev = dev,
+			.check_async = allow_async,
+			.want_async = false,
+		};
+
 		pm_runtime_get_noresume(dev);
-		ret = bus_for_each_drv(dev->bus, NULL, dev, __device_attach);
+		ret = bus_for_each_drv(dev->bus, NULL, &data,
+					__device_attach_driver);
+		if (!ret && allow_async && data.have_async) {
+			/*
+			 * No synchronous driver took the device, but one
+			 * that prefers asynchronous probing matched: try
+			 * the async drivers from the async domain.
+			 */
+			dev_dbg(dev, "scheduling asynchronous probe\n");
+			get_device(dev);
+			async_schedule(__device_attach_async_helper, dev);
+		}
 		pm_runtime_put_sync(dev);
 	}
 out_unlock:
 	device_unlock(dev);
 	return ret;
 }
+
+/**
+ * device_attach - try to attach device to a driver.
+ * @dev: device.
+ *
+ * Walk the list of drivers that the bus has and call
+ * driver_probe_device() for each pair. If a compatible
+ * pair is found, break out and return.
+ *
+ * Returns 1 if the device was bound to a driver;
+ * 0 if no matching driver was found;
+ * -ENODEV if the device is not registered.
+ *
+ * When called for a USB interface, @dev->parent lock must be held.
+ */
+int device_attach(struct device *dev)
+{
+	return __device_attach(dev, false);
+}
 EXPORT_SYMBOL_GPL(device_attach);
 
+/**
+ * device_initial_probe - probe a newly registered device
+ * @dev: device.
+ *
+ * Like device_attach(), but a driver that allows asynchronous probing
+ * is probed from the async domain instead of the caller's context.
+ */
+void device_initial_probe(struct device *dev)
+{
+	__device_attach(dev, true);
+}
+
 static int __driver_attach(struct device *dev, void *data)
 {
 	struct device_driver *drv = data;
@@ -379,6 +552,10 @@ void driver_detach(struct device_driver *drv)
 	struct device_private *dev_prv;
 	struct device *dev;
 
+	/* Let any asynchronous probe of this driver finish first */
+	if (driver_allows_async_probing(drv))
+		async_synchronize_full();
+
 	for (;;) {
 		spin_lock(&drv->p->klist_devices.k_lock);
 		if (list_empty(&drv->p->klist_devices.k_list)) {
@@ -1029,6 +1029,9 @@ int dpm_prepare(pm_message_t state)
 
 	might_sleep();
 
+	/* Don't prepare devices that are still being probed asynchronously */
+	wait_for_device_probe();
+
 	mutex_lock(&dpm_list_mtx);
 	while (!list_empty(&dpm_list)) {
 		struct device *dev = to_device(dpm_list.next);
@@ -1733,6 +1733,8 @@ static struct platform_driver fec_driver = {
 		.pm	= &fec_pm_ops,
 #endif
 		.of_match_table = fec_dt_ids,
+		/* PHY probing and autonegotiation are slow */
+		.probe_type = PROBE_PREFER_ASYNCHRONOUS,
 	},
 	.id_table = fec_devtype,
 	.probe	= fec_probe,
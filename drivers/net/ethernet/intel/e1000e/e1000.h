@@ -83,6 +83,8 @@ struct e1000_info;
 /* How many Tx Descriptors do we need to call netif_wake_queue ? */
 /* How many Rx Buffers do we bundle into one write to the hardware ? */
 #define E1000_RX_BUFFER_WRITE		16 /* Must be power of 2 */
+/* How many jumbo Rx pages do we allocate at once ? */
+#define E1000_RX_PAGE_BULK		16
 
 #define AUTO_ALL_MODES			0
 #define E1000_EEPROM_APME		0x0400
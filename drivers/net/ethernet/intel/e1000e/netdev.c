@@ -778,6 +778,8 @@ static void e1000_alloc_jumbo_rx_buffers(struct e1000_adapter *adapter,
 	struct e1000_ring *rx_ring = adapter->rx_ring;
 	struct e1000_buffer *buffer_info;
 	struct sk_buff *skb;
+	struct page *pages[E1000_RX_PAGE_BULK] = { NULL, };
+	unsigned int nr_pages = 0;
 	unsigned int i;
 	unsigned int bufsz = 256 - 16 /* for skb_reserve */;
 
@@ -800,13 +802,18 @@ static void e1000_alloc_jumbo_rx_buffers(struct e1000_adapter *adapter,
 
 		buffer_info->skb = skb;
 check_page:
-		/* allocate a new page if necessary */
+		/* allocate a new page if necessary, a batch at a time */
 		if (!buffer_info->page) {
-			buffer_info->page = alloc_page(gfp);
-			if (unlikely(!buffer_info->page)) {
+			if (!nr_pages)
+				nr_pages = alloc_pages_bulk(gfp,
+					min_t(unsigned int, E1000_RX_PAGE_BULK,
+					      cleaned_count + 1), pages);
+			if (unlikely(!nr_pages)) {
 				adapter->alloc_rx_buff_failed++;
 				break;
 			}
+			buffer_info->page = pages[--nr_pages];
+			pages[nr_pages] = NULL;
 		}
 
 		if (!buffer_info->dma)
@@ -823,6 +830,10 @@ check_page:
 		buffer_info = &rx_ring->buffer_info[i];
 	}
 
+	/* pages the ring turned out not to need */
+	if (unlikely(nr_pages))
+		free_pages_bulk(nr_pages, pages);
+
 	if (likely(rx_ring->next_to_use != i)) {
 		rx_ring->next_to_use = i;
 		if (unlikely(i-- == 0))
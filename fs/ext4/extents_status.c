@@ -0,0 +1,670 @@
+/*
+ *  fs/ext4/extents_status.c
+ *
+ * In-memory extent status tree.
+ *
+ * Every inode keeps an rbtree of non-overlapping extents which records
+ * what is known about its logical blocks:
+ *
+ *   - written and unwritten extents carry the physical block they map to,
+ *   - delayed extents are blocks reserved by delayed allocation which
+ *     have not been allocated yet,
+ *   - hole extents are ranges known not to be mapped.
+ *
+ * Written, unwritten and hole extents are only a cache of the on-disk
+ * extent tree (or indirect block map): they are filled in by lookups,
+ * dropped whenever the block mapping changes and may be reclaimed by the
+ * shrinker at any time.  Delayed extents are not backed by anything on
+ * disk, so they are never reclaimed; they are added when a block is
+ * reserved for delayed allocation and removed when it gets allocated or
+ * the reservation is released.  This is what fiemap, SEEK_DATA/SEEK_HOLE
+ * and the bigalloc reservation accounting use to find delayed blocks,
+ * instead of walking the buffer heads in the page cache.
+ *
+ * Changes to cached extents are done with i_data_sem held, together with
+ * the change of the block mapping they reflect.  The tree itself is
+ * protected by i_es_lock, so lookups can run without i_data_sem.
+ */
+
+#include <linux/rbtree.h>
+#include <linux/slab.h>
+#include <linux/backing-dev.h>
+#include "ext4.h"
+
+#include <trace/events/ext4.h>
+
+static struct kmem_cache *ext4_es_cachep;
+
+int __init ext4_init_es(void)
+{
+	ext4_es_cachep = KMEM_CACHE(extent_status, SLAB_RECLAIM_ACCOUNT);
+	if (ext4_es_cachep == NULL)
+		return -ENOMEM;
+	return 0;
+}
+
+void ext4_exit_es(void)
+{
+	if (ext4_es_cachep)
+		kmem_cache_destroy(ext4_es_cachep);
+}
+
+void ext4_es_init_tree(struct ext4_es_tree *tree)
+{
+	tree->root = RB_ROOT;
+	tree->cache_es = NULL;
+}
+
+static inline ext4_lblk_t ext4_es_end(struct extent_status *es)
+{
+	BUG_ON(es->es_lblk + es->es_len < es->es_lblk);
+	return es->es_lblk + es->es_len - 1;
+}
+
+static inline struct extent_status *ext4_es_next(struct extent_status *es)
+{
+	struct rb_node *node = rb_next(&es->rb_node);
+
+	return node ? rb_entry(node, struct extent_status, rb_node) : NULL;
+}
+
+/*
+ * Search the tree for the extent containing @lblk.  If there is none,
+ * the first extent after @lblk is returned, or NULL when there is no
+ * extent after it either.
+ */
+static struct extent_status *__es_tree_search(struct rb_root *root,
+					      ext4_lblk_t lblk)
+{
+	struct rb_node *node = root->rb_node;
+	struct extent_status *es = NULL;
+
+	while (node) {
+		es = rb_entry(node, struct extent_status, rb_node);
+		if (lblk < es->es_lblk)
+			node = node->rb_left;
+		else if (lblk > ext4_es_end(es))
+			node = node->rb_right;
+		else
+			return es;
+	}
+
+	if (es && lblk < es->es_lblk)
+		return es;
+
+	if (es && lblk > ext4_es_end(es))
+		return ext4_es_next(es);
+
+	return NULL;
+}
+
+/*
+ * Return the first delayed extent overlapping [@lblk, @end], or NULL.
+ */
+static struct extent_status *__es_find_delayed(struct ext4_es_tree *tree,
+					       ext4_lblk_t lblk,
+					       ext4_lblk_t end)
+{
+	struct extent_status *es;
+
+	es = __es_tree_search(&tree->root, lblk);
+	while (es && es->es_lblk <= end) {
+		if (ext4_es_is_delayed(es))
+			return es;
+		es = ext4_es_next(es);
+	}
+	return NULL;
+}
+
+/*
+ * Add @inode to the list of inodes the shrinker reclaims extents from.
+ * Only cached extents are reclaimable, so this is called after one has
+ * been added, without i_es_lock held.
+ */
+static void ext4_es_lru_add(struct inode *inode)
+{
+	struct ext4_inode_info *ei = EXT4_I(inode);
+	struct ext4_sb_info *sbi = EXT4_SB(inode->i_sb);
+
+	if (!list_empty(&ei->i_es_lru))
+		return;
+
+	spin_lock(&sbi->s_es_lru_lock);
+	if (list_empty(&ei->i_es_lru))
+		list_add_tail(&ei->i_es_lru, &sbi->s_es_lru);
+	spin_unlock(&sbi->s_es_lru_lock);
+}
+
+void ext4_es_lru_del(struct inode *inode)
+{
+	struct ext4_inode_info *ei = EXT4_I(inode);
+	struct ext4_sb_info *sbi = EXT4_SB(inode->i_sb);
+
+	spin_lock(&sbi->s_es_lru_lock);
+	list_del_init(&ei->i_es_lru);
+	spin_unlock(&sbi->s_es_lru_lock);
+}
+
+static struct extent_status *
+ext4_es_alloc_extent(struct inode *inode, struct extent_status *newes)
+{
+	struct extent_status *es;
+
+	/* We are holding i_es_lock, so we cannot sleep here */
+	es = kmem_cache_alloc(ext4_es_cachep, GFP_ATOMIC);
+	if (es == NULL)
+		return NULL;
+	es->es_lblk = newes->es_lblk;
+	es->es_len = newes->es_len;
+	es->es_pblk = newes->es_pblk;
+
+	if (!ext4_es_is_delayed(es)) {
+		EXT4_I(inode)->i_es_lru_nr++;
+		percpu_counter_inc(&EXT4_SB(inode->i_sb)->s_extent_cache_cnt);
+	}
+	return es;
+}
+
+static void ext4_es_free_extent(struct inode *inode, struct extent_status *es)
+{
+	struct ext4_inode_info *ei = EXT4_I(inode);
+
+	if (ei->i_es_tree.cache_es == es)
+		ei->i_es_tree.cache_es = NULL;
+
+	if (!ext4_es_is_delayed(es)) {
+		BUG_ON(ei->i_es_lru_nr == 0);
+		ei->i_es_lru_nr--;
+		percpu_counter_dec(&EXT4_SB(inode->i_sb)->s_extent_cache_cnt);
+	}
+	kmem_cache_free(ext4_es_cachep, es);
+}
+
+/*
+ * Check whether @es1, which is right before @es2, can be merged with it.
+ */
+static int ext4_es_can_be_merged(struct extent_status *es1,
+				 struct extent_status *es2)
+{
+	if (ext4_es_status(es1) != ext4_es_status(es2))
+		return 0;
+
+	if (es1->es_lblk + es1->es_len != es2->es_lblk)
+		return 0;
+
+	if (ext4_es_is_mapped(es1) &&
+	    ext4_es_pblock(es1) + es1->es_len != ext4_es_pblock(es2))
+		return 0;
+
+	return 1;
+}
+
+static struct extent_status *
+ext4_es_try_to_merge_left(struct inode *inode, struct extent_status *es)
+{
+	struct ext4_es_tree *tree = &EXT4_I(inode)->i_es_tree;
+	struct extent_status *es1;
+	struct rb_node *node;
+
+	node = rb_prev(&es->rb_node);
+	if (!node)
+		return es;
+
+	es1 = rb_entry(node, struct extent_status, rb_node);
+	if (ext4_es_can_be_merged(es1, es)) {
+		es1->es_len += es->es_len;
+		rb_erase(&es->rb_node, &tree->root);
+		ext4_es_free_extent(inode, es);
+		es = es1;
+	}
+
+	return es;
+}
+
+static struct extent_status *
+ext4_es_try_to_merge_right(struct inode *inode, struct extent_status *es)
+{
+	struct ext4_es_tree *tree = &EXT4_I(inode)->i_es_tree;
+	struct extent_status *es1;
+
+	es1 = ext4_es_next(es);
+	if (!es1)
+		return es;
+
+	if (ext4_es_can_be_merged(es, es1)) {
+		es->es_len += es1->es_len;
+		rb_erase(&es1->rb_node, &tree->root);
+		ext4_es_free_extent(inode, es1);
+	}
+
+	return es;
+}
+
+/*
+ * Insert @newes into the tree.  The range it covers must not overlap any
+ * extent already in the tree.  An adjacent extent with the same status is
+ * extended instead of allocating a new one where possible.
+ */
+static int __es_insert_extent(struct inode *inode, struct extent_status *newes)
+{
+	struct ext4_es_tree *tree = &EXT4_I(inode)->i_es_tree;
+	struct rb_node **p = &tree->root.rb_node;
+	struct rb_node *parent = NULL;
+	struct extent_status *es;
+
+	while (*p) {
+		parent = *p;
+		es = rb_entry(parent, struct extent_status, rb_node);
+
+		if (newes->es_lblk < es->es_lblk) {
+			if (ext4_es_can_be_merged(newes, es)) {
+				/*
+				 * We can change es_lblk in place because
+				 * the new range does not overlap anything.
+				 */
+				es->es_lblk = newes->es_lblk;
+				es->es_len += newes->es_len;
+				if (ext4_es_is_mapped(es))
+					ext4_es_store_pblock(es,
+						ext4_es_pblock(newes));
+				es = ext4_es_try_to_merge_left(inode, es);
+				goto out;
+			}
+			p = &(*p)->rb_left;
+		} else if (newes->es_lblk > ext4_es_end(es)) {
+			if (ext4_es_can_be_merged(es, newes)) {
+				es->es_len += newes->es_len;
+				es = ext4_es_try_to_merge_right(inode, es);
+				goto out;
+			}
+			p = &(*p)->rb_right;
+		} else {
+			BUG();
+			return -EINVAL;
+		}
+	}
+
+	es = ext4_es_alloc_extent(inode, newes);
+	if (!es)
+		return -ENOMEM;
+	rb_link_node(&es->rb_node, parent, p);
+	rb_insert_color(&es->rb_node, &tree->root);
+
+out:
+	tree->cache_es = es;
+	return 0;
+}
+
+/*
+ * Remove the range [@lblk, @end] from the tree, leaving delayed extents
+ * alone if @keep_delayed is set.
+ *
+ * Cutting a hole into the middle of a cached extent just drops its tail:
+ * it is only a cache.  A delayed extent has to be split in two instead,
+ * which needs memory; -ENOMEM is returned if that fails, with the tree
+ * left in a state where the removal can simply be retried.
+ */
+static int __es_remove_extent(struct inode *inode, ext4_lblk_t lblk,
+			      ext4_lblk_t end, int keep_delayed)
+{
+	struct ext4_es_tree *tree = &EXT4_I(inode)->i_es_tree;
+	struct extent_status *es, *next;
+	ext4_lblk_t es_end;
+	int err;
+
+	es = __es_tree_search(&tree->root, lblk);
+	if (!es || es->es_lblk > end)
+		return 0;
+
+	/* Simply invalidate cache_es. */
+	tree->cache_es = NULL;
+
+	while (es && es->es_lblk <= end) {
+		next = ext4_es_next(es);
+		if (keep_delayed && ext4_es_is_delayed(es)) {
+			es = next;
+			continue;
+		}
+
+		es_end = ext4_es_end(es);
+		if (es->es_lblk < lblk) {
+			if (es_end > end && ext4_es_is_delayed(es)) {
+				struct extent_status newes;
+				ext4_lblk_t orig_len = es->es_len;
+
+				newes.es_lblk = end + 1;
+				newes.es_len = es_end - end;
+				newes.es_pblk = es->es_pblk;
+				es->es_len = lblk - es->es_lblk;
+				err = __es_insert_extent(inode, &newes);
+				if (err) {
+					es->es_len = orig_len;
+					return err;
+				}
+				break;
+			}
+			/* keep the part in front of the range */
+			es->es_len = lblk - es->es_lblk;
+		} else if (es_end > end) {
+			/* keep the part behind the range */
+			if (ext4_es_is_mapped(es))
+				ext4_es_store_pblock(es, ext4_es_pblock(es) +
+						     end + 1 - es->es_lblk);
+			es->es_len = es_end - end;
+			es->es_lblk = end + 1;
+		} else {
+			rb_erase(&es->rb_node, &tree->root);
+			ext4_es_free_extent(inode, es);
+		}
+		es = next;
+	}
+
+	return 0;
+}
+
+/*
+ * ext4_es_insert_extent() sets the status of [@lblk, @lblk + @len) to
+ * @status, replacing whatever the tree had for it.  It is used to add
+ * delayed extents, whose loss cannot be tolerated, so unlike the cache
+ * helpers below it returns -ENOMEM when memory runs out.
+ */
+int ext4_es_insert_extent(struct inode *inode, ext4_lblk_t lblk,
+			  ext4_lblk_t len, ext4_fsblk_t pblk,
+			  unsigned long long status)
+{
+	struct ext4_inode_info *ei = EXT4_I(inode);
+	struct extent_status newes, *es;
+	ext4_lblk_t end = lblk + len - 1;
+	int err = 0;
+
+	BUG_ON(end < lblk);
+	newes.es_lblk = lblk;
+	newes.es_len = len;
+	newes.es_pblk = 0;
+	ext4_es_store_pblock(&newes, pblk);
+	ext4_es_store_status(&newes, status);
+	trace_ext4_es_insert_extent(inode, &newes);
+
+	write_lock(&ei->i_es_lock);
+	/* Nothing to do if an extent already says the same thing */
+	es = __es_tree_search(&ei->i_es_tree.root, lblk);
+	if (es && es->es_lblk <= lblk && end <= ext4_es_end(es) &&
+	    ext4_es_status(es) == ext4_es_status(&newes) &&
+	    (!ext4_es_is_mapped(es) ||
+	     ext4_es_pblock(es) + lblk - es->es_lblk == pblk))
+		goto out;
+
+	err = __es_remove_extent(inode, lblk, end, 0);
+	if (!err)
+		err = __es_insert_extent(inode, &newes);
+out:
+	write_unlock(&ei->i_es_lock);
+
+	if (!err && !ext4_es_is_delayed(&newes))
+		ext4_es_lru_add(inode);
+	return err;
+}
+
+/*
+ * ext4_es_cache_extent() records the result of a block mapping lookup.
+ * Delayed extents in the range are left as they are: the on-disk mapping
+ * of a delayed block is still a hole, or an unwritten extent if it has
+ * been fallocated since.  Failing to allocate memory just means the
+ * range stays uncached.
+ */
+void ext4_es_cache_extent(struct inode *inode, ext4_lblk_t lblk,
+			  ext4_lblk_t len, ext4_fsblk_t pblk,
+			  unsigned long long status)
+{
+	struct ext4_inode_info *ei = EXT4_I(inode);
+	struct extent_status newes, *es;
+	ext4_lblk_t end = lblk + len - 1;
+	ext4_lblk_t next_end;
+
+	BUG_ON(end < lblk);
+	newes.es_pblk = 0;
+	ext4_es_store_status(&newes, status);
+
+	write_lock(&ei->i_es_lock);
+	while (1) {
+		es = __es_find_delayed(&ei->i_es_tree, lblk, end);
+		if (es && es->es_lblk <= lblk) {
+			/* skip the delayed extent we are in */
+			if (ext4_es_end(es) >= end)
+				break;
+			if (status & (EXTENT_STATUS_WRITTEN |
+				      EXTENT_STATUS_UNWRITTEN))
+				pblk += ext4_es_end(es) + 1 - lblk;
+			lblk = ext4_es_end(es) + 1;
+			continue;
+		}
+		next_end = es ? es->es_lblk - 1 : end;
+
+		if (__es_remove_extent(inode, lblk, next_end, 1))
+			break;
+		newes.es_lblk = lblk;
+		newes.es_len = next_end - lblk + 1;
+		ext4_es_store_pblock(&newes, pblk);
+		if (__es_insert_extent(inode, &newes))
+			break;
+
+		if (next_end == end)
+			break;
+		if (status & (EXTENT_STATUS_WRITTEN | EXTENT_STATUS_UNWRITTEN))
+			pblk += next_end + 1 - lblk;
+		lblk = next_end + 1;
+	}
+	write_unlock(&ei->i_es_lock);
+
+	ext4_es_lru_add(inode);
+}
+
+/*
+ * ext4_es_remove_extent() forgets everything about [@lblk, @lblk + @len),
+ * including delayed extents.  It is used when the blocks are truncated
+ * or punched out, or when delayed allocation reservations are released.
+ */
+void ext4_es_remove_extent(struct inode *inode, ext4_lblk_t lblk,
+			   ext4_lblk_t len)
+{
+	struct ext4_inode_info *ei = EXT4_I(inode);
+	ext4_lblk_t end;
+	int err;
+
+	if (len == 0)
+		return;
+	end = lblk + len - 1;
+	BUG_ON(end < lblk);
+	trace_ext4_es_remove_extent(inode, lblk, len);
+
+	while (1) {
+		write_lock(&ei->i_es_lock);
+		err = __es_remove_extent(inode, lblk, end, 0);
+		write_unlock(&ei->i_es_lock);
+		if (err != -ENOMEM)
+			break;
+		/* Splitting a delayed extent failed, wait for memory */
+		congestion_wait(BLK_RW_ASYNC, HZ/50);
+	}
+}
+
+/*
+ * ext4_es_invalidate_extent() drops the cached mapping of
+ * [@lblk, @lblk + @len) after the block mapping there has changed.
+ * Delayed extents stay, as changing the mapping does not allocate them.
+ */
+void ext4_es_invalidate_extent(struct inode *inode, ext4_lblk_t lblk,
+			       ext4_lblk_t len)
+{
+	struct ext4_inode_info *ei = EXT4_I(inode);
+	ext4_lblk_t end;
+
+	if (len == 0)
+		return;
+	end = lblk + len - 1;
+	if (end < lblk)
+		end = EXT_MAX_BLOCKS - 1;
+
+	write_lock(&ei->i_es_lock);
+	/* Never fails, no delayed extent is split */
+	__es_remove_extent(inode, lblk, end, 1);
+	write_unlock(&ei->i_es_lock);
+}
+
+/*
+ * ext4_es_find_delayed_extent() finds the first delayed extent which
+ * overlaps [@lblk, @end] and copies it to @es.  es->es_len is 0 if there
+ * is no such extent.
+ */
+void ext4_es_find_delayed_extent(struct inode *inode, ext4_lblk_t lblk,
+				 ext4_lblk_t end, struct extent_status *es)
+{
+	struct ext4_inode_info *ei = EXT4_I(inode);
+	struct extent_status *es1;
+
+	es->es_lblk = es->es_len = es->es_pblk = 0;
+
+	read_lock(&ei->i_es_lock);
+	es1 = __es_find_delayed(&ei->i_es_tree, lblk, end);
+	if (es1) {
+		es->es_lblk = es1->es_lblk;
+		es->es_len = es1->es_len;
+		es->es_pblk = es1->es_pblk;
+	}
+	read_unlock(&ei->i_es_lock);
+}
+
+/*
+ * ext4_es_lookup_extent() looks up the extent containing @lblk and
+ * copies it to @es.  Returns 1 if one was found, 0 otherwise.
+ */
+int ext4_es_lookup_extent(struct inode *inode, ext4_lblk_t lblk,
+			  struct extent_status *es)
+{
+	struct ext4_inode_info *ei = EXT4_I(inode);
+	struct ext4_es_tree *tree = &ei->i_es_tree;
+	struct extent_status *es1;
+	struct rb_node *node;
+	int found = 0;
+
+	read_lock(&ei->i_es_lock);
+
+	/* find extent in cache firstly */
+	es1 = tree->cache_es;
+	if (es1 && in_range(lblk, es1->es_lblk, es1->es_len)) {
+		found = 1;
+		goto out;
+	}
+
+	node = tree->root.rb_node;
+	while (node) {
+		es1 = rb_entry(node, struct extent_status, rb_node);
+		if (lblk < es1->es_lblk)
+			node = node->rb_left;
+		else if (lblk > ext4_es_end(es1))
+			node = node->rb_right;
+		else {
+			found = 1;
+			break;
+		}
+	}
+
+out:
+	if (found) {
+		BUG_ON(!es1);
+		es->es_lblk = es1->es_lblk;
+		es->es_len = es1->es_len;
+		es->es_pblk = es1->es_pblk;
+		/* a racy, but harmless update of the hint */
+		tree->cache_es = es1;
+	}
+
+	read_unlock(&ei->i_es_lock);
+
+	return found;
+}
+
+static int __es_try_to_reclaim_extents(struct ext4_inode_info *ei,
+				       int nr_to_scan)
+{
+	struct inode *inode = &ei->vfs_inode;
+	struct ext4_es_tree *tree = &ei->i_es_tree;
+	struct rb_node *node;
+	struct extent_status *es;
+	int nr_shrunk = 0;
+
+	node = rb_first(&tree->root);
+	while (node != NULL) {
+		es = rb_entry(node, struct extent_status, rb_node);
+		node = rb_next(&es->rb_node);
+		/* Delayed extents cannot be reclaimed */
+		if (!ext4_es_is_delayed(es)) {
+			rb_erase(&es->rb_node, &tree->root);
+			ext4_es_free_extent(inode, es);
+			nr_shrunk++;
+			if (--nr_to_scan == 0)
+				break;
+		}
+	}
+	tree->cache_es = NULL;
+	return nr_shrunk;
+}
+
+/*
+ * The shrinker goes round the inodes with cached extents, dropping them
+ * from the inodes which were visited least recently.  Inodes left with
+ * delayed extents only are taken off the list until something is cached
+ * for them again.
+ */
+static int ext4_es_shrink(struct shrinker *shrink, struct shrink_control *sc)
+{
+	struct ext4_sb_info *sbi = container_of(shrink,
+					struct ext4_sb_info, s_es_shrinker);
+	struct ext4_inode_info *ei, *tmp;
+	int nr_to_scan = sc->nr_to_scan;
+	int nr_shrunk = 0;
+	LIST_HEAD(scanned);
+
+	if (!nr_to_scan)
+		return percpu_counter_read_positive(&sbi->s_extent_cache_cnt);
+
+	spin_lock(&sbi->s_es_lru_lock);
+	list_for_each_entry_safe(ei, tmp, &sbi->s_es_lru, i_es_lru) {
+		int ret;
+
+		write_lock(&ei->i_es_lock);
+		ret = __es_try_to_reclaim_extents(ei, nr_to_scan);
+		if (ei->i_es_lru_nr == 0)
+			list_del_init(&ei->i_es_lru);
+		else
+			list_move_tail(&ei->i_es_lru, &scanned);
+		write_unlock(&ei->i_es_lock);
+
+		nr_shrunk += ret;
+		nr_to_scan -= ret;
+		if (nr_to_scan <= 0)
+			break;
+	}
+	list_splice_tail(&scanned, &sbi->s_es_lru);
+	spin_unlock(&sbi->s_es_lru_lock);
+
+	trace_ext4_es_shrink(sbi->s_sb, nr_shrunk,
+			     percpu_counter_read_positive(&sbi->s_extent_cache_cnt));
+	return percpu_counter_read_positive(&sbi->s_extent_cache_cnt);
+}
+
+void ext4_es_register_shrinker(struct super_block *sb)
+{
+	struct ext4_sb_info *sbi = EXT4_SB(sb);
+
+	INIT_LIST_HEAD(&sbi->s_es_lru);
+	spin_lock_init(&sbi->s_es_lru_lock);
+	sbi->s_es_shrinker.shrink = ext4_es_shrink;
+	sbi->s_es_shrinker.seeks = DEFAULT_SEEKS;
+	register_shrinker(&sbi->s_es_shrinker);
+}
+
+void ext4_es_unregister_shrinker(struct super_block *sb)
+{
+	unregister_shrinker(&EXT4_SB(sb)->s_es_shrinker);
+}
@@ -0,0 +1,255 @@
+/*
+ *  fs/ext4/fast_commit.c
+ *
+ * Fast commits for fsync.
+ *
+ * Committing the running transaction to make one file durable writes out
+ * every metadata block anybody dirtied in it.  When the only metadata the
+ * file changed since the last commit is its own on-disk inode - the common
+ * case of overwriting data in place, or of timestamp and size updates -
+ * fsync instead logs a copy of that inode into the fast commit area of
+ * the journal, a single block write.  Recovery replays the full
+ * transactions first and then copies the inodes of the fast commits of
+ * the following transaction back into the inode table.
+ *
+ * Anything a raw inode can't describe - block allocation and conversion,
+ * changes to directories, bitmaps, the orphan list, quota or an external
+ * xattr block - marks the inode ineligible for the running transaction
+ * with ext4_fc_mark_ineligible(), and fsync of it does a full commit.
+ */
+
+#include <linux/fs.h>
+#include <linux/jbd2.h>
+#include <linux/crc32.h>
+#include "ext4.h"
+#include "ext4_jbd2.h"
+
+#include <trace/events/ext4.h>
+
+/* Size of a fast commit block holding one inode of @sb */
+#define EXT4_FC_INODE_BLOCK_SIZE(sb)				\
+	(sizeof(journal_header_t) +				\
+	 sizeof(struct ext4_fc_tl) + sizeof(struct ext4_fc_inode) + \
+	 EXT4_INODE_SIZE(sb) +					\
+	 sizeof(struct ext4_fc_tl) + sizeof(struct ext4_fc_tail))
+
+/*
+ * Called with a handle that changes more of the file system on behalf of
+ * @inode than its on-disk inode.
+ */
+void ext4_fc_mark_ineligible(struct inode *inode, handle_t *handle)
+{
+	if (!test_opt2(inode->i_sb, FAST_COMMIT) || !ext4_handle_valid(handle))
+		return;
+
+	EXT4_I(inode)->i_fc_ineligible_tid = handle->h_transaction->t_tid;
+	/* Pairs with smp_rmb() in ext4_fc_ineligible() */
+	smp_wmb();
+}
+
+static int ext4_fc_ineligible(struct inode *inode, tid_t tid)
+{
+	smp_rmb();
+	if (EXT4_I(inode)->i_fc_ineligible_tid == tid)
+		return EXT4_FC_REASON_INELIGIBLE;
+	return EXT4_FC_REASON_NONE;
+}
+
+static inline struct ext4_fc_tl *ext4_fc_next_tl(struct ext4_fc_tl *tl)
+{
+	return (struct ext4_fc_tl *)((char *)(tl + 1) +
+				     le16_to_cpu(tl->fc_len));
+}
+
+/*
+ * Fill in the fast commit block @bh with the current on-disk copy of
+ * @inode.  The inode is copied before checking eligibility once more, so
+ * a concurrent change that made it ineligible either shows up in that
+ * check or isn't part of the copy.
+ */
+static int ext4_fc_write_inode(struct inode *inode, struct buffer_head *bh,
+			       tid_t tid)
+{
+	struct super_block *sb = inode->i_sb;
+	journal_header_t *header = (journal_header_t *)bh->b_data;
+	struct ext4_fc_tl *tl = (struct ext4_fc_tl *)(header + 1);
+	struct ext4_fc_inode *fc_inode = (struct ext4_fc_inode *)(tl + 1);
+	struct ext4_fc_tail *tail;
+	struct ext4_iloc iloc;
+	int err;
+
+	err = ext4_get_inode_loc(inode, &iloc);
+	if (err)
+		return EXT4_FC_REASON_ERROR;
+
+	header->h_magic = cpu_to_be32(JBD2_MAGIC_NUMBER);
+	header->h_blocktype = cpu_to_be32(JBD2_FC_BLOCK);
+	header->h_sequence = cpu_to_be32(tid);
+
+	tl->fc_tag = cpu_to_le16(EXT4_FC_TAG_INODE);
+	tl->fc_len = cpu_to_le16(sizeof(*fc_inode) + EXT4_INODE_SIZE(sb));
+	fc_inode->fc_ino = cpu_to_le32(inode->i_ino);
+	memcpy(fc_inode->fc_raw_inode, ext4_raw_inode(&iloc),
+	       EXT4_INODE_SIZE(sb));
+	brelse(iloc.bh);
+
+	if (ext4_fc_ineligible(inode, tid))
+		return EXT4_FC_REASON_INELIGIBLE;
+
+	tl = ext4_fc_next_tl(tl);
+	tl->fc_tag = cpu_to_le16(EXT4_FC_TAG_TAIL);
+	tl->fc_len = cpu_to_le16(sizeof(*tail));
+	tail = (struct ext4_fc_tail *)(tl + 1);
+	tail->fc_tid = cpu_to_le32(tid);
+	tail->fc_crc = cpu_to_le32(crc32_be(~0, (unsigned char *)bh->b_data,
+				   (char *)&tail->fc_crc - bh->b_data));
+	return EXT4_FC_REASON_NONE;
+}
+
+/*
+ * Make the changes of transaction @commit_tid to @inode durable with a
+ * fast commit.  Returns EXT4_FC_REASON_NONE on success, otherwise why
+ * the caller has to fall back to waiting for the full commit of
+ * @commit_tid.
+ */
+int ext4_fc_commit(struct inode *inode, tid_t commit_tid)
+{
+	struct super_block *sb = inode->i_sb;
+	journal_t *journal = EXT4_SB(sb)->s_journal;
+	struct buffer_head *bh;
+	int reason;
+	int err;
+
+	if (!test_opt2(sb, FAST_COMMIT) ||
+	    !JBD2_HAS_INCOMPAT_FEATURE(journal,
+				       JBD2_FEATURE_INCOMPAT_FAST_COMMIT) ||
+	    EXT4_FC_INODE_BLOCK_SIZE(sb) > sb->s_blocksize)
+		return EXT4_FC_REASON_DISABLED;
+
+	if (!S_ISREG(inode->i_mode))
+		return EXT4_FC_REASON_INELIGIBLE;
+	reason = ext4_fc_ineligible(inode, commit_tid);
+	if (reason)
+		return reason;
+
+	err = jbd2_fc_begin_commit(journal, commit_tid);
+	if (err == -EALREADY)
+		return EXT4_FC_REASON_COMMITTING;
+	if (err == -EAGAIN)
+		return EXT4_FC_REASON_FLUSHED;
+	if (err)
+		return EXT4_FC_REASON_ERROR;
+
+	err = jbd2_fc_get_buf(journal, &bh);
+	if (err) {
+		reason = err == -ENOSPC ? EXT4_FC_REASON_NOSPC :
+					  EXT4_FC_REASON_ERROR;
+		goto fallback;
+	}
+
+	reason = ext4_fc_write_inode(inode, bh, commit_tid);
+	if (!reason && jbd2_fc_write_buf(journal, bh))
+		reason = EXT4_FC_REASON_ERROR;
+	brelse(bh);
+	if (reason)
+		goto fallback;
+
+	jbd2_fc_end_commit(journal);
+	return EXT4_FC_REASON_NONE;
+
+fallback:
+	jbd2_fc_end_commit_fallback(journal, commit_tid);
+	return reason;
+}
+
+/*
+ * Check a fast commit block read back by recovery.  Returns the inode
+ * record, or NULL if the block isn't a complete fast commit of @tid.
+ */
+static struct ext4_fc_inode *ext4_fc_inode_valid(struct super_block *sb,
+						 struct buffer_head *bh,
+						 tid_t tid)
+{
+	journal_header_t *header = (journal_header_t *)bh->b_data;
+	struct ext4_fc_tl *tl = (struct ext4_fc_tl *)(header + 1);
+	struct ext4_fc_inode *fc_inode = (struct ext4_fc_inode *)(tl + 1);
+	struct ext4_fc_tail *tail;
+	unsigned long ino;
+
+	if (EXT4_FC_INODE_BLOCK_SIZE(sb) > sb->s_blocksize ||
+	    le16_to_cpu(tl->fc_tag) != EXT4_FC_TAG_INODE ||
+	    le16_to_cpu(tl->fc_len) !=
+			sizeof(*fc_inode) + EXT4_INODE_SIZE(sb))
+		return NULL;
+
+	tl = ext4_fc_next_tl(tl);
+	tail = (struct ext4_fc_tail *)(tl + 1);
+	if (le16_to_cpu(tl->fc_tag) != EXT4_FC_TAG_TAIL ||
+	    le16_to_cpu(tl->fc_len) != sizeof(*tail) ||
+	    le32_to_cpu(tail->fc_tid) != tid ||
+	    le32_to_cpu(tail->fc_crc) !=
+			crc32_be(~0, (unsigned char *)bh->b_data,
+				 (char *)&tail->fc_crc - bh->b_data))
+		return NULL;
+
+	ino = le32_to_cpu(fc_inode->fc_ino);
+	if (ino < EXT4_FIRST_INO(sb) ||
+	    ino > le32_to_cpu(EXT4_SB(sb)->s_es->s_inodes_count))
+		return NULL;
+	return fc_inode;
+}
+
+/* Copy a logged inode back into its slot of the inode table */
+static int ext4_fc_replay_inode(struct super_block *sb,
+				struct ext4_fc_inode *fc_inode)
+{
+	unsigned long ino = le32_to_cpu(fc_inode->fc_ino);
+	struct ext4_group_desc *gdp;
+	struct buffer_head *bh;
+	ext4_group_t group;
+	ext4_fsblk_t block;
+	int inodes_per_block, inode_offset;
+
+	group = (ino - 1) / EXT4_INODES_PER_GROUP(sb);
+	gdp = ext4_get_group_desc(sb, group, NULL);
+	if (!gdp)
+		return -EIO;
+
+	inodes_per_block = EXT4_SB(sb)->s_inodes_per_block;
+	inode_offset = (ino - 1) % EXT4_INODES_PER_GROUP(sb);
+	block = ext4_inode_table(sb, gdp) + inode_offset / inodes_per_block;
+
+	bh = sb_bread(sb, block);
+	if (!bh)
+		return -EIO;
+	lock_buffer(bh);
+	memcpy(bh->b_data + (inode_offset % inodes_per_block) *
+	       EXT4_INODE_SIZE(sb), fc_inode->fc_raw_inode,
+	       EXT4_INODE_SIZE(sb));
+	unlock_buffer(bh);
+	/* Recovery syncs the block device once it is done */
+	mark_buffer_dirty(bh);
+	brelse(bh);
+	return 0;
+}
+
+static int ext4_fc_replay(journal_t *journal, struct buffer_head *bh,
+			  enum passtype pass, int off, tid_t tid)
+{
+	struct super_block *sb = journal->j_private;
+	struct ext4_fc_inode *fc_inode;
+
+	fc_inode = ext4_fc_inode_valid(sb, bh, tid);
+	if (!fc_inode)
+		return -EIO;
+	if (pass != PASS_REPLAY)
+		return 0;
+
+	trace_ext4_fc_replay(sb, le32_to_cpu(fc_inode->fc_ino), off);
+	return ext4_fc_replay_inode(sb, fc_inode);
+}
+
+void ext4_fc_init(journal_t *journal)
+{
+	journal->j_fc_replay_callback = ext4_fc_replay;
+}
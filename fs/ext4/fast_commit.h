@@ -0,0 +1,56 @@
+/*
+ *  fs/ext4/fast_commit.h
+ *
+ * Fast commits: fsync of a regular file whose changes in the running
+ * transaction are confined to its own on-disk inode logs that inode into
+ * the fast commit area of the journal instead of committing the whole
+ * transaction.
+ */
+
+#ifndef _EXT4_FAST_COMMIT_H
+#define _EXT4_FAST_COMMIT_H
+
+/*
+ * On disk, a fast commit is one journal block: a journal_header_t of type
+ * JBD2_FC_BLOCK carrying the transaction ID, then a sequence of tagged
+ * records ending with the tail.  All record fields are little endian.
+ */
+#define EXT4_FC_TAG_INODE	0x0001	/* raw on-disk inode */
+#define EXT4_FC_TAG_TAIL	0x0002	/* end of the fast commit */
+
+struct ext4_fc_tl {
+	__le16 fc_tag;
+	__le16 fc_len;		/* bytes of value following */
+};
+
+/* Value of EXT4_FC_TAG_INODE, followed by EXT4_INODE_SIZE() bytes */
+struct ext4_fc_inode {
+	__le32 fc_ino;
+	__u8 fc_raw_inode[0];
+};
+
+/* Value of EXT4_FC_TAG_TAIL */
+struct ext4_fc_tail {
+	__le32 fc_tid;
+	__le32 fc_crc;		/* crc32 of the block up to this field */
+};
+
+/*
+ * Outcome of ext4_fc_commit(), reported by the ext4_fc_commit_stop
+ * tracepoint: anything but EXT4_FC_REASON_NONE means a full commit.
+ */
+enum {
+	EXT4_FC_REASON_NONE = 0,	/* fast commit written */
+	EXT4_FC_REASON_DISABLED,	/* not mounted with fast_commit */
+	EXT4_FC_REASON_INELIGIBLE,	/* changes beyond the inode itself */
+	EXT4_FC_REASON_COMMITTING,	/* transaction already committing */
+	EXT4_FC_REASON_FLUSHED,		/* journal flushed since last commit */
+	EXT4_FC_REASON_NOSPC,		/* fast commit area is full */
+	EXT4_FC_REASON_ERROR,		/* fast commit failed */
+};
+
+extern void ext4_fc_init(journal_t *journal);
+extern void ext4_fc_mark_ineligible(struct inode *inode, handle_t *handle);
+extern int ext4_fc_commit(struct inode *inode, tid_t commit_tid);
+
+#endif /* _EXT4_FAST_COMMIT_H */
@@ -210,10 +210,149 @@ static int ext4_file_open(struct inode * inode, struct file * filp)
 	return dquot_file_open(inode, filp);
 }
 
+/*
+ * Look up what @lblk of an extent-mapped file holds.  Written and
+ * unwritten extents and delayed allocated blocks count as data, the
+ * rest is a hole.  Returns 1 for data, 0 for a hole or a negative error,
+ * and sets @len to the number of blocks from @lblk on which are known to
+ * be the same, never going past @last.
+ */
+static int ext4_seek_lookup(struct inode *inode, ext4_lblk_t lblk,
+			    ext4_lblk_t last, ext4_lblk_t *len)
+{
+	struct ext4_map_blocks map;
+	struct extent_status es, delayed;
+	ext4_lblk_t max = last - lblk + 1;
+	int ret;
+
+	map.m_lblk = lblk;
+	map.m_len = min_t(ext4_lblk_t, max, INT_MAX);
+	ret = ext4_map_blocks(NULL, inode, &map, 0);
+	if (ret < 0)
+		return ret;
+	if (ret > 0) {
+		*len = ret;
+		return 1;
+	}
+
+	ext4_es_find_delayed_extent(inode, lblk, last, &delayed);
+	if (delayed.es_len && delayed.es_lblk <= lblk) {
+		*len = min_t(ext4_lblk_t, max,
+			     delayed.es_len - (lblk - delayed.es_lblk));
+		return 1;
+	}
+
+	/* Skip the whole hole, cached or looked up in the extent tree */
+	if (ext4_es_lookup_extent(inode, lblk, &es) && ext4_es_is_hole(&es)) {
+		*len = es.es_len - (lblk - es.es_lblk);
+	} else {
+		ret = ext4_ext_hole_len(inode, lblk, len);
+		if (ret < 0)
+			return ret;
+	}
+	if (delayed.es_len && delayed.es_lblk - lblk < *len)
+		*len = delayed.es_lblk - lblk;
+	if (*len > max)
+		*len = max;
+	return 0;
+}
+
+static loff_t ext4_seek_execute(struct file *file, loff_t offset,
+				loff_t maxsize)
+{
+	if (offset > maxsize)
+		return -EINVAL;
+
+	if (offset != file->f_pos) {
+		file->f_pos = offset;
+		file->f_version = 0;
+	}
+	return offset;
+}
+
+/*
+ * ext4_seek_data() and ext4_seek_hole() implement SEEK_DATA and SEEK_HOLE
+ * for extent-mapped files.  i_mutex keeps i_size and the delayed extents
+ * stable while the block mapping is walked.
+ */
+static loff_t ext4_seek_data(struct file *file, loff_t offset, loff_t maxsize)
+{
+	struct inode *inode = file->f_mapping->host;
+	unsigned int blkbits = inode->i_blkbits;
+	ext4_lblk_t lblk, last, len;
+	loff_t isize, dataoff = offset;
+	int ret = 0;
+
+	if (offset < 0)
+		return -EINVAL;
+
+	mutex_lock(&inode->i_mutex);
+	isize = i_size_read(inode);
+	if (offset >= isize) {
+		mutex_unlock(&inode->i_mutex);
+		return -ENXIO;
+	}
+
+	lblk = offset >> blkbits;
+	last = (isize - 1) >> blkbits;
+	while (lblk <= last) {
+		ret = ext4_seek_lookup(inode, lblk, last, &len);
+		if (ret)
+			break;
+		lblk += len;
+		dataoff = (loff_t) lblk << blkbits;
+	}
+	mutex_unlock(&inode->i_mutex);
+
+	if (ret < 0)
+		return ret;
+	if (dataoff >= isize)
+		return -ENXIO;
+	return ext4_seek_execute(file, dataoff, maxsize);
+}
+
+static loff_t ext4_seek_hole(struct file *file, loff_t offset, loff_t maxsize)
+{
+	struct inode *inode = file->f_mapping->host;
+	unsigned int blkbits = inode->i_blkbits;
+	ext4_lblk_t lblk, last, len;
+	loff_t isize, holeoff = offset;
+	int ret = 1;
+
+	if (offset < 0)
+		return -EINVAL;
+
+	mutex_lock(&inode->i_mutex);
+	isize = i_size_read(inode);
+	if (offset >= isize) {
+		mutex_unlock(&inode->i_mutex);
+		return -ENXIO;
+	}
+
+	lblk = offset >> blkbits;
+	last = (isize - 1) >> blkbits;
+	while (lblk <= last) {
+		ret = ext4_seek_lookup(inode, lblk, last, &len);
+		if (ret <= 0)
+			break;
+		lblk += len;
+		holeoff = (loff_t) lblk << blkbits;
+	}
+	mutex_unlock(&inode->i_mutex);
+
+	if (ret < 0)
+		return ret;
+	/* There is a virtual hole at the end of the file */
+	if (holeoff > isize)
+		holeoff = isize;
+	return ext4_seek_execute(file, holeoff, maxsize);
+}
+
 /*
  * ext4_llseek() copied from generic_file_llseek() to handle both
  * block-mapped and extent-mapped maxbytes values. This should
- * otherwise be identical with generic_file_llseek().
+ * otherwise be identical with generic_file_llseek(), except that
+ * SEEK_DATA and SEEK_HOLE look at the extents of extent-mapped files.
  */
 loff_t ext4_llseek(struct file *file, loff_t offset, int origin)
 {
@@ -225,6 +364,14 @@ loff_t ext4_llseek(struct file *file, loff_t offset, int origin)
 	else
 		maxbytes = inode->i_sb->s_maxbytes;
 
+	if (S_ISREG(inode->i_mode) &&
+	    ext4_test_inode_flag(inode, EXT4_INODE_EXTENTS)) {
+		if (origin == SEEK_DATA)
+			return ext4_seek_data(file, offset, maxbytes);
+		if (origin == SEEK_HOLE)
+			return ext4_seek_hole(file, offset, maxbytes);
+	}
+
 	return generic_file_llseek_size(file, offset, origin, maxbytes);
 }
 
@@ -211,6 +211,8 @@ int ext4_sync_file(struct file *file, loff_t start, loff_t end, int datasync)
 	int ret;
 	tid_t commit_tid;
 	bool needs_barrier = false;
+	ktime_t fc_start;
+	int reason;
 
 	J_ASSERT(ext4_journal_current_handle() == NULL);
 
@@ -255,13 +257,26 @@ int ext4_sync_file(struct file *file, loff_t start, loff_t end, int datasync)
 	}
 
 	commit_tid = datasync ? ei->i_datasync_tid : ei->i_sync_tid;
-	if (journal->j_flags & JBD2_BARRIER &&
-	    !jbd2_trans_will_send_data_barrier(journal, commit_tid))
-		needs_barrier = true;
-	jbd2_log_start_commit(journal, commit_tid);
-	ret = jbd2_log_wait_commit(journal, commit_tid);
-	if (needs_barrier)
-		blkdev_issue_flush(inode->i_sb->s_bdev, GFP_KERNEL, NULL);
+	fc_start = ktime_get();
+	trace_ext4_fc_commit_start(inode, commit_tid);
+
+	/*
+	 * A fast commit logs just this inode; if the transaction has more of
+	 * the file's changes than that, wait for its full commit instead.
+	 */
+	reason = ext4_fc_commit(inode, commit_tid);
+	if (reason) {
+		if (journal->j_flags & JBD2_BARRIER &&
+		    !jbd2_trans_will_send_data_barrier(journal, commit_tid))
+			needs_barrier = true;
+		jbd2_log_start_commit(journal, commit_tid);
+		ret = jbd2_log_wait_commit(journal, commit_tid);
+		if (needs_barrier)
+			blkdev_issue_flush(inode->i_sb->s_bdev, GFP_KERNEL,
+					   NULL);
+	}
+	trace_ext4_fc_commit_stop(inode, commit_tid, reason,
+			ktime_to_ns(ktime_sub(ktime_get(), fc_start)));
  out:
 	mutex_unlock(&inode->i_mutex);
 	trace_ext4_sync_file_exit(inode, ret);
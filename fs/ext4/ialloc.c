@@ -923,10 +923,17 @@ got:
 		}
 	}
 
+	/* Small files and directories start out in the inode */
+	if (EXT4_HAS_INCOMPAT_FEATURE(sb, EXT4_FEATURE_INCOMPAT_INLINE_DATA) &&
+	    ei->i_extra_isize && (S_ISREG(mode) || S_ISDIR(mode)))
+		ext4_set_inode_state(inode, EXT4_STATE_MAY_INLINE_DATA);
+
 	if (ext4_handle_valid(handle)) {
 		ei->i_sync_tid = handle->h_transaction->t_tid;
 		ei->i_datasync_tid = handle->h_transaction->t_tid;
 	}
+	/* Neither the bitmaps nor the directory entry are in the inode */
+	ext4_fc_mark_ineligible(inode, handle);
 
 	err = ext4_mark_inode_dirty(handle, inode);
 	if (err) {
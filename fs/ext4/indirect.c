@@ -1356,6 +1356,7 @@ void ext4_ind_truncate(struct inode *inode)
 	handle = start_transaction(inode);
 	if (IS_ERR(handle))
 		return;		/* AKPM: return what? */
+	ext4_fc_mark_ineligible(inode, handle);
 
 	last_block = (inode->i_size + blocksize-1)
 					>> EXT4_BLOCK_SIZE_BITS(inode->i_sb);
@@ -1408,6 +1409,9 @@ void ext4_ind_truncate(struct inode *inode)
 	 */
 	ei->i_disksize = inode->i_size;
 
+	/* Drop the cached mapping before the blocks can be reused */
+	ext4_es_remove_extent(inode, last_block, EXT_MAX_BLOCKS - last_block);
+
 	if (last_block == max_block) {
 		/*
 		 * It is unnecessary to free any data blocks if last_block is
@@ -0,0 +1,1484 @@
+/*
+ *  linux/fs/ext4/inline.c
+ *
+ * Inline data: small files and directories kept in the inode itself.
+ *
+ * The first EXT4_MIN_INLINE_DATA_SIZE bytes live in i_block and the rest
+ * in the value of the "system.data" extended attribute, which is always
+ * in the inode body and is present, maybe empty, on every inode with
+ * EXT4_INODE_INLINE_DATA set.
+ *
+ * An inline directory keeps its parent's inode number in the first four
+ * bytes of i_block in place of "." and "..".  The rest of i_block and the
+ * attribute value each hold a chain of ordinary directory entries.
+ *
+ * xattr_sem protects the inline data and i_inline_size.  Other attributes
+ * move the system.data value around, so it is looked up every time it is
+ * needed rather than remembered.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+
+#include <linux/fiemap.h>
+
+#include "ext4_jbd2.h"
+#include "ext4.h"
+#include "xattr.h"
+
+#define EXT4_INLINE_DIR_I_BLOCK_SIZE \
+	(EXT4_MIN_INLINE_DATA_SIZE - EXT4_INLINE_DOTDOT_SIZE)
+
+/*
+ * "." and ".." of an inline directory take the f_pos they would in a
+ * block but only four bytes in the inode, so the offsets of the other
+ * entries are shifted by the difference.  This also keeps f_pos valid
+ * across a conversion to a block.
+ */
+#define EXT4_INLINE_DIR_EXTRA_OFFSET \
+	(EXT4_DIR_REC_LEN(1) + EXT4_DIR_REC_LEN(2) - EXT4_INLINE_DOTDOT_SIZE)
+
+static int ext4_get_inline_size(struct inode *inode)
+{
+	return EXT4_I(inode)->i_inline_size;
+}
+
+/* Return the system.data entry of the inode body, or NULL */
+static struct ext4_xattr_entry *ext4_get_inline_xattr(struct inode *inode,
+						      struct ext4_iloc *iloc)
+{
+	struct ext4_xattr_ibody_find is = {
+		.s = { .not_found = -ENODATA, },
+		.iloc = *iloc,
+	};
+	struct ext4_xattr_info i = {
+		.name_index = EXT4_XATTR_INDEX_SYSTEM_DATA,
+		.name = EXT4_XATTR_SYSTEM_DATA,
+	};
+
+	if (ext4_xattr_ibody_find(inode, &i, &is) || is.s.not_found)
+		return NULL;
+	return is.s.here;
+}
+
+static void *ext4_get_inline_xattr_pos(struct inode *inode,
+				       struct ext4_iloc *iloc,
+				       struct ext4_xattr_entry *entry)
+{
+	struct ext4_xattr_ibody_header *header;
+
+	header = IHDR(inode, ext4_raw_inode(iloc));
+	return (void *)IFIRST(header) + le16_to_cpu(entry->e_value_offs);
+}
+
+/*
+ * How large the system.data value may grow, counting the space its
+ * current value already takes.  Called with xattr_sem held.
+ */
+static int get_max_inline_xattr_value_size(struct inode *inode,
+					   struct ext4_iloc *iloc)
+{
+	struct ext4_xattr_ibody_header *header;
+	struct ext4_xattr_entry *entry, *inline_entry = NULL;
+	struct ext4_inode *raw_inode;
+	void *end;
+	int free, min_offs;
+
+	min_offs = EXT4_SB(inode->i_sb)->s_inode_size -
+			EXT4_GOOD_OLD_INODE_SIZE -
+			EXT4_I(inode)->i_extra_isize -
+			sizeof(struct ext4_xattr_ibody_header);
+
+	/*
+	 * With no attribute in the inode yet, the table holds just our
+	 * entry and the four zero bytes ending it.
+	 */
+	if (!ext4_test_inode_state(inode, EXT4_STATE_XATTR)) {
+		free = min_offs -
+			EXT4_XATTR_LEN(strlen(EXT4_XATTR_SYSTEM_DATA)) -
+			EXT4_XATTR_ROUND - sizeof(__u32);
+		return free > 0 ? EXT4_XATTR_SIZE(free) : 0;
+	}
+
+	raw_inode = ext4_raw_inode(iloc);
+	end = (void *)raw_inode + EXT4_SB(inode->i_sb)->s_inode_size;
+	header = IHDR(inode, raw_inode);
+	entry = IFIRST(header);
+
+	for (; (void *)entry + sizeof(__u32) <= end && !IS_LAST_ENTRY(entry);
+	     entry = EXT4_XATTR_NEXT(entry)) {
+		if (!entry->e_value_block && entry->e_value_size) {
+			int offs = le16_to_cpu(entry->e_value_offs);
+
+			if (offs < min_offs)
+				min_offs = offs;
+		}
+		if (entry->e_name_index == EXT4_XATTR_INDEX_SYSTEM_DATA &&
+		    entry->e_name_len == strlen(EXT4_XATTR_SYSTEM_DATA) &&
+		    !memcmp(entry->e_name, EXT4_XATTR_SYSTEM_DATA,
+			    entry->e_name_len))
+			inline_entry = entry;
+	}
+	free = min_offs - ((void *)entry - (void *)IFIRST(header)) -
+		sizeof(__u32);
+
+	if (inline_entry)
+		return free +
+			EXT4_XATTR_SIZE(le32_to_cpu(inline_entry->e_value_size));
+
+	free -= EXT4_XATTR_LEN(strlen(EXT4_XATTR_SYSTEM_DATA));
+	if (free > EXT4_XATTR_ROUND)
+		return EXT4_XATTR_SIZE(free - EXT4_XATTR_ROUND);
+	return 0;
+}
+
+/*
+ * The most data the inode can hold inline: i_block plus whatever the
+ * system.data value can grow to.  0 if it has no room at all.
+ */
+static int ext4_get_max_inline_size(struct inode *inode)
+{
+	struct ext4_iloc iloc;
+	int max_inline_size;
+
+	if (EXT4_I(inode)->i_extra_isize == 0)
+		return 0;
+
+	if (ext4_get_inode_loc(inode, &iloc))
+		return 0;
+
+	down_read(&EXT4_I(inode)->xattr_sem);
+	max_inline_size = get_max_inline_xattr_value_size(inode, &iloc);
+	up_read(&EXT4_I(inode)->xattr_sem);
+
+	brelse(iloc.bh);
+
+	if (!max_inline_size)
+		return 0;
+	return max_inline_size + EXT4_MIN_INLINE_DATA_SIZE;
+}
+
+/*
+ * Called by ext4_iget() for an inode with EXT4_INODE_INLINE_DATA set,
+ * before anyone else can see it.
+ */
+int ext4_find_inline_data_nolock(struct inode *inode)
+{
+	struct ext4_xattr_entry *entry;
+	struct ext4_iloc iloc;
+	int error;
+
+	if (EXT4_I(inode)->i_extra_isize == 0) {
+		EXT4_ERROR_INODE(inode, "inline data without extra inode space");
+		return -EIO;
+	}
+
+	error = ext4_get_inode_loc(inode, &iloc);
+	if (error)
+		return error;
+
+	entry = ext4_get_inline_xattr(inode, &iloc);
+	if (!entry || entry->e_value_block) {
+		EXT4_ERROR_INODE(inode, "inline data attribute is missing");
+		error = -EIO;
+	} else {
+		EXT4_I(inode)->i_inline_size = EXT4_MIN_INLINE_DATA_SIZE +
+			le32_to_cpu(entry->e_value_size);
+		ext4_set_inode_state(inode, EXT4_STATE_MAY_INLINE_DATA);
+	}
+	brelse(iloc.bh);
+	return error;
+}
+
+/* Copy the first @len bytes of inline data; returns the bytes copied */
+static int ext4_read_inline_data(struct inode *inode, void *buffer,
+				 unsigned int len, struct ext4_iloc *iloc)
+{
+	struct ext4_xattr_entry *entry;
+	unsigned int cp_len;
+
+	BUG_ON(len > ext4_get_inline_size(inode));
+
+	cp_len = min_t(unsigned int, len, EXT4_MIN_INLINE_DATA_SIZE);
+	memcpy(buffer, (void *)ext4_raw_inode(iloc)->i_block, cp_len);
+
+	len -= cp_len;
+	buffer += cp_len;
+	if (!len)
+		return cp_len;
+
+	entry = ext4_get_inline_xattr(inode, iloc);
+	if (!entry) {
+		EXT4_ERROR_INODE(inode, "inline data attribute is missing");
+		return -EIO;
+	}
+	len = min_t(unsigned int, len, le32_to_cpu(entry->e_value_size));
+	memcpy(buffer, ext4_get_inline_xattr_pos(inode, iloc, entry), len);
+	return cp_len + len;
+}
+
+/*
+ * Write @len bytes at @pos of the inline data.  The caller holds
+ * xattr_sem for writing, has write access to iloc->bh and has made room
+ * with ext4_prepare_inline_data().
+ */
+static void ext4_write_inline_data(struct inode *inode,
+				   struct ext4_iloc *iloc,
+				   void *buffer, loff_t pos, unsigned int len)
+{
+	struct ext4_xattr_entry *entry;
+	unsigned int cp_len;
+
+	BUG_ON(pos + len > ext4_get_inline_size(inode));
+
+	if (pos < EXT4_MIN_INLINE_DATA_SIZE) {
+		cp_len = min_t(unsigned int, len,
+			       EXT4_MIN_INLINE_DATA_SIZE - pos);
+		memcpy((void *)ext4_raw_inode(iloc)->i_block + pos,
+		       buffer, cp_len);
+		len -= cp_len;
+		buffer += cp_len;
+		pos += cp_len;
+	}
+	if (!len)
+		return;
+
+	pos -= EXT4_MIN_INLINE_DATA_SIZE;
+	entry = ext4_get_inline_xattr(inode, iloc);
+	BUG_ON(!entry);
+	memcpy(ext4_get_inline_xattr_pos(inode, iloc, entry) + pos,
+	       buffer, len);
+}
+
+/* Turn @inode into an inline one with room for @len zeroed bytes */
+static int ext4_create_inline_data(handle_t *handle,
+				   struct inode *inode, unsigned int len)
+{
+	struct ext4_xattr_ibody_find is = {
+		.s = { .not_found = -ENODATA, },
+	};
+	struct ext4_xattr_info i = {
+		.name_index = EXT4_XATTR_INDEX_SYSTEM_DATA,
+		.name = EXT4_XATTR_SYSTEM_DATA,
+	};
+	void *value = NULL;
+	int error;
+
+	error = ext4_reserve_inode_write(handle, inode, &is.iloc);
+	if (error)
+		return error;
+
+	if (ext4_test_inode_state(inode, EXT4_STATE_NEW)) {
+		memset(ext4_raw_inode(&is.iloc), 0,
+		       EXT4_SB(inode->i_sb)->s_inode_size);
+		ext4_clear_inode_state(inode, EXT4_STATE_NEW);
+	}
+
+	if (len > EXT4_MIN_INLINE_DATA_SIZE) {
+		len -= EXT4_MIN_INLINE_DATA_SIZE;
+		value = kzalloc(len, GFP_NOFS);
+		if (!value) {
+			error = -ENOMEM;
+			goto out;
+		}
+		i.value = value;
+	} else {
+		i.value = "";
+		len = 0;
+	}
+	i.value_len = len;
+
+	error = ext4_xattr_ibody_find(inode, &i, &is);
+	if (error)
+		goto out;
+
+	error = ext4_xattr_ibody_set(handle, inode, &i, &is);
+	if (error) {
+		if (error == -ENOSPC)
+			ext4_clear_inode_state(inode,
+					       EXT4_STATE_MAY_INLINE_DATA);
+		goto out;
+	}
+
+	memset((void *)ext4_raw_inode(&is.iloc)->i_block, 0,
+	       EXT4_MIN_INLINE_DATA_SIZE);
+	memset(EXT4_I(inode)->i_data, 0, sizeof(EXT4_I(inode)->i_data));
+	ext4_clear_inode_flag(inode, EXT4_INODE_EXTENTS);
+	ext4_set_inode_flag(inode, EXT4_INODE_INLINE_DATA);
+	EXT4_I(inode)->i_inline_size = len + EXT4_MIN_INLINE_DATA_SIZE;
+	kfree(value);
+	return ext4_mark_iloc_dirty(handle, inode, &is.iloc);
+
+out:
+	kfree(value);
+	brelse(is.iloc.bh);
+	return error;
+}
+
+/* Grow the inline data of @inode to @len bytes, keeping its contents */
+static int ext4_update_inline_data(handle_t *handle, struct inode *inode,
+				   unsigned int len)
+{
+	struct ext4_xattr_ibody_find is = {
+		.s = { .not_found = -ENODATA, },
+	};
+	struct ext4_xattr_info i = {
+		.name_index = EXT4_XATTR_INDEX_SYSTEM_DATA,
+		.name = EXT4_XATTR_SYSTEM_DATA,
+	};
+	size_t old_len;
+	void *value;
+	int error;
+
+	if (len <= ext4_get_inline_size(inode))
+		return 0;
+
+	error = ext4_reserve_inode_write(handle, inode, &is.iloc);
+	if (error)
+		return error;
+
+	error = ext4_xattr_ibody_find(inode, &i, &is);
+	if (error)
+		goto out;
+	if (is.s.not_found) {
+		EXT4_ERROR_INODE(inode, "inline data attribute is missing");
+		error = -EIO;
+		goto out;
+	}
+
+	len -= EXT4_MIN_INLINE_DATA_SIZE;
+	value = kzalloc(len, GFP_NOFS);
+	if (!value) {
+		error = -ENOMEM;
+		goto out;
+	}
+	old_len = le32_to_cpu(is.s.here->e_value_size);
+	if (old_len)
+		memcpy(value, ext4_get_inline_xattr_pos(inode, &is.iloc,
+							is.s.here), old_len);
+
+	i.value = value;
+	i.value_len = len;
+	error = ext4_xattr_ibody_set(handle, inode, &i, &is);
+	kfree(value);
+	if (error)
+		goto out;
+
+	EXT4_I(inode)->i_inline_size = len + EXT4_MIN_INLINE_DATA_SIZE;
+	return ext4_mark_iloc_dirty(handle, inode, &is.iloc);
+
+out:
+	brelse(is.iloc.bh);
+	return error;
+}
+
+/*
+ * Make room for @len bytes of inline data, creating the attribute if
+ * @inode has no inline data yet.  -ENOSPC if they do not fit.
+ */
+static int ext4_prepare_inline_data(handle_t *handle, struct inode *inode,
+				    unsigned int len)
+{
+	int ret;
+
+	if (len > ext4_get_max_inline_size(inode))
+		return -ENOSPC;
+
+	down_write(&EXT4_I(inode)->xattr_sem);
+	if (!ext4_test_inode_state(inode, EXT4_STATE_MAY_INLINE_DATA))
+		ret = -ENOSPC;
+	else if (ext4_has_inline_data(inode))
+		ret = ext4_update_inline_data(handle, inode, len);
+	else
+		ret = ext4_create_inline_data(handle, inode, len);
+	up_write(&EXT4_I(inode)->xattr_sem);
+
+	return ret;
+}
+
+/*
+ * Drop the inline data of @inode and leave it with an empty block map.
+ * The caller holds xattr_sem for writing and has saved the data.
+ */
+static int ext4_destroy_inline_data_nolock(handle_t *handle,
+					   struct inode *inode)
+{
+	struct ext4_inode_info *ei = EXT4_I(inode);
+	struct ext4_xattr_ibody_find is = {
+		.s = { .not_found = -ENODATA, },
+	};
+	struct ext4_xattr_info i = {
+		.name_index = EXT4_XATTR_INDEX_SYSTEM_DATA,
+		.name = EXT4_XATTR_SYSTEM_DATA,
+		.value = NULL,
+		.value_len = 0,
+	};
+	int error;
+
+	if (!ext4_has_inline_data(inode))
+		return 0;
+
+	error = ext4_reserve_inode_write(handle, inode, &is.iloc);
+	if (error)
+		return error;
+
+	error = ext4_xattr_ibody_find(inode, &i, &is);
+	if (error)
+		goto out;
+	if (!is.s.not_found) {
+		error = ext4_xattr_ibody_set(handle, inode, &i, &is);
+		if (error)
+			goto out;
+	}
+
+	memset((void *)ext4_raw_inode(&is.iloc)->i_block, 0,
+	       EXT4_MIN_INLINE_DATA_SIZE);
+	memset(ei->i_data, 0, sizeof(ei->i_data));
+
+	/*
+	 * The extent header goes to i_data only; the raw i_block is
+	 * written from it once the inline flag is cleared below.
+	 */
+	if (EXT4_HAS_INCOMPAT_FEATURE(inode->i_sb,
+				      EXT4_FEATURE_INCOMPAT_EXTENTS)) {
+		ext4_set_inode_flag(inode, EXT4_INODE_EXTENTS);
+		ext4_ext_tree_init(handle, inode);
+	}
+	ext4_clear_inode_flag(inode, EXT4_INODE_INLINE_DATA);
+	ext4_clear_inode_state(inode, EXT4_STATE_MAY_INLINE_DATA);
+	ei->i_inline_size = 0;
+
+	return ext4_mark_iloc_dirty(handle, inode, &is.iloc);
+
+out:
+	brelse(is.iloc.bh);
+	return error;
+}
+
+/*
+ * Put back data saved by a conversion that could not allocate its
+ * block.  Called with xattr_sem held for writing.
+ */
+static void ext4_restore_inline_data(handle_t *handle, struct inode *inode,
+				     void *buf, int inline_size)
+{
+	struct ext4_iloc iloc;
+	int ret;
+
+	ret = ext4_create_inline_data(handle, inode, inline_size);
+	if (!ret)
+		ret = ext4_reserve_inode_write(handle, inode, &iloc);
+	if (ret) {
+		ext4_msg(inode->i_sb, KERN_EMERG,
+			 "error restoring inline data for inode %lu: %d, "
+			 "data may be lost", inode->i_ino, ret);
+		return;
+	}
+	ext4_write_inline_data(inode, &iloc, buf, 0, inline_size);
+	ext4_set_inode_state(inode, EXT4_STATE_MAY_INLINE_DATA);
+	ext4_mark_iloc_dirty(handle, inode, &iloc);
+}
+
+/*
+ * Fill page 0 from the inline data, zeroing the rest of it.  Called with
+ * the page locked and xattr_sem held.
+ */
+static int ext4_read_inline_page(struct inode *inode, struct page *page)
+{
+	struct ext4_iloc iloc;
+	void *kaddr;
+	size_t len;
+	int ret;
+
+	BUG_ON(!PageLocked(page));
+	BUG_ON(!ext4_has_inline_data(inode));
+	BUG_ON(page->index);
+
+	ret = ext4_get_inode_loc(inode, &iloc);
+	if (ret)
+		return ret;
+
+	len = min_t(size_t, ext4_get_inline_size(inode), i_size_read(inode));
+	kaddr = kmap_atomic(page);
+	ret = ext4_read_inline_data(inode, kaddr, len, &iloc);
+	kunmap_atomic(kaddr);
+	if (ret >= 0) {
+		zero_user_segment(page, len, PAGE_CACHE_SIZE);
+		SetPageUptodate(page);
+	}
+	brelse(iloc.bh);
+	return ret;
+}
+
+/*
+ * ->readpage() for an inline inode.  -EAGAIN if the data has moved out
+ * to blocks meanwhile, so the caller reads it the usual way.
+ */
+int ext4_readpage_inline(struct inode *inode, struct page *page)
+{
+	int ret = 0;
+
+	down_read(&EXT4_I(inode)->xattr_sem);
+	if (!ext4_has_inline_data(inode)) {
+		up_read(&EXT4_I(inode)->xattr_sem);
+		return -EAGAIN;
+	}
+
+	/* Only the first page holds data, the others are holes */
+	if (!page->index)
+		ret = ext4_read_inline_page(inode, page);
+	else if (!PageUptodate(page)) {
+		zero_user_segment(page, 0, PAGE_CACHE_SIZE);
+		SetPageUptodate(page);
+	}
+	up_read(&EXT4_I(inode)->xattr_sem);
+
+	unlock_page(page);
+	return ret >= 0 ? 0 : ret;
+}
+
+/*
+ * Move the inline data of a regular file out to its first block, through
+ * page 0.  xattr_sem is dropped before the block is allocated, since
+ * allocation may dirty the inode and so try to expand its extra fields;
+ * the page lock keeps the data meanwhile.
+ */
+static int ext4_convert_inline_data_to_extent(struct address_space *mapping,
+					      struct inode *inode,
+					      unsigned flags)
+{
+	int ret, err, needed_blocks, inline_size;
+	int retries = 0;
+	handle_t *handle;
+	struct page *page;
+	void *kaddr;
+
+	down_write(&EXT4_I(inode)->xattr_sem);
+	if (!ext4_has_inline_data(inode)) {
+		/* Nothing inline yet: just keep later writes out of the inode */
+		ext4_clear_inode_state(inode, EXT4_STATE_MAY_INLINE_DATA);
+		up_write(&EXT4_I(inode)->xattr_sem);
+		return 0;
+	}
+	up_write(&EXT4_I(inode)->xattr_sem);
+
+	needed_blocks = ext4_writepage_trans_blocks(inode);
+retry:
+	handle = ext4_journal_start(inode, needed_blocks);
+	if (IS_ERR(handle))
+		return PTR_ERR(handle);
+
+	/* We cannot recurse into the filesystem with the handle open */
+	flags |= AOP_FLAG_NOFS;
+
+	page = grab_cache_page_write_begin(mapping, 0, flags);
+	if (!page) {
+		ret = -ENOMEM;
+		goto out;
+	}
+
+	down_write(&EXT4_I(inode)->xattr_sem);
+	if (!ext4_has_inline_data(inode)) {
+		/* Someone else converted it first */
+		ret = 0;
+		up_write(&EXT4_I(inode)->xattr_sem);
+		goto out_page;
+	}
+
+	inline_size = ext4_get_inline_size(inode);
+	ret = 0;
+	if (!PageUptodate(page))
+		ret = ext4_read_inline_page(inode, page);
+	if (ret >= 0)
+		ret = ext4_destroy_inline_data_nolock(handle, inode);
+	up_write(&EXT4_I(inode)->xattr_sem);
+	if (ret)
+		goto out_page;
+
+	ret = __block_write_begin(page, 0, inline_size, ext4_get_block);
+	if (ret) {
+		/* Nothing was allocated, so the data goes back inline */
+		down_write(&EXT4_I(inode)->xattr_sem);
+		kaddr = kmap(page);
+		ext4_restore_inline_data(handle, inode, kaddr, inline_size);
+		kunmap(page);
+		up_write(&EXT4_I(inode)->xattr_sem);
+		goto out_page;
+	}
+
+	if (ext4_should_journal_data(inode)) {
+		/* The first buffer covers all of the former inline data */
+		struct buffer_head *bh = page_buffers(page);
+
+		ret = do_journal_get_write_access(handle, bh);
+		if (!ret)
+			ret = ext4_handle_dirty_metadata(handle, NULL, bh);
+		ext4_set_inode_state(inode, EXT4_STATE_JDATA);
+	} else {
+		if (ext4_should_order_data(inode))
+			ret = ext4_jbd2_file_inode(handle, inode);
+		block_commit_write(page, 0, inline_size);
+	}
+
+out_page:
+	unlock_page(page);
+	page_cache_release(page);
+out:
+	err = ext4_journal_stop(handle);
+	if (!ret)
+		ret = err;
+	if (ret == -ENOSPC && ext4_should_retry_alloc(inode->i_sb, &retries))
+		goto retry;
+	return ret;
+}
+
+/*
+ * Move the inline data of a regular file out to a block, for callers
+ * about to work on it through its block map.
+ */
+int ext4_convert_inline_data(struct inode *inode)
+{
+	return ext4_convert_inline_data_to_extent(inode->i_mapping, inode, 0);
+}
+
+/*
+ * ->write_begin() for a regular file that may hold inline data.  Returns
+ * 1 with page 0 locked and the handle open if the write goes inline,
+ * 0 once the file has been moved to blocks, or an error.
+ */
+int ext4_try_to_write_inline_data(struct address_space *mapping,
+				  struct inode *inode,
+				  loff_t pos, unsigned len,
+				  unsigned flags,
+				  struct page **pagep)
+{
+	handle_t *handle;
+	struct page *page;
+	int ret;
+
+	if (pos + len > ext4_get_max_inline_size(inode))
+		goto convert;
+
+	/* The inode block, and the superblock and orphan list on a short copy */
+	handle = ext4_journal_start(inode, 3);
+	if (IS_ERR(handle))
+		return PTR_ERR(handle);
+
+	ret = ext4_prepare_inline_data(handle, inode, pos + len);
+	if (ret == -ENOSPC) {
+		ext4_journal_stop(handle);
+		goto convert;
+	}
+	if (ret)
+		goto out;
+
+	flags |= AOP_FLAG_NOFS;
+
+	page = grab_cache_page_write_begin(mapping, 0, flags);
+	if (!page) {
+		ret = -ENOMEM;
+		goto out;
+	}
+
+	down_read(&EXT4_I(inode)->xattr_sem);
+	if (!ext4_has_inline_data(inode)) {
+		ret = 0;
+		goto out_page;
+	}
+
+	if (!PageUptodate(page)) {
+		ret = ext4_read_inline_page(inode, page);
+		if (ret < 0)
+			goto out_page;
+	}
+	up_read(&EXT4_I(inode)->xattr_sem);
+
+	*pagep = page;
+	return 1;
+
+out_page:
+	up_read(&EXT4_I(inode)->xattr_sem);
+	unlock_page(page);
+	page_cache_release(page);
+out:
+	ext4_journal_stop(handle);
+	return ret;
+
+convert:
+	return ext4_convert_inline_data_to_extent(mapping, inode, flags);
+}
+
+/* ->write_end() half of ext4_try_to_write_inline_data() */
+int ext4_write_inline_data_end(struct inode *inode, loff_t pos, unsigned len,
+			       unsigned copied, struct page *page)
+{
+	handle_t *handle = ext4_journal_current_handle();
+	struct ext4_iloc iloc;
+	void *kaddr;
+	int ret;
+
+	if (unlikely(copied < len) && !PageUptodate(page))
+		return 0;
+
+	ret = ext4_reserve_inode_write(handle, inode, &iloc);
+	if (ret) {
+		ext4_std_error(inode->i_sb, ret);
+		return 0;
+	}
+
+	down_write(&EXT4_I(inode)->xattr_sem);
+	BUG_ON(!ext4_has_inline_data(inode));
+
+	kaddr = kmap_atomic(page);
+	ext4_write_inline_data(inode, &iloc, kaddr + pos, pos, copied);
+	kunmap_atomic(kaddr);
+	SetPageUptodate(page);
+	/* The inode holds the data, writepage has nothing to do */
+	ClearPageDirty(page);
+
+	up_write(&EXT4_I(inode)->xattr_sem);
+
+	ext4_update_inode_fsync_trans(handle, inode, 1);
+	ret = ext4_mark_iloc_dirty(handle, inode, &iloc);
+	if (ret)
+		ext4_std_error(inode->i_sb, ret);
+	return copied;
+}
+
+/*
+ * Cut the inline data of a regular file down to i_size.  Inline data
+ * never grows on truncate: reads past it return zeroes.
+ */
+void ext4_inline_data_truncate(struct inode *inode, int *has_inline)
+{
+	struct ext4_xattr_ibody_find is = {
+		.s = { .not_found = -ENODATA, },
+	};
+	struct ext4_xattr_info i = {
+		.name_index = EXT4_XATTR_INDEX_SYSTEM_DATA,
+		.name = EXT4_XATTR_SYSTEM_DATA,
+	};
+	handle_t *handle;
+	void *value = NULL;
+	size_t value_len;
+	loff_t i_size;
+	int inline_size;
+
+	handle = ext4_journal_start(inode, ext4_writepage_trans_blocks(inode));
+	if (IS_ERR(handle))
+		return;
+
+	down_write(&EXT4_I(inode)->xattr_sem);
+	if (!ext4_has_inline_data(inode)) {
+		*has_inline = 0;
+		up_write(&EXT4_I(inode)->xattr_sem);
+		ext4_journal_stop(handle);
+		return;
+	}
+
+	if (ext4_reserve_inode_write(handle, inode, &is.iloc))
+		goto out_unlock;
+
+	i_size = inode->i_size;
+	inline_size = ext4_get_inline_size(inode);
+	EXT4_I(inode)->i_disksize = i_size;
+
+	if (i_size < inline_size) {
+		/* Shrink the part in the attribute first */
+		if (inline_size > EXT4_MIN_INLINE_DATA_SIZE) {
+			if (ext4_xattr_ibody_find(inode, &i, &is) ||
+			    is.s.not_found)
+				goto out_iloc;
+
+			value_len = le32_to_cpu(is.s.here->e_value_size);
+			value = kmalloc(value_len, GFP_NOFS);
+			if (!value)
+				goto out_iloc;
+			memcpy(value, ext4_get_inline_xattr_pos(inode, &is.iloc,
+								is.s.here),
+			       value_len);
+
+			i.value = value;
+			i.value_len = i_size > EXT4_MIN_INLINE_DATA_SIZE ?
+				i_size - EXT4_MIN_INLINE_DATA_SIZE : 0;
+			if (ext4_xattr_ibody_set(handle, inode, &i, &is))
+				goto out_iloc;
+		}
+
+		/* then the part in i_block */
+		if (i_size < EXT4_MIN_INLINE_DATA_SIZE)
+			memset((void *)ext4_raw_inode(&is.iloc)->i_block +
+			       i_size, 0, EXT4_MIN_INLINE_DATA_SIZE - i_size);
+
+		EXT4_I(inode)->i_inline_size =
+			max_t(loff_t, i_size, EXT4_MIN_INLINE_DATA_SIZE);
+	}
+
+	ext4_mark_iloc_dirty(handle, inode, &is.iloc);
+	is.iloc.bh = NULL;
+
+out_iloc:
+	brelse(is.iloc.bh);
+out_unlock:
+	up_write(&EXT4_I(inode)->xattr_sem);
+	kfree(value);
+
+	if (inode->i_nlink)
+		ext4_orphan_del(handle, inode);
+	inode->i_mtime = inode->i_ctime = ext4_current_time(inode);
+	ext4_mark_inode_dirty(handle, inode);
+	if (IS_SYNC(inode))
+		ext4_handle_sync(handle);
+	ext4_journal_stop(handle);
+}
+
+/* Report the inline data of @inode as one extent inside its inode */
+int ext4_inline_data_fiemap(struct inode *inode,
+			    struct fiemap_extent_info *fieinfo,
+			    int *has_inline)
+{
+	__u64 physical = 0;
+	__u64 length;
+	__u32 flags = FIEMAP_EXTENT_DATA_INLINE | FIEMAP_EXTENT_LAST;
+	struct ext4_iloc iloc;
+	int error = 0;
+
+	down_read(&EXT4_I(inode)->xattr_sem);
+	if (!ext4_has_inline_data(inode)) {
+		*has_inline = 0;
+		goto out;
+	}
+
+	error = ext4_get_inode_loc(inode, &iloc);
+	if (error)
+		goto out;
+
+	physical = (__u64)iloc.bh->b_blocknr << inode->i_sb->s_blocksize_bits;
+	physical += (char *)ext4_raw_inode(&iloc) - iloc.bh->b_data;
+	physical += offsetof(struct ext4_inode, i_block);
+	length = min_t(__u64, i_size_read(inode), ext4_get_inline_size(inode));
+	brelse(iloc.bh);
+
+	if (length)
+		error = fiemap_fill_next_extent(fieinfo, 0, physical,
+						length, flags);
+	if (error > 0)
+		error = 0;
+out:
+	up_read(&EXT4_I(inode)->xattr_sem);
+	return error;
+}
+
+/*
+ * Set up @inode as an empty inline directory in @parent.  -ENOSPC if it
+ * cannot hold inline data, so that the caller allocates a block instead.
+ */
+int ext4_try_create_inline_dir(handle_t *handle, struct inode *parent,
+			       struct inode *inode)
+{
+	struct ext4_dir_entry_2 *de;
+	struct ext4_iloc iloc;
+	int ret;
+
+	ret = ext4_prepare_inline_data(handle, inode,
+				       EXT4_MIN_INLINE_DATA_SIZE);
+	if (ret)
+		return ret;
+
+	ret = ext4_reserve_inode_write(handle, inode, &iloc);
+	if (ret)
+		return ret;
+
+	/*
+	 * The parent's number takes the place of "." and "..", and one
+	 * empty entry covers the rest of i_block.
+	 */
+	de = (struct ext4_dir_entry_2 *)ext4_raw_inode(&iloc)->i_block;
+	de->inode = cpu_to_le32(parent->i_ino);
+	de = (struct ext4_dir_entry_2 *)((void *)de + EXT4_INLINE_DOTDOT_SIZE);
+	de->inode = 0;
+	de->rec_len = ext4_rec_len_to_disk(EXT4_INLINE_DIR_I_BLOCK_SIZE,
+					   EXT4_INLINE_DIR_I_BLOCK_SIZE);
+	set_nlink(inode, 2);
+	inode->i_size = EXT4_I(inode)->i_disksize = EXT4_MIN_INLINE_DATA_SIZE;
+
+	return ext4_mark_iloc_dirty(handle, inode, &iloc);
+}
+
+/*
+ * Add an entry to one of the two entry chains of an inline directory.
+ * Returns 1 on success, -ENOSPC if the chain is full.
+ */
+static int ext4_add_dirent_to_inline(handle_t *handle,
+				     struct dentry *dentry,
+				     struct inode *inode,
+				     struct ext4_iloc *iloc,
+				     void *inline_start, int inline_size)
+{
+	struct inode *dir = dentry->d_parent->d_inode;
+	const char *name = (const char *)dentry->d_name.name;
+	int namelen = dentry->d_name.len;
+	struct ext4_dir_entry_2 *de;
+	int err;
+
+	err = ext4_find_dest_de(dir, inode, iloc->bh, inline_start,
+				inline_size, name, namelen, &de);
+	if (err)
+		return err;
+
+	BUFFER_TRACE(iloc->bh, "get_write_access");
+	err = ext4_journal_get_write_access(handle, iloc->bh);
+	if (err)
+		return err;
+	ext4_insert_dentry(dir, inode, de, inline_size, name, namelen);
+
+	dir->i_mtime = dir->i_ctime = ext4_current_time(dir);
+	dir->i_version++;
+	return 1;
+}
+
+static int ext4_add_dirent_to_inline_xattr(handle_t *handle,
+					   struct dentry *dentry,
+					   struct inode *inode,
+					   struct ext4_iloc *iloc)
+{
+	struct inode *dir = dentry->d_parent->d_inode;
+	struct ext4_xattr_entry *entry;
+	int inline_size;
+
+	inline_size = ext4_get_inline_size(dir) - EXT4_MIN_INLINE_DATA_SIZE;
+	if (!inline_size)
+		return -ENOSPC;
+
+	entry = ext4_get_inline_xattr(dir, iloc);
+	if (!entry)
+		return -EIO;
+
+	return ext4_add_dirent_to_inline(handle, dentry, inode, iloc,
+			ext4_get_inline_xattr_pos(dir, iloc, entry),
+			inline_size);
+}
+
+/*
+ * Stretch the last entry of a chain that grew from @old_size to
+ * @new_size bytes over the new space, or add an empty entry covering it
+ * if the chain was empty.
+ */
+static void ext4_update_final_de(void *de_buf, int old_size, int new_size)
+{
+	struct ext4_dir_entry_2 *de, *prev_de;
+	void *limit;
+	int de_len;
+
+	de = (struct ext4_dir_entry_2 *)de_buf;
+	if (old_size) {
+		limit = de_buf + old_size;
+		do {
+			prev_de = de;
+			de_len = ext4_rec_len_from_disk(de->rec_len, old_size);
+			de_buf += de_len;
+			de = (struct ext4_dir_entry_2 *)de_buf;
+		} while (de_len && de_buf < limit);
+
+		prev_de->rec_len = ext4_rec_len_to_disk(de_len + new_size -
+							old_size, new_size);
+	} else {
+		de->inode = 0;
+		de->rec_len = ext4_rec_len_to_disk(new_size, new_size);
+	}
+}
+
+/* Grow the attribute of an inline directory as far as the inode allows */
+static int ext4_update_inline_dir(handle_t *handle, struct inode *dir,
+				  struct ext4_iloc *iloc)
+{
+	int old_size = ext4_get_inline_size(dir) - EXT4_MIN_INLINE_DATA_SIZE;
+	int new_size = get_max_inline_xattr_value_size(dir, iloc);
+	struct ext4_xattr_entry *entry;
+	int ret;
+
+	if (new_size - old_size <= EXT4_DIR_REC_LEN(1))
+		return -ENOSPC;
+
+	ret = ext4_update_inline_data(handle, dir,
+				      new_size + EXT4_MIN_INLINE_DATA_SIZE);
+	if (ret)
+		return ret;
+
+	entry = ext4_get_inline_xattr(dir, iloc);
+	if (!entry)
+		return -EIO;
+
+	ext4_update_final_de(ext4_get_inline_xattr_pos(dir, iloc, entry),
+			     old_size, new_size);
+	dir->i_size = EXT4_I(dir)->i_disksize = ext4_get_inline_size(dir);
+	return 0;
+}
+
+/*
+ * Move the entries of an inline directory to a newly allocated first
+ * block, with "." and ".." recreated in front of them.
+ */
+static int ext4_convert_inline_dir(handle_t *handle, struct inode *dir)
+{
+	unsigned int blocksize = dir->i_sb->s_blocksize;
+	unsigned int dots_size = EXT4_DIR_REC_LEN(1) + EXT4_DIR_REC_LEN(2);
+	struct buffer_head *dir_block;
+	struct ext4_dir_entry_2 *de;
+	struct ext4_iloc iloc;
+	void *buf = NULL;
+	int inline_size, err;
+
+	err = ext4_get_inode_loc(dir, &iloc);
+	if (err)
+		return err;
+
+	down_write(&EXT4_I(dir)->xattr_sem);
+	if (!ext4_has_inline_data(dir)) {
+		up_write(&EXT4_I(dir)->xattr_sem);
+		goto out;
+	}
+
+	inline_size = ext4_get_inline_size(dir);
+	buf = kmalloc(inline_size, GFP_NOFS);
+	if (!buf) {
+		err = -ENOMEM;
+		up_write(&EXT4_I(dir)->xattr_sem);
+		goto out;
+	}
+
+	err = ext4_read_inline_data(dir, buf, inline_size, &iloc);
+	if (err >= 0)
+		err = ext4_destroy_inline_data_nolock(handle, dir);
+	up_write(&EXT4_I(dir)->xattr_sem);
+	if (err)
+		goto out;
+
+	dir_block = ext4_bread(handle, dir, 0, 1, &err);
+	if (!dir_block) {
+		/* Nothing was allocated, so the entries go back inline */
+		down_write(&EXT4_I(dir)->xattr_sem);
+		ext4_restore_inline_data(handle, dir, buf, inline_size);
+		up_write(&EXT4_I(dir)->xattr_sem);
+		goto out;
+	}
+
+	BUFFER_TRACE(dir_block, "get_write_access");
+	err = ext4_journal_get_write_access(handle, dir_block);
+	if (err)
+		goto out_brelse;
+
+	de = (struct ext4_dir_entry_2 *)dir_block->b_data;
+	de->inode = cpu_to_le32(dir->i_ino);
+	de->name_len = 1;
+	de->rec_len = ext4_rec_len_to_disk(EXT4_DIR_REC_LEN(1), blocksize);
+	strcpy(de->name, ".");
+	de = (struct ext4_dir_entry_2 *)((void *)de + EXT4_DIR_REC_LEN(1));
+	de->inode = ((struct ext4_dir_entry_2 *)buf)->inode;
+	de->name_len = 2;
+	de->rec_len = ext4_rec_len_to_disk(EXT4_DIR_REC_LEN(2), blocksize);
+	strcpy(de->name, "..");
+	if (EXT4_HAS_INCOMPAT_FEATURE(dir->i_sb,
+				      EXT4_FEATURE_INCOMPAT_FILETYPE)) {
+		de->file_type = EXT4_FT_DIR;
+		((struct ext4_dir_entry_2 *)dir_block->b_data)->file_type =
+			EXT4_FT_DIR;
+	}
+
+	/* The two inline chains are contiguous, so one pass fixes the end */
+	memcpy(dir_block->b_data + dots_size, buf + EXT4_INLINE_DOTDOT_SIZE,
+	       inline_size - EXT4_INLINE_DOTDOT_SIZE);
+	ext4_update_final_de(dir_block->b_data + dots_size,
+			     inline_size - EXT4_INLINE_DOTDOT_SIZE,
+			     blocksize - dots_size);
+
+	dir->i_size = EXT4_I(dir)->i_disksize = blocksize;
+	BUFFER_TRACE(dir_block, "call ext4_handle_dirty_metadata");
+	err = ext4_handle_dirty_metadata(handle, dir, dir_block);
+out_brelse:
+	brelse(dir_block);
+out:
+	kfree(buf);
+	brelse(iloc.bh);
+	return err;
+}
+
+/*
+ * Add @dentry to its inline parent directory: first in i_block, then in
+ * the attribute, growing it if the inode has room.  Returns 1 if the
+ * entry was added, or 0 once the directory has been moved to a block
+ * and the caller should add it there.
+ */
+int ext4_try_add_inline_entry(handle_t *handle, struct dentry *dentry,
+			      struct inode *inode)
+{
+	struct inode *dir = dentry->d_parent->d_inode;
+	struct ext4_iloc iloc;
+	void *inline_start;
+	int ret;
+
+	ret = ext4_get_inode_loc(dir, &iloc);
+	if (ret)
+		return ret;
+
+	down_write(&EXT4_I(dir)->xattr_sem);
+	if (!ext4_has_inline_data(dir))
+		goto out;
+
+	inline_start = (void *)ext4_raw_inode(&iloc)->i_block +
+			EXT4_INLINE_DOTDOT_SIZE;
+	ret = ext4_add_dirent_to_inline(handle, dentry, inode, &iloc,
+					inline_start,
+					EXT4_INLINE_DIR_I_BLOCK_SIZE);
+	if (ret != -ENOSPC)
+		goto out;
+
+	ret = ext4_add_dirent_to_inline_xattr(handle, dentry, inode, &iloc);
+	if (ret != -ENOSPC)
+		goto out;
+
+	ret = ext4_update_inline_dir(handle, dir, &iloc);
+	if (!ret)
+		ret = ext4_add_dirent_to_inline_xattr(handle, dentry, inode,
+						      &iloc);
+	if (ret != -ENOSPC)
+		goto out;
+
+	/* The inode is full: move the directory out to a block */
+	up_write(&EXT4_I(dir)->xattr_sem);
+	brelse(iloc.bh);
+	ret = ext4_convert_inline_dir(handle, dir);
+	if (!ret)
+		ret = ext4_mark_inode_dirty(handle, dir);
+	return ret;
+
+out:
+	up_write(&EXT4_I(dir)->xattr_sem);
+	brelse(iloc.bh);
+	if (ret == 1)
+		ext4_mark_inode_dirty(handle, dir);
+	return ret;
+}
+
+/*
+ * Look up @d_name in an inline directory.  ".." is answered with the
+ * parent's number at the start of i_block, which sits where de->inode
+ * would.  The inode's buffer is returned as the one holding the entry.
+ */
+struct buffer_head *ext4_find_inline_entry(struct inode *dir,
+					   const struct qstr *d_name,
+					   struct ext4_dir_entry_2 **res_dir,
+					   int *has_inline_data)
+{
+	struct ext4_xattr_entry *entry;
+	struct ext4_iloc iloc;
+	void *inline_start;
+	int inline_size;
+	int ret;
+
+	if (ext4_get_inode_loc(dir, &iloc))
+		return NULL;
+
+	down_read(&EXT4_I(dir)->xattr_sem);
+	if (!ext4_has_inline_data(dir)) {
+		*has_inline_data = 0;
+		goto out;
+	}
+
+	inline_start = (void *)ext4_raw_inode(&iloc)->i_block;
+	if (d_name->len == 2 && !memcmp(d_name->name, "..", 2)) {
+		*res_dir = inline_start;
+		goto out_find;
+	}
+
+	ret = ext4_search_dir(iloc.bh, inline_start + EXT4_INLINE_DOTDOT_SIZE,
+			      EXT4_INLINE_DIR_I_BLOCK_SIZE, dir, d_name,
+			      EXT4_INLINE_DOTDOT_SIZE, res_dir);
+	if (ret == 1)
+		goto out_find;
+	if (ret < 0)
+		goto out;
+
+	inline_size = ext4_get_inline_size(dir) - EXT4_MIN_INLINE_DATA_SIZE;
+	if (!inline_size)
+		goto out;
+
+	entry = ext4_get_inline_xattr(dir, &iloc);
+	if (!entry)
+		goto out;
+
+	ret = ext4_search_dir(iloc.bh,
+			      ext4_get_inline_xattr_pos(dir, &iloc, entry),
+			      inline_size, dir, d_name,
+			      EXT4_MIN_INLINE_DATA_SIZE, res_dir);
+	if (ret == 1)
+		goto out_find;
+
+out:
+	brelse(iloc.bh);
+	iloc.bh = NULL;
+out_find:
+	up_read(&EXT4_I(dir)->xattr_sem);
+	return iloc.bh;
+}
+
+/* Delete an entry found by ext4_find_inline_entry() */
+int ext4_delete_inline_entry(handle_t *handle,
+			     struct inode *dir,
+			     struct ext4_dir_entry_2 *de_del,
+			     struct buffer_head *bh,
+			     int *has_inline_data)
+{
+	struct ext4_xattr_entry *entry;
+	struct ext4_iloc iloc;
+	void *inline_start;
+	int inline_size;
+	int err;
+
+	err = ext4_get_inode_loc(dir, &iloc);
+	if (err)
+		return err;
+
+	down_write(&EXT4_I(dir)->xattr_sem);
+	if (!ext4_has_inline_data(dir)) {
+		*has_inline_data = 0;
+		goto out;
+	}
+
+	inline_start = (void *)ext4_raw_inode(&iloc)->i_block +
+			EXT4_INLINE_DOTDOT_SIZE;
+	inline_size = EXT4_INLINE_DIR_I_BLOCK_SIZE;
+	if ((void *)de_del < inline_start ||
+	    (void *)de_del >= inline_start + inline_size) {
+		entry = ext4_get_inline_xattr(dir, &iloc);
+		if (!entry) {
+			err = -EIO;
+			goto out;
+		}
+		inline_start = ext4_get_inline_xattr_pos(dir, &iloc, entry);
+		inline_size = ext4_get_inline_size(dir) -
+				EXT4_MIN_INLINE_DATA_SIZE;
+	}
+
+	BUFFER_TRACE(bh, "get_write_access");
+	err = ext4_journal_get_write_access(handle, bh);
+	if (err)
+		goto out;
+
+	err = ext4_generic_delete_entry(handle, dir, de_del, bh,
+					inline_start, inline_size);
+	if (err)
+		goto out;
+
+	BUFFER_TRACE(bh, "call ext4_handle_dirty_metadata");
+	err = ext4_handle_dirty_metadata(handle, dir, bh);
+out:
+	up_write(&EXT4_I(dir)->xattr_sem);
+	brelse(iloc.bh);
+	if (err != -ENOENT)
+		ext4_std_error(dir->i_sb, err);
+	return err;
+}
+
+/* Returns 0 if the chain at @buf holds a live entry */
+static int ext4_inline_entries_empty(struct inode *dir,
+				     struct buffer_head *bh,
+				     void *buf, int size)
+{
+	struct ext4_dir_entry_2 *de;
+	unsigned int offset = 0;
+
+	while (offset < size) {
+		de = (struct ext4_dir_entry_2 *)(buf + offset);
+		if (ext4_check_dir_entry(dir, NULL, de, bh, buf, size,
+					 offset))
+			return 1;
+		if (le32_to_cpu(de->inode))
+			return 0;
+		offset += ext4_rec_len_from_disk(de->rec_len, size);
+	}
+	return 1;
+}
+
+/* empty_dir() for an inline directory */
+int empty_inline_dir(struct inode *dir, int *has_inline_data)
+{
+	struct ext4_xattr_entry *entry;
+	struct ext4_iloc iloc;
+	void *inline_start;
+	int inline_size;
+	int ret = 1;
+
+	if (ext4_get_inode_loc(dir, &iloc)) {
+		EXT4_ERROR_INODE(dir, "error reading inline directory");
+		return 1;
+	}
+
+	down_read(&EXT4_I(dir)->xattr_sem);
+	if (!ext4_has_inline_data(dir)) {
+		*has_inline_data = 0;
+		goto out;
+	}
+
+	inline_start = (void *)ext4_raw_inode(&iloc)->i_block;
+	if (!le32_to_cpu(((struct ext4_dir_entry_2 *)inline_start)->inode)) {
+		ext4_warning(dir->i_sb,
+			     "bad inline directory (dir #%lu) - no `..'",
+			     dir->i_ino);
+		goto out;
+	}
+
+	ret = ext4_inline_entries_empty(dir, iloc.bh,
+					inline_start + EXT4_INLINE_DOTDOT_SIZE,
+					EXT4_INLINE_DIR_I_BLOCK_SIZE);
+	if (!ret)
+		goto out;
+
+	inline_size = ext4_get_inline_size(dir) - EXT4_MIN_INLINE_DATA_SIZE;
+	if (!inline_size)
+		goto out;
+
+	entry = ext4_get_inline_xattr(dir, &iloc);
+	if (entry)
+		ret = ext4_inline_entries_empty(dir, iloc.bh,
+				ext4_get_inline_xattr_pos(dir, &iloc, entry),
+				inline_size);
+out:
+	up_read(&EXT4_I(dir)->xattr_sem);
+	brelse(iloc.bh);
+	return ret;
+}
+
+/*
+ * The ".." entry of an inline directory, for rename: the parent's number
+ * at the start of i_block is laid out like de->inode.
+ */
+struct buffer_head *ext4_get_first_inline_block(struct inode *inode,
+					struct ext4_dir_entry_2 **parent_de,
+					int *retval)
+{
+	struct ext4_iloc iloc;
+
+	*retval = ext4_get_inode_loc(inode, &iloc);
+	if (*retval)
+		return NULL;
+
+	*parent_de = (struct ext4_dir_entry_2 *)ext4_raw_inode(&iloc)->i_block;
+	return iloc.bh;
+}
+
+/*
+ * readdir() for an inline directory.  The entries are copied out first,
+ * so filldir() runs without xattr_sem and sees a consistent snapshot.
+ */
+int ext4_read_inline_dir(struct file *filp,
+			 void *dirent, filldir_t filldir,
+			 int *has_inline_data)
+{
+	struct inode *inode = filp->f_path.dentry->d_inode;
+	struct super_block *sb = inode->i_sb;
+	unsigned int dotdot_offset = EXT4_DIR_REC_LEN(1);
+	unsigned int dotdot_end = dotdot_offset + EXT4_DIR_REC_LEN(2);
+	unsigned int extra_offset = EXT4_INLINE_DIR_EXTRA_OFFSET;
+	unsigned int extra_size, parent_ino;
+	struct ext4_dir_entry_2 *de;
+	struct ext4_iloc iloc;
+	void *dir_buf = NULL;
+	int inline_size;
+	loff_t i;
+	int ret;
+
+	ret = ext4_get_inode_loc(inode, &iloc);
+	if (ret)
+		return ret;
+
+	down_read(&EXT4_I(inode)->xattr_sem);
+	if (!ext4_has_inline_data(inode)) {
+		up_read(&EXT4_I(inode)->xattr_sem);
+		*has_inline_data = 0;
+		goto out;
+	}
+
+	inline_size = ext4_get_inline_size(inode);
+	dir_buf = kmalloc(inline_size, GFP_NOFS);
+	if (!dir_buf) {
+		ret = -ENOMEM;
+		up_read(&EXT4_I(inode)->xattr_sem);
+		goto out;
+	}
+
+	ret = ext4_read_inline_data(inode, dir_buf, inline_size, &iloc);
+	up_read(&EXT4_I(inode)->xattr_sem);
+	if (ret < 0)
+		goto out;
+	ret = 0;
+
+	parent_ino = le32_to_cpu(((struct ext4_dir_entry_2 *)dir_buf)->inode);
+	extra_size = extra_offset + inline_size;
+
+	/*
+	 * If the directory changed since the last call, f_pos may point
+	 * into the middle of an entry: rescan from the start for the
+	 * first entry at or after it.
+	 */
+	if (filp->f_version != inode->i_version) {
+		for (i = 0; i < extra_size && i < filp->f_pos;) {
+			if (!i) {
+				i = dotdot_offset;
+				continue;
+			}
+			if (i == dotdot_offset) {
+				i = dotdot_end;
+				continue;
+			}
+			de = (struct ext4_dir_entry_2 *)
+				(dir_buf + i - extra_offset);
+			/*
+			 * A full dirent test each time round is too
+			 * expensive, but a zero rec_len would loop
+			 * forever.  The test below catches the rest.
+			 */
+			if (ext4_rec_len_from_disk(de->rec_len, inline_size) <
+			    EXT4_DIR_REC_LEN(1))
+				break;
+			i += ext4_rec_len_from_disk(de->rec_len, inline_size);
+		}
+		filp->f_pos = i;
+		filp->f_version = inode->i_version;
+	}
+
+	while (filp->f_pos < extra_size) {
+		if (filp->f_pos == 0) {
+			if (filldir(dirent, ".", 1, 0, inode->i_ino, DT_DIR))
+				goto out;
+			filp->f_pos = dotdot_offset;
+			continue;
+		}
+		if (filp->f_pos == dotdot_offset) {
+			if (filldir(dirent, "..", 2, dotdot_offset,
+				    parent_ino, DT_DIR))
+				goto out;
+			filp->f_pos = dotdot_end;
+			continue;
+		}
+
+		de = (struct ext4_dir_entry_2 *)
+			(dir_buf + filp->f_pos - extra_offset);
+		if (ext4_check_dir_entry(inode, filp, de, iloc.bh, dir_buf,
+					 inline_size,
+					 filp->f_pos - extra_offset))
+			goto out;
+		if (le32_to_cpu(de->inode)) {
+			if (filldir(dirent, de->name, de->name_len,
+				    filp->f_pos, le32_to_cpu(de->inode),
+				    get_dtype(sb, de->file_type)))
+				goto out;
+		}
+		filp->f_pos += ext4_rec_len_from_disk(de->rec_len, inline_size);
+	}
+out:
+	kfree(dir_buf);
+	brelse(iloc.bh);
+	return ret;
+}
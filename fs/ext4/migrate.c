@@ -442,11 +442,12 @@ int ext4_ext_migrate(struct inode *inode)
 
 	/*
 	 * If the filesystem does not support extents, or the inode
-	 * already is extent-based, error out.
+	 * already is extent-based or holds inline data, error out.
 	 */
 	if (!EXT4_HAS_INCOMPAT_FEATURE(inode->i_sb,
 				       EXT4_FEATURE_INCOMPAT_EXTENTS) ||
-	    (ext4_test_inode_flag(inode, EXT4_INODE_EXTENTS)))
+	    (ext4_test_inode_flag(inode, EXT4_INODE_EXTENTS)) ||
+	    ext4_has_inline_data(inode))
 		return -EINVAL;
 
 	if (S_ISLNK(inode->i_mode) && inode->i_blocks == 0)
@@ -517,6 +518,7 @@ int ext4_ext_migrate(struct inode *inode)
 		retval = PTR_ERR(handle);
 		goto out;
 	}
+	ext4_fc_mark_ineligible(inode, handle);
 
 	ei = EXT4_I(inode);
 	i_data = ei->i_data;
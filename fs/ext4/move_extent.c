@@ -763,6 +763,8 @@ out:
 
 	ext4_ext_invalidate_cache(orig_inode);
 	ext4_ext_invalidate_cache(donor_inode);
+	ext4_es_invalidate_extent(orig_inode, from, count);
+	ext4_es_invalidate_extent(donor_inode, from, count);
 
 	double_up_write_data_sem(orig_inode, donor_inode);
 
@@ -817,6 +819,8 @@ move_extent_per_page(struct file *o_filp, struct inode *donor_inode,
 		*err = PTR_ERR(handle);
 		return 0;
 	}
+	ext4_fc_mark_ineligible(orig_inode, handle);
+	ext4_fc_mark_ineligible(donor_inode, handle);
 
 	if (segment_eq(get_fs(), KERNEL_DS))
 		w_flags |= AOP_FLAG_UNINTERRUPTIBLE;
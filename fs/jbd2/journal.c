@@ -42,6 +42,7 @@
 #include <linux/log2.h>
 #include <linux/vmalloc.h>
 #include <linux/backing-dev.h>
+#include <linux/blkdev.h>
 #include <linux/bitops.h>
 #include <linux/ratelimit.h>
 
@@ -85,6 +86,11 @@ EXPORT_SYMBOL(jbd2_log_wait_commit);
 EXPORT_SYMBOL(jbd2_log_start_commit);
 EXPORT_SYMBOL(jbd2_journal_start_commit);
 EXPORT_SYMBOL(jbd2_journal_force_commit_nested);
+EXPORT_SYMBOL(jbd2_fc_begin_commit);
+EXPORT_SYMBOL(jbd2_fc_end_commit);
+EXPORT_SYMBOL(jbd2_fc_end_commit_fallback);
+EXPORT_SYMBOL(jbd2_fc_get_buf);
+EXPORT_SYMBOL(jbd2_fc_write_buf);
 EXPORT_SYMBOL(jbd2_journal_wipe);
 EXPORT_SYMBOL(jbd2_journal_blocks_per_page);
 EXPORT_SYMBOL(jbd2_journal_invalidatepage);
@@ -662,6 +668,183 @@ int jbd2_log_wait_commit(journal_t *journal, tid_t tid)
 	return err;
 }
 
+/*
+ * Fast commits: instead of committing the running transaction, the file
+ * system writes a compact record of what fsync needs into the fast commit
+ * area at the end of the journal.  Recovery hands those blocks back to the
+ * file system on top of the last committed transaction.  The area belongs
+ * to the running transaction and is reused once that commits.
+ */
+
+/**
+ * int jbd2_fc_begin_commit() - start a fast commit of a transaction
+ * @journal: Journal to act on.
+ * @tid: Transaction the fast commit is for.
+ *
+ * Waits for the commit of the previous transaction, whose blocks the fast
+ * commit builds upon, and for other fast commits.  Returns -EALREADY if a
+ * full commit of @tid is done or under way, in which case the caller just
+ * waits for it, and another error if the fast commit is not possible.
+ * On success the commit of @tid is held off until jbd2_fc_end_commit().
+ */
+int jbd2_fc_begin_commit(journal_t *journal, tid_t tid)
+{
+	transaction_t *transaction;
+	int ret;
+
+	if (!JBD2_HAS_INCOMPAT_FEATURE(journal,
+				       JBD2_FEATURE_INCOMPAT_FAST_COMMIT))
+		return -EOPNOTSUPP;
+
+	write_lock(&journal->j_state_lock);
+	while (1) {
+		transaction = journal->j_running_transaction;
+		if (is_journal_aborted(journal)) {
+			ret = -EIO;
+			break;
+		}
+		if (tid_geq(journal->j_commit_sequence, tid) ||
+		    !transaction || transaction->t_tid != tid ||
+		    transaction->t_state != T_RUNNING ||
+		    tid_geq(journal->j_commit_request, tid)) {
+			ret = -EALREADY;
+			break;
+		}
+		/* Recovery skips the log until a commit rewrites s_start */
+		if (journal->j_flags & JBD2_FLUSHED) {
+			ret = -EAGAIN;
+			break;
+		}
+		if (journal->j_committing_transaction) {
+			tid_t prev = journal->j_committing_transaction->t_tid;
+
+			write_unlock(&journal->j_state_lock);
+			jbd2_log_wait_commit(journal, prev);
+			write_lock(&journal->j_state_lock);
+			continue;
+		}
+		if (journal->j_flags & JBD2_FAST_COMMIT_ONGOING) {
+			DEFINE_WAIT(wait);
+
+			prepare_to_wait(&journal->j_fc_wait, &wait,
+					TASK_UNINTERRUPTIBLE);
+			write_unlock(&journal->j_state_lock);
+			schedule();
+			write_lock(&journal->j_state_lock);
+			finish_wait(&journal->j_fc_wait, &wait);
+			continue;
+		}
+		journal->j_flags |= JBD2_FAST_COMMIT_ONGOING;
+		ret = 0;
+		break;
+	}
+	write_unlock(&journal->j_state_lock);
+	return ret;
+}
+
+static void __jbd2_fc_end_commit(journal_t *journal, tid_t tid, int fallback)
+{
+	write_lock(&journal->j_state_lock);
+	journal->j_flags &= ~JBD2_FAST_COMMIT_ONGOING;
+	/*
+	 * A failed fast commit may have left a block behind that recovery
+	 * stops at, so the transaction must commit before another one can
+	 * use the area.
+	 */
+	if (fallback)
+		__jbd2_log_start_commit(journal, tid);
+	write_unlock(&journal->j_state_lock);
+	wake_up(&journal->j_fc_wait);
+}
+
+/**
+ * void jbd2_fc_end_commit() - finish a fast commit
+ * @journal: Journal to act on.
+ */
+void jbd2_fc_end_commit(journal_t *journal)
+{
+	__jbd2_fc_end_commit(journal, 0, 0);
+}
+
+/**
+ * void jbd2_fc_end_commit_fallback() - abandon a fast commit
+ * @journal: Journal to act on.
+ * @tid: Transaction the fast commit was for.
+ *
+ * Finishes a fast commit that could not be completed and starts the full
+ * commit of @tid in its place; the caller waits for it.
+ */
+void jbd2_fc_end_commit_fallback(journal_t *journal, tid_t tid)
+{
+	__jbd2_fc_end_commit(journal, tid, 1);
+}
+
+/**
+ * int jbd2_fc_get_buf() - get the next block of the fast commit area
+ * @journal: Journal to act on.
+ * @bhp: Returns the zeroed buffer of the block.
+ *
+ * Only valid between jbd2_fc_begin_commit() and jbd2_fc_end_commit().
+ * Returns -ENOSPC once the area is full.
+ */
+int jbd2_fc_get_buf(journal_t *journal, struct buffer_head **bhp)
+{
+	struct buffer_head *bh;
+	unsigned long long blocknr;
+	int err;
+
+	if (journal->j_fc_first + journal->j_fc_off >= journal->j_fc_last)
+		return -ENOSPC;
+
+	err = jbd2_journal_bmap(journal, journal->j_fc_first + journal->j_fc_off,
+				&blocknr);
+	if (err)
+		return err;
+
+	bh = __getblk(journal->j_dev, blocknr, journal->j_blocksize);
+	if (!bh)
+		return -ENOMEM;
+	lock_buffer(bh);
+	memset(bh->b_data, 0, journal->j_blocksize);
+	set_buffer_uptodate(bh);
+	unlock_buffer(bh);
+
+	journal->j_fc_off++;
+	*bhp = bh;
+	return 0;
+}
+
+/**
+ * int jbd2_fc_write_buf() - write a fast commit block and wait for it
+ * @journal: Journal to act on.
+ * @bh: Buffer from jbd2_fc_get_buf().
+ *
+ * With barriers the write also flushes the data written before it, as
+ * the commit record of a full commit does.
+ */
+int jbd2_fc_write_buf(journal_t *journal, struct buffer_head *bh)
+{
+	int write_op = WRITE_SYNC;
+
+	if (journal->j_flags & JBD2_BARRIER) {
+		if (journal->j_fs_dev != journal->j_dev)
+			blkdev_issue_flush(journal->j_fs_dev, GFP_NOFS, NULL);
+		write_op = WRITE_FLUSH_FUA;
+	}
+
+	lock_buffer(bh);
+	clear_buffer_dirty(bh);
+	set_buffer_uptodate(bh);
+	bh->b_end_io = end_buffer_write_sync;
+	get_bh(bh);
+	submit_bh(write_op, bh);
+	wait_on_buffer(bh);
+
+	if (unlikely(!buffer_uptodate(bh)))
+		return -EIO;
+	return 0;
+}
+
 /*
  * Log buffer allocation routines:
  */
@@ -894,6 +1077,7 @@ static journal_t * journal_init_common (void)
 	init_waitqueue_head(&journal->j_wait_checkpoint);
 	init_waitqueue_head(&journal->j_wait_commit);
 	init_waitqueue_head(&journal->j_wait_updates);
+	init_waitqueue_head(&journal->j_fc_wait);
 	mutex_init(&journal->j_barrier);
 	mutex_init(&journal->j_checkpoint_mutex);
 	spin_lock_init(&journal->j_revoke_lock);
@@ -1092,6 +1276,9 @@ static int journal_reset(journal_t *journal)
 
 	first = be32_to_cpu(sb->s_first);
 	last = be32_to_cpu(sb->s_maxlen);
+	if (JBD2_HAS_INCOMPAT_FEATURE(journal,
+				      JBD2_FEATURE_INCOMPAT_FAST_COMMIT))
+		last -= be32_to_cpu(sb->s_num_fc_blks);
 	if (first + JBD2_MIN_JOURNAL_BLOCKS > last + 1) {
 		printk(KERN_ERR "JBD2: Journal too short (blocks %llu-%llu).\n",
 		       first, last);
@@ -1259,6 +1446,17 @@ static int journal_get_superblock(journal_t *journal)
 		goto out;
 	}
 
+	if (JBD2_HAS_INCOMPAT_FEATURE(journal,
+				      JBD2_FEATURE_INCOMPAT_FAST_COMMIT) &&
+	    (!sb->s_num_fc_blks ||
+	     be32_to_cpu(sb->s_first) + JBD2_MIN_JOURNAL_BLOCKS +
+	     be32_to_cpu(sb->s_num_fc_blks) > journal->j_maxlen)) {
+		printk(KERN_WARNING
+			"JBD2: Invalid fast commit area size: %u\n",
+			be32_to_cpu(sb->s_num_fc_blks));
+		goto out;
+	}
+
 	return 0;
 
 out:
@@ -1266,6 +1464,57 @@ out:
 	return err;
 }
 
+/*
+ * With fast commits the last s_num_fc_blks blocks of the journal are
+ * the fast commit area, and the log proper ends right in front of it.
+ */
+static void journal_set_fc_area(journal_t *journal)
+{
+	journal_superblock_t *sb = journal->j_superblock;
+
+	journal->j_fc_last = be32_to_cpu(sb->s_maxlen);
+	journal->j_fc_first = journal->j_fc_last -
+			      be32_to_cpu(sb->s_num_fc_blks);
+	journal->j_fc_off = 0;
+	journal->j_last = journal->j_fc_first;
+}
+
+/*
+ * Carve the fast commit area out of the end of a loaded journal.  The
+ * log must be empty, as it is right after jbd2_journal_load(), since its
+ * blocks wrap around at the new end.
+ */
+static int journal_init_fc_area(journal_t *journal)
+{
+	journal_superblock_t *sb = journal->j_superblock;
+	int err = 0;
+
+	if (be32_to_cpu(sb->s_first) + JBD2_MIN_JOURNAL_BLOCKS +
+	    JBD2_DEFAULT_FAST_COMMIT_BLOCKS > journal->j_maxlen)
+		return -EINVAL;
+
+	if (!(journal->j_flags & JBD2_LOADED)) {
+		sb->s_num_fc_blks = cpu_to_be32(JBD2_DEFAULT_FAST_COMMIT_BLOCKS);
+		return 0;
+	}
+
+	write_lock(&journal->j_state_lock);
+	if (journal->j_running_transaction ||
+	    journal->j_committing_transaction ||
+	    journal->j_head != journal->j_tail) {
+		err = -EINVAL;
+		goto out;
+	}
+	sb->s_num_fc_blks = cpu_to_be32(JBD2_DEFAULT_FAST_COMMIT_BLOCKS);
+	journal_set_fc_area(journal);
+	journal->j_head = journal->j_first;
+	journal->j_tail = journal->j_first;
+	journal->j_free = journal->j_last - journal->j_first;
+out:
+	write_unlock(&journal->j_state_lock);
+	return err;
+}
+
 /*
  * Load the on-disk journal superblock and read the key fields into the
  * journal_t.
@@ -1287,6 +1536,9 @@ static int load_superblock(journal_t *journal)
 	journal->j_first = be32_to_cpu(sb->s_first);
 	journal->j_last = be32_to_cpu(sb->s_maxlen);
 	journal->j_errno = be32_to_cpu(sb->s_errno);
+	if (JBD2_HAS_INCOMPAT_FEATURE(journal,
+				      JBD2_FEATURE_INCOMPAT_FAST_COMMIT))
+		journal_set_fc_area(journal);
 
 	return 0;
 }
@@ -1515,10 +1767,24 @@ int jbd2_journal_set_features (journal_t *journal, unsigned long compat,
 
 	sb = journal->j_superblock;
 
+	if ((incompat & JBD2_FEATURE_INCOMPAT_FAST_COMMIT) &&
+	    !JBD2_HAS_INCOMPAT_FEATURE(journal,
+				       JBD2_FEATURE_INCOMPAT_FAST_COMMIT) &&
+	    journal_init_fc_area(journal))
+		return 0;
+
 	sb->s_feature_compat    |= cpu_to_be32(compat);
 	sb->s_feature_ro_compat |= cpu_to_be32(ro);
 	sb->s_feature_incompat  |= cpu_to_be32(incompat);
 
+	/*
+	 * The new layout of a loaded journal must reach the disk before
+	 * anything is written to the fast commit area.
+	 */
+	if ((incompat & JBD2_FEATURE_INCOMPAT_FAST_COMMIT) &&
+	    (journal->j_flags & JBD2_LOADED))
+		jbd2_journal_update_superblock(journal, 1);
+
 	return 1;
 }
 
@@ -35,9 +35,9 @@ struct recovery_info
 	int		nr_replays;
 	int		nr_revokes;
 	int		nr_revoke_hits;
+	int		nr_fc_blocks;
 };
 
-enum passtype {PASS_SCAN, PASS_REVOKE, PASS_REPLAY};
 static int do_one_pass(journal_t *journal,
 				struct recovery_info *info, enum passtype pass);
 static int scan_revoke_records(journal_t *, struct buffer_head *,
@@ -203,6 +203,55 @@ static int count_tags(journal_t *journal, struct buffer_head *bh)
 }
 
 
+/*
+ * Fast commits are only valid on top of the transaction following the
+ * last one found in the log.  The scan pass counts the blocks of that
+ * transaction the file system accepts, stopping at the first one it
+ * doesn't; the replay pass then hands it exactly those blocks again.
+ */
+static int fc_do_one_pass(journal_t *journal,
+			  struct recovery_info *info, enum passtype pass)
+{
+	unsigned long next_fc_block = journal->j_fc_first;
+	unsigned long end_fc_block = journal->j_fc_last;
+	struct buffer_head *bh;
+	journal_header_t *header;
+	int err = 0;
+
+	if (pass == PASS_REPLAY)
+		end_fc_block = next_fc_block + info->nr_fc_blocks;
+
+	while (next_fc_block < end_fc_block) {
+		err = jread(&bh, journal, next_fc_block);
+		if (err)
+			break;
+
+		header = (journal_header_t *)bh->b_data;
+		if (header->h_magic != cpu_to_be32(JBD2_MAGIC_NUMBER) ||
+		    be32_to_cpu(header->h_blocktype) != JBD2_FC_BLOCK ||
+		    be32_to_cpu(header->h_sequence) != info->end_transaction) {
+			brelse(bh);
+			err = -EINVAL;
+			break;
+		}
+
+		err = journal->j_fc_replay_callback(journal, bh, pass,
+					next_fc_block - journal->j_fc_first,
+					info->end_transaction);
+		brelse(bh);
+		if (err)
+			break;
+		if (pass == PASS_SCAN)
+			info->nr_fc_blocks++;
+		next_fc_block++;
+	}
+
+	/* In the scan pass, the first bad block just ends the fast commits */
+	if (pass == PASS_SCAN)
+		return 0;
+	return err;
+}
+
 /* Make sure we wrap around the log correctly! */
 #define wrap(journal, var)						\
 do {									\
@@ -250,12 +299,21 @@ int jbd2_journal_recover(journal_t *journal)
 		err = do_one_pass(journal, &info, PASS_REVOKE);
 	if (!err)
 		err = do_one_pass(journal, &info, PASS_REPLAY);
+	if (!err && JBD2_HAS_INCOMPAT_FEATURE(journal,
+					JBD2_FEATURE_INCOMPAT_FAST_COMMIT) &&
+	    journal->j_fc_replay_callback) {
+		err = fc_do_one_pass(journal, &info, PASS_SCAN);
+		if (!err)
+			err = fc_do_one_pass(journal, &info, PASS_REPLAY);
+	}
 
 	jbd_debug(1, "JBD2: recovery, exit status %d, "
 		  "recovered transactions %u to %u\n",
 		  err, info.start_transaction, info.end_transaction);
 	jbd_debug(1, "JBD2: Replayed %d and revoked %d/%d blocks\n",
 		  info.nr_replays, info.nr_revoke_hits, info.nr_revokes);
+	jbd_debug(1, "JBD2: Replayed %d fast commit blocks\n",
+		  info.nr_fc_blocks);
 
 	/* Restart the log at the next transaction ID, thus invalidating
 	 * any existing commit records in the log. */
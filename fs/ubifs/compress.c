@@ -28,6 +28,8 @@
  */
 
 #include <linux/crypto.h>
+#include <linux/percpu.h>
+#include <linux/ktime.h>
 #include "ubifs.h"
 
 /* Fake description object for the "none" compressor */
@@ -71,9 +73,59 @@ static struct ubifs_compressor zlib_compr = {
 };
 #endif
 
+/* Type reserved for mainline's ZSTD, which is not implemented here */
+static struct ubifs_compressor zstd_compr = {
+	.compr_type = UBIFS_COMPR_ZSTD,
+	.name = "zstd",
+};
+
+#ifdef CONFIG_UBIFS_FS_LZ4
+static DEFINE_MUTEX(lz4_mutex);
+
+static struct ubifs_compressor lz4_compr = {
+	.compr_type = UBIFS_COMPR_LZ4,
+	.comp_mutex = &lz4_mutex,
+	.name = "lz4",
+	.capi_name = "lz4",
+};
+#else
+static struct ubifs_compressor lz4_compr = {
+	.compr_type = UBIFS_COMPR_LZ4,
+	.name = "lz4",
+};
+#endif
+
 /* All UBIFS compressors */
 struct ubifs_compressor *ubifs_compressors[UBIFS_COMPR_TYPES_CNT];
 
+/* Workqueue write-back batches are compressed on */
+struct workqueue_struct *ubifs_pcompr_wq;
+
+/* Serializes 'ubifs_pcompr_init()' */
+static DEFINE_MUTEX(pcompr_mutex);
+
+/**
+ * account_compr - update compression statistics.
+ * @compr: compressor description object
+ * @start: when compression started
+ * @in_len: length of the data given to the compressor
+ * @out_len: length of the data stored as a result
+ * @rejected: non-zero if the data was stored uncompressed
+ */
+static void account_compr(struct ubifs_compressor *compr, ktime_t start,
+			  int in_len, int out_len, int rejected)
+{
+	s64 ns = ktime_to_ns(ktime_sub(ktime_get(), start));
+
+	spin_lock(&compr->stat_lock);
+	compr->comp_cnt += 1;
+	compr->comp_rejected += rejected;
+	compr->comp_in += in_len;
+	compr->comp_out += out_len;
+	compr->comp_ns += ns;
+	spin_unlock(&compr->stat_lock);
+}
+
 /**
  * ubifs_compress - compress data.
  * @in_buf: data to compress
@@ -91,40 +143,72 @@ struct ubifs_compressor *ubifs_compressors[UBIFS_COMPR_TYPES_CNT];
  *
  * Note, if the input buffer was not compressed, it is copied to the output
  * buffer and %UBIFS_COMPR_NONE is returned in @compr_type.
+ *
+ * Once parallel compression has been enabled, every CPU compresses with its
+ * own cryptoapi handle instead of serializing on @compr->comp_mutex.
  */
 void ubifs_compress(const void *in_buf, int in_len, void *out_buf, int *out_len,
 		    int *compr_type)
 {
 	int err;
 	struct ubifs_compressor *compr = ubifs_compressors[*compr_type];
+	struct ubifs_pcc __percpu *pcc;
+	ktime_t start;
 
 	if (*compr_type == UBIFS_COMPR_NONE)
 		goto no_compr;
 
+	/* Inodes using a compressor that is not compiled in are written plain */
+	if (!compr->capi_name)
+		goto no_compr;
+
 	/* If the input data is small, do not even try to compress it */
 	if (in_len < UBIFS_MIN_COMPR_LEN)
 		goto no_compr;
 
-	if (compr->comp_mutex)
-		mutex_lock(compr->comp_mutex);
-	err = crypto_comp_compress(compr->cc, in_buf, in_len, out_buf,
-				   (unsigned int *)out_len);
-	if (compr->comp_mutex)
-		mutex_unlock(compr->comp_mutex);
+	start = ktime_get();
+	pcc = ACCESS_ONCE(compr->pcc);
+	if (pcc) {
+		struct ubifs_pcc *p;
+
+		/*
+		 * Compressing a block with zlib takes long enough that it should
+		 * not be done with preemption disabled, so the handle of the
+		 * current CPU is locked instead. If the task migrates meanwhile
+		 * it merely shares that handle with the tasks of the old CPU.
+		 */
+		smp_read_barrier_depends();
+		p = per_cpu_ptr(pcc, raw_smp_processor_id());
+		mutex_lock(&p->mutex);
+		err = crypto_comp_compress(p->cc, in_buf, in_len, out_buf,
+					   (unsigned int *)out_len);
+		mutex_unlock(&p->mutex);
+	} else {
+		if (compr->comp_mutex)
+			mutex_lock(compr->comp_mutex);
+		err = crypto_comp_compress(compr->cc, in_buf, in_len, out_buf,
+					   (unsigned int *)out_len);
+		if (compr->comp_mutex)
+			mutex_unlock(compr->comp_mutex);
+	}
 	if (unlikely(err)) {
 		ubifs_warn("cannot compress %d bytes, compressor %s, "
 			   "error %d, leave data uncompressed",
 			   in_len, compr->name, err);
-		 goto no_compr;
+		account_compr(compr, start, in_len, in_len, 1);
+		goto no_compr;
 	}
 
 	/*
 	 * If the data compressed only slightly, it is better to leave it
 	 * uncompressed to improve read speed.
 	 */
-	if (in_len - *out_len < UBIFS_MIN_COMPRESS_DIFF)
+	if (in_len - *out_len < UBIFS_MIN_COMPRESS_DIFF) {
+		account_compr(compr, start, in_len, in_len, 1);
 		goto no_compr;
+	}
 
+	account_compr(compr, start, in_len, *out_len, 0);
 	return;
 
 no_compr:
@@ -150,6 +234,8 @@ int ubifs_decompress(const void *in_buf, int in_len, void *out_buf,
 {
 	int err;
 	struct ubifs_compressor *compr;
+	ktime_t start;
+	s64 ns;
 
 	if (unlikely(compr_type < 0 || compr_type >= UBIFS_COMPR_TYPES_CNT)) {
 		ubifs_err("invalid compression type %d", compr_type);
@@ -169,16 +255,134 @@ int ubifs_decompress(const void *in_buf, int in_len, void *out_buf,
 		return 0;
 	}
 
+	start = ktime_get();
 	if (compr->decomp_mutex)
 		mutex_lock(compr->decomp_mutex);
 	err = crypto_comp_decompress(compr->cc, in_buf, in_len, out_buf,
 				     (unsigned int *)out_len);
 	if (compr->decomp_mutex)
 		mutex_unlock(compr->decomp_mutex);
-	if (err)
+	if (err) {
 		ubifs_err("cannot decompress %d bytes, compressor %s, "
 			  "error %d", in_len, compr->name, err);
+		return err;
+	}
+
+	ns = ktime_to_ns(ktime_sub(ktime_get(), start));
+	spin_lock(&compr->stat_lock);
+	compr->decomp_cnt += 1;
+	compr->decomp_out += *out_len;
+	compr->decomp_ns += ns;
+	spin_unlock(&compr->stat_lock);
+	return 0;
+}
+
+/**
+ * pcc_free - free per-CPU cryptoapi compressor handles.
+ * @pcc: the handles to free
+ */
+static void pcc_free(struct ubifs_pcc __percpu *pcc)
+{
+	int cpu;
+
+	for_each_possible_cpu(cpu) {
+		struct crypto_comp *cc = per_cpu_ptr(pcc, cpu)->cc;
+
+		if (cc)
+			crypto_free_comp(cc);
+	}
+	free_percpu(pcc);
+}
+
+/**
+ * pcc_alloc - allocate per-CPU cryptoapi compressor handles.
+ * @compr: compressor description object
+ *
+ * Returns the handles in case of success and an error pointer in case of
+ * failure.
+ */
+static struct ubifs_pcc __percpu *pcc_alloc(struct ubifs_compressor *compr)
+{
+	struct ubifs_pcc __percpu *pcc;
+	int cpu;
+
+	pcc = alloc_percpu(struct ubifs_pcc);
+	if (!pcc)
+		return ERR_PTR(-ENOMEM);
+
+	for_each_possible_cpu(cpu) {
+		struct crypto_comp *cc;
+
+		cc = crypto_alloc_comp(compr->capi_name, 0, 0);
+		if (IS_ERR(cc)) {
+			pcc_free(pcc);
+			return ERR_CAST(cc);
+		}
+		per_cpu_ptr(pcc, cpu)->cc = cc;
+		mutex_init(&per_cpu_ptr(pcc, cpu)->mutex);
+	}
+
+	return pcc;
+}
+
+/**
+ * ubifs_pcompr_init - prepare for parallel compression.
+ *
+ * This function creates the workqueue write-back batches are compressed on
+ * and allocates per-CPU cryptoapi handles for all compiled in compressors.
+ * This is done once, when the first file-system enables parallel
+ * compression, and the resources are kept until the module is unloaded,
+ * because all file-systems compress with the per-CPU handles from then on.
+ * Returns zero in case of success and a negative error code in case of
+ * failure.
+ */
+int ubifs_pcompr_init(void)
+{
+	struct ubifs_pcc __percpu *pcc[UBIFS_COMPR_TYPES_CNT] = { NULL };
+	struct workqueue_struct *wq;
+	struct ubifs_compressor *compr;
+	int i, err = 0;
+
+	mutex_lock(&pcompr_mutex);
+	if (ubifs_pcompr_wq)
+		goto out_unlock;
+
+	for (i = 0; i < UBIFS_COMPR_TYPES_CNT; i++) {
+		compr = ubifs_compressors[i];
+		if (compr->compr_type == UBIFS_COMPR_NONE || !compr->capi_name)
+			continue;
+
+		pcc[i] = pcc_alloc(compr);
+		if (IS_ERR(pcc[i])) {
+			err = PTR_ERR(pcc[i]);
+			pcc[i] = NULL;
+			ubifs_err("cannot allocate per-CPU compressors %s, "
+				  "error %d", compr->name, err);
+			goto out_free;
+		}
+	}
+
+	wq = alloc_workqueue("ubifs_pcompr", WQ_UNBOUND | WQ_MEM_RECLAIM, 0);
+	if (!wq) {
+		err = -ENOMEM;
+		goto out_free;
+	}
+
+	/* Make sure the handles are initialized before they are visible */
+	smp_wmb();
+	for (i = 0; i < UBIFS_COMPR_TYPES_CNT; i++)
+		if (pcc[i])
+			ubifs_compressors[i]->pcc = pcc[i];
+	ubifs_pcompr_wq = wq;
+	mutex_unlock(&pcompr_mutex);
+	return 0;
 
+out_free:
+	for (i = 0; i < UBIFS_COMPR_TYPES_CNT; i++)
+		if (pcc[i])
+			pcc_free(pcc[i]);
+out_unlock:
+	mutex_unlock(&pcompr_mutex);
 	return err;
 }
 
@@ -191,6 +395,7 @@ int ubifs_decompress(const void *in_buf, int in_len, void *out_buf,
  */
 static int __init compr_init(struct ubifs_compressor *compr)
 {
+	spin_lock_init(&compr->stat_lock);
 	if (compr->capi_name) {
 		compr->cc = crypto_alloc_comp(compr->capi_name, 0, 0);
 		if (IS_ERR(compr->cc)) {
@@ -210,6 +415,10 @@ static int __init compr_init(struct ubifs_compressor *compr)
  */
 static void compr_exit(struct ubifs_compressor *compr)
 {
+	if (compr->pcc) {
+		pcc_free(compr->pcc);
+		compr->pcc = NULL;
+	}
 	if (compr->capi_name)
 		crypto_free_comp(compr->cc);
 	return;
@@ -233,9 +442,21 @@ int __init ubifs_compressors_init(void)
 	if (err)
 		goto out_lzo;
 
+	err = compr_init(&lz4_compr);
+	if (err)
+		goto out_zlib;
+
+	err = compr_init(&zstd_compr);
+	if (err)
+		goto out_lz4;
+
 	ubifs_compressors[UBIFS_COMPR_NONE] = &none_compr;
 	return 0;
 
+out_lz4:
+	compr_exit(&lz4_compr);
+out_zlib:
+	compr_exit(&zlib_compr);
 out_lzo:
 	compr_exit(&lzo_compr);
 	return err;
@@ -246,6 +467,10 @@ out_lzo:
  */
 void ubifs_compressors_exit(void)
 {
+	if (ubifs_pcompr_wq)
+		destroy_workqueue(ubifs_pcompr_wq);
 	compr_exit(&lzo_compr);
 	compr_exit(&zlib_compr);
+	compr_exit(&lz4_compr);
+	compr_exit(&zstd_compr);
 }
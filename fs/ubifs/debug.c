@@ -32,6 +32,7 @@
 #include <linux/math64.h>
 #include <linux/uaccess.h>
 #include <linux/random.h>
+#include <linux/seq_file.h>
 #include "ubifs.h"
 
 #ifdef CONFIG_UBIFS_FS_DEBUG
@@ -277,7 +278,7 @@ void dbg_dump_inode(struct ubifs_info *c, const struct inode *inode)
 		return;
 
 	printk(KERN_DEBUG "List of directory entries:\n");
-	ubifs_assert(!mutex_is_locked(&c->tnc_mutex));
+	ubifs_assert(!rwsem_is_locked(&c->tnc_sem));
 
 	lowest_dent_key(c, &key, inode->i_ino);
 	while (1) {
@@ -1555,7 +1556,7 @@ int dbg_check_tnc(struct ubifs_info *c, int extra)
 	if (!dbg_is_chk_index(c))
 		return 0;
 
-	ubifs_assert(mutex_is_locked(&c->tnc_mutex));
+	ubifs_assert(rwsem_is_locked(&c->tnc_sem));
 	if (!c->zroot.znode)
 		return 0;
 
@@ -1647,7 +1648,7 @@ int dbg_walk_index(struct ubifs_info *c, dbg_leaf_callback leaf_cb,
 	struct ubifs_zbranch *zbr;
 	struct ubifs_znode *znode, *child;
 
-	mutex_lock(&c->tnc_mutex);
+	down_write(&c->tnc_sem);
 	/* If the root indexing node is not in TNC - pull it */
 	if (!c->zroot.znode) {
 		c->zroot.znode = ubifs_load_znode(c, &c->zroot, NULL, 0);
@@ -1749,7 +1750,7 @@ int dbg_walk_index(struct ubifs_info *c, dbg_leaf_callback leaf_cb,
 		}
 	}
 
-	mutex_unlock(&c->tnc_mutex);
+	up_write(&c->tnc_sem);
 	return 0;
 
 out_dump:
@@ -1760,7 +1761,7 @@ out_dump:
 	ubifs_msg("dump of znode at LEB %d:%d", zbr->lnum, zbr->offs);
 	dbg_dump_znode(c, znode);
 out_unlock:
-	mutex_unlock(&c->tnc_mutex);
+	up_write(&c->tnc_sem);
 	return err;
 }
 
@@ -2865,9 +2866,9 @@ static ssize_t dfs_file_write(struct file *file, const char __user *u,
 		return count;
 	}
 	if (file->f_path.dentry == d->dfs_dump_tnc) {
-		mutex_lock(&c->tnc_mutex);
+		down_write(&c->tnc_sem);
 		dbg_dump_tnc(c);
-		mutex_unlock(&c->tnc_mutex);
+		up_write(&c->tnc_sem);
 		return count;
 	}
 
@@ -3083,6 +3084,62 @@ static const struct file_operations dfs_global_fops = {
 	.llseek = no_llseek,
 };
 
+/*
+ * The "compr_stats" file shows, for every compiled in compressor, how many
+ * buffers were compressed and how many of them were stored uncompressed,
+ * the compression ratio (stored size in percent of the original size), and
+ * compression and decompression throughput in MB/s.
+ */
+static int dfs_compr_stats_show(struct seq_file *m, void *v)
+{
+	int i;
+
+	seq_printf(m, "%-6s %10s %10s %12s %12s %6s %8s %10s %8s\n",
+		   "name", "compr", "rejected", "in_bytes", "out_bytes",
+		   "ratio", "MB/s", "decompr", "MB/s");
+
+	for (i = 0; i < UBIFS_COMPR_TYPES_CNT; i++) {
+		struct ubifs_compressor *compr = ubifs_compressors[i];
+		unsigned long long cnt, rejected, in, out, ns;
+		unsigned long long dcnt, dout, dns;
+
+		if (compr->compr_type == UBIFS_COMPR_NONE || !compr->capi_name)
+			continue;
+
+		spin_lock(&compr->stat_lock);
+		cnt = compr->comp_cnt;
+		rejected = compr->comp_rejected;
+		in = compr->comp_in;
+		out = compr->comp_out;
+		ns = compr->comp_ns;
+		dcnt = compr->decomp_cnt;
+		dout = compr->decomp_out;
+		dns = compr->decomp_ns;
+		spin_unlock(&compr->stat_lock);
+
+		seq_printf(m, "%-6s %10llu %10llu %12llu %12llu %5llu%% %8llu "
+			   "%10llu %8llu\n", compr->name, cnt, rejected, in, out,
+			   in ? div64_u64(out * 100, in) : 0,
+			   ns ? div64_u64(in * 1000, ns) : 0, dcnt,
+			   dns ? div64_u64(dout * 1000, dns) : 0);
+	}
+
+	return 0;
+}
+
+static int dfs_compr_stats_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, dfs_compr_stats_show, NULL);
+}
+
+static const struct file_operations dfs_compr_stats_fops = {
+	.open = dfs_compr_stats_open,
+	.read = seq_read,
+	.llseek = seq_lseek,
+	.release = single_release,
+	.owner = THIS_MODULE,
+};
+
 /**
  * dbg_debugfs_init - initialize debugfs file-system.
  *
@@ -3145,6 +3202,12 @@ int dbg_debugfs_init(void)
 		goto out_remove;
 	dfs_tst_rcvry = dent;
 
+	fname = "compr_stats";
+	dent = debugfs_create_file(fname, S_IRUSR, dfs_rootdir, NULL,
+				   &dfs_compr_stats_fops);
+	if (IS_ERR_OR_NULL(dent))
+		goto out_remove;
+
 	return 0;
 
 out_remove:
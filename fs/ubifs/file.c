@@ -892,7 +892,15 @@ static int ubifs_readpage(struct file *file, struct page *page)
 	return 0;
 }
 
-static int do_writepage(struct page *page, int len)
+/**
+ * do_writepage - write a page to the journal.
+ * @page: the page to write, locked
+ * @len: amount of data in the page
+ * @pp: data nodes prepared by parallel compression, or %NULL to compress
+ *      the page here
+ */
+static int do_writepage(struct page *page, int len,
+			struct ubifs_pcompr_page *pp)
 {
 	int err = 0, i, blen;
 	unsigned int block;
@@ -916,7 +924,11 @@ static int do_writepage(struct page *page, int len)
 	while (len) {
 		blen = min_t(int, len, UBIFS_BLOCK_SIZE);
 		data_key_init(c, &key, inode->i_ino, block);
-		err = ubifs_jnl_write_data(c, inode, &key, addr, blen);
+		if (pp)
+			err = ubifs_jnl_write_data_node(c, &key, pp->dn[i],
+							pp->dlen[i]);
+		else
+			err = ubifs_jnl_write_data(c, inode, &key, addr, blen);
 		if (err)
 			break;
 		if (++i >= UBIFS_BLOCKS_PER_PAGE)
@@ -1032,7 +1044,7 @@ static int ubifs_writepage(struct page *page, struct writeback_control *wbc)
 			 * with this.
 			 */
 		}
-		return do_writepage(page, PAGE_CACHE_SIZE);
+		return do_writepage(page, PAGE_CACHE_SIZE, NULL);
 	}
 
 	/*
@@ -1053,13 +1065,146 @@ static int ubifs_writepage(struct page *page, struct writeback_control *wbc)
 			goto out_unlock;
 	}
 
-	return do_writepage(page, len);
+	return do_writepage(page, len, NULL);
 
 out_unlock:
 	unlock_page(page);
 	return err;
 }
 
+/*
+ * Parallel compression of write-back batches.
+ *
+ * Compressing data is the most CPU-intensive part of write-back, and when
+ * 'ubifs_writepage()' compresses page by page, write-back of big files is
+ * limited by the speed of a single CPU. With the "parallel_compr" mount
+ * option, 'ubifs_writepages()' collects up to %UBIFS_PCOMPR_PAGES dirty
+ * pages, compresses them concurrently on the 'ubifs_pcompr_wq' workqueue,
+ * and then writes the prepared data nodes to the journal in page index
+ * order, exactly like 'ubifs_writepage()' would.
+ *
+ * Only pages which are fully inside both @i_size and the synchronized inode
+ * size are batched. Other pages need to be zeroed or need the inode to be
+ * written first, so the batch is flushed and they are handed to
+ * 'ubifs_writepage()'.
+ */
+
+/**
+ * compress_page - prepare the data nodes of a batched page.
+ * @pp: the batched page
+ */
+static void compress_page(struct ubifs_pcompr_page *pp)
+{
+	struct page *page = pp->page;
+	struct inode *inode = page->mapping->host;
+	struct ubifs_info *c = inode->i_sb->s_fs_info;
+	unsigned int block = page->index << UBIFS_BLOCKS_PER_PAGE_SHIFT;
+	union ubifs_key key;
+	void *addr;
+	int i;
+
+	addr = kmap(page);
+	for (i = 0; i < UBIFS_BLOCKS_PER_PAGE; i++) {
+		data_key_init(c, &key, inode->i_ino, block + i);
+		pp->dlen[i] = ubifs_prepare_data_node(c, inode, &key,
+						      addr + i * UBIFS_BLOCK_SIZE,
+						      UBIFS_BLOCK_SIZE, pp->dn[i]);
+	}
+	kunmap(page);
+}
+
+void ubifs_pcompr_work(struct work_struct *work)
+{
+	compress_page(container_of(work, struct ubifs_pcompr_page, work));
+}
+
+/**
+ * pcompr_flush - compress and write out the pages of a batch.
+ * @pc: parallel compression information
+ *
+ * The first page is compressed by the caller while the workqueue takes care
+ * of the others. Every page of the batch is written and unlocked, even if
+ * writing some of them fails. Returns zero in case of success and the first
+ * error otherwise.
+ */
+static int pcompr_flush(struct ubifs_pcompr *pc)
+{
+	int i, err = 0;
+
+	if (!pc->cnt)
+		return 0;
+
+	for (i = 1; i < pc->cnt; i++)
+		queue_work(ubifs_pcompr_wq, &pc->pages[i].work);
+	compress_page(&pc->pages[0]);
+	for (i = 1; i < pc->cnt; i++)
+		flush_work(&pc->pages[i].work);
+
+	for (i = 0; i < pc->cnt; i++) {
+		int ret = do_writepage(pc->pages[i].page, PAGE_CACHE_SIZE,
+				       &pc->pages[i]);
+
+		if (ret && !err)
+			err = ret;
+	}
+
+	pc->cnt = 0;
+	return err;
+}
+
+static int pcompr_writepage(struct page *page, struct writeback_control *wbc,
+			    void *data)
+{
+	struct ubifs_pcompr *pc = data;
+	struct inode *inode = page->mapping->host;
+	struct ubifs_inode *ui = ubifs_inode(inode);
+	pgoff_t end_index = i_size_read(inode) >> PAGE_CACHE_SHIFT;
+	loff_t synced_i_size;
+	int err, ret;
+
+	ubifs_assert(PagePrivate(page));
+
+	spin_lock(&ui->ui_lock);
+	synced_i_size = ui->synced_i_size;
+	spin_unlock(&ui->ui_lock);
+
+	if (page->index >= end_index ||
+	    page->index >= synced_i_size >> PAGE_CACHE_SHIFT) {
+		err = pcompr_flush(pc);
+		ret = ubifs_writepage(page, wbc);
+		return err ? err : ret;
+	}
+
+	pc->pages[pc->cnt++].page = page;
+	if (pc->cnt == UBIFS_PCOMPR_PAGES)
+		return pcompr_flush(pc);
+	return 0;
+}
+
+static int ubifs_writepages(struct address_space *mapping,
+			    struct writeback_control *wbc)
+{
+	struct inode *inode = mapping->host;
+	struct ubifs_info *c = inode->i_sb->s_fs_info;
+	struct ubifs_inode *ui = ubifs_inode(inode);
+	struct ubifs_pcompr *pc = ACCESS_ONCE(c->pcompr);
+	int err, ret;
+
+	if (!c->parallel_compr || !pc || !(ui->flags & UBIFS_COMPR_FL) ||
+	    ui->compr_type == UBIFS_COMPR_NONE)
+		return generic_writepages(mapping, wbc);
+
+	smp_read_barrier_depends();
+	if (!mutex_trylock(&pc->mutex))
+		/* Another inode is being written back */
+		return generic_writepages(mapping, wbc);
+
+	err = write_cache_pages(mapping, wbc, pcompr_writepage, pc);
+	ret = pcompr_flush(pc);
+	mutex_unlock(&pc->mutex);
+	return err ? err : ret;
+}
+
 /**
  * do_attr_changes - change inode attributes.
  * @inode: inode to change attributes for
@@ -1156,7 +1301,7 @@ static int do_truncation(struct ubifs_info *c, struct inode *inode,
 				if (UBIFS_BLOCKS_PER_PAGE_SHIFT)
 					offset = new_size &
 						 (PAGE_CACHE_SIZE - 1);
-				err = do_writepage(page, offset);
+				err = do_writepage(page, offset, NULL);
 				page_cache_release(page);
 				if (err)
 					goto out_budg;
@@ -1552,6 +1697,7 @@ static int ubifs_file_mmap(struct file *file, struct vm_area_struct *vma)
 const struct address_space_operations ubifs_file_address_operations = {
 	.readpage       = ubifs_readpage,
 	.writepage      = ubifs_writepage,
+	.writepages     = ubifs_writepages,
 	.write_begin    = ubifs_write_begin,
 	.write_end      = ubifs_write_end,
 	.invalidatepage = ubifs_invalidatepage,
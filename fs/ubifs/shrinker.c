@@ -74,7 +74,7 @@ static int shrink_tnc(struct ubifs_info *c, int nr, int age, int *contention)
 	int time = get_seconds();
 
 	ubifs_assert(mutex_is_locked(&c->umount_mutex));
-	ubifs_assert(mutex_is_locked(&c->tnc_mutex));
+	ubifs_assert(rwsem_is_locked(&c->tnc_sem));
 
 	if (!c->zroot.znode || atomic_long_read(&c->clean_zn_cnt) == 0)
 		return 0;
@@ -84,9 +84,9 @@ static int shrink_tnc(struct ubifs_info *c, int nr, int age, int *contention)
 	 * to destroy large sub-trees. Indeed, if a znode is old, then all its
 	 * children are older or of the same age.
 	 *
-	 * Note, we are holding 'c->tnc_mutex', so we do not have to lock the
-	 * 'c->space_lock' when _reading_ 'c->clean_zn_cnt', because it is
-	 * changed only when the 'c->tnc_mutex' is held.
+	 * Note, we are holding 'c->tnc_sem' for writing, so we do not have to
+	 * lock the 'c->space_lock' when _reading_ 'c->clean_zn_cnt', because
+	 * it is changed only when the 'c->tnc_sem' is held.
 	 */
 	zprev = NULL;
 	znode = ubifs_tnc_levelorder_next(c->zroot.znode, NULL);
@@ -185,7 +185,7 @@ static int shrink_tnc_trees(int nr, int age, int *contention)
 		 * We're holding 'c->umount_mutex', so the file-system won't go
 		 * away.
 		 */
-		if (!mutex_trylock(&c->tnc_mutex)) {
+		if (!down_write_trylock(&c->tnc_sem)) {
 			mutex_unlock(&c->umount_mutex);
 			*contention = 1;
 			p = p->next;
@@ -198,7 +198,7 @@ static int shrink_tnc_trees(int nr, int age, int *contention)
 		 */
 		c->shrinker_run_no = run_no;
 		freed += shrink_tnc(c, nr, age, contention);
-		mutex_unlock(&c->tnc_mutex);
+		up_write(&c->tnc_sem);
 		spin_lock(&ubifs_infos_lock);
 		/* Get the next list element before we move this one */
 		p = p->next;
@@ -443,6 +443,11 @@ static int ubifs_show_options(struct seq_file *s, struct dentry *root)
 			   ubifs_compr_name(c->mount_opts.compr_type));
 	}
 
+	if (c->mount_opts.parallel_compr == 2)
+		seq_printf(s, ",parallel_compr");
+	else if (c->mount_opts.parallel_compr == 1)
+		seq_printf(s, ",no_parallel_compr");
+
 	return 0;
 }
 
@@ -937,6 +942,8 @@ static int check_volume_empty(struct ubifs_info *c)
  * Opt_chk_data_crc: check CRCs when reading data nodes
  * Opt_no_chk_data_crc: do not check CRCs when reading data nodes
  * Opt_override_compr: override default compressor
+ * Opt_parallel_compr: compress write-back batches in parallel
+ * Opt_no_parallel_compr: compress write-back page by page
  * Opt_err: just end of array marker
  */
 enum {
@@ -947,6 +954,8 @@ enum {
 	Opt_chk_data_crc,
 	Opt_no_chk_data_crc,
 	Opt_override_compr,
+	Opt_parallel_compr,
+	Opt_no_parallel_compr,
 	Opt_err,
 };
 
@@ -958,6 +967,8 @@ static const match_table_t tokens = {
 	{Opt_chk_data_crc, "chk_data_crc"},
 	{Opt_no_chk_data_crc, "no_chk_data_crc"},
 	{Opt_override_compr, "compr=%s"},
+	{Opt_parallel_compr, "parallel_compr"},
+	{Opt_no_parallel_compr, "no_parallel_compr"},
 	{Opt_err, NULL},
 };
 
@@ -1047,6 +1058,8 @@ static int ubifs_parse_options(struct ubifs_info *c, char *options,
 				c->mount_opts.compr_type = UBIFS_COMPR_LZO;
 			else if (!strcmp(name, "zlib"))
 				c->mount_opts.compr_type = UBIFS_COMPR_ZLIB;
+			else if (!strcmp(name, "lz4"))
+				c->mount_opts.compr_type = UBIFS_COMPR_LZ4;
 			else {
 				ubifs_err("unknown compressor \"%s\"", name);
 				kfree(name);
@@ -1057,6 +1070,14 @@ static int ubifs_parse_options(struct ubifs_info *c, char *options,
 			c->default_compr = c->mount_opts.compr_type;
 			break;
 		}
+		case Opt_parallel_compr:
+			c->mount_opts.parallel_compr = 2;
+			c->parallel_compr = 1;
+			break;
+		case Opt_no_parallel_compr:
+			c->mount_opts.parallel_compr = 1;
+			c->parallel_compr = 0;
+			break;
 		default:
 		{
 			unsigned long flag;
@@ -1135,6 +1156,73 @@ again:
 	}
 }
 
+/**
+ * pcompr_init - initialize parallel compression information.
+ * @c: UBIFS file-system description object
+ *
+ * The information is kept until the file-system is un-mounted, even if
+ * parallel compression is disabled on re-mount, because write-back may be
+ * using it at that very moment.
+ */
+static void pcompr_init(struct ubifs_info *c)
+{
+	struct ubifs_pcompr *pc;
+	int i, j;
+
+	ubifs_assert(c->parallel_compr == 1);
+
+	if (c->pcompr)
+		return; /* Already initialized */
+
+	if (ubifs_pcompr_init())
+		goto out_disable;
+
+	pc = kzalloc(sizeof(struct ubifs_pcompr), GFP_KERNEL);
+	if (!pc)
+		goto out_disable;
+
+	pc->buf = vmalloc(UBIFS_PCOMPR_PAGES * UBIFS_BLOCKS_PER_PAGE *
+			  COMPRESSED_DATA_NODE_BUF_SZ);
+	if (!pc->buf) {
+		kfree(pc);
+		goto out_disable;
+	}
+
+	mutex_init(&pc->mutex);
+	for (i = 0; i < UBIFS_PCOMPR_PAGES; i++) {
+		struct ubifs_pcompr_page *pp = &pc->pages[i];
+
+		INIT_WORK(&pp->work, ubifs_pcompr_work);
+		for (j = 0; j < UBIFS_BLOCKS_PER_PAGE; j++)
+			pp->dn[j] = pc->buf + (i * UBIFS_BLOCKS_PER_PAGE + j) *
+					      COMPRESSED_DATA_NODE_BUF_SZ;
+	}
+
+	/* Make sure the information is initialized before it is visible */
+	smp_wmb();
+	c->pcompr = pc;
+	return;
+
+out_disable:
+	ubifs_warn("cannot initialize parallel compression, disabling it");
+	c->mount_opts.parallel_compr = 1;
+	c->parallel_compr = 0;
+}
+
+/**
+ * pcompr_free - free parallel compression information.
+ * @c: UBIFS file-system description object
+ */
+static void pcompr_free(struct ubifs_info *c)
+{
+	if (!c->pcompr)
+		return;
+
+	vfree(c->pcompr->buf);
+	kfree(c->pcompr);
+	c->pcompr = NULL;
+}
+
 /**
  * check_free_space - check if there is enough free space to mount.
  * @c: UBIFS file-system description object
@@ -1223,6 +1311,9 @@ static int mount_ubifs(struct ubifs_info *c)
 	if (c->bulk_read == 1)
 		bu_init(c);
 
+	if (c->parallel_compr)
+		pcompr_init(c);
+
 	if (!c->ro_mount) {
 		c->write_reserve_buf = kmalloc(COMPRESSED_DATA_NODE_BUF_SZ,
 					       GFP_KERNEL);
@@ -1510,6 +1601,7 @@ out_cbuf:
 	kfree(c->cbuf);
 out_free:
 	kfree(c->write_reserve_buf);
+	pcompr_free(c);
 	kfree(c->bu.buf);
 	vfree(c->ileb_buf);
 	vfree(c->sbuf);
@@ -1549,6 +1641,7 @@ static void ubifs_umount(struct ubifs_info *c)
 	kfree(c->rcvrd_mst_node);
 	kfree(c->mst_node);
 	kfree(c->write_reserve_buf);
+	pcompr_free(c);
 	kfree(c->bu.buf);
 	vfree(c->ileb_buf);
 	vfree(c->sbuf);
@@ -1890,6 +1983,9 @@ static int ubifs_remount_fs(struct super_block *sb, int *flags, char *data)
 		c->bu.buf = NULL;
 	}
 
+	if (c->parallel_compr)
+		pcompr_init(c);
+
 	ubifs_assert(c->lst.taken_empty_lebs > 0);
 	return 0;
 }
@@ -1982,7 +2078,8 @@ static struct ubifs_info *alloc_ubifs_info(struct ubi_volume_desc *ubi)
 		spin_lock_init(&c->orphan_lock);
 		init_rwsem(&c->commit_sem);
 		mutex_init(&c->lp_mutex);
-		mutex_init(&c->tnc_mutex);
+		init_rwsem(&c->tnc_sem);
+		spin_lock_init(&c->tnc_load_lock);
 		mutex_init(&c->log_mutex);
 		mutex_init(&c->mst_mutex);
 		mutex_init(&c->umount_mutex);
@@ -2245,12 +2342,12 @@ static int __init ubifs_init(void)
 	BUILD_BUG_ON(UBIFS_REF_NODE_SZ != 64);
 
 	/*
-	 * We use 2 bit wide bit-fields to store compression type, which should
+	 * We use 3 bit wide bit-fields to store compression type, which should
 	 * be amended if more compressors are added. The bit-fields are:
 	 * @compr_type in 'struct ubifs_inode', @default_compr in
 	 * 'struct ubifs_info' and @compr_type in 'struct ubifs_mount_opts'.
 	 */
-	BUILD_BUG_ON(UBIFS_COMPR_TYPES_CNT > 4);
+	BUILD_BUG_ON(UBIFS_COMPR_TYPES_CNT > 8);
 
 	/*
 	 * We require that PAGE_CACHE_SIZE is greater-than-or-equal-to
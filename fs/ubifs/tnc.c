@@ -25,9 +25,12 @@
  * the UBIFS B-tree.
  *
  * At the moment the locking rules of the TNC tree are quite simple and
- * straightforward. We just have a mutex and lock it when we traverse the
- * tree. If a znode is not in memory, we read it from flash while still having
- * the mutex locked.
+ * straightforward. We just have a read-write semaphore and lock it when we
+ * traverse the tree: lookups lock it for reading, everything which changes
+ * the tree locks it for writing. If a znode is not in memory, we read it from
+ * flash while still having the semaphore locked. Lookups may race to load the
+ * same znode or leaf node, and only one of the copies is added to the TNC (see
+ * 'ubifs_load_znode()' and 'lnc_add()').
  */
 
 #include <linux/crc32.h>
@@ -323,8 +326,12 @@ static struct ubifs_znode *dirty_cow_znode(struct ubifs_info *c,
  * Note, this function does not add the @node object to LNC directly, but
  * allocates a copy of the object and adds the copy to LNC. The reason for this
  * is that @node has been allocated outside of the TNC subsystem and will be
- * used with @c->tnc_mutex unlock upon return from the TNC subsystem. But LNC
+ * used with @c->tnc_sem unlocked upon return from the TNC subsystem. But LNC
  * may be changed at any time, e.g. freed by the shrinker.
+ *
+ * Lookups only hold @c->tnc_sem for reading, so two of them may race to add
+ * the same node. The winner is installed atomically and the loser's copy is
+ * dropped.
  */
 static int lnc_add(struct ubifs_info *c, struct ubifs_zbranch *zbr,
 		   const void *node)
@@ -333,7 +340,6 @@ static int lnc_add(struct ubifs_info *c, struct ubifs_zbranch *zbr,
 	void *lnc_node;
 	const struct ubifs_dent_node *dent = node;
 
-	ubifs_assert(!zbr->leaf);
 	ubifs_assert(zbr->len != 0);
 	ubifs_assert(is_hash_key(c, &zbr->key));
 
@@ -349,7 +355,9 @@ static int lnc_add(struct ubifs_info *c, struct ubifs_zbranch *zbr,
 		/* We don't have to have the cache, so no error */
 		return 0;
 
-	zbr->leaf = lnc_node;
+	if (cmpxchg(&zbr->leaf, NULL, lnc_node))
+		/* Another lookup has added it meanwhile */
+		kfree(lnc_node);
 	return 0;
 }
 
@@ -360,14 +368,15 @@ static int lnc_add(struct ubifs_info *c, struct ubifs_zbranch *zbr,
  * @node: leaf node
  *
  * This function is similar to 'lnc_add()', but it does not create a copy of
- * @node but inserts @node to TNC directly.
+ * @node but inserts @node to TNC directly. If another lookup has added the
+ * node meanwhile, @node is freed, so on success the caller has to use
+ * @zbr->leaf rather than @node.
  */
 static int lnc_add_directly(struct ubifs_info *c, struct ubifs_zbranch *zbr,
 			    void *node)
 {
 	int err;
 
-	ubifs_assert(!zbr->leaf);
 	ubifs_assert(zbr->len != 0);
 
 	err = ubifs_validate_entry(c, node);
@@ -377,7 +386,9 @@ static int lnc_add_directly(struct ubifs_info *c, struct ubifs_zbranch *zbr,
 		return err;
 	}
 
-	zbr->leaf = node;
+	if (cmpxchg(&zbr->leaf, NULL, node))
+		/* Another lookup has added it meanwhile */
+		kfree(node);
 	return 0;
 }
 
@@ -555,8 +566,8 @@ static int matches_name(struct ubifs_info *c, struct ubifs_zbranch *zbr,
 		err = lnc_add_directly(c, zbr, dent);
 		if (err)
 			goto out_free;
-	} else
-		dent = zbr->leaf;
+	}
+	dent = zbr->leaf;
 
 	nlen = le16_to_cpu(dent->nlen);
 	err = memcmp(dent->name, nm->name, min_t(int, nlen, nm->len));
@@ -848,8 +859,8 @@ static int fallible_matches_name(struct ubifs_info *c,
 		err = lnc_add_directly(c, zbr, dent);
 		if (err)
 			goto out_free;
-	} else
-		dent = zbr->leaf;
+	}
+	dent = zbr->leaf;
 
 	nlen = le16_to_cpu(dent->nlen);
 	err = memcmp(dent->name, nm->name, min_t(int, nlen, nm->len));
@@ -1451,7 +1462,7 @@ int ubifs_tnc_locate(struct ubifs_info *c, const union ubifs_key *key,
 	struct ubifs_zbranch zbr, *zt;
 
 again:
-	mutex_lock(&c->tnc_mutex);
+	down_read(&c->tnc_sem);
 	found = ubifs_lookup_level0(c, key, &znode, &n);
 	if (!found) {
 		err = -ENOENT;
@@ -1468,7 +1479,7 @@ again:
 	if (is_hash_key(c, key)) {
 		/*
 		 * In this case the leaf node cache gets used, so we pass the
-		 * address of the zbranch and keep the mutex locked
+		 * address of the zbranch and keep the TNC locked
 		 */
 		err = tnc_read_node_nm(c, zt, node);
 		goto out;
@@ -1477,10 +1488,10 @@ again:
 		err = ubifs_tnc_read_node(c, zt, node);
 		goto out;
 	}
-	/* Drop the TNC mutex prematurely and race with garbage collection */
+	/* Drop the TNC lock prematurely and race with garbage collection */
 	zbr = znode->zbranch[n];
 	gc_seq1 = c->gc_seq;
-	mutex_unlock(&c->tnc_mutex);
+	up_read(&c->tnc_sem);
 
 	if (ubifs_get_wbuf(c, zbr.lnum)) {
 		/* We do not GC journal heads */
@@ -1492,7 +1503,7 @@ again:
 	if (err <= 0 || maybe_leb_gced(c, zbr.lnum, gc_seq1)) {
 		/*
 		 * The node may have been GC'ed out from under us so try again
-		 * while keeping the TNC mutex locked.
+		 * while keeping the TNC locked.
 		 */
 		safely = 1;
 		goto again;
@@ -1500,7 +1511,7 @@ again:
 	return 0;
 
 out:
-	mutex_unlock(&c->tnc_mutex);
+	up_read(&c->tnc_sem);
 	return err;
 }
 
@@ -1528,7 +1539,7 @@ int ubifs_tnc_get_bu_keys(struct ubifs_info *c, struct bu_info *bu)
 	bu->blk_cnt = 0;
 	bu->eof = 0;
 
-	mutex_lock(&c->tnc_mutex);
+	down_read(&c->tnc_sem);
 	/* Find first key */
 	err = ubifs_lookup_level0(c, &bu->key, &znode, &n);
 	if (err < 0)
@@ -1607,7 +1618,7 @@ out:
 		err = 0;
 	}
 	bu->gc_seq = c->gc_seq;
-	mutex_unlock(&c->tnc_mutex);
+	up_read(&c->tnc_sem);
 	if (err)
 		return err;
 	/*
@@ -1812,7 +1823,7 @@ static int do_lookup_nm(struct ubifs_info *c, const union ubifs_key *key,
 	struct ubifs_znode *znode;
 
 	dbg_tnck(key, "name '%.*s' key ", nm->len, nm->name);
-	mutex_lock(&c->tnc_mutex);
+	down_read(&c->tnc_sem);
 	found = ubifs_lookup_level0(c, key, &znode, &n);
 	if (!found) {
 		err = -ENOENT;
@@ -1836,7 +1847,7 @@ static int do_lookup_nm(struct ubifs_info *c, const union ubifs_key *key,
 	err = tnc_read_node_nm(c, &znode->zbranch[n], node);
 
 out_unlock:
-	mutex_unlock(&c->tnc_mutex);
+	up_read(&c->tnc_sem);
 	return err;
 }
 
@@ -2169,7 +2180,7 @@ int ubifs_tnc_add(struct ubifs_info *c, const union ubifs_key *key, int lnum,
 	int found, n, err = 0;
 	struct ubifs_znode *znode;
 
-	mutex_lock(&c->tnc_mutex);
+	down_write(&c->tnc_sem);
 	dbg_tnck(key, "%d:%d, len %d, key ", lnum, offs, len);
 	found = lookup_level0_dirty(c, key, &znode, &n);
 	if (!found) {
@@ -2193,7 +2204,7 @@ int ubifs_tnc_add(struct ubifs_info *c, const union ubifs_key *key, int lnum,
 		err = found;
 	if (!err)
 		err = dbg_check_tnc(c, 0);
-	mutex_unlock(&c->tnc_mutex);
+	up_write(&c->tnc_sem);
 
 	return err;
 }
@@ -2218,7 +2229,7 @@ int ubifs_tnc_replace(struct ubifs_info *c, const union ubifs_key *key,
 	int found, n, err = 0;
 	struct ubifs_znode *znode;
 
-	mutex_lock(&c->tnc_mutex);
+	down_write(&c->tnc_sem);
 	dbg_tnck(key, "old LEB %d:%d, new LEB %d:%d, len %d, key ", old_lnum,
 		 old_offs, lnum, offs, len);
 	found = lookup_level0_dirty(c, key, &znode, &n);
@@ -2279,7 +2290,7 @@ int ubifs_tnc_replace(struct ubifs_info *c, const union ubifs_key *key,
 		err = dbg_check_tnc(c, 0);
 
 out_unlock:
-	mutex_unlock(&c->tnc_mutex);
+	up_write(&c->tnc_sem);
 	return err;
 }
 
@@ -2301,7 +2312,7 @@ int ubifs_tnc_add_nm(struct ubifs_info *c, const union ubifs_key *key,
 	int found, n, err = 0;
 	struct ubifs_znode *znode;
 
-	mutex_lock(&c->tnc_mutex);
+	down_write(&c->tnc_sem);
 	dbg_tnck(key, "LEB %d:%d, name '%.*s', key ",
 		 lnum, offs, nm->len, nm->name);
 	found = lookup_level0_dirty(c, key, &znode, &n);
@@ -2364,7 +2375,7 @@ int ubifs_tnc_add_nm(struct ubifs_info *c, const union ubifs_key *key,
 			struct qstr noname = { .len = 0, .name = "" };
 
 			err = dbg_check_tnc(c, 0);
-			mutex_unlock(&c->tnc_mutex);
+			up_write(&c->tnc_sem);
 			if (err)
 				return err;
 			return ubifs_tnc_remove_nm(c, key, &noname);
@@ -2374,7 +2385,7 @@ int ubifs_tnc_add_nm(struct ubifs_info *c, const union ubifs_key *key,
 out_unlock:
 	if (!err)
 		err = dbg_check_tnc(c, 0);
-	mutex_unlock(&c->tnc_mutex);
+	up_write(&c->tnc_sem);
 	return err;
 }
 
@@ -2505,7 +2516,7 @@ int ubifs_tnc_remove(struct ubifs_info *c, const union ubifs_key *key)
 	int found, n, err = 0;
 	struct ubifs_znode *znode;
 
-	mutex_lock(&c->tnc_mutex);
+	down_write(&c->tnc_sem);
 	dbg_tnck(key, "key ");
 	found = lookup_level0_dirty(c, key, &znode, &n);
 	if (found < 0) {
@@ -2518,7 +2529,7 @@ int ubifs_tnc_remove(struct ubifs_info *c, const union ubifs_key *key)
 		err = dbg_check_tnc(c, 0);
 
 out_unlock:
-	mutex_unlock(&c->tnc_mutex);
+	up_write(&c->tnc_sem);
 	return err;
 }
 
@@ -2536,7 +2547,7 @@ int ubifs_tnc_remove_nm(struct ubifs_info *c, const union ubifs_key *key,
 	int n, err;
 	struct ubifs_znode *znode;
 
-	mutex_lock(&c->tnc_mutex);
+	down_write(&c->tnc_sem);
 	dbg_tnck(key, "%.*s, key ", nm->len, nm->name);
 	err = lookup_level0_dirty(c, key, &znode, &n);
 	if (err < 0)
@@ -2567,7 +2578,7 @@ int ubifs_tnc_remove_nm(struct ubifs_info *c, const union ubifs_key *key,
 out_unlock:
 	if (!err)
 		err = dbg_check_tnc(c, 0);
-	mutex_unlock(&c->tnc_mutex);
+	up_write(&c->tnc_sem);
 	return err;
 }
 
@@ -2607,7 +2618,7 @@ int ubifs_tnc_remove_range(struct ubifs_info *c, union ubifs_key *from_key,
 	struct ubifs_znode *znode;
 	union ubifs_key *key;
 
-	mutex_lock(&c->tnc_mutex);
+	down_write(&c->tnc_sem);
 	while (1) {
 		/* Find first level 0 znode that contains keys to remove */
 		err = ubifs_lookup_level0(c, from_key, &znode, &n);
@@ -2669,7 +2680,7 @@ int ubifs_tnc_remove_range(struct ubifs_info *c, union ubifs_key *from_key,
 out_unlock:
 	if (!err)
 		err = dbg_check_tnc(c, 0);
-	mutex_unlock(&c->tnc_mutex);
+	up_write(&c->tnc_sem);
 	return err;
 }
 
@@ -2775,7 +2786,7 @@ struct ubifs_dent_node *ubifs_tnc_next_ent(struct ubifs_info *c,
 	dbg_tnck(key, "%s ", nm->name ? (char *)nm->name : "(lowest)");
 	ubifs_assert(is_hash_key(c, key));
 
-	mutex_lock(&c->tnc_mutex);
+	down_read(&c->tnc_sem);
 	err = ubifs_lookup_level0(c, key, &znode, &n);
 	if (unlikely(err < 0))
 		goto out_unlock;
@@ -2834,13 +2845,13 @@ struct ubifs_dent_node *ubifs_tnc_next_ent(struct ubifs_info *c,
 	if (unlikely(err))
 		goto out_free;
 
-	mutex_unlock(&c->tnc_mutex);
+	up_read(&c->tnc_sem);
 	return dent;
 
 out_free:
 	kfree(dent);
 out_unlock:
-	mutex_unlock(&c->tnc_mutex);
+	up_read(&c->tnc_sem);
 	return ERR_PTR(err);
 }
 
@@ -3215,7 +3226,7 @@ int ubifs_tnc_has_node(struct ubifs_info *c, union ubifs_key *key, int level,
 {
 	int err;
 
-	mutex_lock(&c->tnc_mutex);
+	down_write(&c->tnc_sem);
 	if (is_idx) {
 		err = is_idx_node_in_tnc(c, key, level, lnum, offs);
 		if (err < 0)
@@ -3232,7 +3243,7 @@ int ubifs_tnc_has_node(struct ubifs_info *c, union ubifs_key *key, int level,
 		err = is_leaf_node_in_tnc(c, key, lnum, offs);
 
 out_unlock:
-	mutex_unlock(&c->tnc_mutex);
+	up_write(&c->tnc_sem);
 	return err;
 }
 
@@ -3256,7 +3267,7 @@ int ubifs_dirty_idx_node(struct ubifs_info *c, union ubifs_key *key, int level,
 	struct ubifs_znode *znode;
 	int err = 0;
 
-	mutex_lock(&c->tnc_mutex);
+	down_write(&c->tnc_sem);
 	znode = lookup_znode(c, key, level, lnum, offs);
 	if (!znode)
 		goto out_unlock;
@@ -3271,7 +3282,7 @@ int ubifs_dirty_idx_node(struct ubifs_info *c, union ubifs_key *key, int level,
 	}
 
 out_unlock:
-	mutex_unlock(&c->tnc_mutex);
+	up_write(&c->tnc_sem);
 	return err;
 }
 
@@ -3305,7 +3316,7 @@ int dbg_check_inode_size(struct ubifs_info *c, const struct inode *inode,
 	data_key_init(c, &from_key, inode->i_ino, block);
 	highest_data_key(c, &to_key, inode->i_ino);
 
-	mutex_lock(&c->tnc_mutex);
+	down_read(&c->tnc_sem);
 	err = ubifs_lookup_level0(c, &from_key, &znode, &n);
 	if (err < 0)
 		goto out_unlock;
@@ -3334,13 +3345,13 @@ out_dump:
 	ubifs_err("inode %lu has size %lld, but there are data at offset %lld",
 		  (unsigned long)inode->i_ino, size,
 		  ((loff_t)block) << UBIFS_BLOCK_SHIFT);
-	mutex_unlock(&c->tnc_mutex);
+	up_read(&c->tnc_sem);
 	dbg_dump_inode(c, inode);
 	dbg_dump_stack();
 	return -EINVAL;
 
 out_unlock:
-	mutex_unlock(&c->tnc_mutex);
+	up_read(&c->tnc_sem);
 	return err;
 }
 
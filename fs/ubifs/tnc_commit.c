@@ -92,7 +92,7 @@ static int make_idx_node(struct ubifs_info *c, struct ubifs_idx_node *idx,
 
 	/*
 	 * Note, unlike 'write_index()' we do not add memory barriers here
-	 * because this function is called with @c->tnc_mutex locked.
+	 * because this function is called with @c->tnc_sem locked for writing.
 	 */
 	__clear_bit(DIRTY_ZNODE, &znode->flags);
 	__clear_bit(COW_ZNODE, &znode->flags);
@@ -749,7 +749,7 @@ int ubifs_tnc_start_commit(struct ubifs_info *c, struct ubifs_zbranch *zroot)
 {
 	int err = 0, cnt;
 
-	mutex_lock(&c->tnc_mutex);
+	down_write(&c->tnc_sem);
 	err = dbg_check_tnc(c, 1);
 	if (err)
 		goto out;
@@ -791,7 +791,7 @@ int ubifs_tnc_start_commit(struct ubifs_info *c, struct ubifs_zbranch *zroot)
 	c->bi.uncommitted_idx = 0;
 	c->bi.min_idx_lebs = ubifs_calc_min_idx_lebs(c);
 	spin_unlock(&c->space_lock);
-	mutex_unlock(&c->tnc_mutex);
+	up_write(&c->tnc_sem);
 
 	dbg_cmt("number of index LEBs %d", c->lst.idx_lebs);
 	dbg_cmt("size of index %llu", c->calc_idx_sz);
@@ -800,7 +800,7 @@ int ubifs_tnc_start_commit(struct ubifs_info *c, struct ubifs_zbranch *zroot)
 out_free:
 	free_idx_lebs(c);
 out:
-	mutex_unlock(&c->tnc_mutex);
+	up_write(&c->tnc_sem);
 	return err;
 }
 
@@ -918,7 +918,7 @@ static int write_index(struct ubifs_info *c)
 		 * while.
 		 *
 		 * Q: why we cannot increment @c->clean_zn_cnt?
-		 * A: because we do not have the @c->tnc_mutex locked, and the
+		 * A: because we do not have the @c->tnc_sem locked, and the
 		 *    following code would be racy and buggy:
 		 *
 		 *    if (!ubifs_zn_obsolete(znode)) {
@@ -1068,7 +1068,7 @@ int ubifs_tnc_end_commit(struct ubifs_info *c)
 	if (err)
 		return err;
 
-	mutex_lock(&c->tnc_mutex);
+	down_write(&c->tnc_sem);
 
 	dbg_cmt("TNC height is %d", c->zroot.znode->level + 1);
 
@@ -1078,7 +1078,7 @@ int ubifs_tnc_end_commit(struct ubifs_info *c)
 	kfree(c->ilebs);
 	c->ilebs = NULL;
 
-	mutex_unlock(&c->tnc_mutex);
+	up_write(&c->tnc_sem);
 
 	return 0;
 }
@@ -402,6 +402,11 @@ out_dump:
  * This function loads znode pointed to by @zbr into the TNC cache and
  * returns pointer to it in case of success and a negative error code in case
  * of failure.
+ *
+ * Lookups call this function with @c->tnc_sem locked for reading, so the
+ * znode may be loaded by several of them at the same time. Only the first one
+ * to finish adds it to the TNC, and the others return that znode instead of
+ * their own copy.
  */
 struct ubifs_znode *ubifs_load_znode(struct ubifs_info *c,
 				     struct ubifs_zbranch *zbr,
@@ -410,7 +415,6 @@ struct ubifs_znode *ubifs_load_znode(struct ubifs_info *c,
 	int err;
 	struct ubifs_znode *znode;
 
-	ubifs_assert(!zbr->znode);
 	/*
 	 * A slab cache is not presently used for znodes because the znode size
 	 * depends on the fanout which is stored in the superblock.
@@ -423,6 +427,17 @@ struct ubifs_znode *ubifs_load_znode(struct ubifs_info *c,
 	if (err)
 		goto out;
 
+	znode->parent = parent;
+	znode->time = get_seconds();
+	znode->iip = iip;
+
+	spin_lock(&c->tnc_load_lock);
+	if (zbr->znode) {
+		spin_unlock(&c->tnc_load_lock);
+		kfree(znode);
+		return zbr->znode;
+	}
+
 	atomic_long_inc(&c->clean_zn_cnt);
 
 	/*
@@ -433,10 +448,10 @@ struct ubifs_znode *ubifs_load_znode(struct ubifs_info *c,
 	 */
 	atomic_long_inc(&ubifs_clean_zn_cnt);
 
+	/* Lookups find the znode without the lock, initialize it first */
+	smp_wmb();
 	zbr->znode = znode;
-	znode->parent = parent;
-	znode->time = get_seconds();
-	znode->iip = iip;
+	spin_unlock(&c->tnc_load_lock);
 
 	return znode;
 
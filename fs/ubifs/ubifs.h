@@ -36,6 +36,7 @@
 #include <linux/mtd/ubi.h>
 #include <linux/pagemap.h>
 #include <linux/backing-dev.h>
+#include <linux/workqueue.h>
 #include "ubifs-media.h"
 
 /* Version of this UBIFS implementation */
@@ -163,6 +164,9 @@
 /* Maximum number of data nodes to bulk-read */
 #define UBIFS_MAX_BULK_READ 32
 
+/* Maximum number of pages in a parallel compression batch */
+#define UBIFS_PCOMPR_PAGES 16
+
 /*
  * Lockdep classes for UBIFS inode @ui_mutex.
  */
@@ -404,7 +408,7 @@ struct ubifs_inode {
 	unsigned int dirty:1;
 	unsigned int xattr:1;
 	unsigned int bulk_read:1;
-	unsigned int compr_type:2;
+	unsigned int compr_type:3;
 	struct mutex ui_mutex;
 	spinlock_t ui_lock;
 	loff_t synced_i_size;
@@ -803,6 +807,34 @@ struct bu_info {
 	int eof;
 };
 
+/**
+ * struct ubifs_pcompr_page - a page of a parallel compression batch.
+ * @work: work item compressing the page
+ * @page: the page, locked
+ * @dlen: lengths of the prepared data nodes
+ * @dn: prepared data nodes, one per block of the page
+ */
+struct ubifs_pcompr_page {
+	struct work_struct work;
+	struct page *page;
+	int dlen[UBIFS_BLOCKS_PER_PAGE];
+	struct ubifs_data_node *dn[UBIFS_BLOCKS_PER_PAGE];
+};
+
+/**
+ * struct ubifs_pcompr - parallel compression information.
+ * @mutex: serializes write-back of batches
+ * @cnt: number of pages in the batch
+ * @pages: pages of the batch
+ * @buf: buffer the data nodes are prepared in
+ */
+struct ubifs_pcompr {
+	struct mutex mutex;
+	int cnt;
+	struct ubifs_pcompr_page pages[UBIFS_PCOMPR_PAGES];
+	void *buf;
+};
+
 /**
  * struct ubifs_node_range - node length range description data structure.
  * @len: fixed node length
@@ -819,6 +851,17 @@ struct ubifs_node_range {
 	int max_len;
 };
 
+/**
+ * struct ubifs_pcc - per-CPU cryptoapi compressor handle.
+ * @cc: cryptoapi compressor handle
+ * @mutex: serializes users of @cc, because the compressing task may be
+ *         preempted and another task may pick the same CPU's handle
+ */
+struct ubifs_pcc {
+	struct crypto_comp *cc;
+	struct mutex mutex;
+};
+
 /**
  * struct ubifs_compressor - UBIFS compressor description structure.
  * @compr_type: compressor type (%UBIFS_COMPR_LZO, etc)
@@ -827,6 +870,19 @@ struct ubifs_node_range {
  * @decomp_mutex: mutex used during decompression
  * @name: compressor name
  * @capi_name: cryptoapi compressor name
+ * @pcc: per-CPU cryptoapi compressor handles used for compression, so that
+ *       CPUs do not serialize on @comp_mutex (%NULL until parallel
+ *       compression is first enabled)
+ * @stat_lock: protects the statistics below
+ * @comp_cnt: how many buffers were compressed
+ * @comp_rejected: how many of them were stored uncompressed because they
+ *                 did not compress well enough or the compressor failed
+ * @comp_in: bytes given to the compressor
+ * @comp_out: bytes stored as a result, including rejected buffers
+ * @comp_ns: time spent compressing, in nanoseconds
+ * @decomp_cnt: how many buffers were decompressed
+ * @decomp_out: bytes produced by the decompressor
+ * @decomp_ns: time spent decompressing, in nanoseconds
  */
 struct ubifs_compressor {
 	int compr_type;
@@ -835,6 +891,16 @@ struct ubifs_compressor {
 	struct mutex *decomp_mutex;
 	const char *name;
 	const char *capi_name;
+	struct ubifs_pcc __percpu *pcc;
+	spinlock_t stat_lock;
+	unsigned long long comp_cnt;
+	unsigned long long comp_rejected;
+	unsigned long long comp_in;
+	unsigned long long comp_out;
+	unsigned long long comp_ns;
+	unsigned long long decomp_cnt;
+	unsigned long long decomp_out;
+	unsigned long long decomp_ns;
 };
 
 /**
@@ -930,13 +996,16 @@ struct ubifs_orphan {
  *                  specified in @compr_type)
  * @compr_type: compressor type to override the superblock compressor with
  *              (%UBIFS_COMPR_NONE, etc)
+ * @parallel_compr: enable/disable parallel compression of write-back
+ *                  batches (%0 default, %1 disable, %2 enable)
  */
 struct ubifs_mount_opts {
 	unsigned int unmount_mode:2;
 	unsigned int bulk_read:2;
 	unsigned int chk_data_crc:2;
 	unsigned int override_compr:1;
-	unsigned int compr_type:2;
+	unsigned int compr_type:3;
+	unsigned int parallel_compr:2;
 };
 
 /**
@@ -1022,9 +1091,13 @@ struct ubifs_debug_info;
  * @bulk_read: enable bulk-reads
  * @default_compr: default compression algorithm (%UBIFS_COMPR_LZO, etc)
  * @rw_incompat: the media is not R/W compatible
+ * @parallel_compr: compress write-back batches in parallel
  *
- * @tnc_mutex: protects the Tree Node Cache (TNC), @zroot, @cnext, @enext, and
- *             @calc_idx_sz
+ * @tnc_sem: protects the Tree Node Cache (TNC), @zroot, @cnext, @enext, and
+ *           @calc_idx_sz; lookups take it for reading, modifications for
+ *           writing
+ * @tnc_load_lock: serializes adding loaded znodes to the TNC, which lookups
+ *                 do with @tnc_sem only locked for reading
  * @zroot: zbranch which points to the root index node and znode
  * @cnext: next znode to commit
  * @enext: next znode to commit to empty space
@@ -1052,6 +1125,8 @@ struct ubifs_debug_info;
  * @write_reserve_buf: on the write path we allocate memory, which might
  *                     sometimes be unavailable, in which case we use this
  *                     write reserve buffer
+ * @pcompr: parallel compression information, allocated when parallel
+ *          compression is first enabled
  *
  * @log_lebs: number of logical eraseblocks in the log
  * @log_bytes: log size in bytes
@@ -1259,10 +1334,12 @@ struct ubifs_info {
 	unsigned int space_fixup:1;
 	unsigned int no_chk_data_crc:1;
 	unsigned int bulk_read:1;
-	unsigned int default_compr:2;
+	unsigned int default_compr:3;
 	unsigned int rw_incompat:1;
+	unsigned int parallel_compr:1;
 
-	struct mutex tnc_mutex;
+	struct rw_semaphore tnc_sem;
+	spinlock_t tnc_load_lock;
 	struct ubifs_zbranch zroot;
 	struct ubifs_znode *cnext;
 	struct ubifs_znode *enext;
@@ -1288,6 +1365,7 @@ struct ubifs_info {
 
 	struct mutex write_reserve_mutex;
 	void *write_reserve_buf;
+	struct ubifs_pcompr *pcompr;
 
 	int log_lebs;
 	long long log_bytes;
@@ -1465,6 +1543,7 @@ extern const struct inode_operations ubifs_dir_inode_operations;
 extern const struct inode_operations ubifs_symlink_inode_operations;
 extern struct backing_dev_info ubifs_backing_dev_info;
 extern struct ubifs_compressor *ubifs_compressors[UBIFS_COMPR_TYPES_CNT];
+extern struct workqueue_struct *ubifs_pcompr_wq;
 
 /* io.c */
 void ubifs_ro_mode(struct ubifs_info *c, int err);
@@ -1528,6 +1607,12 @@ int ubifs_consolidate_log(struct ubifs_info *c);
 int ubifs_jnl_update(struct ubifs_info *c, const struct inode *dir,
 		     const struct qstr *nm, const struct inode *inode,
 		     int deletion, int xent);
+int ubifs_prepare_data_node(struct ubifs_info *c, const struct inode *inode,
+			    const union ubifs_key *key, const void *buf,
+			    int len, struct ubifs_data_node *data);
+int ubifs_jnl_write_data_node(struct ubifs_info *c,
+			      const union ubifs_key *key,
+			      struct ubifs_data_node *data, int dlen);
 int ubifs_jnl_write_data(struct ubifs_info *c, const struct inode *inode,
 			 const union ubifs_key *key, const void *buf, int len);
 int ubifs_jnl_write_inode(struct ubifs_info *c, const struct inode *inode);
@@ -1731,6 +1816,7 @@ int ubifs_calc_dark(const struct ubifs_info *c, int spc);
 /* file.c */
 int ubifs_fsync(struct file *file, loff_t start, loff_t end, int datasync);
 int ubifs_setattr(struct dentry *dentry, struct iattr *attr);
+void ubifs_pcompr_work(struct work_struct *work);
 
 /* dir.c */
 struct inode *ubifs_new_inode(struct ubifs_info *c, const struct inode *dir,
@@ -1778,6 +1864,7 @@ void ubifs_compress(const void *in_buf, int in_len, void *out_buf, int *out_len,
 		    int *compr_type);
 int ubifs_decompress(const void *buf, int len, void *out, int *out_len,
 		     int compr_type);
+int ubifs_pcompr_init(void);
 
 #include "debug.h"
 #include "misc.h"
@@ -42,6 +42,10 @@ enum bdi_stat_item {
 	BDI_WRITEBACK,
 	BDI_DIRTIED,
 	BDI_WRITTEN,
+	BDI_READAHEAD,		/* pages read ahead */
+	BDI_READAHEAD_USED,	/* ... and accessed */
+	BDI_READAHEAD_WASTED,	/* ... and dropped without being accessed */
+	BDI_READAHEAD_STALL,	/* readers waited on readahead I/O */
 	NR_BDI_STAT_ITEMS
 };
 
@@ -65,6 +69,12 @@ struct bdi_writeback {
 struct backing_dev_info {
 	struct list_head bdi_list;
 	unsigned long ra_pages;	/* max readahead in PAGE_CACHE_SIZE units */
+	unsigned long ra_adapt_pages;	/* max readahead if ra_adaptive */
+	unsigned int ra_adaptive;	/* size readahead by observed hits */
+	unsigned long ra_stamp;		/* last time ra_adapt_pages was updated */
+	unsigned long ra_used_stamp;	/* READAHEAD_USED at ra_stamp */
+	unsigned long ra_wasted_stamp;	/* READAHEAD_WASTED at ra_stamp */
+	unsigned long ra_stall_stamp;	/* READAHEAD_STALL at ra_stamp */
 	unsigned long state;	/* Always use atomic bitops on this */
 	unsigned int capabilities; /* Device capabilities */
 	congested_fn *congested_fn; /* Function pointer if device is md/dm */
@@ -144,6 +154,16 @@ static inline void __add_bdi_stat(struct backing_dev_info *bdi,
 	__percpu_counter_add(&bdi->bdi_stat[item], amount, BDI_STAT_BATCH);
 }
 
+static inline void add_bdi_stat(struct backing_dev_info *bdi,
+		enum bdi_stat_item item, s64 amount)
+{
+	unsigned long flags;
+
+	local_irq_save(flags);
+	__add_bdi_stat(bdi, item, amount);
+	local_irq_restore(flags);
+}
+
 static inline void __inc_bdi_stat(struct backing_dev_info *bdi,
 		enum bdi_stat_item item)
 {
@@ -180,6 +180,27 @@ extern int bus_unregister_notifier(struct bus_type *bus,
 extern struct kset *bus_get_kset(struct bus_type *bus);
 extern struct klist *bus_get_device_klist(struct bus_type *bus);
 
+/**
+ * enum probe_type - device driver probe type to try
+ *	Device drivers may opt in for asynchronous probing of the devices
+ *	they handle at registration time, so that slow probes (PHY
+ *	negotiation, card detection, ...) run in parallel instead of
+ *	serializing boot.
+ *
+ * @PROBE_DEFAULT_STRATEGY: Synchronous probing, unless the driver is
+ *	named in the driver_async_probe= boot parameter.
+ * @PROBE_PREFER_ASYNCHRONOUS: Probe from the async domain. The driver
+ *	must not rely on its devices being bound once registration
+ *	returns; wait_for_device_probe() is the synchronization point.
+ * @PROBE_FORCE_SYNCHRONOUS: Always probe synchronously, e.g. because
+ *	the caller checks the binding result right after registration.
+ */
+enum probe_type {
+	PROBE_DEFAULT_STRATEGY,
+	PROBE_PREFER_ASYNCHRONOUS,
+	PROBE_FORCE_SYNCHRONOUS,
+};
+
 /**
  * struct device_driver - The basic device driver structure
  * @name:	Name of the device driver.
@@ -187,6 +208,7 @@ extern struct klist *bus_get_device_klist(struct bus_type *bus);
  * @owner:	The module owner.
  * @mod_name:	Used for built-in modules.
  * @suppress_bind_attrs: Disables bind/unbind via sysfs.
+ * @probe_type:	Whether the driver may be probed asynchronously.
  * @of_match_table: The open firmware table.
  * @probe:	Called to query the existence of a specific device,
  *		whether this driver can work with it, and bind the driver
@@ -219,6 +241,7 @@ struct device_driver {
 	const char		*mod_name;	/* used for built-in modules */
 
 	bool suppress_bind_attrs;	/* disables bind/unbind via sysfs */
+	enum probe_type probe_type;
 
 	const struct of_device_id	*of_match_table;
 
@@ -0,0 +1,115 @@
+#ifndef _LINUX_FRONTSWAP_H
+#define _LINUX_FRONTSWAP_H
+
+#include <linux/swap.h>
+#include <linux/mm.h>
+#include <linux/bitops.h>
+
+struct frontswap_ops {
+	void (*init)(unsigned);
+	int (*put_page)(unsigned, pgoff_t, struct page *);
+	int (*get_page)(unsigned, pgoff_t, struct page *);
+	void (*flush_page)(unsigned, pgoff_t);
+	void (*flush_area)(unsigned);
+};
+
+extern struct frontswap_ops
+	frontswap_register_ops(struct frontswap_ops *ops);
+extern void __frontswap_init(struct swap_info_struct *sis);
+extern int __frontswap_put_page(struct page *page);
+extern int __frontswap_get_page(struct page *page);
+extern void __frontswap_flush_page(struct swap_info_struct *sis, pgoff_t);
+extern void __frontswap_flush_area(struct swap_info_struct *sis);
+extern int frontswap_enabled;
+extern unsigned long frontswap_curr_pages(void);
+extern void frontswap_shrink(unsigned long target_pages);
+
+#ifdef CONFIG_FRONTSWAP
+static inline unsigned long *frontswap_map_get(struct swap_info_struct *sis)
+{
+	return sis->frontswap_map;
+}
+
+static inline void frontswap_map_set(struct swap_info_struct *sis,
+				     unsigned long *map)
+{
+	sis->frontswap_map = map;
+	atomic_set(&sis->frontswap_pages, 0);
+}
+
+static inline int frontswap_test(struct swap_info_struct *sis, pgoff_t offset)
+{
+	return sis->frontswap_map && test_bit(offset, sis->frontswap_map);
+}
+
+static inline void frontswap_set(struct swap_info_struct *sis, pgoff_t offset)
+{
+	if (sis->frontswap_map)
+		set_bit(offset, sis->frontswap_map);
+}
+
+static inline int frontswap_test_and_clear(struct swap_info_struct *sis,
+					   pgoff_t offset)
+{
+	return sis->frontswap_map &&
+		test_and_clear_bit(offset, sis->frontswap_map);
+}
+#else
+#define frontswap_enabled (0)
+#define frontswap_test(_sis, _offset) (0)
+
+static inline unsigned long *frontswap_map_get(struct swap_info_struct *sis)
+{
+	return NULL;
+}
+
+static inline void frontswap_map_set(struct swap_info_struct *sis,
+				     unsigned long *map)
+{
+}
+#endif
+
+/*
+ * As with cleancache, these wrappers reduce every frontswap hook to
+ * nothing when CONFIG_FRONTSWAP is off, and to a single global variable
+ * check when it is on but no backend has registered.
+ */
+
+static inline void frontswap_init(struct swap_info_struct *sis)
+{
+	if (frontswap_enabled)
+		__frontswap_init(sis);
+}
+
+static inline int frontswap_put_page(struct page *page)
+{
+	int ret = -1;
+
+	if (frontswap_enabled)
+		ret = __frontswap_put_page(page);
+	return ret;
+}
+
+static inline int frontswap_get_page(struct page *page)
+{
+	int ret = -1;
+
+	if (frontswap_enabled)
+		ret = __frontswap_get_page(page);
+	return ret;
+}
+
+static inline void frontswap_flush_page(struct swap_info_struct *sis,
+					pgoff_t offset)
+{
+	if (frontswap_enabled)
+		__frontswap_flush_page(sis, offset);
+}
+
+static inline void frontswap_flush_area(struct swap_info_struct *sis)
+{
+	if (frontswap_enabled)
+		__frontswap_flush_area(sis);
+}
+
+#endif /* _LINUX_FRONTSWAP_H */
@@ -74,6 +74,7 @@ extern void *jbd2_alloc(size_t size, gfp_t flags);
 extern void jbd2_free(void *ptr, size_t size);
 
 #define JBD2_MIN_JOURNAL_BLOCKS 1024
+#define JBD2_DEFAULT_FAST_COMMIT_BLOCKS 256
 
 #ifdef __KERNEL__
 
@@ -130,6 +131,7 @@ typedef struct journal_s	journal_t;	/* Journal control structure */
 #define JBD2_SUPERBLOCK_V1	3
 #define JBD2_SUPERBLOCK_V2	4
 #define JBD2_REVOKE_BLOCK	5
+#define JBD2_FC_BLOCK		6
 
 /*
  * Standard header for all descriptor blocks:
@@ -241,7 +243,10 @@ typedef struct journal_superblock_s
 	__be32	s_max_trans_data;	/* Limit of data blocks per trans. */
 
 /* 0x0050 */
-	__u32	s_padding[44];
+	__u32	s_padding[42];
+/* 0x00F8 */
+	__be32	s_num_fc_blks;		/* Blocks in the fast commit area */
+	__u32	s_padding2;
 
 /* 0x0100 */
 	__u8	s_users[16*48];		/* ids of all fs'es sharing the log */
@@ -263,13 +268,20 @@ typedef struct journal_superblock_s
 #define JBD2_FEATURE_INCOMPAT_REVOKE		0x00000001
 #define JBD2_FEATURE_INCOMPAT_64BIT		0x00000002
 #define JBD2_FEATURE_INCOMPAT_ASYNC_COMMIT	0x00000004
+/*
+ * Upstream's fast commits use INCOMPAT 0x20 and superblock offsets 0x50
+ * to 0x5B and 0xFC with a different on-disk format, so ours take the top
+ * bit and the word at 0xF8, which upstream leaves unassigned.
+ */
+#define JBD2_FEATURE_INCOMPAT_FAST_COMMIT	0x80000000
 
 /* Features known to this kernel version: */
 #define JBD2_KNOWN_COMPAT_FEATURES	JBD2_FEATURE_COMPAT_CHECKSUM
 #define JBD2_KNOWN_ROCOMPAT_FEATURES	0
 #define JBD2_KNOWN_INCOMPAT_FEATURES	(JBD2_FEATURE_INCOMPAT_REVOKE | \
 					JBD2_FEATURE_INCOMPAT_64BIT | \
-					JBD2_FEATURE_INCOMPAT_ASYNC_COMMIT)
+					JBD2_FEATURE_INCOMPAT_ASYNC_COMMIT | \
+					JBD2_FEATURE_INCOMPAT_FAST_COMMIT)
 
 #ifdef __KERNEL__
 
@@ -635,6 +647,9 @@ jbd2_time_diff(unsigned long start, unsigned long end)
 
 #define JBD2_NR_BATCH	64
 
+/* Recovery passes, also handed to the fast commit replay callback */
+enum passtype {PASS_SCAN, PASS_REVOKE, PASS_REPLAY};
+
 /**
  * struct journal_s - The journal_s type is the concrete type associated with
  *     journal_t.
@@ -702,6 +717,12 @@ jbd2_time_diff(unsigned long start, unsigned long end)
  * @j_history_lock: Protect the transactions statistics history
  * @j_proc_entry: procfs entry for the jbd statistics directory
  * @j_stats: Overall statistics
+ * @j_fc_first: The block number of the first block of the fast commit area
+ * @j_fc_last: The block number one beyond the fast commit area
+ * @j_fc_off: Number of fast commit blocks used by the running transaction
+ * @j_fc_wait: Wait queue for waiting for a fast commit to complete
+ * @j_fc_replay_callback: Called during recovery to replay the fast commit
+ *  blocks found after the last committed transaction
  * @j_private: An opaque pointer to fs-private information.
  */
 
@@ -934,6 +955,31 @@ struct journal_s
 	/* Failed journal commit ID */
 	unsigned int		j_failed_commit;
 
+	/*
+	 * Fast commit area: the blocks from j_fc_first up to j_fc_last at the
+	 * end of the journal, of which the first j_fc_off have been written
+	 * by fast commits of the running transaction.
+	 * [JBD2_FAST_COMMIT_ONGOING]
+	 */
+	unsigned long		j_fc_first;
+	unsigned long		j_fc_last;
+	unsigned long		j_fc_off;
+
+	/* Wait queue for waiting for a fast commit to complete */
+	wait_queue_head_t	j_fc_wait;
+
+	/*
+	 * Called by recovery for each fast commit block of the transaction
+	 * following the last one in the log: @off is the index of the block
+	 * in the fast commit area and @tid the transaction it must belong to.
+	 * In PASS_SCAN a non-zero return ends the valid part of the area,
+	 * in PASS_REPLAY it fails the recovery.
+	 */
+	int			(*j_fc_replay_callback)(journal_t *journal,
+							struct buffer_head *bh,
+							enum passtype pass,
+							int off, tid_t tid);
+
 	/*
 	 * An opaque pointer to fs-private information.  ext3 puts its
 	 * superblock pointer here
@@ -953,6 +999,8 @@ struct journal_s
 #define JBD2_ABORT_ON_SYNCDATA_ERR	0x040	/* Abort the journal on file
 						 * data write error in ordered
 						 * mode */
+#define JBD2_FAST_COMMIT_ONGOING	0x080	/* A fast commit is being
+						 * written */
 
 /*
  * Function declarations for the journaling transaction and buffer
@@ -1169,6 +1217,13 @@ int jbd2_log_wait_commit(journal_t *journal, tid_t tid);
 int jbd2_log_do_checkpoint(journal_t *journal);
 int jbd2_trans_will_send_data_barrier(journal_t *journal, tid_t tid);
 
+/* Fast commits */
+int jbd2_fc_begin_commit(journal_t *journal, tid_t tid);
+void jbd2_fc_end_commit(journal_t *journal);
+void jbd2_fc_end_commit_fallback(journal_t *journal, tid_t tid);
+int jbd2_fc_get_buf(journal_t *journal, struct buffer_head **bhp);
+int jbd2_fc_write_buf(journal_t *journal, struct buffer_head *bh);
+
 void __jbd2_log_wait_for_space(journal_t *journal);
 extern void __jbd2_journal_drop_transaction(journal_t *, transaction_t *);
 extern int jbd2_cleanup_journal_tail(journal_t *);
@@ -2,6 +2,7 @@
 #define LINUX_MM_INLINE_H
 
 #include <linux/huge_mm.h>
+#include <linux/swap.h>
 
 /**
  * page_is_file_cache - should the page be on a file LRU or anon LRU?
@@ -99,4 +100,87 @@ static inline enum lru_list page_lru(struct page *page)
 	return lru;
 }
 
+#ifdef CONFIG_LRU_GEN
+static inline unsigned long lru_gen_from_seq(unsigned long seq)
+{
+	return seq % MAX_NR_GENS + 1;
+}
+
+/*
+ * Reclaim only relies on generations once aging has run often enough
+ * for "young" to mean something; until then, and whenever the policy is
+ * switched off, the referenced bits are sampled through the rmap.
+ */
+static inline bool lru_gen_enabled(void)
+{
+	return lru_gen_enable && ACCESS_ONCE(lru_gen_max_seq) >= MIN_NR_GENS;
+}
+
+/**
+ * page_lru_gen_young - was the page accessed in a recent generation?
+ * @page: the page to test
+ *
+ * Returns true if @page was seen accessed in one of the MIN_NR_GENS
+ * most recent aging sequences.  Only the sequence modulo MAX_NR_GENS is
+ * kept, so reclaim has to lru_gen_clear_page() once it finds the page
+ * old, before that generation number comes round again.
+ */
+static inline bool page_lru_gen_young(struct page *page)
+{
+	unsigned long gen = page_lru_gen(page);
+	unsigned long max_gen = lru_gen_from_seq(ACCESS_ONCE(lru_gen_max_seq));
+
+	if (!gen)
+		return false;
+	return (max_gen + MAX_NR_GENS - gen) % MAX_NR_GENS < MIN_NR_GENS;
+}
+
+/* Reclaim found @page old: forget its generation */
+static inline void lru_gen_clear_page(struct page *page)
+{
+	if (page_lru_gen(page))
+		set_page_lru_gen(page, 0);
+}
+
+/* Move @page into the youngest generation */
+static inline void lru_gen_mark_page(struct page *page)
+{
+	if (lru_gen_enable)
+		set_page_lru_gen(page,
+				 lru_gen_from_seq(ACCESS_ONCE(lru_gen_max_seq)));
+}
+
+/*
+ * Anon pages start out in the youngest generation; file pages have to
+ * prove themselves, so that use-once streaming IO is reclaimed first.
+ */
+static inline void lru_gen_add_page(struct page *page, int file)
+{
+	if (!file && !page_lru_gen(page))
+		lru_gen_mark_page(page);
+}
+#else
+static inline bool lru_gen_enabled(void)
+{
+	return false;
+}
+
+static inline bool page_lru_gen_young(struct page *page)
+{
+	return false;
+}
+
+static inline void lru_gen_clear_page(struct page *page)
+{
+}
+
+static inline void lru_gen_mark_page(struct page *page)
+{
+}
+
+static inline void lru_gen_add_page(struct page *page, int file)
+{
+}
+#endif
+
 #endif
@@ -95,6 +95,7 @@ enum pageflags {
 	PG_reclaim,		/* To be reclaimed asap */
 	PG_swapbacked,		/* Page is backed by RAM/swap */
 	PG_unevictable,		/* Page is "unevictable"  */
+	PG_readahead_unused,	/* Read ahead, not accessed yet */
 #ifdef CONFIG_MMU
 	PG_mlocked,		/* Page is vma mlocked */
 #endif
@@ -229,6 +230,8 @@ PAGEFLAG(MappedToDisk, mappedtodisk)
 /* PG_readahead is only used for file reads; PG_reclaim is only for writes */
 PAGEFLAG(Reclaim, reclaim) TESTCLEARFLAG(Reclaim, reclaim)
 PAGEFLAG(Readahead, reclaim)		/* Reminder to do async read-ahead */
+PAGEFLAG(ReadaheadUnused, readahead_unused) __SETPAGEFLAG(ReadaheadUnused,
+	readahead_unused) TESTCLEARFLAG(ReadaheadUnused, readahead_unused)
 
 #ifdef CONFIG_HIGHMEM
 /*
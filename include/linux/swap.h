@@ -171,6 +171,16 @@ enum {
 #define COUNT_CONTINUED	0x80	/* See swap_map continuation for full count */
 #define SWAP_MAP_SHMEM	0xbf	/* Owned by shmem/tmpfs, in first swap_map */
 
+/*
+ * Swap devices whose seeks are cheap are handed out in clusters of
+ * SWAPFILE_CLUSTER slots, one cluster per cpu at a time, so that swap
+ * writes stay sequential and cpus do not scan the same part of the map.
+ */
+struct swap_cluster_info {
+	struct list_head list;		/* on free_clusters while unused */
+	unsigned int count;		/* slots allocated, or bad */
+};
+
 /*
  * The in-memory structure used to track swap areas.
  */
@@ -189,11 +199,18 @@ struct swap_info_struct {
 	unsigned int cluster_nr;	/* countdown to next cluster search */
 	unsigned int lowest_alloc;	/* while preparing discard cluster */
 	unsigned int highest_alloc;	/* while preparing discard cluster */
+	struct swap_cluster_info *cluster_info; /* SSD only, else NULL */
+	struct list_head free_clusters;	/* clusters with no slot in use */
+	unsigned int __percpu *cluster_next_cpu; /* per-cpu cursor, SSD only */
 	struct swap_extent *curr_swap_extent;
 	struct swap_extent first_swap_extent;
 	struct block_device *bdev;	/* swap device or bdev of swap file */
 	struct file *swap_file;		/* seldom referenced */
 	unsigned int old_block_size;	/* seldom referenced */
+#ifdef CONFIG_FRONTSWAP
+	unsigned long *frontswap_map;	/* frontswap in-use, one bit per page */
+	atomic_t frontswap_pages;	/* frontswap pages in-use counter */
+#endif
 };
 
 struct swap_list_t {
@@ -215,6 +232,11 @@ extern unsigned int nr_free_pagecache_pages(void);
 #define nr_free_pages() global_page_state(NR_FREE_PAGES)
 
 
+/* linux/mm/workingset.c */
+void *workingset_eviction(struct address_space *mapping, struct page *page);
+bool workingset_refault(void *shadow);
+void workingset_activation(struct page *page);
+
 /* linux/mm/swap.c */
 extern void __lru_cache_add(struct page *, enum lru_list lru);
 extern void lru_cache_add_lru(struct page *, enum lru_list lru);
@@ -291,6 +313,18 @@ static inline void scan_unevictable_unregister_node(struct node *node)
 }
 #endif
 
+#ifdef CONFIG_LRU_GEN
+/*
+ * Generations of the multi-generation LRU.  A page is young if it was
+ * seen accessed in one of the MIN_NR_GENS most recent aging sequences.
+ */
+#define MAX_NR_GENS	7
+#define MIN_NR_GENS	2
+
+extern int lru_gen_enable;
+extern unsigned long lru_gen_max_seq;
+#endif
+
 extern int kswapd_run(int nid);
 extern void kswapd_stop(int nid);
 #ifdef CONFIG_CGROUP_MEM_RES_CTLR
@@ -336,15 +370,24 @@ extern int swap_duplicate(swp_entry_t);
 extern int swapcache_prepare(swp_entry_t);
 extern void swap_free(swp_entry_t);
 extern void swapcache_free(swp_entry_t, struct page *page);
+extern void swapcache_free_entries(swp_entry_t *entries, int n);
+extern int get_swap_pages(int n, swp_entry_t *entries);
+extern int __swap_count(swp_entry_t entry);
 extern int free_swap_and_cache(swp_entry_t);
 extern int swap_type_of(dev_t, sector_t, struct block_device **);
 extern unsigned int count_swap_pages(int, int);
 extern sector_t map_swap_page(struct page *, struct block_device **);
+extern struct swap_info_struct *page_swap_info(struct page *);
 extern sector_t swapdev_block(int, pgoff_t);
 extern int reuse_swap_page(struct page *);
 extern int try_to_free_swap(struct page *);
 struct backing_dev_info;
 
+/* linux/mm/swap_slots.c */
+#define SWAP_SLOTS_CACHE_SIZE	64
+extern void free_swap_slot(swp_entry_t entry);
+extern void drain_swap_slots_cache(void);
+
 /* linux/mm/thrash.c */
 extern struct mm_struct *swap_token_mm;
 extern void grab_swap_token(struct mm_struct *);
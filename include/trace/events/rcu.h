@@ -237,6 +237,35 @@ TRACE_EVENT(rcu_fqs,
 		  __entry->cpu, __entry->qsevent)
 );
 
+/*
+ * Tracepoint for the wakeups of the kthreads that invoke the callbacks
+ * of no-CBs CPUs.  These trace events include the type of RCU, the
+ * no-CBs CPU, and the reason, which can be "WakeEmpty" when a callback
+ * queued on an empty list wakes the kthread, "WakeNot" when the list
+ * already held callbacks so no wakeup was needed, or "WokeNonEmpty"
+ * when the kthread found callbacks to process.
+ */
+TRACE_EVENT(rcu_nocb_wake,
+
+	TP_PROTO(char *rcuname, int cpu, char *reason),
+
+	TP_ARGS(rcuname, cpu, reason),
+
+	TP_STRUCT__entry(
+		__field(char *, rcuname)
+		__field(int, cpu)
+		__field(char *, reason)
+	),
+
+	TP_fast_assign(
+		__entry->rcuname = rcuname;
+		__entry->cpu = cpu;
+		__entry->reason = reason;
+	),
+
+	TP_printk("%s %d %s", __entry->rcuname, __entry->cpu, __entry->reason)
+);
+
 #endif /* #if defined(CONFIG_TREE_RCU) || defined(CONFIG_TREE_PREEMPT_RCU) */
 
 /*
@@ -536,6 +565,7 @@ TRACE_EVENT(rcu_torture_read,
 #define trace_rcu_unlock_preempted_task(rcuname, gpnum, pid) do { } while (0)
 #define trace_rcu_quiescent_state_report(rcuname, gpnum, mask, qsmask, level, grplo, grphi, gp_tasks) do { } while (0)
 #define trace_rcu_fqs(rcuname, gpnum, cpu, qsevent) do { } while (0)
+#define trace_rcu_nocb_wake(rcuname, cpu, reason) do { } while (0)
 #define trace_rcu_dyntick(polarity, oldnesting, newnesting) do { } while (0)
 #define trace_rcu_prep_idle(reason) do { } while (0)
 #define trace_rcu_callback(rcuname, rhp, qlen) do { } while (0)
@@ -813,6 +813,9 @@ static int __init kernel_init(void * unused)
 
 	do_basic_setup();
 
+	/* The initramfs is unpacked in parallel with the initcalls */
+	wait_for_initramfs();
+
 	/* Open the /dev/console on the rootfs, this should never fail */
 	if (sys_open((const char __user *) "/dev/console", O_RDWR, 0) < 0)
 		printk(KERN_WARNING "Warning: unable to open an initial console.\n");
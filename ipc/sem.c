@@ -42,11 +42,14 @@
  * - scalability:
  *   - all global variables are read-mostly.
  *   - semop() calls and semctl(RMID) are synchronized by RCU.
- *   - most operations do write operations (actually: spin_lock calls) to
- *     the per-semaphore array structure.
- *   Thus: Perfect SMP scaling between independent semaphore arrays.
- *         If multiple semaphores in one array are used, then cache line
- *         trashing on the semaphore array spinlock will limit the scaling.
+ *   - semop() calls that operate on a single semaphore only take the
+ *     spinlock of that semaphore, as long as no complex (multi-sop)
+ *     operation is pending on the array. Everything else takes the
+ *     array spinlock and then waits until all per-semaphore lock holders
+ *     are gone (see sem_lock_ops()).
+ *   Thus: Perfect SMP scaling between independent semaphore arrays, and
+ *         between independent semaphores of one array as long as only
+ *         simple operations are used.
  * - semncnt and semzcnt are calculated on demand in count_semncnt() and
  *   count_semzcnt()
  * - the task that performs a successful semop() scans the list of all
@@ -71,6 +74,10 @@
  *   and per-semaphore list (stored in the array). This allows to achieve FIFO
  *   ordering without always scanning all pending operations.
  *   The worst-case behavior is nevertheless O(N^2) for N wakeups.
+ * - Simple operations are only linked into the per-array list while complex
+ *   operations are pending (see merge_queues()). While the array lock is not
+ *   held and complex_count is 0, the per-array list is empty and every
+ *   sleeper is found on exactly one per-semaphore list.
  */
 
 #include <linux/slab.h>
@@ -92,6 +99,7 @@
 
 /* One semaphore structure for each semaphore in the system. */
 struct sem {
+	spinlock_t	lock;	/* protects semval & co for simple semops */
 	int	semval;		/* current value */
 	int	sempid;		/* pid of last operation */
 	struct list_head sem_pending; /* pending single-sop operations */
@@ -138,11 +146,11 @@ struct sem_undo_list {
 
 #define sem_ids(ns)	((ns)->ids[IPC_SEM_IDS])
 
-#define sem_unlock(sma)		ipc_unlock(&(sma)->sem_perm)
 #define sem_checkid(sma, semid)	ipc_checkid(&sma->sem_perm, semid)
 
 static int newary(struct ipc_namespace *, struct ipc_params *);
 static void freeary(struct ipc_namespace *, struct kern_ipc_perm *);
+static void unmerge_queues(struct sem_array *sma);
 #ifdef CONFIG_PROC_FS
 static int sysvipc_sem_proc_show(struct seq_file *s, void *it);
 #endif
@@ -190,24 +198,67 @@ void __init sem_init (void)
 				IPC_SEM_IDS, sysvipc_sem_proc_show);
 }
 
+/*
+ * Wait until all currently ongoing simple ops have completed.
+ * Caller must own sem_perm.lock. New simple ops cannot start, because
+ * simple ops first check that sem_perm.lock is free.
+ */
+static void sem_wait_array(struct sem_array *sma)
+{
+	int i;
+
+	/* pairs with the smp_mb() in sem_lock_ops() */
+	smp_mb();
+	for (i = 0; i < sma->sem_nsems; i++)
+		spin_unlock_wait(&sma->sem_base[i].lock);
+}
+
 /*
  * sem_lock_(check_) routines are called in the paths where the rw_mutex
- * is not held.
+ * is not held. They lock the whole array.
  */
 static inline struct sem_array *sem_lock(struct ipc_namespace *ns, int id)
 {
 	struct kern_ipc_perm *ipcp = ipc_lock(&sem_ids(ns), id);
+	struct sem_array *sma;
 
 	if (IS_ERR(ipcp))
 		return (struct sem_array *)ipcp;
 
-	return container_of(ipcp, struct sem_array, sem_perm);
+	sma = container_of(ipcp, struct sem_array, sem_perm);
+	sem_wait_array(sma);
+	return sma;
 }
 
 static inline struct sem_array *sem_lock_check(struct ipc_namespace *ns,
 						int id)
 {
 	struct kern_ipc_perm *ipcp = ipc_lock_check(&sem_ids(ns), id);
+	struct sem_array *sma;
+
+	if (IS_ERR(ipcp))
+		return (struct sem_array *)ipcp;
+
+	sma = container_of(ipcp, struct sem_array, sem_perm);
+	sem_wait_array(sma);
+	return sma;
+}
+
+static inline void sem_unlock(struct sem_array *sma)
+{
+	unmerge_queues(sma);
+	ipc_unlock(&sma->sem_perm);
+}
+
+/*
+ * Look up a semaphore array without locking it. Must be called with
+ * rcu_read_lock() held; the caller locks with sem_lock_ops() and then
+ * checks sem_perm.deleted.
+ */
+static inline struct sem_array *
+sem_obtain_object_check(struct ipc_namespace *ns, int id)
+{
+	struct kern_ipc_perm *ipcp = ipc_obtain_object_check(&sem_ids(ns), id);
 
 	if (IS_ERR(ipcp))
 		return (struct sem_array *)ipcp;
@@ -215,9 +266,62 @@ static inline struct sem_array *sem_lock_check(struct ipc_namespace *ns,
 	return container_of(ipcp, struct sem_array, sem_perm);
 }
 
+/**
+ * sem_lock_ops - lock a semaphore array for a semop()
+ * @sma: semaphore array, obtained under rcu_read_lock()
+ * @sops: the operations that will be performed
+ * @nsops: number of operations
+ *
+ * A single-sop operation only takes the spinlock of the semaphore it works
+ * on, provided that no complex operation is pending and nobody holds the
+ * array lock. Everything else takes the array lock and waits for the
+ * per-semaphore lock holders to drain.
+ *
+ * Returns the number of the locked semaphore, or -1 if the whole array is
+ * locked. The result must be passed to sem_unlock_ops().
+ */
+static int sem_lock_ops(struct sem_array *sma, struct sembuf *sops, int nsops)
+{
+	if (nsops == 1 && !sma->complex_count) {
+		struct sem *sem = sma->sem_base + sops->sem_num;
+
+		spin_lock(&sem->lock);
+		/*
+		 * The store to sem->lock must be visible before we look at
+		 * sem_perm.lock, pairs with the smp_mb() in sem_wait_array().
+		 */
+		smp_mb();
+		if (!spin_is_locked(&sma->sem_perm.lock)) {
+			/*
+			 * complex_count is only changed under sem_perm.lock:
+			 * read it after we saw the lock free.
+			 */
+			smp_rmb();
+			if (!sma->complex_count)
+				return sops->sem_num;
+		}
+		spin_unlock(&sem->lock);
+	}
+
+	spin_lock(&sma->sem_perm.lock);
+	sem_wait_array(sma);
+	return -1;
+}
+
+static inline void sem_unlock_ops(struct sem_array *sma, int locknum)
+{
+	if (locknum == -1) {
+		unmerge_queues(sma);
+		spin_unlock(&sma->sem_perm.lock);
+	} else {
+		spin_unlock(&sma->sem_base[locknum].lock);
+	}
+}
+
 static inline void sem_lock_and_putref(struct sem_array *sma)
 {
 	ipc_lock_by_ptr(&sma->sem_perm);
+	sem_wait_array(sma);
 	ipc_rcu_putref(sma);
 }
 
@@ -324,8 +428,10 @@ static int newary(struct ipc_namespace *ns, struct ipc_params *params)
 
 	sma->sem_base = (struct sem *) &sma[1];
 
-	for (i = 0; i < nsems; i++)
+	for (i = 0; i < nsems; i++) {
+		spin_lock_init(&sma->sem_base[i].lock);
 		INIT_LIST_HEAD(&sma->sem_base[i].sem_pending);
+	}
 
 	sma->complex_count = 0;
 	INIT_LIST_HEAD(&sma->sem_pending);
@@ -508,6 +614,48 @@ static void unlink_queue(struct sem_array *sma, struct sem_queue *q)
 		sma->complex_count--;
 }
 
+/**
+ * merge_queues - link all simple operations into the per-array list
+ * @sma: semaphore array
+ *
+ * Called with the array lock held before the first complex operation is
+ * queued: from then on update_queue() scans the per-array list and needs
+ * to see every sleeper. Ordering between different semaphores is lost,
+ * the per-semaphore FIFO order is kept.
+ */
+static void merge_queues(struct sem_array *sma)
+{
+	struct sem_queue *q;
+	int i;
+
+	for (i = 0; i < sma->sem_nsems; i++) {
+		struct sem *sem = sma->sem_base + i;
+
+		list_for_each_entry(q, &sem->sem_pending, simple_list) {
+			if (list_empty(&q->list))
+				list_add_tail(&q->list, &sma->sem_pending);
+		}
+	}
+}
+
+/**
+ * unmerge_queues - undo merge_queues() once no complex operation is left
+ * @sma: semaphore array
+ *
+ * Called before the array lock is dropped, so that simple operations that
+ * only hold a per-semaphore lock never touch the per-array list.
+ */
+static void unmerge_queues(struct sem_array *sma)
+{
+	struct sem_queue *q, *tq;
+
+	if (sma->complex_count)
+		return;
+
+	list_for_each_entry_safe(q, tq, &sma->sem_pending, list)
+		list_del_init(&q->list);
+}
+
 /** check_restart(sma, q)
  * @sma: semaphore array
  * @q: the operation that just completed
@@ -597,8 +745,16 @@ static int update_queue(struct sem_array *sma, int semnum, struct list_head *pt)
 	 * that was modified doesn't help us. Assume that multiple semaphores
 	 * were modified.
 	 */
-	if (sma->complex_count)
+	if (sma->complex_count) {
 		semnum = -1;
+	} else if (semnum == -1) {
+		/* Only simple operations: each sleeper waits on one semaphore */
+		for (semnum = 0; semnum < sma->sem_nsems; semnum++) {
+			if (update_queue(sma, semnum, pt))
+				semop_completed = 1;
+		}
+		return semop_completed;
+	}
 
 	if (semnum == -1) {
 		pending_list = &sma->sem_pending;
@@ -683,8 +839,19 @@ static void do_smart_update(struct sem_array *sma, struct sembuf *sops, int nsop
 				otime = 1;
 	}
 done:
-	if (otime)
-		sma->sem_otime = get_seconds();
+	if (otime) {
+		time_t now = get_seconds();
+
+		/*
+		 * Simple semops on different semaphores get here holding
+		 * only their own semaphore's lock, so they race to update
+		 * sem_otime.  It is a single word and they all store the
+		 * current time, so whichever store lands last is right;
+		 * skip it when unchanged to keep the line from bouncing.
+		 */
+		if (ACCESS_ONCE(sma->sem_otime) != now)
+			ACCESS_ONCE(sma->sem_otime) = now;
+	}
 }
 
 
@@ -703,10 +870,18 @@ static int count_semncnt (struct sem_array * sma, ushort semnum)
 	struct sem_queue * q;
 
 	semncnt = 0;
+	list_for_each_entry(q, &sma->sem_base[semnum].sem_pending, simple_list) {
+		struct sembuf * sops = q->sops;
+		if ((sops->sem_op < 0) && !(sops->sem_flg & IPC_NOWAIT))
+			semncnt++;
+	}
 	list_for_each_entry(q, &sma->sem_pending, list) {
 		struct sembuf * sops = q->sops;
 		int nsops = q->nsops;
 		int i;
+		/* simple operations were counted above */
+		if (nsops == 1)
+			continue;
 		for (i = 0; i < nsops; i++)
 			if (sops[i].sem_num == semnum
 			    && (sops[i].sem_op < 0)
@@ -722,10 +897,18 @@ static int count_semzcnt (struct sem_array * sma, ushort semnum)
 	struct sem_queue * q;
 
 	semzcnt = 0;
+	list_for_each_entry(q, &sma->sem_base[semnum].sem_pending, simple_list) {
+		struct sembuf * sops = q->sops;
+		if ((sops->sem_op == 0) && !(sops->sem_flg & IPC_NOWAIT))
+			semzcnt++;
+	}
 	list_for_each_entry(q, &sma->sem_pending, list) {
 		struct sembuf * sops = q->sops;
 		int nsops = q->nsops;
 		int i;
+		/* simple operations were counted above */
+		if (nsops == 1)
+			continue;
 		for (i = 0; i < nsops; i++)
 			if (sops[i].sem_num == semnum
 			    && (sops[i].sem_op == 0)
@@ -745,9 +928,11 @@ static void freeary(struct ipc_namespace *ns, struct kern_ipc_perm *ipcp)
 	struct sem_queue *q, *tq;
 	struct sem_array *sma = container_of(ipcp, struct sem_array, sem_perm);
 	struct list_head tasks;
+	int i;
 
 	/* Free the existing undo structures for this semaphore set.  */
 	assert_spin_locked(&sma->sem_perm.lock);
+	sem_wait_array(sma);
 	list_for_each_entry_safe(un, tu, &sma->list_id, list_id) {
 		list_del(&un->list_id);
 		spin_lock(&un->ulp->lock);
@@ -763,6 +948,14 @@ static void freeary(struct ipc_namespace *ns, struct kern_ipc_perm *ipcp)
 		unlink_queue(sma, q);
 		wake_up_sem_queue_prepare(&tasks, q, -EIDRM);
 	}
+	for (i = 0; i < sma->sem_nsems; i++) {
+		struct sem *sem = sma->sem_base + i;
+
+		list_for_each_entry_safe(q, tq, &sem->sem_pending, simple_list) {
+			unlink_queue(sma, q);
+			wake_up_sem_queue_prepare(&tasks, q, -EIDRM);
+		}
+	}
 
 	/* Remove the semaphore set from the IDR */
 	sem_rmid(ns, sma);
@@ -1094,6 +1287,7 @@ static int semctl_down(struct ipc_namespace *ns, int semid,
 		return PTR_ERR(ipcp);
 
 	sma = container_of(ipcp, struct sem_array, sem_perm);
+	sem_wait_array(sma);
 
 	err = security_sem_semctl(sma, cmd);
 	if (err)
@@ -1335,7 +1529,7 @@ SYSCALL_DEFINE4(semtimedop, int, semid, struct sembuf __user *, tsops,
 	struct sembuf fast_sops[SEMOPM_FAST];
 	struct sembuf* sops = fast_sops, *sop;
 	struct sem_undo *un;
-	int undos = 0, alter = 0, max;
+	int undos = 0, alter = 0, max, locknum;
 	struct sem_queue queue;
 	unsigned long jiffies_left = 0;
 	struct ipc_namespace *ns;
@@ -1390,14 +1584,27 @@ SYSCALL_DEFINE4(semtimedop, int, semid, struct sembuf __user *, tsops,
 
 	INIT_LIST_HEAD(&tasks);
 
-	sma = sem_lock_check(ns, semid);
+	rcu_read_lock();
+	sma = sem_obtain_object_check(ns, semid);
 	if (IS_ERR(sma)) {
+		rcu_read_unlock();
 		if (un)
 			rcu_read_unlock();
 		error = PTR_ERR(sma);
 		goto out_free;
 	}
 
+	/* sem_nsems never changes: check it before sem_lock_ops() uses it */
+	error = -EFBIG;
+	if (max >= sma->sem_nsems) {
+		rcu_read_unlock();
+		if (un)
+			rcu_read_unlock();
+		goto out_free;
+	}
+
+	locknum = sem_lock_ops(sma, sops, nsops);
+
 	/*
 	 * semid identifiers are not unique - find_alloc_undo may have
 	 * allocated an undo structure, it was invalidated by an RMID
@@ -1413,7 +1620,7 @@ SYSCALL_DEFINE4(semtimedop, int, semid, struct sembuf __user *, tsops,
 		} else {
 			/*
 			 * rcu lock can be released, "un" cannot disappear:
-			 * - sem_lock is acquired, thus IPC_RMID is
+			 * - sem_lock_ops() is done, thus IPC_RMID is
 			 *   impossible.
 			 * - exit_sem is impossible, it always operates on
 			 *   current (or a dead task).
@@ -1423,8 +1630,7 @@ SYSCALL_DEFINE4(semtimedop, int, semid, struct sembuf __user *, tsops,
 		}
 	}
 
-	error = -EFBIG;
-	if (max >= sma->sem_nsems)
+	if (sma->sem_perm.deleted)
 		goto out_unlock_free;
 
 	error = -EACCES;
@@ -1452,10 +1658,6 @@ SYSCALL_DEFINE4(semtimedop, int, semid, struct sembuf __user *, tsops,
 	queue.undo = un;
 	queue.pid = task_tgid_vnr(current);
 	queue.alter = alter;
-	if (alter)
-		list_add_tail(&queue.list, &sma->sem_pending);
-	else
-		list_add(&queue.list, &sma->sem_pending);
 
 	if (nsops == 1) {
 		struct sem *curr;
@@ -1465,7 +1667,24 @@ SYSCALL_DEFINE4(semtimedop, int, semid, struct sembuf __user *, tsops,
 			list_add_tail(&queue.simple_list, &curr->sem_pending);
 		else
 			list_add(&queue.simple_list, &curr->sem_pending);
+
+		/*
+		 * The per-array list is only maintained while complex
+		 * operations are pending, and then we hold the array lock.
+		 */
+		if (!sma->complex_count)
+			INIT_LIST_HEAD(&queue.list);
+		else if (alter)
+			list_add_tail(&queue.list, &sma->sem_pending);
+		else
+			list_add(&queue.list, &sma->sem_pending);
 	} else {
+		if (!sma->complex_count)
+			merge_queues(sma);
+		if (alter)
+			list_add_tail(&queue.list, &sma->sem_pending);
+		else
+			list_add(&queue.list, &sma->sem_pending);
 		INIT_LIST_HEAD(&queue.simple_list);
 		sma->complex_count++;
 	}
@@ -1475,7 +1694,8 @@ SYSCALL_DEFINE4(semtimedop, int, semid, struct sembuf __user *, tsops,
 
 sleep_again:
 	current->state = TASK_INTERRUPTIBLE;
-	sem_unlock(sma);
+	sem_unlock_ops(sma, locknum);
+	rcu_read_unlock();
 
 	if (timeout)
 		jiffies_left = schedule_timeout(jiffies_left);
@@ -1497,7 +1717,15 @@ sleep_again:
 		goto out_free;
 	}
 
-	sma = sem_lock(ns, semid);
+	rcu_read_lock();
+	sma = sem_obtain_object_check(ns, semid);
+	if (!IS_ERR(sma)) {
+		locknum = sem_lock_ops(sma, sops, nsops);
+		if (sma->sem_perm.deleted) {
+			sem_unlock_ops(sma, locknum);
+			sma = ERR_PTR(-EIDRM);
+		}
+	}
 
 	/*
 	 * Wait until it's guaranteed that no wakeup_sem_queue_do() is ongoing.
@@ -1505,9 +1733,10 @@ sleep_again:
 	error = get_queue_result(&queue);
 
 	/*
-	 * Array removed? If yes, leave without sem_unlock().
+	 * Array removed? If yes, leave without sem_unlock_ops().
 	 */
 	if (IS_ERR(sma)) {
+		rcu_read_unlock();
 		goto out_free;
 	}
 
@@ -1536,7 +1765,8 @@ sleep_again:
 	unlink_queue(sma, &queue);
 
 out_unlock_free:
-	sem_unlock(sma);
+	sem_unlock_ops(sma, locknum);
+	rcu_read_unlock();
 
 	wake_up_sem_queue_do(&tasks);
 out_free:
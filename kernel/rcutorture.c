@@ -46,6 +46,7 @@
 #include <linux/stat.h>
 #include <linux/srcu.h>
 #include <linux/slab.h>
+#include <linux/vmalloc.h>
 #include <asm/byteorder.h>
 
 MODULE_LICENSE("GPL");
@@ -64,6 +65,10 @@ static int irqreader = 1;	/* RCU readers from irq (timers). */
 static int fqs_duration;	/* Duration of bursts (us), 0 to disable. */
 static int fqs_holdoff;		/* Hold time within burst (us). */
 static int fqs_stutter = 3;	/* Wait time between bursts (s). */
+static int cbflood_n_burst;	/* # bursts per callback flood, 0=disable. */
+static int cbflood_n_per_burst = 20000; /* # callbacks per burst. */
+static int cbflood_inter_holdoff = HZ; /* Wait between floods (jiffies). */
+static int cbflood_intra_holdoff = 1; /* Wait between bursts (jiffies). */
 static int onoff_interval;	/* Wait time between CPU hotplugs, 0=disable. */
 static int shutdown_secs;	/* Shutdown time (s).  <=0 for no shutdown. */
 static int test_boost = 1;	/* Test RCU prio boost: 0=no, 1=maybe, 2=yes. */
@@ -93,6 +98,14 @@ module_param(fqs_holdoff, int, 0444);
 MODULE_PARM_DESC(fqs_holdoff, "Holdoff time within fqs bursts (us)");
 module_param(fqs_stutter, int, 0444);
 MODULE_PARM_DESC(fqs_stutter, "Wait time between fqs bursts (s)");
+module_param(cbflood_n_burst, int, 0444);
+MODULE_PARM_DESC(cbflood_n_burst, "# bursts in flood, 0 to disable");
+module_param(cbflood_n_per_burst, int, 0444);
+MODULE_PARM_DESC(cbflood_n_per_burst, "# callbacks per burst in flood");
+module_param(cbflood_inter_holdoff, int, 0444);
+MODULE_PARM_DESC(cbflood_inter_holdoff, "Holdoff between floods (jiffies)");
+module_param(cbflood_intra_holdoff, int, 0444);
+MODULE_PARM_DESC(cbflood_intra_holdoff, "Holdoff between bursts (jiffies)");
 module_param(onoff_interval, int, 0444);
 MODULE_PARM_DESC(onoff_interval, "Time between CPU hotplugs (s), 0=disable");
 module_param(shutdown_secs, int, 0444);
@@ -124,6 +137,7 @@ static struct task_struct *stats_task;
 static struct task_struct *shuffler_task;
 static struct task_struct *stutter_task;
 static struct task_struct *fqs_task;
+static struct task_struct *cbflood_task;
 static struct task_struct *boost_tasks[NR_CPUS];
 static struct task_struct *shutdown_task;
 #ifdef CONFIG_HOTPLUG_CPU
@@ -159,6 +173,9 @@ static long n_rcu_torture_boost_rterror;
 static long n_rcu_torture_boost_failure;
 static long n_rcu_torture_boosts;
 static long n_rcu_torture_timers;
+static long n_cbfloods;
+static atomic_long_t n_cbflood_invoked;
+static long n_cbflood_lost;
 static long n_offline_attempts;
 static long n_offline_successes;
 static long n_online_attempts;
@@ -318,6 +335,7 @@ struct rcu_torture_ops {
 	void (*deferred_free)(struct rcu_torture *p);
 	void (*sync)(void);
 	void (*cb_barrier)(void);
+	void (*call)(struct rcu_head *head, void (*func)(struct rcu_head *rcu));
 	void (*fqs)(void);
 	int (*stats)(char *page);
 	int irq_capable;
@@ -408,6 +426,7 @@ static struct rcu_torture_ops rcu_ops = {
 	.deferred_free	= rcu_torture_deferred_free,
 	.sync		= synchronize_rcu,
 	.cb_barrier	= rcu_barrier,
+	.call		= call_rcu,
 	.fqs		= rcu_force_quiescent_state,
 	.stats		= NULL,
 	.irq_capable	= 1,
@@ -510,6 +529,7 @@ static struct rcu_torture_ops rcu_bh_ops = {
 	.deferred_free	= rcu_bh_torture_deferred_free,
 	.sync		= synchronize_rcu_bh,
 	.cb_barrier	= rcu_barrier_bh,
+	.call		= call_rcu_bh,
 	.fqs		= rcu_bh_force_quiescent_state,
 	.stats		= NULL,
 	.irq_capable	= 1,
@@ -705,6 +725,7 @@ static struct rcu_torture_ops sched_ops = {
 	.deferred_free	= rcu_sched_torture_deferred_free,
 	.sync		= synchronize_sched,
 	.cb_barrier	= rcu_barrier_sched,
+	.call		= call_rcu_sched,
 	.fqs		= rcu_sched_force_quiescent_state,
 	.stats		= NULL,
 	.irq_capable	= 1,
@@ -883,6 +904,59 @@ rcu_torture_fqs(void *arg)
 	return 0;
 }
 
+static void rcu_torture_cbflood_cb(struct rcu_head *rhp)
+{
+	atomic_long_inc(&n_cbflood_invoked);
+}
+
+/*
+ * RCU torture callback-flood kthread.  Repeatedly posts bursts of
+ * callbacks, as a mass file deletion or a route flap would, then waits
+ * for them with ->cb_barrier() and checks that every one of them was
+ * invoked.  This exercises callback throttling and, on CPUs whose
+ * callbacks are offloaded (rcu_nocbs=), the offload kthreads.
+ */
+static int
+rcu_torture_cbflood(void *arg)
+{
+	int i;
+	int j;
+	long expected;
+	struct rcu_head *rhp;
+
+	rhp = vmalloc(sizeof(*rhp) * cbflood_n_burst * cbflood_n_per_burst);
+	if (rhp == NULL) {
+		VERBOSE_PRINTK_ERRSTRING("rcu_torture_cbflood: out of memory");
+		goto wait_for_stop;
+	}
+	VERBOSE_PRINTK_STRING("rcu_torture_cbflood task started");
+	do {
+		schedule_timeout_interruptible(cbflood_inter_holdoff);
+		expected = atomic_long_read(&n_cbflood_invoked) +
+			   cbflood_n_burst * cbflood_n_per_burst;
+		for (i = 0; i < cbflood_n_burst; i++) {
+			for (j = 0; j < cbflood_n_per_burst; j++)
+				cur_ops->call(&rhp[i * cbflood_n_per_burst + j],
+					      rcu_torture_cbflood_cb);
+			schedule_timeout_interruptible(cbflood_intra_holdoff);
+		}
+		cur_ops->cb_barrier();
+		n_cbfloods++;
+		if (atomic_long_read(&n_cbflood_invoked) != expected) {
+			n_cbflood_lost++;
+			atomic_inc(&n_rcu_torture_error);
+		}
+		rcu_stutter_wait("rcu_torture_cbflood");
+	} while (!kthread_should_stop() && fullstop == FULLSTOP_DONTSTOP);
+	vfree(rhp);
+wait_for_stop:
+	VERBOSE_PRINTK_STRING("rcu_torture_cbflood task stopping");
+	rcutorture_shutdown_absorb("rcu_torture_cbflood");
+	while (!kthread_should_stop())
+		schedule_timeout_uninterruptible(1);
+	return 0;
+}
+
 /*
  * RCU torture writer kthread.  Repeatedly substitutes a new structure
  * for that pointed to by rcu_torture_current, freeing the old structure
@@ -1119,7 +1193,7 @@ rcu_torture_printk(char *page)
 		       "rtc: %p ver: %lu tfle: %d rta: %d rtaf: %d rtf: %d "
 		       "rtmbe: %d rtbke: %ld rtbre: %ld "
 		       "rtbf: %ld rtb: %ld nt: %ld "
-		       "onoff: %ld/%ld:%ld/%ld",
+		       "onoff: %ld/%ld:%ld/%ld cbf: %ld/%ld",
 		       rcu_torture_current,
 		       rcu_torture_current_version,
 		       list_empty(&rcu_torture_freelist),
@@ -1135,8 +1209,11 @@ rcu_torture_printk(char *page)
 		       n_online_successes,
 		       n_online_attempts,
 		       n_offline_successes,
-		       n_offline_attempts);
+		       n_offline_attempts,
+		       n_cbfloods,
+		       n_cbflood_lost);
 	if (atomic_read(&n_rcu_torture_mberror) != 0 ||
+	    n_cbflood_lost != 0 ||
 	    n_rcu_torture_boost_ktrerror != 0 ||
 	    n_rcu_torture_boost_rterror != 0 ||
 	    n_rcu_torture_boost_failure != 0)
@@ -1300,13 +1377,16 @@ rcu_torture_print_module_parms(struct rcu_torture_ops *cur_ops, char *tag)
 		"fqs_duration=%d fqs_holdoff=%d fqs_stutter=%d "
 		"test_boost=%d/%d test_boost_interval=%d "
 		"test_boost_duration=%d shutdown_secs=%d "
-		"onoff_interval=%d\n",
+		"onoff_interval=%d cbflood_n_burst=%d "
+		"cbflood_n_per_burst=%d cbflood_inter_holdoff=%d "
+		"cbflood_intra_holdoff=%d\n",
 		torture_type, tag, nrealreaders, nfakewriters,
 		stat_interval, verbose, test_no_idle_hz, shuffle_interval,
 		stutter, irqreader, fqs_duration, fqs_holdoff, fqs_stutter,
 		test_boost, cur_ops->can_boost,
 		test_boost_interval, test_boost_duration, shutdown_secs,
-		onoff_interval);
+		onoff_interval, cbflood_n_burst, cbflood_n_per_burst,
+		cbflood_inter_holdoff, cbflood_intra_holdoff);
 }
 
 static struct notifier_block rcutorture_shutdown_nb = {
@@ -1579,6 +1659,11 @@ rcu_torture_cleanup(void)
 		kthread_stop(fqs_task);
 	}
 	fqs_task = NULL;
+	if (cbflood_task) {
+		VERBOSE_PRINTK_STRING("Stopping rcu_torture_cbflood task");
+		kthread_stop(cbflood_task);
+	}
+	cbflood_task = NULL;
 	if ((test_boost == 1 && cur_ops->can_boost) ||
 	    test_boost == 2) {
 		unregister_cpu_notifier(&rcutorture_cpu_nb);
@@ -1641,6 +1726,13 @@ rcu_torture_init(void)
 				  "fqs_duration, fqs disabled.\n");
 		fqs_duration = 0;
 	}
+	if ((cur_ops->call == NULL || cur_ops->cb_barrier == NULL) &&
+	    cbflood_n_burst != 0) {
+		printk(KERN_ALERT "rcu-torture: ->call or ->cb_barrier NULL "
+				  "and non-zero cbflood_n_burst, "
+				  "cbflood disabled.\n");
+		cbflood_n_burst = 0;
+	}
 	if (cur_ops->init)
 		cur_ops->init(); /* no "goto unwind" prior to this point!!! */
 
@@ -1673,6 +1765,9 @@ rcu_torture_init(void)
 	n_rcu_torture_boost_rterror = 0;
 	n_rcu_torture_boost_failure = 0;
 	n_rcu_torture_boosts = 0;
+	n_cbfloods = 0;
+	atomic_long_set(&n_cbflood_invoked, 0);
+	n_cbflood_lost = 0;
 	for (i = 0; i < RCU_TORTURE_PIPE_LEN + 1; i++)
 		atomic_set(&rcu_torture_wcount[i], 0);
 	for_each_possible_cpu(cpu) {
@@ -1786,6 +1881,22 @@ rcu_torture_init(void)
 			goto unwind;
 		}
 	}
+	if (cbflood_n_per_burst < 1)
+		cbflood_n_per_burst = 1;
+	if (cbflood_inter_holdoff < 1)
+		cbflood_inter_holdoff = 1;
+	if (cbflood_intra_holdoff < 1)
+		cbflood_intra_holdoff = 1;
+	if (cbflood_n_burst > 0) {
+		cbflood_task = kthread_run(rcu_torture_cbflood, NULL,
+					   "rcu_torture_cbflood");
+		if (IS_ERR(cbflood_task)) {
+			firsterr = PTR_ERR(cbflood_task);
+			VERBOSE_PRINTK_ERRSTRING("Failed to create cbflood");
+			cbflood_task = NULL;
+			goto unwind;
+		}
+	}
 	if (test_boost_interval < 1)
 		test_boost_interval = 1;
 	if (test_boost_duration < 2)
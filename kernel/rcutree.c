@@ -1700,9 +1700,15 @@ static void invoke_rcu_core(void)
 	raise_softirq(RCU_SOFTIRQ);
 }
 
+/*
+ * Queue a callback on the current CPU.  Callbacks queued on a no-CBs
+ * CPU are handed to its offload kthread, unless @local asks for them to
+ * stay on the CPU's own list, as the offload kthreads' own grace-period
+ * waits must to avoid waiting on one another.
+ */
 static void
 __call_rcu(struct rcu_head *head, void (*func)(struct rcu_head *rcu),
-	   struct rcu_state *rsp)
+	   struct rcu_state *rsp, bool local)
 {
 	unsigned long flags;
 	struct rcu_data *rdp;
@@ -1722,6 +1728,13 @@ __call_rcu(struct rcu_head *head, void (*func)(struct rcu_head *rcu),
 	local_irq_save(flags);
 	rdp = this_cpu_ptr(rsp->rda);
 
+	/* Offloaded CPUs leave grace-period handling to the kthread. */
+	if (!local && rcu_is_nocb_cpu(rdp->cpu)) {
+		__call_rcu_nocb(rdp, head);
+		local_irq_restore(flags);
+		return;
+	}
+
 	/* Add the callback to our list. */
 	*rdp->nxttail[RCU_NEXT_TAIL] = head;
 	rdp->nxttail[RCU_NEXT_TAIL] = &head->next;
@@ -1778,7 +1791,7 @@ __call_rcu(struct rcu_head *head, void (*func)(struct rcu_head *rcu),
  */
 void call_rcu_sched(struct rcu_head *head, void (*func)(struct rcu_head *rcu))
 {
-	__call_rcu(head, func, &rcu_sched_state);
+	__call_rcu(head, func, &rcu_sched_state, false);
 }
 EXPORT_SYMBOL_GPL(call_rcu_sched);
 
@@ -1787,7 +1800,7 @@ EXPORT_SYMBOL_GPL(call_rcu_sched);
  */
 void call_rcu_bh(struct rcu_head *head, void (*func)(struct rcu_head *rcu))
 {
-	__call_rcu(head, func, &rcu_bh_state);
+	__call_rcu(head, func, &rcu_bh_state, false);
 }
 EXPORT_SYMBOL_GPL(call_rcu_bh);
 
@@ -1935,6 +1948,18 @@ static int rcu_cpu_has_callbacks(int cpu)
 	       rcu_preempt_needs_cpu(cpu);
 }
 
+#ifdef CONFIG_NO_HZ_FULL
+/*
+ * Check to see if a full dynticks CPU must keep its scheduling-clock
+ * interrupt, returning 1 if so: RCU is waiting on it for a quiescent
+ * state, or it has callbacks, and both are driven from the tick.
+ */
+int rcu_nohz_full_cpu_has_work(int cpu)
+{
+	return rcu_pending(cpu) || rcu_cpu_has_callbacks(cpu);
+}
+#endif /* #ifdef CONFIG_NO_HZ_FULL */
+
 static DEFINE_PER_CPU(struct rcu_head, rcu_barrier_head) = {NULL};
 static atomic_t rcu_barrier_cpu_count;
 static DEFINE_MUTEX(rcu_barrier_mutex);
@@ -2033,6 +2058,7 @@ rcu_boot_init_percpu_data(int cpu, struct rcu_state *rsp)
 	WARN_ON_ONCE(atomic_read(&rdp->dynticks->dynticks) != 1);
 	rdp->cpu = cpu;
 	rdp->rsp = rsp;
+	rcu_boot_init_nocb_percpu_data(rdp);
 	raw_spin_unlock_irqrestore(&rnp->lock, flags);
 }
 
@@ -348,8 +348,12 @@ void irq_exit(void)
 		invoke_softirq();
 
 #ifdef CONFIG_NO_HZ
-	/* Make sure that timer wheel updates are propagated */
-	if (idle_cpu(smp_processor_id()) && !in_interrupt() && !need_resched())
+	/*
+	 * Make sure that timer wheel updates are propagated, and let full
+	 * dynticks CPUs re-evaluate whether they still need the tick.
+	 */
+	if (!in_interrupt() && (tick_nohz_full_cpu(smp_processor_id()) ||
+	    (idle_cpu(smp_processor_id()) && !need_resched())))
 		tick_nohz_irq_exit();
 #endif
 	rcu_irq_exit();
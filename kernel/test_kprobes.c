@@ -17,6 +17,7 @@
 #include <linux/kernel.h>
 #include <linux/kprobes.h>
 #include <linux/random.h>
+#include <linux/delay.h>
 
 #define div_factor 3
 
@@ -241,6 +242,87 @@ static int test_jprobes(void)
 
 	return 0;
 }
+#ifdef CONFIG_OPTPROBES
+static u32 opth_val;
+
+static int opt_kp_pre_handler(struct kprobe *p, struct pt_regs *regs)
+{
+	opth_val = (rand1 / div_factor);
+	return 0;
+}
+
+/* No post_handler, so that the probe can be jump optimized */
+static struct kprobe okp = {
+	.symbol_name = "kprobe_target",
+	.pre_handler = opt_kp_pre_handler
+};
+
+/* Return true once the optimizer has replaced the breakpoint by a jump */
+static bool optprobe_is_optimized(struct kprobe *p)
+{
+	struct optimized_kprobe *op;
+	struct kprobe *ap;
+	bool ret = false;
+
+	preempt_disable();
+	ap = get_kprobe(p->addr);
+	if (ap && (ap->flags & KPROBE_FLAG_OPTIMIZED)) {
+		op = container_of(ap, struct optimized_kprobe, kp);
+		ret = list_empty(&op->list);
+	}
+	preempt_enable();
+
+	return ret;
+}
+
+static int test_optprobe(void)
+{
+	int ret, i;
+
+	ret = register_kprobe(&okp);
+	if (ret < 0) {
+		printk(KERN_ERR "Kprobe smoke test failed: "
+				"register_kprobe (optprobe) returned %d\n", ret);
+		return ret;
+	}
+
+	/* Optimization is done asynchronously by the kprobe optimizer */
+	for (i = 0; i < 100 && !optprobe_is_optimized(&okp); i++)
+		msleep(10);
+	if (!optprobe_is_optimized(&okp)) {
+		printk(KERN_ERR "Kprobe smoke test failed: "
+				"probe at %pS not optimized\n", okp.addr);
+		handler_errors++;
+	}
+
+	opth_val = 0;
+	ret = target(rand1);
+	if (opth_val == 0) {
+		printk(KERN_ERR "Kprobe smoke test failed: "
+				"optprobe pre_handler not called\n");
+		handler_errors++;
+	}
+	if (ret != (rand1 / div_factor)) {
+		printk(KERN_ERR "Kprobe smoke test failed: "
+				"incorrect return value with optprobe\n");
+		handler_errors++;
+	}
+
+	unregister_kprobe(&okp);
+
+	/* The original instruction must be back in place */
+	opth_val = 0;
+	ret = target(rand1);
+	if (opth_val != 0 || ret != (rand1 / div_factor)) {
+		printk(KERN_ERR "Kprobe smoke test failed: "
+				"optprobe still active after unregistration\n");
+		handler_errors++;
+	}
+
+	return 0;
+}
+#endif /* CONFIG_OPTPROBES */
+
 #ifdef CONFIG_KRETPROBES
 static u32 krph_val;
 
@@ -389,6 +471,13 @@ int init_test_probes(void)
 	if (ret < 0)
 		errors++;
 
+#ifdef CONFIG_OPTPROBES
+	num_tests++;
+	ret = test_optprobe();
+	if (ret < 0)
+		errors++;
+#endif /* CONFIG_OPTPROBES */
+
 #ifdef CONFIG_KRETPROBES
 	num_tests++;
 	ret = test_kretprobe();
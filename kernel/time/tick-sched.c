@@ -20,6 +20,10 @@
 #include <linux/profile.h>
 #include <linux/sched.h>
 #include <linux/module.h>
+#include <linux/bootmem.h>
+#include <linux/posix-timers.h>
+
+#include <trace/events/timer.h>
 
 #include <asm/irq_regs.h>
 
@@ -123,6 +127,37 @@ static int __init setup_tick_nohz(char *str)
 
 __setup("nohz=", setup_tick_nohz);
 
+#ifdef CONFIG_NO_HZ_FULL
+cpumask_var_t tick_nohz_full_mask;
+bool tick_nohz_full_running;
+
+/*
+ * Parse the boot-time nohz_full= CPU list. The boot CPU keeps its tick
+ * and the timekeeping duty for the full dynticks CPUs.
+ */
+static int __init tick_nohz_full_setup(char *str)
+{
+	int cpu;
+
+	alloc_bootmem_cpumask_var(&tick_nohz_full_mask);
+	if (cpulist_parse(str, tick_nohz_full_mask) < 0) {
+		printk(KERN_WARNING "NOHZ: Incorrect nohz_full cpumask\n");
+		return 1;
+	}
+
+	cpu = smp_processor_id();
+	if (cpumask_test_cpu(cpu, tick_nohz_full_mask)) {
+		printk(KERN_WARNING "NOHZ: Clearing %d from nohz_full range "
+		       "for timekeeping\n", cpu);
+		cpumask_clear_cpu(cpu, tick_nohz_full_mask);
+	}
+	tick_nohz_full_running = true;
+
+	return 1;
+}
+__setup("nohz_full=", tick_nohz_full_setup);
+#endif
+
 /**
  * tick_nohz_update_jiffies - update jiffies when idle was interrupted
  *
@@ -275,49 +310,14 @@ u64 get_cpu_iowait_time_us(int cpu, u64 *last_update_time)
 }
 EXPORT_SYMBOL_GPL(get_cpu_iowait_time_us);
 
-static void tick_nohz_stop_sched_tick(struct tick_sched *ts)
+static void tick_nohz_stop_sched_tick(struct tick_sched *ts, ktime_t now,
+				      int cpu)
 {
 	unsigned long seq, last_jiffies, next_jiffies, delta_jiffies;
-	ktime_t last_update, expires, now;
+	ktime_t last_update, expires;
 	struct clock_event_device *dev = __get_cpu_var(tick_cpu_device).evtdev;
 	u64 time_delta;
-	int cpu;
-
-	cpu = smp_processor_id();
-	ts = &per_cpu(tick_cpu_sched, cpu);
-
-	now = tick_nohz_start_idle(cpu, ts);
 
-	/*
-	 * If this cpu is offline and it is the one which updates
-	 * jiffies, then give up the assignment and let it be taken by
-	 * the cpu which runs the tick timer next. If we don't drop
-	 * this here the jiffies might be stale and do_timer() never
-	 * invoked.
-	 */
-	if (unlikely(!cpu_online(cpu))) {
-		if (cpu == tick_do_timer_cpu)
-			tick_do_timer_cpu = TICK_DO_TIMER_NONE;
-	}
-
-	if (unlikely(ts->nohz_mode == NOHZ_MODE_INACTIVE))
-		return;
-
-	if (need_resched())
-		return;
-
-	if (unlikely(local_softirq_pending() && cpu_online(cpu))) {
-		static int ratelimit;
-
-		if (ratelimit < 10) {
-			printk(KERN_ERR "NOHZ: local_softirq_pending %02x\n",
-			       (unsigned int) local_softirq_pending());
-			ratelimit++;
-		}
-		return;
-	}
-
-	ts->idle_calls++;
 	/* Read jiffies and the time when jiffies were updated last */
 	do {
 		seq = read_seqbegin(&xtime_lock);
@@ -404,14 +404,16 @@ static void tick_nohz_stop_sched_tick(struct tick_sched *ts)
 		 * the scheduler tick in nohz_restart_sched_tick.
 		 */
 		if (!ts->tick_stopped) {
-			select_nohz_load_balancer(1);
+			if (ts->inidle)
+				select_nohz_load_balancer(1);
 
 			ts->idle_tick = hrtimer_get_expires(&ts->sched_timer);
 			ts->tick_stopped = 1;
 			ts->idle_jiffies = last_jiffies;
 		}
 
-		ts->idle_sleeps++;
+		if (ts->inidle)
+			ts->idle_sleeps++;
 
 		/* Mark expires */
 		ts->idle_expires = expires;
@@ -448,6 +450,237 @@ out:
 	ts->sleep_length = ktime_sub(dev->next_event, now);
 }
 
+static bool can_stop_idle_tick(int cpu, struct tick_sched *ts)
+{
+	/*
+	 * If this cpu is offline and it is the one which updates
+	 * jiffies, then give up the assignment and let it be taken by
+	 * the cpu which runs the tick timer next. If we don't drop
+	 * this here the jiffies might be stale and do_timer() never
+	 * invoked.
+	 */
+	if (unlikely(!cpu_online(cpu))) {
+		if (cpu == tick_do_timer_cpu)
+			tick_do_timer_cpu = TICK_DO_TIMER_NONE;
+	}
+
+	if (unlikely(ts->nohz_mode == NOHZ_MODE_INACTIVE))
+		return false;
+
+	if (need_resched())
+		return false;
+
+	if (unlikely(local_softirq_pending() && cpu_online(cpu))) {
+		static int ratelimit;
+
+		if (ratelimit < 10) {
+			printk(KERN_ERR "NOHZ: local_softirq_pending %02x\n",
+			       (unsigned int) local_softirq_pending());
+			ratelimit++;
+		}
+		return false;
+	}
+
+#ifdef CONFIG_NO_HZ_FULL
+	/*
+	 * The full dynticks CPUs rely on this CPU to keep jiffies and
+	 * the timekeeping up to date, so it must not drop that duty.
+	 */
+	if (tick_nohz_full_running && cpu == tick_do_timer_cpu)
+		return false;
+#endif
+
+	return true;
+}
+
+static void __tick_nohz_idle_enter(struct tick_sched *ts)
+{
+	int cpu = smp_processor_id();
+	ktime_t now;
+
+	now = tick_nohz_start_idle(cpu, ts);
+
+	if (can_stop_idle_tick(cpu, ts)) {
+		ts->idle_calls++;
+		tick_nohz_stop_sched_tick(ts, now, cpu);
+	}
+}
+
+static void tick_nohz_restart(struct tick_sched *ts, ktime_t now)
+{
+	hrtimer_cancel(&ts->sched_timer);
+	hrtimer_set_expires(&ts->sched_timer, ts->idle_tick);
+
+	while (1) {
+		/* Forward the time to expire in the future */
+		hrtimer_forward(&ts->sched_timer, now, tick_period);
+
+		if (ts->nohz_mode == NOHZ_MODE_HIGHRES) {
+			hrtimer_start_expires(&ts->sched_timer,
+					      HRTIMER_MODE_ABS_PINNED);
+			/* Check, if the timer was already in the past */
+			if (hrtimer_active(&ts->sched_timer))
+				break;
+		} else {
+			if (!tick_program_event(
+				hrtimer_get_expires(&ts->sched_timer), 0))
+				break;
+		}
+		/* Update jiffies and reread time */
+		tick_do_update_jiffies64(now);
+		now = ktime_get();
+	}
+}
+
+#ifdef CONFIG_NO_HZ_FULL
+/*
+ * Without the tick nobody accounted the time the task ran alone on this
+ * CPU. Charge it as user time, which is where a task asking for full
+ * dynticks is expected to spend it.
+ */
+static void tick_nohz_full_account_ticks(struct tick_sched *ts,
+					 struct task_struct *p)
+{
+#ifndef CONFIG_VIRT_CPU_ACCOUNTING
+	unsigned long ticks = jiffies - ts->idle_jiffies;
+
+	if (ticks && ticks < LONG_MAX) {
+		cputime_t cputime = jiffies_to_cputime(ticks);
+
+		account_user_time(p, cputime, cputime);
+	}
+#endif
+	ts->idle_jiffies = jiffies;
+}
+
+static bool can_stop_full_tick(int cpu)
+{
+	WARN_ON_ONCE(!irqs_disabled());
+
+	if (!sched_can_stop_tick()) {
+		trace_tick_stop(0, "more than 1 task in runqueue\n");
+		return false;
+	}
+
+	if (!posix_cpu_timers_can_stop_tick(current)) {
+		trace_tick_stop(0, "posix timers running\n");
+		return false;
+	}
+
+	if (rcu_nohz_full_cpu_has_work(cpu)) {
+		trace_tick_stop(0, "rcu needs the cpu\n");
+		return false;
+	}
+
+	return true;
+}
+
+static void tick_nohz_full_restart(struct tick_sched *ts, ktime_t now)
+{
+	tick_nohz_full_account_ticks(ts, current);
+	ts->tick_stopped = 0;
+	tick_nohz_restart(ts, now);
+}
+
+/*
+ * Re-evaluate the tick of a full dynticks CPU running a task: stop it
+ * while the task is alone and nothing else needs the tick, restart it
+ * otherwise. Called with interrupts disabled.
+ */
+static void tick_nohz_full_update_tick(struct tick_sched *ts)
+{
+	int cpu = smp_processor_id();
+
+	if (!tick_nohz_full_cpu(cpu) || is_idle_task(current))
+		return;
+
+	if (unlikely(ts->nohz_mode == NOHZ_MODE_INACTIVE))
+		return;
+
+	if (can_stop_full_tick(cpu)) {
+		int was_stopped = ts->tick_stopped;
+
+		tick_nohz_stop_sched_tick(ts, ktime_get(), cpu);
+		if (!was_stopped && ts->tick_stopped)
+			trace_tick_stop(1, " ");
+	} else if (ts->tick_stopped) {
+		tick_nohz_full_restart(ts, ktime_get());
+	}
+}
+
+/**
+ * tick_nohz_full_kick_cpu - re-evaluate the tick of a full dynticks CPU
+ * @cpu: the CPU to kick
+ *
+ * The IPI ends in irq_exit(), where tick_nohz_irq_exit() restarts the
+ * tick if the CPU can no longer run without it.
+ */
+void tick_nohz_full_kick_cpu(int cpu)
+{
+	if (!tick_nohz_full_cpu(cpu))
+		return;
+
+	smp_send_reschedule(cpu);
+}
+
+/**
+ * tick_nohz_full_kick_all - re-evaluate the tick of all full dynticks CPUs
+ *
+ * Used when something the tick runs, such as a CPU timer, is armed for a
+ * task that may be running on any of them.  The local CPU is re-evaluated
+ * right away, as no interrupt may come to do it while its tick is stopped.
+ */
+void tick_nohz_full_kick_all(void)
+{
+	unsigned long flags;
+	int cpu, this_cpu;
+
+	if (!tick_nohz_full_running)
+		return;
+
+	local_irq_save(flags);
+	this_cpu = smp_processor_id();
+	for_each_cpu_and(cpu, tick_nohz_full_mask, cpu_online_mask)
+		if (cpu != this_cpu)
+			smp_send_reschedule(cpu);
+	tick_nohz_full_update_tick(&per_cpu(tick_cpu_sched, this_cpu));
+	local_irq_restore(flags);
+}
+
+/**
+ * tick_nohz_task_switch - account and re-evaluate the tick on task switch
+ * @prev: the task which was switched out
+ *
+ * The time @prev ran with the tick stopped is charged to it. The tick is
+ * then restarted when switching to idle, which stops it again on its own,
+ * or when the new task can't run without it.
+ */
+void tick_nohz_task_switch(struct task_struct *prev)
+{
+	struct tick_sched *ts;
+	unsigned long flags;
+	int cpu;
+
+	local_irq_save(flags);
+
+	cpu = smp_processor_id();
+	if (!tick_nohz_full_cpu(cpu))
+		goto out;
+
+	ts = &per_cpu(tick_cpu_sched, cpu);
+	if (!ts->tick_stopped || ts->inidle)
+		goto out;
+
+	tick_nohz_full_account_ticks(ts, prev);
+	if (is_idle_task(current) || !can_stop_full_tick(cpu))
+		tick_nohz_full_restart(ts, ktime_get());
+out:
+	local_irq_restore(flags);
+}
+#else
+static inline void tick_nohz_full_update_tick(struct tick_sched *ts) { }
+#endif /* CONFIG_NO_HZ_FULL */
+
 /**
  * tick_nohz_idle_enter - stop the idle tick from the idle task
  *
@@ -483,7 +716,7 @@ void tick_nohz_idle_enter(void)
 	 * update of the idle time accounting in tick_nohz_start_idle().
 	 */
 	ts->inidle = 1;
-	tick_nohz_stop_sched_tick(ts);
+	__tick_nohz_idle_enter(ts);
 
 	local_irq_enable();
 }
@@ -495,15 +728,21 @@ void tick_nohz_idle_enter(void)
  * a reschedule, it may still add, modify or delete a timer, enqueue
  * an RCU callback, etc...
  * So we need to re-calculate and reprogram the next tick event.
+ *
+ * On a full dynticks CPU the interrupt may also have changed whether
+ * the running task can go on without the tick.
  */
 void tick_nohz_irq_exit(void)
 {
 	struct tick_sched *ts = &__get_cpu_var(tick_cpu_sched);
 
-	if (!ts->inidle)
+	if (ts->inidle) {
+		if (idle_cpu(smp_processor_id()) && !need_resched())
+			__tick_nohz_idle_enter(ts);
 		return;
+	}
 
-	tick_nohz_stop_sched_tick(ts);
+	tick_nohz_full_update_tick(ts);
 }
 
 /**
@@ -518,32 +757,6 @@ ktime_t tick_nohz_get_sleep_length(void)
 	return ts->sleep_length;
 }
 
-static void tick_nohz_restart(struct tick_sched *ts, ktime_t now)
-{
-	hrtimer_cancel(&ts->sched_timer);
-	hrtimer_set_expires(&ts->sched_timer, ts->idle_tick);
-
-	while (1) {
-		/* Forward the time to expire in the future */
-		hrtimer_forward(&ts->sched_timer, now, tick_period);
-
-		if (ts->nohz_mode == NOHZ_MODE_HIGHRES) {
-			hrtimer_start_expires(&ts->sched_timer,
-					      HRTIMER_MODE_ABS_PINNED);
-			/* Check, if the timer was already in the past */
-			if (hrtimer_active(&ts->sched_timer))
-				break;
-		} else {
-			if (!tick_program_event(
-				hrtimer_get_expires(&ts->sched_timer), 0))
-				break;
-		}
-		/* Update jiffies and reread time */
-		tick_do_update_jiffies64(now);
-		now = ktime_get();
-	}
-}
-
 /**
  * tick_nohz_idle_exit - restart the idle tick from the idle task
  *
@@ -629,9 +842,10 @@ static void tick_nohz_handler(struct clock_event_device *dev)
 	 * concurrency: This happens only when the cpu in charge went
 	 * into a long sleep. If two cpus happen to assign themself to
 	 * this duty, then the jiffies update is still serialized by
-	 * xtime_lock.
+	 * xtime_lock. Full dynticks CPUs never take the duty.
 	 */
-	if (unlikely(tick_do_timer_cpu == TICK_DO_TIMER_NONE))
+	if (unlikely(tick_do_timer_cpu == TICK_DO_TIMER_NONE) &&
+	    !tick_nohz_full_cpu(cpu))
 		tick_do_timer_cpu = cpu;
 
 	/* Check, if the jiffies need an update */
@@ -781,9 +995,10 @@ static enum hrtimer_restart tick_sched_timer(struct hrtimer *timer)
 	 * concurrency: This happens only when the cpu in charge went
 	 * into a long sleep. If two cpus happen to assign themself to
 	 * this duty, then the jiffies update is still serialized by
-	 * xtime_lock.
+	 * xtime_lock. Full dynticks CPUs never take the duty.
 	 */
-	if (unlikely(tick_do_timer_cpu == TICK_DO_TIMER_NONE))
+	if (unlikely(tick_do_timer_cpu == TICK_DO_TIMER_NONE) &&
+	    !tick_nohz_full_cpu(cpu))
 		tick_do_timer_cpu = cpu;
 #endif
 
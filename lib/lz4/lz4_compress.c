@@ -0,0 +1,148 @@
+/*
+ * LZ4 Compressor for Linux kernel
+ *
+ * A single pass, greedy LZ4 block encoder: a hash table maps each 4 byte
+ * sequence to its last position in the input, and the first candidate
+ * found there is extended as far as it matches. Inputs which do not
+ * compress are skipped over faster and faster, which bounds the time
+ * spent on incompressible data.
+ *
+ * The output is the LZ4 block format accepted by lz4_decompress.c and by
+ * the reference LZ4 implementation.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+
+#include <linux/module.h>
+#include <linux/kernel.h>
+#include <linux/types.h>
+#include <linux/string.h>
+#include <linux/lz4.h>
+#include <asm/unaligned.h>
+#include "lz4defs.h"
+
+/* Inputs shorter than this are stored as literals only */
+#define LZ4_MIN_LENGTH	(MFLIMIT + 1)
+
+/* Every 2^SKIP_TRIGGER literals without a match, the search step grows */
+#define SKIP_TRIGGER	6
+
+static inline u32 lz4_hash(u32 sequence)
+{
+	return (sequence * 2654435761U) >> (32 - LZ4_HASHLOG);
+}
+
+/* Write the extension bytes of a literal or match length */
+static inline u8 *lz4_write_length(u8 *op, size_t length)
+{
+	while (length >= 255) {
+		*op++ = 255;
+		length -= 255;
+	}
+	*op++ = length;
+	return op;
+}
+
+/* Upper bound of the bytes a sequence with these lengths takes */
+static inline size_t lz4_sequence_size(size_t literals, size_t matchlength)
+{
+	return 1 + literals + literals / 255 + 1 + 2 + matchlength / 255 + 1;
+}
+
+int lz4_compress(const unsigned char *src, size_t src_len,
+		unsigned char *dst, size_t *dst_len, void *wrkmem)
+{
+	u32 *table = wrkmem;
+	const u8 *ip = src;
+	const u8 *anchor = src;
+	const u8 *const iend = src + src_len;
+	const u8 *const mflimit = iend - MFLIMIT;
+	const u8 *const matchlimit = iend - LASTLITERALS;
+	u8 *op = dst;
+	u8 *const oend = dst + *dst_len;
+	size_t literals;
+	u8 *token;
+
+	BUILD_BUG_ON(LZ4_MEM_COMPRESS != LZ4_HASH_SIZE * sizeof(u32));
+
+	if (src_len < LZ4_MIN_LENGTH)
+		goto last_literals;
+
+	memset(table, 0, LZ4_MEM_COMPRESS);
+	ip++;
+
+	while (ip < mflimit) {
+		u32 sequence = get_unaligned((const u32 *)ip);
+		u32 h = lz4_hash(sequence);
+		const u8 *ref = src + table[h];
+		size_t length;
+
+		table[h] = ip - src;
+		if (ref >= ip || ip - ref > MAX_DISTANCE ||
+		    get_unaligned((const u32 *)ref) != sequence) {
+			ip += 1 + ((ip - anchor) >> SKIP_TRIGGER);
+			continue;
+		}
+
+		/* extend the match backwards over pending literals */
+		while (ip > anchor && ref > src && ip[-1] == ref[-1]) {
+			ip--;
+			ref--;
+		}
+
+		/* and forwards, stopping LASTLITERALS before the end */
+		length = MINMATCH;
+		while (ip + length < matchlimit && ip[length] == ref[length])
+			length++;
+
+		literals = ip - anchor;
+		if (unlikely(lz4_sequence_size(literals, length - MINMATCH) >
+			     (size_t)(oend - op)))
+			return -1;
+
+		token = op++;
+		if (literals >= RUN_MASK) {
+			*token = RUN_MASK << ML_BITS;
+			op = lz4_write_length(op, literals - RUN_MASK);
+		} else
+			*token = literals << ML_BITS;
+		memcpy(op, anchor, literals);
+		op += literals;
+
+		put_unaligned_le16(ip - ref, op);
+		op += 2;
+
+		length -= MINMATCH;
+		if (length >= ML_MASK) {
+			*token |= ML_MASK;
+			op = lz4_write_length(op, length - ML_MASK);
+		} else
+			*token |= length;
+
+		ip += length + MINMATCH;
+		anchor = ip;
+	}
+
+last_literals:
+	literals = iend - anchor;
+	if (unlikely(1 + literals + literals / 255 + 1 > (size_t)(oend - op)))
+		return -1;
+
+	token = op++;
+	if (literals >= RUN_MASK) {
+		*token = RUN_MASK << ML_BITS;
+		op = lz4_write_length(op, literals - RUN_MASK);
+	} else
+		*token = literals << ML_BITS;
+	memcpy(op, anchor, literals);
+	op += literals;
+
+	*dst_len = op - dst;
+	return 0;
+}
+EXPORT_SYMBOL(lz4_compress);
+
+MODULE_LICENSE("GPL");
+MODULE_DESCRIPTION("LZ4 Compressor");
@@ -0,0 +1,134 @@
+/*
+ * LZ4 Decompressor for Linux kernel
+ *
+ * Decodes the LZ4 block format: a sequence of tokens, each followed by
+ * a run of literals and a (offset, length) back reference. The last
+ * sequence of a block only has literals.
+ *
+ * Every read and write is bounds checked, so corrupted or malicious
+ * input can't make the decoder overrun either buffer.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+
+#ifndef STATIC
+#include <linux/module.h>
+#include <linux/kernel.h>
+#endif
+#include <linux/types.h>
+#include <linux/lz4.h>
+#include <asm/unaligned.h>
+#include "lz4defs.h"
+
+/* Read an extended length: bytes are added up until one isn't 255 */
+static inline int lz4_read_length(const u8 **ip, const u8 *iend,
+				  size_t *length)
+{
+	unsigned int s;
+
+	do {
+		if (unlikely(*ip >= iend))
+			return -1;
+		s = *(*ip)++;
+		*length += s;
+	} while (s == 255);
+
+	return 0;
+}
+
+static int lz4_uncompress_unknownoutputsize(const u8 *source, u8 *dest,
+					    size_t isize, size_t maxoutputsize)
+{
+	const u8 *ip = source;
+	const u8 *const iend = ip + isize;
+	u8 *op = dest;
+	u8 *const oend = op + maxoutputsize;
+
+	while (ip < iend) {
+		unsigned int token;
+		size_t length;
+		size_t offset;
+		const u8 *ref;
+
+		/* get runlength */
+		token = *ip++;
+		length = token >> ML_BITS;
+		if (length == RUN_MASK && lz4_read_length(&ip, iend, &length))
+			goto _output_error;
+
+		/* copy literals */
+		if (unlikely(length > (size_t)(iend - ip) ||
+			     length > (size_t)(oend - op)))
+			goto _output_error;
+		memcpy(op, ip, length);
+		op += length;
+		ip += length;
+
+		/* the last sequence has no match */
+		if (ip == iend)
+			break;
+
+		/* get offset */
+		if (unlikely(iend - ip < 2))
+			goto _output_error;
+		offset = get_unaligned_le16(ip);
+		ip += 2;
+		if (unlikely(offset == 0 || offset > (size_t)(op - dest)))
+			goto _output_error;
+		ref = op - offset;
+
+		/* get matchlength */
+		length = token & ML_MASK;
+		if (length == ML_MASK && lz4_read_length(&ip, iend, &length))
+			goto _output_error;
+		length += MINMATCH;
+		if (unlikely(length > (size_t)(oend - op)))
+			goto _output_error;
+
+		/*
+		 * copy repeated sequence: a word at a time when the match is
+		 * at least that far behind, since each word read then only
+		 * covers bytes already written; byte by byte otherwise, as
+		 * short offsets encode runs.
+		 */
+		if (offset >= COPYLENGTH) {
+			while (length >= COPYLENGTH) {
+				LZ4_COPY8(op, ref);
+				op += COPYLENGTH;
+				ref += COPYLENGTH;
+				length -= COPYLENGTH;
+			}
+		}
+		while (length--)
+			*op++ = *ref++;
+	}
+
+	/* end of decoding */
+	return op - dest;
+
+	/* write overflow error detected */
+_output_error:
+	return -1;
+}
+
+int lz4_decompress_unknownoutputsize(const unsigned char *src, size_t src_len,
+		unsigned char *dest, size_t *dest_len)
+{
+	int out_len;
+
+	out_len = lz4_uncompress_unknownoutputsize(src, dest, src_len,
+						   *dest_len);
+	if (out_len < 0)
+		return -1;
+	*dest_len = out_len;
+
+	return 0;
+}
+#ifndef STATIC
+EXPORT_SYMBOL(lz4_decompress_unknownoutputsize);
+
+MODULE_LICENSE("GPL");
+MODULE_DESCRIPTION("LZ4 Decompressor");
+#endif
@@ -0,0 +1,37 @@
+/*
+ * lz4defs.h -- architecture specific defines
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+
+/*
+ * Each sequence starts with a token: the high nibble is the literal
+ * length, the low nibble the match length minus MINMATCH. A nibble of
+ * 15 is followed by extra length bytes, each adding up to 255.
+ */
+#define MINMATCH 4
+
+#define ML_BITS	4
+#define ML_MASK	((1U << ML_BITS) - 1)
+#define RUN_BITS (8 - ML_BITS)
+#define RUN_MASK ((1U << RUN_BITS) - 1)
+
+/* Matches are copied a word at a time once they are this far behind */
+#define COPYLENGTH 8
+
+#define LZ4_COPY8(d, s)	\
+	put_unaligned(get_unaligned((const u64 *)(s)), (u64 *)(d))
+
+/*
+ * Compressor limits: the last match must start at least MFLIMIT bytes
+ * before the end of the block and the last LASTLITERALS bytes are always
+ * literals, so that decoders may copy whole words near the end.
+ */
+#define MFLIMIT		12
+#define LASTLITERALS	5
+#define MAX_DISTANCE	((1 << 16) - 1)
+
+#define LZ4_HASHLOG	12
+#define LZ4_HASH_SIZE	(1 << LZ4_HASHLOG)
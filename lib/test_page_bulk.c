@@ -0,0 +1,274 @@
+/*
+ * Test and benchmark for alloc_pages_bulk() and free_pages_bulk().
+ *
+ * alloc_pages_bulk() only fills the NULL entries of the array it is
+ * given, in order, from this cpu's free lists, so the cases below pass
+ * it empty arrays, arrays with some entries already holding a page, and
+ * freed pages that were dirtied, and check what comes back.  The last
+ * two cases get the same number of pages with alloc_page() and with
+ * alloc_pages_bulk(), so that their times can be compared:
+ *
+ *	modprobe test_page_bulk nr_pages=64 nr_loops=100000
+ *
+ * The module never stays loaded: it returns -EAGAIN when every case
+ * passed and -EINVAL when one failed, so it can simply be loaded again.
+ */
+
+#include <linux/module.h>
+#include <linux/kernel.h>
+#include <linux/mm.h>
+#include <linux/gfp.h>
+#include <linux/highmem.h>
+#include <linux/slab.h>
+#include <linux/string.h>
+#include <linux/ktime.h>
+#include <linux/sched.h>
+
+static int nr_pages = 32;
+module_param(nr_pages, int, 0444);
+MODULE_PARM_DESC(nr_pages, "Number of entries in the page array");
+
+static int nr_loops = 10000;
+module_param(nr_loops, int, 0444);
+MODULE_PARM_DESC(nr_loops, "Number of arrays filled by the timed cases");
+
+static struct page **page_array;
+
+/* Count the entries of page_array holding a page */
+static unsigned long populated(void)
+{
+	unsigned long i, nr = 0;
+
+	for (i = 0; i < nr_pages; i++)
+		if (page_array[i])
+			nr++;
+	return nr;
+}
+
+/*
+ * A page from alloc_pages_bulk() is an order-0 page nobody else holds a
+ * reference to, and appears only once in the array.
+ */
+static bool page_ok(unsigned long idx)
+{
+	struct page *page = page_array[idx];
+	unsigned long i;
+
+	if (page_count(page) != 1 || PageCompound(page) || PageLRU(page)) {
+		printk(KERN_ERR "test_page_bulk: entry %lu: count %d, "
+		       "flags %lx\n", idx, page_count(page), page->flags);
+		return false;
+	}
+	for (i = 0; i < idx; i++) {
+		if (page_array[i] == page) {
+			printk(KERN_ERR "test_page_bulk: entries %lu and %lu "
+			       "hold the same page\n", i, idx);
+			return false;
+		}
+	}
+	return true;
+}
+
+/* An empty array comes back with exactly its first entries populated */
+static int fill_empty_test(void)
+{
+	unsigned long nr, i;
+	int ret = 0;
+
+	memset(page_array, 0, nr_pages * sizeof(*page_array));
+	nr = alloc_pages_bulk(GFP_KERNEL, nr_pages, page_array);
+	if (!nr)
+		return -ENOMEM;
+
+	if (nr > nr_pages || populated() != nr) {
+		printk(KERN_ERR "test_page_bulk: %lu pages reported, %lu in "
+		       "the array\n", nr, populated());
+		ret = -EINVAL;
+	}
+	for (i = 0; i < nr_pages && !ret; i++) {
+		if ((i < nr) != (page_array[i] != NULL)) {
+			printk(KERN_ERR "test_page_bulk: entry %lu of %lu "
+			       "pages is %p\n", i, nr, page_array[i]);
+			ret = -EINVAL;
+		} else if (page_array[i] && !page_ok(i)) {
+			ret = -EINVAL;
+		}
+	}
+
+	free_pages_bulk(nr_pages, page_array);
+	return ret;
+}
+
+/*
+ * Pages already in the array, here in every other entry, must be left
+ * where they are and counted in the return value.
+ */
+static int fill_holes_test(void)
+{
+	struct page **preset;
+	unsigned long nr, i;
+	int ret = 0;
+
+	preset = kcalloc(nr_pages, sizeof(*preset), GFP_KERNEL);
+	if (!preset)
+		return -ENOMEM;
+
+	memset(page_array, 0, nr_pages * sizeof(*page_array));
+	for (i = 0; i < nr_pages; i += 2) {
+		preset[i] = alloc_page(GFP_KERNEL);
+		if (!preset[i]) {
+			ret = -ENOMEM;
+			goto out;
+		}
+		page_array[i] = preset[i];
+	}
+
+	nr = alloc_pages_bulk(GFP_KERNEL, nr_pages, page_array);
+	if (nr != populated()) {
+		printk(KERN_ERR "test_page_bulk: %lu pages reported, %lu in "
+		       "the array\n", nr, populated());
+		ret = -EINVAL;
+	}
+	for (i = 0; i < nr_pages; i++) {
+		if (preset[i] && page_array[i] != preset[i]) {
+			printk(KERN_ERR "test_page_bulk: entry %lu was "
+			       "replaced\n", i);
+			ret = -EINVAL;
+		} else if (page_array[i] && !page_ok(i)) {
+			ret = -EINVAL;
+		}
+	}
+
+	/* Only the pages alloc_pages_bulk() put in are freed in bulk */
+	for (i = 0; i < nr_pages; i++)
+		if (page_array[i] == preset[i])
+			page_array[i] = NULL;
+	free_pages_bulk(nr_pages, page_array);
+out:
+	for (i = 0; i < nr_pages; i += 2)
+		if (preset[i])
+			__free_page(preset[i]);
+	kfree(preset);
+	return ret;
+}
+
+/*
+ * Pages dirtied and put back on the free lists by free_pages_bulk() are
+ * the first ones handed out again, and must be cleared for __GFP_ZERO.
+ */
+static int zeroed_test(void)
+{
+	unsigned long nr, i;
+	void *addr;
+	int ret = 0;
+
+	memset(page_array, 0, nr_pages * sizeof(*page_array));
+	nr = alloc_pages_bulk(GFP_KERNEL, nr_pages, page_array);
+	for (i = 0; i < nr; i++) {
+		memset(kmap(page_array[i]), 0xa5, PAGE_SIZE);
+		kunmap(page_array[i]);
+	}
+	free_pages_bulk(nr_pages, page_array);
+
+	memset(page_array, 0, nr_pages * sizeof(*page_array));
+	nr = alloc_pages_bulk(GFP_KERNEL | __GFP_ZERO, nr_pages, page_array);
+	if (!nr)
+		return -ENOMEM;
+	for (i = 0; i < nr && !ret; i++) {
+		addr = kmap(page_array[i]);
+		if (memchr_inv(addr, 0, PAGE_SIZE)) {
+			printk(KERN_ERR "test_page_bulk: entry %lu not "
+			       "zeroed\n", i);
+			ret = -EINVAL;
+		}
+		kunmap(page_array[i]);
+	}
+
+	free_pages_bulk(nr_pages, page_array);
+	return ret;
+}
+
+/* Fill and empty the array one alloc_page() and __free_page() at a time */
+static int single_page_loop(void)
+{
+	int i, j;
+
+	for (i = 0; i < nr_loops; i++) {
+		for (j = 0; j < nr_pages; j++) {
+			page_array[j] = alloc_page(GFP_KERNEL);
+			if (!page_array[j]) {
+				while (j--)
+					__free_page(page_array[j]);
+				return -ENOMEM;
+			}
+		}
+		for (j = 0; j < nr_pages; j++)
+			__free_page(page_array[j]);
+		cond_resched();
+	}
+	return 0;
+}
+
+/* The same with one alloc_pages_bulk() and free_pages_bulk() per array */
+static int bulk_page_loop(void)
+{
+	unsigned long nr;
+	int i;
+
+	for (i = 0; i < nr_loops; i++) {
+		memset(page_array, 0, nr_pages * sizeof(*page_array));
+		nr = alloc_pages_bulk(GFP_KERNEL, nr_pages, page_array);
+		free_pages_bulk(nr_pages, page_array);
+		if (!nr)
+			return -ENOMEM;
+		cond_resched();
+	}
+	return 0;
+}
+
+static struct test_case_desc {
+	const char *name;
+	int (*test_func)(void);
+} test_case_array[] = {
+	{ "fill_empty_test", fill_empty_test },
+	{ "fill_holes_test", fill_holes_test },
+	{ "zeroed_test", zeroed_test },
+	{ "single_page_loop", single_page_loop },
+	{ "bulk_page_loop", bulk_page_loop },
+};
+
+static int __init page_bulk_test_init(void)
+{
+	ktime_t start;
+	s64 usecs;
+	int i, ret, failed = 0;
+
+	if (nr_pages <= 0 || nr_loops <= 0)
+		return -EINVAL;
+
+	page_array = kcalloc(nr_pages, sizeof(*page_array), GFP_KERNEL);
+	if (!page_array)
+		return -ENOMEM;
+
+	printk(KERN_INFO "test_page_bulk: arrays of %d pages, %d loops\n",
+	       nr_pages, nr_loops);
+	for (i = 0; i < ARRAY_SIZE(test_case_array); i++) {
+		start = ktime_get();
+		ret = test_case_array[i].test_func();
+		usecs = ktime_us_delta(ktime_get(), start);
+		if (ret)
+			failed++;
+		printk(KERN_INFO "test_page_bulk: %s: %s (%d) in %lld usecs\n",
+		       test_case_array[i].name, ret ? "failed" : "passed", ret,
+		       (long long)usecs);
+	}
+
+	kfree(page_array);
+
+	/* Fail will directly unload the module */
+	return failed ? -EINVAL : -EAGAIN;
+}
+module_init(page_bulk_test_init);
+
+MODULE_LICENSE("GPL");
+MODULE_DESCRIPTION("alloc_pages_bulk() test and benchmark");
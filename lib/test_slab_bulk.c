@@ -0,0 +1,293 @@
+/*
+ * Test for kmem_cache_alloc_bulk() and kmem_cache_free_bulk().
+ *
+ * The bulk calls take a batch of objects off, or put it back on, the
+ * cpu's freelist with interrupts disabled once, and only go to the slow
+ * path when the freelist runs dry in the middle of the batch.  For each
+ * of the caches below, created with a batch of nr_objects big enough to
+ * need several new slabs, the module checks that
+ *
+ *  - objects from new slabs went through the cache's constructor,
+ *  - no two objects of a batch share memory,
+ *  - objects can be freed with the other API than the one that
+ *    allocated them,
+ *  - a freed batch is handed out again from the cpu's freelist, and
+ *    cleared for __GFP_ZERO although it was dirtied.
+ *
+ * It then prints the cost per object of kmem_cache_alloc() plus
+ * kmem_cache_free(), and of the bulk calls:
+ *
+ *	modprobe test_slab_bulk nr_objects=512 nr_rounds=10000
+ *
+ * Leaked objects are reported by kmem_cache_destroy().  The module does
+ * not stay loaded; it fails with -EINVAL if a check failed.
+ */
+
+#include <linux/module.h>
+#include <linux/kernel.h>
+#include <linux/slab.h>
+#include <linux/string.h>
+#include <linux/preempt.h>
+#include <linux/ktime.h>
+#include <linux/sched.h>
+#include <linux/math64.h>
+
+static int nr_objects = 128;
+module_param(nr_objects, int, 0444);
+MODULE_PARM_DESC(nr_objects, "Number of objects allocated at once");
+
+static int nr_rounds = 1000;
+module_param(nr_rounds, int, 0444);
+MODULE_PARM_DESC(nr_rounds, "Number of batches timed per cache");
+
+#define CTOR_MAGIC	0x5ab1eb1cUL
+
+struct ctor_obj {
+	unsigned long magic;
+	char payload[120];
+};
+
+static void ctor_obj_init(void *p)
+{
+	struct ctor_obj *obj = p;
+
+	obj->magic = CTOR_MAGIC;
+}
+
+static struct bulk_cache {
+	const char *name;
+	size_t size;
+	unsigned long flags;
+	void (*ctor)(void *);
+	struct kmem_cache *cachep;
+} bulk_caches[] = {
+	{ "test_slab_bulk_32", 32, 0, NULL },
+	{ "test_slab_bulk_192", 192, SLAB_HWCACHE_ALIGN, NULL },
+	{ "test_slab_bulk_ctor", sizeof(struct ctor_obj), 0, ctor_obj_init },
+	{ "test_slab_bulk_1024", 1024, 0, NULL },
+};
+
+static void **objs, **freed;
+
+static bool bulk_alloc(struct bulk_cache *bc, gfp_t gfp)
+{
+	if (kmem_cache_alloc_bulk(bc->cachep, gfp, nr_objects, objs))
+		return true;
+	printk(KERN_ERR "test_slab_bulk: %s: cannot allocate %d objects\n",
+	       bc->name, nr_objects);
+	return false;
+}
+
+/* The cache is still empty, so the whole batch comes from new slabs */
+static bool constructed_check(struct bulk_cache *bc)
+{
+	bool ok = true;
+	int i;
+
+	if (!bc->ctor)
+		return true;
+	if (!bulk_alloc(bc, GFP_KERNEL))
+		return false;
+	for (i = 0; i < nr_objects; i++) {
+		struct ctor_obj *obj = objs[i];
+
+		if (obj->magic != CTOR_MAGIC) {
+			printk(KERN_ERR "test_slab_bulk: %s: object %d not "
+			       "constructed\n", bc->name, i);
+			ok = false;
+		}
+	}
+	kmem_cache_free_bulk(bc->cachep, nr_objects, objs);
+	return ok;
+}
+
+/*
+ * Fill every object with its own byte: if two objects overlapped, the
+ * later memset() shows up in the earlier one.
+ */
+static bool sharing_check(struct bulk_cache *bc)
+{
+	bool ok = true;
+	int i;
+
+	if (!bulk_alloc(bc, GFP_KERNEL))
+		return false;
+	for (i = 0; i < nr_objects; i++)
+		memset(objs[i], i + 1, bc->size);
+	for (i = 0; i < nr_objects; i++) {
+		if (memchr_inv(objs[i], (u8)(i + 1), bc->size)) {
+			printk(KERN_ERR "test_slab_bulk: %s: object %d at %p "
+			       "overlaps another one\n", bc->name, i, objs[i]);
+			ok = false;
+		}
+		/* Objects go back to a constructor's cache constructed */
+		if (bc->ctor)
+			bc->ctor(objs[i]);
+	}
+	kmem_cache_free_bulk(bc->cachep, nr_objects, objs);
+	return ok;
+}
+
+/*
+ * Half of a bulk allocated batch goes back with kmem_cache_free(), and
+ * objects from kmem_cache_alloc() go back with kmem_cache_free_bulk().
+ * Anything lost on the way is reported when the cache is destroyed.
+ */
+static bool mixed_free_check(struct bulk_cache *bc)
+{
+	int i, half = nr_objects / 2;
+
+	if (!bulk_alloc(bc, GFP_KERNEL))
+		return false;
+	for (i = 0; i < half; i++)
+		kmem_cache_free(bc->cachep, objs[i]);
+	kmem_cache_free_bulk(bc->cachep, nr_objects - half, objs + half);
+
+	for (i = 0; i < nr_objects; i++) {
+		objs[i] = kmem_cache_alloc(bc->cachep, GFP_KERNEL);
+		if (!objs[i]) {
+			printk(KERN_ERR "test_slab_bulk: %s: kmem_cache_alloc() "
+			       "failed\n", bc->name);
+			kmem_cache_free_bulk(bc->cachep, i, objs);
+			return false;
+		}
+	}
+	kmem_cache_free_bulk(bc->cachep, nr_objects, objs);
+	return true;
+}
+
+/*
+ * kmem_cache_free_bulk() puts the batch on this cpu's freelist, so the
+ * next batch allocated on the same cpu reuses some of it.  Caches with a
+ * constructor expect their objects back constructed, and do not take
+ * __GFP_ZERO.
+ */
+static bool reuse_check(struct bulk_cache *bc)
+{
+	gfp_t gfp = bc->ctor ? GFP_ATOMIC : GFP_ATOMIC | __GFP_ZERO;
+	int i, j, reused = 0;
+	bool ok = true;
+
+	preempt_disable();
+	if (!bulk_alloc(bc, GFP_ATOMIC)) {
+		preempt_enable();
+		return false;
+	}
+	for (i = 0; i < nr_objects; i++) {
+		if (!bc->ctor)
+			memset(objs[i], 0xa5, bc->size);
+		freed[i] = objs[i];
+	}
+	kmem_cache_free_bulk(bc->cachep, nr_objects, objs);
+	if (!bulk_alloc(bc, gfp)) {
+		preempt_enable();
+		return false;
+	}
+	preempt_enable();
+
+	for (i = 0; i < nr_objects; i++) {
+		if (!bc->ctor && memchr_inv(objs[i], 0, bc->size)) {
+			printk(KERN_ERR "test_slab_bulk: %s: object %p not "
+			       "zeroed\n", bc->name, objs[i]);
+			ok = false;
+		}
+		for (j = 0; j < nr_objects; j++) {
+			if (objs[i] == freed[j]) {
+				reused++;
+				break;
+			}
+		}
+	}
+	if (!reused) {
+		printk(KERN_ERR "test_slab_bulk: %s: no freed object was "
+		       "reused\n", bc->name);
+		ok = false;
+	}
+	kmem_cache_free_bulk(bc->cachep, nr_objects, objs);
+	return ok;
+}
+
+/* Time nr_rounds batches both ways, and print the cost per object */
+static void bench_cache(struct bulk_cache *bc)
+{
+	u64 nr = (u64)nr_rounds * nr_objects;
+	u64 single_ns, bulk_ns;
+	ktime_t start;
+	int i, j;
+
+	start = ktime_get();
+	for (i = 0; i < nr_rounds; i++) {
+		for (j = 0; j < nr_objects; j++) {
+			objs[j] = kmem_cache_alloc(bc->cachep, GFP_KERNEL);
+			if (!objs[j]) {
+				kmem_cache_free_bulk(bc->cachep, j, objs);
+				return;
+			}
+		}
+		for (j = 0; j < nr_objects; j++)
+			kmem_cache_free(bc->cachep, objs[j]);
+		cond_resched();
+	}
+	single_ns = ktime_to_ns(ktime_sub(ktime_get(), start));
+
+	start = ktime_get();
+	for (i = 0; i < nr_rounds; i++) {
+		if (!kmem_cache_alloc_bulk(bc->cachep, GFP_KERNEL, nr_objects,
+					   objs))
+			return;
+		kmem_cache_free_bulk(bc->cachep, nr_objects, objs);
+		cond_resched();
+	}
+	bulk_ns = ktime_to_ns(ktime_sub(ktime_get(), start));
+
+	printk(KERN_INFO "test_slab_bulk: %s: %llu ns per object one by one, "
+	       "%llu ns in bulk\n", bc->name,
+	       (unsigned long long)div64_u64(single_ns, nr),
+	       (unsigned long long)div64_u64(bulk_ns, nr));
+}
+
+static int __init slab_bulk_test_init(void)
+{
+	int i, failed = 0;
+
+	if (nr_objects < 2 || nr_rounds < 1)
+		return -EINVAL;
+
+	objs = kcalloc(nr_objects, sizeof(void *), GFP_KERNEL);
+	freed = kcalloc(nr_objects, sizeof(void *), GFP_KERNEL);
+	if (!objs || !freed) {
+		kfree(freed);
+		kfree(objs);
+		return -ENOMEM;
+	}
+
+	for (i = 0; i < ARRAY_SIZE(bulk_caches); i++) {
+		struct bulk_cache *bc = &bulk_caches[i];
+
+		bc->cachep = kmem_cache_create(bc->name, bc->size, 0,
+					       bc->flags, bc->ctor);
+		if (!bc->cachep) {
+			printk(KERN_ERR "test_slab_bulk: cannot create %s\n",
+			       bc->name);
+			failed++;
+			continue;
+		}
+
+		if (constructed_check(bc) && sharing_check(bc) &&
+		    mixed_free_check(bc) && reuse_check(bc))
+			bench_cache(bc);
+		else
+			failed++;
+
+		kmem_cache_destroy(bc->cachep);
+		bc->cachep = NULL;
+	}
+
+	kfree(freed);
+	kfree(objs);
+	return failed ? -EINVAL : -EAGAIN;
+}
+module_init(slab_bulk_test_init);
+
+MODULE_LICENSE("GPL");
+MODULE_DESCRIPTION("kmem_cache_alloc_bulk() and kmem_cache_free_bulk() test");
@@ -0,0 +1,371 @@
+/*
+ * Stress and benchmark test for the vmalloc allocator.
+ *
+ * Runs a set of allocation patterns on every online cpu at once and
+ * prints how long each of them took.  Every area handed out is checked
+ * to lie within VMALLOC_START..VMALLOC_END with the alignment asked for,
+ * and the areas kept alive by the fragmentation test are checked not to
+ * overlap.  E.g.:
+ *
+ *	modprobe test_vmalloc nr_iterations=100000
+ *
+ * The module always fails to load, so that it can be run again: with
+ * -EAGAIN when every case passed on every cpu, and with -EINVAL when one
+ * failed.
+ */
+
+#include <linux/module.h>
+#include <linux/kernel.h>
+#include <linux/vmalloc.h>
+#include <linux/mm.h>
+#include <linux/slab.h>
+#include <linux/random.h>
+#include <linux/kthread.h>
+#include <linux/completion.h>
+#include <linux/ktime.h>
+#include <linux/cpu.h>
+#include <linux/sched.h>
+#include <linux/sort.h>
+#include <linux/log2.h>
+
+static int nr_iterations = 10000;
+module_param(nr_iterations, int, 0444);
+MODULE_PARM_DESC(nr_iterations, "Number of iterations of each test");
+
+static int nr_pages_max = 16;
+module_param(nr_pages_max, int, 0444);
+MODULE_PARM_DESC(nr_pages_max, "Largest size, in pages, of random allocations");
+
+static int nr_long_lived = 1000;
+module_param(nr_long_lived, int, 0444);
+MODULE_PARM_DESC(nr_long_lived,
+		 "Number of allocations kept during the fragmentation test");
+
+/* Check that an area of @size bytes at @ptr was placed where it may be */
+static bool area_ok(const void *ptr, unsigned long size, unsigned long align)
+{
+	unsigned long addr = (unsigned long)ptr;
+
+	if (addr >= VMALLOC_START && addr + size > addr &&
+	    addr + size <= VMALLOC_END && IS_ALIGNED(addr, align))
+		return true;
+
+	printk(KERN_ERR "test_vmalloc: bad area %p, size %lu, align %lu\n",
+	       ptr, size, align);
+	return false;
+}
+
+/* Allocate and free one page at a time */
+static int fix_size_alloc_test(void)
+{
+	void *ptr;
+	int i;
+
+	for (i = 0; i < nr_iterations; i++) {
+		ptr = vmalloc(PAGE_SIZE);
+		if (!ptr)
+			return -ENOMEM;
+		if (!area_ok(ptr, PAGE_SIZE, PAGE_SIZE)) {
+			vfree(ptr);
+			return -EINVAL;
+		}
+		*((u8 *)ptr) = 0;
+		vfree(ptr);
+	}
+	return 0;
+}
+
+/* Allocate and free random sizes */
+static int random_size_alloc_test(void)
+{
+	unsigned long size;
+	void *ptr;
+	int i;
+
+	for (i = 0; i < nr_iterations; i++) {
+		size = (random32() % nr_pages_max + 1) << PAGE_SHIFT;
+		ptr = vmalloc(size);
+		if (!ptr)
+			return -ENOMEM;
+		if (!area_ok(ptr, size, PAGE_SIZE)) {
+			vfree(ptr);
+			return -EINVAL;
+		}
+		vfree(ptr);
+	}
+	return 0;
+}
+
+/*
+ * ioremap style areas are aligned to their size rounded up to a power
+ * of two, up to IOREMAP_MAX_ORDER: the free space search has to skip
+ * the holes too small once aligned.
+ */
+static int align_alloc_test(void)
+{
+	struct vm_struct *area;
+	unsigned long size, align;
+	int i;
+
+	for (i = 0; i < nr_iterations; i++) {
+		size = (random32() % nr_pages_max + 1) << PAGE_SHIFT;
+		align = min_t(unsigned long, roundup_pow_of_two(size + 1),
+			      1UL << IOREMAP_MAX_ORDER);
+		area = __get_vm_area(size, VM_IOREMAP,
+				     VMALLOC_START, VMALLOC_END);
+		if (!area)
+			return -ENOMEM;
+		if (!area_ok(area->addr, size, align)) {
+			free_vm_area(area);
+			return -EINVAL;
+		}
+		free_vm_area(area);
+	}
+	return 0;
+}
+
+struct test_area {
+	unsigned long start;
+	unsigned long end;
+};
+
+static int cmp_area(const void *a, const void *b)
+{
+	const struct test_area *x = a, *y = b;
+
+	if (x->start == y->start)
+		return 0;
+	return x->start < y->start ? -1 : 1;
+}
+
+/* Check that none of @nr live areas overlaps another */
+static bool areas_disjoint(struct test_area *areas, int nr)
+{
+	int i;
+
+	sort(areas, nr, sizeof(*areas), cmp_area, NULL);
+	for (i = 1; i < nr; i++) {
+		if (areas[i].start < areas[i - 1].end) {
+			printk(KERN_ERR "test_vmalloc: areas %lx-%lx and "
+			       "%lx-%lx overlap\n",
+			       areas[i - 1].start, areas[i - 1].end,
+			       areas[i].start, areas[i].end);
+			return false;
+		}
+	}
+	return true;
+}
+
+/*
+ * Keep many small areas around, free every other one, and allocate and
+ * free in the holes this leaves: this is where a linear search of the
+ * free space used to take longest.  Finally refill the holes and check
+ * that no two of the live areas overlap.
+ */
+static int fragmented_alloc_test(void)
+{
+	void **ptrs;
+	struct test_area *areas;
+	unsigned long size;
+	void *ptr;
+	int i, ret = 0;
+
+	ptrs = vzalloc(nr_long_lived * sizeof(void *));
+	areas = vzalloc(nr_long_lived * sizeof(*areas));
+	if (!ptrs || !areas) {
+		ret = -ENOMEM;
+		goto out;
+	}
+
+	for (i = 0; i < nr_long_lived; i++) {
+		ptrs[i] = vmalloc(PAGE_SIZE);
+		if (!ptrs[i]) {
+			ret = -ENOMEM;
+			goto out;
+		}
+		areas[i].start = (unsigned long)ptrs[i];
+		areas[i].end = areas[i].start + PAGE_SIZE;
+	}
+	for (i = 0; i < nr_long_lived; i += 2) {
+		vfree(ptrs[i]);
+		ptrs[i] = NULL;
+	}
+
+	for (i = 0; i < nr_iterations; i++) {
+		size = (random32() % 2 + 1) << PAGE_SHIFT;
+		ptr = vmalloc(size);
+		if (!ptr) {
+			ret = -ENOMEM;
+			goto out;
+		}
+		if (!area_ok(ptr, size, PAGE_SIZE))
+			ret = -EINVAL;
+		vfree(ptr);
+		if (ret)
+			goto out;
+	}
+
+	for (i = 0; i < nr_long_lived; i += 2) {
+		size = (random32() % 2 + 1) << PAGE_SHIFT;
+		ptrs[i] = vmalloc(size);
+		if (!ptrs[i]) {
+			ret = -ENOMEM;
+			goto out;
+		}
+		if (!area_ok(ptrs[i], size, PAGE_SIZE)) {
+			ret = -EINVAL;
+			goto out;
+		}
+		areas[i].start = (unsigned long)ptrs[i];
+		areas[i].end = areas[i].start + size;
+	}
+	if (!areas_disjoint(areas, nr_long_lived))
+		ret = -EINVAL;
+out:
+	for (i = 0; ptrs && i < nr_long_lived; i++)
+		vfree(ptrs[i]);
+	vfree(ptrs);
+	vfree(areas);
+	return ret;
+}
+
+/* Map and unmap the same pages with vmap() */
+static int vmap_test(void)
+{
+	struct page *pages[4];
+	void *ptr;
+	int i, ret = 0;
+
+	for (i = 0; i < ARRAY_SIZE(pages); i++) {
+		pages[i] = alloc_page(GFP_KERNEL);
+		if (!pages[i]) {
+			while (i--)
+				__free_page(pages[i]);
+			return -ENOMEM;
+		}
+	}
+
+	for (i = 0; i < nr_iterations; i++) {
+		ptr = vmap(pages, ARRAY_SIZE(pages), VM_MAP, PAGE_KERNEL);
+		if (!ptr) {
+			ret = -ENOMEM;
+			break;
+		}
+		if (!area_ok(ptr, ARRAY_SIZE(pages) << PAGE_SHIFT, PAGE_SIZE))
+			ret = -EINVAL;
+		vunmap(ptr);
+		if (ret)
+			break;
+	}
+
+	for (i = 0; i < ARRAY_SIZE(pages); i++)
+		__free_page(pages[i]);
+	return ret;
+}
+
+static struct test_case_desc {
+	const char *name;
+	int (*test_func)(void);
+} test_case_array[] = {
+	{ "fix_size_alloc_test", fix_size_alloc_test },
+	{ "random_size_alloc_test", random_size_alloc_test },
+	{ "align_alloc_test", align_alloc_test },
+	{ "fragmented_alloc_test", fragmented_alloc_test },
+	{ "vmap_test", vmap_test },
+};
+
+struct test_driver {
+	struct task_struct *task;
+	struct completion done;
+	s64 usecs[ARRAY_SIZE(test_case_array)];
+	int failed[ARRAY_SIZE(test_case_array)];
+};
+
+static DECLARE_COMPLETION(test_start);
+
+static int test_func(void *private)
+{
+	struct test_driver *t = private;
+	ktime_t start;
+	int i;
+
+	wait_for_completion(&test_start);
+
+	for (i = 0; i < ARRAY_SIZE(test_case_array); i++) {
+		start = ktime_get();
+		t->failed[i] = test_case_array[i].test_func();
+		t->usecs[i] = ktime_us_delta(ktime_get(), start);
+		cond_resched();
+	}
+
+	complete(&t->done);
+
+	/* wait for kthread_stop() */
+	set_current_state(TASK_UNINTERRUPTIBLE);
+	while (!kthread_should_stop()) {
+		schedule();
+		set_current_state(TASK_UNINTERRUPTIBLE);
+	}
+	__set_current_state(TASK_RUNNING);
+	return 0;
+}
+
+static int __init vmalloc_test_init(void)
+{
+	struct test_driver *tdriver;
+	int cpu, i, failed = 0;
+
+	tdriver = kcalloc(nr_cpu_ids, sizeof(*tdriver), GFP_KERNEL);
+	if (!tdriver)
+		return -ENOMEM;
+
+	get_online_cpus();
+
+	for_each_online_cpu(cpu) {
+		struct test_driver *t = &tdriver[cpu];
+
+		init_completion(&t->done);
+		t->task = kthread_create(test_func, t, "vmalloc_test/%d", cpu);
+		if (IS_ERR(t->task)) {
+			printk(KERN_ERR "test_vmalloc: cannot start thread "
+			       "on cpu %d\n", cpu);
+			t->task = NULL;
+			failed++;
+			continue;
+		}
+		kthread_bind(t->task, cpu);
+		wake_up_process(t->task);
+	}
+
+	/* let all the threads hit the allocator at the same time */
+	complete_all(&test_start);
+
+	for_each_online_cpu(cpu) {
+		struct test_driver *t = &tdriver[cpu];
+
+		if (!t->task)
+			continue;
+		wait_for_completion(&t->done);
+		kthread_stop(t->task);
+
+		for (i = 0; i < ARRAY_SIZE(test_case_array); i++) {
+			if (t->failed[i])
+				failed++;
+			printk(KERN_INFO "test_vmalloc: cpu %d %s: %s, "
+			       "%d iterations in %lld usecs\n", cpu,
+			       test_case_array[i].name,
+			       t->failed[i] ? "failed" : "passed",
+			       nr_iterations, (long long)t->usecs[i]);
+		}
+	}
+
+	put_online_cpus();
+	kfree(tdriver);
+
+	/* Fail will directly unload the module */
+	return failed ? -EINVAL : -EAGAIN;
+}
+module_init(vmalloc_test_init);
+
+MODULE_LICENSE("GPL");
+MODULE_DESCRIPTION("vmalloc stress and benchmark test");
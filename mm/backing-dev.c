@@ -100,6 +100,11 @@ static int bdi_debug_stats_show(struct seq_file *m, void *v)
 		   "BdiDirtied:         %10lu kB\n"
 		   "BdiWritten:         %10lu kB\n"
 		   "BdiWriteBandwidth:  %10lu kBps\n"
+		   "ReadAhead:          %10lu kB\n"
+		   "ReadAheadUsed:      %10lu kB\n"
+		   "ReadAheadWasted:    %10lu kB\n"
+		   "ReadAheadStall:     %10lu kB\n"
+		   "ReadAheadWindow:    %10lu kB\n"
 		   "b_dirty:            %10lu\n"
 		   "b_io:               %10lu\n"
 		   "b_more_io:          %10lu\n"
@@ -113,6 +118,12 @@ static int bdi_debug_stats_show(struct seq_file *m, void *v)
 		   (unsigned long) K(bdi_stat(bdi, BDI_DIRTIED)),
 		   (unsigned long) K(bdi_stat(bdi, BDI_WRITTEN)),
 		   (unsigned long) K(bdi->write_bandwidth),
+		   (unsigned long) K(bdi_stat(bdi, BDI_READAHEAD)),
+		   (unsigned long) K(bdi_stat(bdi, BDI_READAHEAD_USED)),
+		   (unsigned long) K(bdi_stat(bdi, BDI_READAHEAD_WASTED)),
+		   (unsigned long) K(bdi_stat(bdi, BDI_READAHEAD_STALL)),
+		   K(bdi->ra_adaptive && bdi->ra_adapt_pages ?
+		     bdi->ra_adapt_pages : bdi->ra_pages),
 		   nr_dirty,
 		   nr_io,
 		   nr_more_io,
@@ -171,6 +182,7 @@ static ssize_t read_ahead_kb_store(struct device *dev,
 	read_ahead_kb = simple_strtoul(buf, &end, 10);
 	if (*buf && (end[0] == '\0' || (end[0] == '\n' && end[1] == '\0'))) {
 		bdi->ra_pages = read_ahead_kb >> (PAGE_SHIFT - 10);
+		bdi->ra_adapt_pages = 0;
 		ret = count;
 	}
 	return ret;
@@ -225,12 +237,32 @@ static ssize_t max_ratio_store(struct device *dev,
 }
 BDI_SHOW(max_ratio, bdi->max_ratio)
 
+static ssize_t read_ahead_adaptive_store(struct device *dev,
+		struct device_attribute *attr, const char *buf, size_t count)
+{
+	struct backing_dev_info *bdi = dev_get_drvdata(dev);
+	char *end;
+	unsigned long adaptive;
+	ssize_t ret = -EINVAL;
+
+	adaptive = simple_strtoul(buf, &end, 10);
+	if (*buf && (end[0] == '\0' || (end[0] == '\n' && end[1] == '\0')) &&
+	    adaptive <= 1) {
+		bdi->ra_adaptive = adaptive;
+		bdi->ra_adapt_pages = 0;
+		ret = count;
+	}
+	return ret;
+}
+BDI_SHOW(read_ahead_adaptive, bdi->ra_adaptive)
+
 #define __ATTR_RW(attr) __ATTR(attr, 0644, attr##_show, attr##_store)
 
 static struct device_attribute bdi_dev_attrs[] = {
 	__ATTR_RW(read_ahead_kb),
 	__ATTR_RW(min_ratio),
 	__ATTR_RW(max_ratio),
+	__ATTR_RW(read_ahead_adaptive),
 	__ATTR_NULL,
 };
 
@@ -679,6 +711,13 @@ int bdi_init(struct backing_dev_info *bdi)
 
 	bdi->dirty_exceeded = 0;
 
+	bdi->ra_adapt_pages = 0;
+	bdi->ra_adaptive = 0;
+	bdi->ra_stamp = jiffies;
+	bdi->ra_used_stamp = 0;
+	bdi->ra_wasted_stamp = 0;
+	bdi->ra_stall_stamp = 0;
+
 	bdi->bw_time_stamp = jiffies;
 	bdi->written_stamp = 0;
 
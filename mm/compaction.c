@@ -14,6 +14,9 @@
 #include <linux/backing-dev.h>
 #include <linux/sysctl.h>
 #include <linux/sysfs.h>
+#include <linux/kthread.h>
+#include <linux/freezer.h>
+#include <linux/cpu.h>
 #include "internal.h"
 
 #define CREATE_TRACE_POINTS
@@ -31,9 +34,11 @@ struct compact_control {
 	struct list_head migratepages;	/* List of pages being migrated */
 	unsigned long nr_freepages;	/* Number of isolated free pages */
 	unsigned long nr_migratepages;	/* Number of pages to migrate */
+	unsigned long nr_moved;		/* Pages migrated so far */
 	unsigned long free_pfn;		/* isolate_freepages search base */
 	unsigned long migrate_pfn;	/* isolate_migratepages search base */
 	bool sync;			/* Synchronous migration */
+	bool proactive;			/* kcompactd, no allocation failed yet */
 
 	unsigned int order;		/* order a direct compactor needs */
 	int migratetype;		/* MOVABLE, RECLAIMABLE etc */
@@ -522,7 +527,11 @@ static int compact_zone(struct zone *zone, struct compact_control *cc)
 {
 	int ret;
 
-	ret = compaction_suitable(zone, cc->order);
+	/* A proactive caller has done its own fragmentation check */
+	if (cc->proactive)
+		ret = COMPACT_CONTINUE;
+	else
+		ret = compaction_suitable(zone, cc->order);
 	switch (ret) {
 	case COMPACT_PARTIAL:
 	case COMPACT_SKIPPED:
@@ -561,6 +570,7 @@ static int compact_zone(struct zone *zone, struct compact_control *cc)
 		update_nr_listpages(cc);
 		nr_remaining = cc->nr_migratepages;
 
+		cc->nr_moved += nr_migrate - nr_remaining;
 		count_vm_event(COMPACTBLOCKS);
 		count_vm_events(COMPACTPAGES, nr_migrate - nr_remaining);
 		if (nr_remaining)
@@ -744,3 +754,288 @@ void compaction_unregister_node(struct node *node)
 	return device_remove_file(&node->dev, &dev_attr_compact);
 }
 #endif /* CONFIG_SYSFS && CONFIG_NUMA */
+
+/*
+ * kcompactd compacts a node in the background, so that high-order
+ * allocations find free blocks instead of stalling in direct compaction.
+ * It is woken by kswapd once reclaim for a high-order request is done,
+ * and, unless kcompactd_extfrag_threshold is 1000, wakes up by itself
+ * every kcompactd_sleep_millisecs to compact any zone whose fragmentation
+ * index at kcompactd_order is above that threshold.
+ */
+int sysctl_kcompactd_order = PAGE_ALLOC_COSTLY_ORDER;
+int sysctl_kcompactd_extfrag_threshold = 1000;
+int sysctl_kcompactd_sleep_millisecs = 500;
+
+/* Is kcompactd worth running on this zone before anyone fails to allocate? */
+static bool kcompactd_zone_fragmented(struct zone *zone, int order)
+{
+	unsigned long watermark;
+
+	/* As in compaction_suitable(), migration needs some free pages */
+	watermark = low_wmark_pages(zone) + (2UL << order);
+	if (!zone_watermark_ok(zone, 0, watermark, 0, 0))
+		return false;
+
+	/* -1000 means a block of this order is already free */
+	return fragmentation_index(zone, order) >
+		sysctl_kcompactd_extfrag_threshold;
+}
+
+static bool kcompactd_node_suitable(pg_data_t *pgdat, int order,
+				    int classzone_idx)
+{
+	int zoneid;
+
+	for (zoneid = 0; zoneid <= classzone_idx; zoneid++) {
+		struct zone *zone = &pgdat->node_zones[zoneid];
+
+		if (!populated_zone(zone))
+			continue;
+		if (compaction_suitable(zone, order) == COMPACT_CONTINUE)
+			return true;
+	}
+	return false;
+}
+
+static bool kcompactd_work_requested(pg_data_t *pgdat)
+{
+	return pgdat->kcompactd_max_order > 0 || kthread_should_stop();
+}
+
+/*
+ * Compact the zones of a node for an order kswapd could not satisfy,
+ * or, when @proactive, for sysctl_kcompactd_order in whichever zones
+ * are fragmented beyond sysctl_kcompactd_extfrag_threshold.
+ *
+ * Returns false if zones were compacted proactively but none of them
+ * ended up less fragmented than before.
+ */
+static bool kcompactd_do_work(pg_data_t *pgdat, bool proactive)
+{
+	int order, classzone_idx, zoneid;
+	unsigned long nr_moved = 0;
+	bool drained = false;
+	bool compacted = false, improved = false;
+
+	if (proactive) {
+		order = sysctl_kcompactd_order;
+		classzone_idx = pgdat->nr_zones - 1;
+	} else {
+		order = pgdat->kcompactd_max_order;
+		classzone_idx = pgdat->kcompactd_classzone_idx;
+	}
+
+	for (zoneid = 0; zoneid <= classzone_idx; zoneid++) {
+		struct zone *zone = &pgdat->node_zones[zoneid];
+		struct compact_control cc = {
+			.nr_freepages = 0,
+			.nr_migratepages = 0,
+			.nr_moved = 0,
+			.order = order,
+			.migratetype = MIGRATE_MOVABLE,
+			.zone = zone,
+			.sync = true,
+			.proactive = proactive,
+		};
+		int status, fragindex = 0;
+
+		if (kthread_should_stop())
+			break;
+		if (!populated_zone(zone))
+			continue;
+		if (proactive) {
+			if (!kcompactd_zone_fragmented(zone, order))
+				continue;
+		} else if (compaction_deferred(zone)) {
+			continue;
+		}
+
+		/* Flush pending updates to the LRU lists */
+		if (!drained) {
+			lru_add_drain_all();
+			drained = true;
+		}
+
+		INIT_LIST_HEAD(&cc.freepages);
+		INIT_LIST_HEAD(&cc.migratepages);
+
+		if (proactive) {
+			count_vm_event(KCOMPACTD_PROACTIVE);
+			fragindex = fragmentation_index(zone, order);
+		}
+		status = compact_zone(zone, &cc);
+		nr_moved += cc.nr_moved;
+
+		if (proactive) {
+			compacted = true;
+			if (fragmentation_index(zone, order) < fragindex)
+				improved = true;
+		}
+
+		if (zone_watermark_ok(zone, order, low_wmark_pages(zone), 0, 0)) {
+			zone->compact_considered = 0;
+			zone->compact_defer_shift = 0;
+		} else if (status == COMPACT_COMPLETE && !proactive) {
+			/* The whole zone was scanned in vain: back off */
+			defer_compaction(zone);
+		}
+
+		VM_BUG_ON(!list_empty(&cc.freepages));
+		VM_BUG_ON(!list_empty(&cc.migratepages));
+	}
+
+	if (nr_moved)
+		count_vm_events(KCOMPACTD_PAGES, nr_moved);
+
+	/*
+	 * Regardless of success, we are done until woken up next.  A request
+	 * that arrived meanwhile for a lower order than what we just did is
+	 * considered satisfied.
+	 */
+	if (!proactive) {
+		if (pgdat->kcompactd_max_order <= order)
+			pgdat->kcompactd_max_order = 0;
+		if (pgdat->kcompactd_classzone_idx >= classzone_idx)
+			pgdat->kcompactd_classzone_idx = pgdat->nr_zones - 1;
+	}
+
+	return improved || !compacted;
+}
+
+/*
+ * Called by kswapd when it goes to sleep after reclaiming for a
+ * high-order allocation.
+ */
+void wakeup_kcompactd(pg_data_t *pgdat, int order, int classzone_idx)
+{
+	if (!order)
+		return;
+
+	if (pgdat->kcompactd_max_order < order)
+		pgdat->kcompactd_max_order = order;
+	if (pgdat->kcompactd_classzone_idx > classzone_idx)
+		pgdat->kcompactd_classzone_idx = classzone_idx;
+
+	if (!waitqueue_active(&pgdat->kcompactd_wait))
+		return;
+	if (!kcompactd_node_suitable(pgdat, order, classzone_idx))
+		return;
+
+	wake_up_interruptible(&pgdat->kcompactd_wait);
+}
+
+static int kcompactd(void *p)
+{
+	pg_data_t *pgdat = (pg_data_t *)p;
+	const struct cpumask *cpumask = cpumask_of_node(pgdat->node_id);
+	unsigned int defer_shift = 0, deferred = 0;
+
+	if (!cpumask_empty(cpumask))
+		set_cpus_allowed_ptr(current, cpumask);
+
+	set_freezable();
+
+	pgdat->kcompactd_max_order = 0;
+	pgdat->kcompactd_classzone_idx = pgdat->nr_zones - 1;
+
+	while (!kthread_should_stop()) {
+		long timeout;
+
+		timeout = msecs_to_jiffies(sysctl_kcompactd_sleep_millisecs);
+		wait_event_freezable_timeout(pgdat->kcompactd_wait,
+				kcompactd_work_requested(pgdat), timeout);
+		if (kthread_should_stop())
+			break;
+
+		if (pgdat->kcompactd_max_order > 0) {
+			count_vm_event(KCOMPACTD_WAKE);
+			kcompactd_do_work(pgdat, false);
+		} else if (sysctl_kcompactd_extfrag_threshold < 1000) {
+			/*
+			 * A proactive pass that did not lower the fragmentation
+			 * index is likely to fail again, e.g. on unmovable
+			 * pages, so skip twice as many periods after each one.
+			 */
+			if (deferred) {
+				deferred--;
+			} else if (kcompactd_do_work(pgdat, true)) {
+				defer_shift = 0;
+			} else {
+				if (defer_shift < COMPACT_MAX_DEFER_SHIFT)
+					defer_shift++;
+				deferred = 1U << defer_shift;
+			}
+		}
+	}
+
+	return 0;
+}
+
+/*
+ * This kcompactd start function will be called by init and node-hot-add.
+ */
+int kcompactd_run(int nid)
+{
+	pg_data_t *pgdat = NODE_DATA(nid);
+	int ret = 0;
+
+	if (pgdat->kcompactd)
+		return 0;
+
+	pgdat->kcompactd = kthread_run(kcompactd, pgdat, "kcompactd%d", nid);
+	if (IS_ERR(pgdat->kcompactd)) {
+		printk(KERN_ERR "Failed to start kcompactd on node %d\n", nid);
+		ret = PTR_ERR(pgdat->kcompactd);
+		pgdat->kcompactd = NULL;
+	}
+	return ret;
+}
+
+/*
+ * Called by memory hotplug when all memory in a node is offlined.
+ */
+void kcompactd_stop(int nid)
+{
+	struct task_struct *kcompactd = NODE_DATA(nid)->kcompactd;
+
+	if (kcompactd) {
+		kthread_stop(kcompactd);
+		NODE_DATA(nid)->kcompactd = NULL;
+	}
+}
+
+/*
+ * A cpu of a node came back online: let its kcompactd run there again,
+ * as kswapd does.
+ */
+static int __devinit kcompactd_cpu_callback(struct notifier_block *nfb,
+					    unsigned long action, void *hcpu)
+{
+	int nid;
+
+	if (action == CPU_ONLINE || action == CPU_ONLINE_FROZEN) {
+		for_each_node_state(nid, N_HIGH_MEMORY) {
+			pg_data_t *pgdat = NODE_DATA(nid);
+			const struct cpumask *mask;
+
+			mask = cpumask_of_node(pgdat->node_id);
+
+			if (pgdat->kcompactd &&
+			    cpumask_any_and(cpu_online_mask, mask) < nr_cpu_ids)
+				set_cpus_allowed_ptr(pgdat->kcompactd, mask);
+		}
+	}
+	return NOTIFY_OK;
+}
+
+static int __init kcompactd_init(void)
+{
+	int nid;
+
+	for_each_node_state(nid, N_HIGH_MEMORY)
+		kcompactd_run(nid);
+	hotcpu_notifier(kcompactd_cpu_callback, 0);
+	return 0;
+}
+module_init(kcompactd_init)
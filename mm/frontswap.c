@@ -0,0 +1,172 @@
+/*
+ * Frontswap frontend
+ *
+ * This code provides the generic "frontend" layer to call a matching
+ * "backend" driver implementation of frontswap.  A backend such as
+ * zcache or Xen tmem may absorb a page synchronously when it is swapped
+ * out, so that swap_writepage() and swap_readpage() never reach the
+ * swap device for it.
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2.
+ */
+
+#include <linux/module.h>
+#include <linux/mm.h>
+#include <linux/swap.h>
+#include <linux/swapops.h>
+#include <linux/debugfs.h>
+#include <linux/frontswap.h>
+
+/*
+ * This global enablement flag is read by every swap_writepage() and
+ * swap_readpage(), so like cleancache_enabled it is a plain global
+ * rather than a check of frontswap_ops.
+ */
+int frontswap_enabled;
+EXPORT_SYMBOL(frontswap_enabled);
+
+/*
+ * frontswap_ops is set by frontswap_register_ops to contain the pointers
+ * to the frontswap "backend" implementation functions.
+ */
+static struct frontswap_ops frontswap_ops;
+
+/* useful stats available in /sys/kernel/debug/frontswap */
+static u64 frontswap_succ_puts;
+static u64 frontswap_failed_puts;
+static u64 frontswap_gets;
+static u64 frontswap_flushes;
+
+/*
+ * register operations for frontswap, returning previous thus allowing
+ * detection of multiple backends and possible nesting
+ */
+struct frontswap_ops frontswap_register_ops(struct frontswap_ops *ops)
+{
+	struct frontswap_ops old = frontswap_ops;
+
+	frontswap_ops = *ops;
+	frontswap_enabled = 1;
+	return old;
+}
+EXPORT_SYMBOL(frontswap_register_ops);
+
+/* Called when a swap device is swapon'd */
+void __frontswap_init(struct swap_info_struct *sis)
+{
+	if (sis->frontswap_map == NULL)
+		return;
+	(*frontswap_ops.init)(sis->type);
+}
+EXPORT_SYMBOL(__frontswap_init);
+
+/*
+ * "Put" data from a page to frontswap and associate it with the page's
+ * swaptype and offset.  Page must be locked and in the swap cache.
+ * If frontswap already contains a page with matching swaptype and
+ * offset, the frontswap implementation may either overwrite the data
+ * and return success or flush the page from frontswap and return
+ * failure; either way the stale copy must not be found again.
+ */
+int __frontswap_put_page(struct page *page)
+{
+	swp_entry_t entry = { .val = page_private(page), };
+	struct swap_info_struct *sis = page_swap_info(page);
+	pgoff_t offset = swp_offset(entry);
+	int dup = 0;
+	int ret;
+
+	BUG_ON(!PageLocked(page));
+	if (sis->frontswap_map == NULL)
+		return -1;
+	if (frontswap_test(sis, offset))
+		dup = 1;
+	ret = (*frontswap_ops.put_page)(sis->type, offset, page);
+	if (ret == 0) {
+		frontswap_set(sis, offset);
+		frontswap_succ_puts++;
+		if (!dup)
+			atomic_inc(&sis->frontswap_pages);
+	} else {
+		frontswap_failed_puts++;
+		/* the old data is now stale: it must not be read back */
+		if (dup && frontswap_test_and_clear(sis, offset)) {
+			(*frontswap_ops.flush_page)(sis->type, offset);
+			atomic_dec(&sis->frontswap_pages);
+		}
+	}
+	return ret;
+}
+EXPORT_SYMBOL(__frontswap_put_page);
+
+/*
+ * "Get" data from frontswap associated with swaptype and offset that were
+ * specified when the data was put to frontswap and use it to fill the
+ * specified page with data.  Page must be locked and in the swap cache.
+ */
+int __frontswap_get_page(struct page *page)
+{
+	swp_entry_t entry = { .val = page_private(page), };
+	struct swap_info_struct *sis = page_swap_info(page);
+	pgoff_t offset = swp_offset(entry);
+	int ret = -1;
+
+	BUG_ON(!PageLocked(page));
+	if (frontswap_test(sis, offset))
+		ret = (*frontswap_ops.get_page)(sis->type, offset, page);
+	if (ret == 0)
+		frontswap_gets++;
+	return ret;
+}
+EXPORT_SYMBOL(__frontswap_get_page);
+
+/*
+ * Flush any data from frontswap associated with the specified swaptype
+ * and offset so that a subsequent "get" will fail.  Called with
+ * swap_lock held when the swap slot is given back.
+ */
+void __frontswap_flush_page(struct swap_info_struct *sis, pgoff_t offset)
+{
+	if (frontswap_test_and_clear(sis, offset)) {
+		(*frontswap_ops.flush_page)(sis->type, offset);
+		atomic_dec(&sis->frontswap_pages);
+		frontswap_flushes++;
+	}
+}
+EXPORT_SYMBOL(__frontswap_flush_page);
+
+/*
+ * Flush all data from frontswap associated with all offsets for the
+ * specified swaptype.  Called at swapoff, once try_to_unuse() has
+ * brought every page back in.
+ */
+void __frontswap_flush_area(struct swap_info_struct *sis)
+{
+	if (sis->frontswap_map == NULL)
+		return;
+	(*frontswap_ops.flush_area)(sis->type);
+	atomic_set(&sis->frontswap_pages, 0);
+	memset(sis->frontswap_map, 0,
+	       BITS_TO_LONGS(sis->max) * sizeof(long));
+}
+EXPORT_SYMBOL(__frontswap_flush_area);
+
+static int __init init_frontswap(void)
+{
+#ifdef CONFIG_DEBUG_FS
+	struct dentry *root = debugfs_create_dir("frontswap", NULL);
+
+	if (root == NULL)
+		return -ENXIO;
+	debugfs_create_u64("succ_puts", S_IRUGO,
+				root, &frontswap_succ_puts);
+	debugfs_create_u64("failed_puts", S_IRUGO,
+				root, &frontswap_failed_puts);
+	debugfs_create_u64("gets", S_IRUGO,
+				root, &frontswap_gets);
+	debugfs_create_u64("flushes", S_IRUGO,
+				root, &frontswap_flushes);
+#endif
+	return 0;
+}
+module_init(init_frontswap);
@@ -37,6 +37,7 @@
 #include <linux/hash.h>
 #include <linux/freezer.h>
 #include <linux/oom.h>
+#include <linux/math64.h>
 
 #include <asm/tlbflush.h>
 #include "internal.h"
@@ -190,6 +191,31 @@ static unsigned int ksm_thread_pages_to_scan = 100;
 /* Milliseconds ksmd should sleep between batches */
 static unsigned int ksm_thread_sleep_millisecs = 20;
 
+/* Whether ksmd should adjust pages_to_scan itself */
+static unsigned int ksm_adaptive_scan;
+
+/* Share of one cpu that an adaptive ksmd may use, in percent */
+static unsigned int ksm_max_cpu_percent = 20;
+
+/* Bounds of pages_to_scan when adaptive */
+static unsigned int ksm_min_pages_to_scan = 16;
+static unsigned int ksm_max_pages_to_scan = 4096;
+
+/* Pages scanned and merged, and ksmd runtime, since the last adjustment */
+static unsigned long ksm_tune_stamp;
+static unsigned long ksm_tune_scanned;
+static unsigned long ksm_tune_merged;
+static u64 ksm_tune_runtime;
+
+/* Whether to map all-zero pages to the zero page rather than merge them */
+static unsigned int ksm_use_zero_pages;
+
+/* The number of pages replaced by the zero page */
+static unsigned long ksm_zero_pages_merged;
+
+/* Checksum of an all-zero page, to spot candidates for the zero page */
+static u32 zero_checksum __read_mostly;
+
 #define KSM_RUN_STOP	0
 #define KSM_RUN_MERGE	1
 #define KSM_RUN_UNMERGE	2
@@ -770,6 +796,7 @@ static int replace_page(struct vm_area_struct *vma, struct page *page,
 	pud_t *pud;
 	pmd_t *pmd;
 	pte_t *ptep;
+	pte_t newpte;
 	spinlock_t *ptl;
 	unsigned long addr;
 	int err = -EFAULT;
@@ -797,12 +824,20 @@ static int replace_page(struct vm_area_struct *vma, struct page *page,
 		goto out;
 	}
 
-	get_page(kpage);
-	page_add_anon_rmap(kpage, vma, addr);
+	if (kpage == ZERO_PAGE(addr)) {
+		/* as in do_anonymous_page(): no refcount, rmap or rss */
+		newpte = pte_mkspecial(pfn_pte(page_to_pfn(kpage),
+					       vma->vm_page_prot));
+		dec_mm_counter(mm, MM_ANONPAGES);
+	} else {
+		get_page(kpage);
+		page_add_anon_rmap(kpage, vma, addr);
+		newpte = mk_pte(kpage, vma->vm_page_prot);
+	}
 
 	flush_cache_page(vma, addr, pte_pfn(*ptep));
 	ptep_clear_flush(vma, addr, ptep);
-	set_pte_at_notify(mm, addr, ptep, mk_pte(kpage, vma->vm_page_prot));
+	set_pte_at_notify(mm, addr, ptep, newpte);
 
 	page_remove_rmap(page);
 	if (!page_mapped(page))
@@ -847,7 +882,8 @@ static int page_trans_compound_anon_split(struct page *page)
  * @vma: the vma that holds the pte pointing to page
  * @page: the PageAnon page that we want to replace with kpage
  * @kpage: the PageKsm page that we want to map instead of page,
- *         or NULL the first time when we want to use page as kpage.
+ *         or NULL the first time when we want to use page as kpage,
+ *         or the zero page when page is all zeroes.
  *
  * This function returns 0 if the pages were merged, -EFAULT otherwise.
  */
@@ -897,7 +933,8 @@ static int try_to_merge_one_page(struct vm_area_struct *vma,
 			err = replace_page(vma, page, kpage, orig_pte);
 	}
 
-	if ((vma->vm_flags & VM_LOCKED) && kpage && !err) {
+	if ((vma->vm_flags & VM_LOCKED) && kpage && !err &&
+	    PageKsm(kpage)) {
 		munlock_vma_page(page);
 		if (!PageMlocked(kpage)) {
 			unlock_page(page);
@@ -944,6 +981,33 @@ out:
 	return err;
 }
 
+/*
+ * try_to_merge_with_zero_page - replace an all-zero page by the zero page,
+ * just as if it had only ever been read: nothing is added to the stable
+ * tree, and a later write fault gives the mm a fresh page again.
+ *
+ * This function returns 0 if the page was replaced, -EFAULT otherwise.
+ */
+static int try_to_merge_with_zero_page(struct rmap_item *rmap_item,
+				       struct page *page)
+{
+	struct mm_struct *mm = rmap_item->mm;
+	struct vm_area_struct *vma;
+	int err = -EFAULT;
+
+	down_read(&mm->mmap_sem);
+	if (ksm_test_exit(mm))
+		goto out;
+	vma = find_vma(mm, rmap_item->address);
+	if (!vma || vma->vm_start > rmap_item->address)
+		goto out;
+
+	err = try_to_merge_one_page(vma, page, ZERO_PAGE(rmap_item->address));
+out:
+	up_read(&mm->mmap_sem);
+	return err;
+}
+
 /*
  * try_to_merge_two_pages - take two identical pages and prepare them
  * to be merged into one page.
@@ -1153,6 +1217,7 @@ static void stable_tree_append(struct rmap_item *rmap_item,
 	rmap_item->head = stable_node;
 	rmap_item->address |= STABLE_FLAG;
 	hlist_add_head(&rmap_item->hlist, &stable_node->hlist);
+	ksm_tune_merged++;
 
 	if (rmap_item->hlist.next)
 		ksm_pages_sharing++;
@@ -1209,6 +1274,20 @@ static void cmp_and_merge_page(struct page *page, struct rmap_item *rmap_item)
 		return;
 	}
 
+	/*
+	 * An all-zero page is best merged with the zero page, which costs
+	 * no stable tree node and no ksm page.
+	 */
+	if (ksm_use_zero_pages && checksum == zero_checksum &&
+	    !PageKsm(page)) {
+		err = try_to_merge_with_zero_page(rmap_item, page);
+		if (!err) {
+			ksm_zero_pages_merged++;
+			ksm_tune_merged++;
+			return;
+		}
+	}
+
 	tree_rmap_item =
 		unstable_tree_search_insert(rmap_item, page, &tree_page);
 	if (tree_rmap_item) {
@@ -1421,7 +1500,60 @@ static void ksm_do_scan(unsigned int scan_npages)
 		if (!PageKsm(page) || !in_stable_tree(rmap_item))
 			cmp_and_merge_page(page, rmap_item);
 		put_page(page);
+		ksm_tune_scanned++;
+	}
+}
+
+#define KSM_TUNE_INTERVAL	HZ
+
+/*
+ * ksm_tune_scan - adapt pages_to_scan to how much merging ksmd finds.
+ *
+ * Once a second, scan twice as many pages per batch if at least 1 in 64
+ * of the pages scanned since the last time got merged, and half as many
+ * if fewer than 1 in 1024 did: there is no point in spending cpu time on
+ * areas that were already merged, or that never will be.  Whatever the
+ * yield, pages_to_scan is scaled down whenever ksmd used more than
+ * max_cpu_percent of a cpu, and kept between min_pages_to_scan and
+ * max_pages_to_scan.
+ */
+static void ksm_tune_scan(void)
+{
+	unsigned long elapsed = jiffies - ksm_tune_stamp;
+	unsigned long pages = ksm_thread_pages_to_scan;
+	u64 runtime, wall;
+	unsigned int cpu;
+
+	if (elapsed < KSM_TUNE_INTERVAL)
+		return;
+
+	/* Measurements spanning a long sleep, or the first ones, mean nothing */
+	if (elapsed > 10 * KSM_TUNE_INTERVAL)
+		goto reset;
+
+	runtime = current->se.sum_exec_runtime - ksm_tune_runtime;
+	wall = (u64)jiffies_to_msecs(elapsed) * NSEC_PER_MSEC;
+	cpu = min_t(u64, div64_u64(runtime * 100, wall), 1000);
+
+	if (cpu > ksm_max_cpu_percent) {
+		pages = pages * ksm_max_cpu_percent / cpu;
+	} else if (ksm_tune_merged * 64 >= ksm_tune_scanned) {
+		pages *= 2;
+		/* the cost of a batch grows with its size */
+		if (cpu && pages / 2 * ksm_max_cpu_percent / cpu < pages)
+			pages = pages / 2 * ksm_max_cpu_percent / cpu;
+	} else if (ksm_tune_merged * 1024 < ksm_tune_scanned) {
+		pages /= 2;
 	}
+
+	pages = max_t(unsigned long, pages, ksm_min_pages_to_scan);
+	pages = min_t(unsigned long, pages, ksm_max_pages_to_scan);
+	ksm_thread_pages_to_scan = max_t(unsigned long, pages, 1);
+reset:
+	ksm_tune_stamp = jiffies;
+	ksm_tune_scanned = 0;
+	ksm_tune_merged = 0;
+	ksm_tune_runtime = current->se.sum_exec_runtime;
 }
 
 static int ksmd_should_run(void)
@@ -1436,8 +1568,11 @@ static int ksm_scan_thread(void *nothing)
 
 	while (!kthread_should_stop()) {
 		mutex_lock(&ksm_thread_mutex);
-		if (ksmd_should_run())
+		if (ksmd_should_run()) {
 			ksm_do_scan(ksm_thread_pages_to_scan);
+			if (ksm_adaptive_scan)
+				ksm_tune_scan();
+		}
 		mutex_unlock(&ksm_thread_mutex);
 
 		try_to_freeze();
@@ -1883,6 +2018,98 @@ static ssize_t pages_to_scan_store(struct kobject *kobj,
 }
 KSM_ATTR(pages_to_scan);
 
+static ssize_t adaptive_scan_show(struct kobject *kobj,
+				  struct kobj_attribute *attr, char *buf)
+{
+	return sprintf(buf, "%u\n", ksm_adaptive_scan);
+}
+
+static ssize_t adaptive_scan_store(struct kobject *kobj,
+				   struct kobj_attribute *attr,
+				   const char *buf, size_t count)
+{
+	int err;
+	unsigned long value;
+
+	err = strict_strtoul(buf, 10, &value);
+	if (err || value > 1)
+		return -EINVAL;
+
+	ksm_adaptive_scan = value;
+
+	return count;
+}
+KSM_ATTR(adaptive_scan);
+
+static ssize_t max_cpu_percent_show(struct kobject *kobj,
+				    struct kobj_attribute *attr, char *buf)
+{
+	return sprintf(buf, "%u\n", ksm_max_cpu_percent);
+}
+
+static ssize_t max_cpu_percent_store(struct kobject *kobj,
+				     struct kobj_attribute *attr,
+				     const char *buf, size_t count)
+{
+	int err;
+	unsigned long percent;
+
+	err = strict_strtoul(buf, 10, &percent);
+	if (err || percent < 1 || percent > 100)
+		return -EINVAL;
+
+	ksm_max_cpu_percent = percent;
+
+	return count;
+}
+KSM_ATTR(max_cpu_percent);
+
+static ssize_t min_pages_to_scan_show(struct kobject *kobj,
+				      struct kobj_attribute *attr, char *buf)
+{
+	return sprintf(buf, "%u\n", ksm_min_pages_to_scan);
+}
+
+static ssize_t min_pages_to_scan_store(struct kobject *kobj,
+				       struct kobj_attribute *attr,
+				       const char *buf, size_t count)
+{
+	int err;
+	unsigned long nr_pages;
+
+	err = strict_strtoul(buf, 10, &nr_pages);
+	if (err || nr_pages < 1 || nr_pages > ksm_max_pages_to_scan)
+		return -EINVAL;
+
+	ksm_min_pages_to_scan = nr_pages;
+
+	return count;
+}
+KSM_ATTR(min_pages_to_scan);
+
+static ssize_t max_pages_to_scan_show(struct kobject *kobj,
+				      struct kobj_attribute *attr, char *buf)
+{
+	return sprintf(buf, "%u\n", ksm_max_pages_to_scan);
+}
+
+static ssize_t max_pages_to_scan_store(struct kobject *kobj,
+				       struct kobj_attribute *attr,
+				       const char *buf, size_t count)
+{
+	int err;
+	unsigned long nr_pages;
+
+	err = strict_strtoul(buf, 10, &nr_pages);
+	if (err || nr_pages > UINT_MAX || nr_pages < ksm_min_pages_to_scan)
+		return -EINVAL;
+
+	ksm_max_pages_to_scan = nr_pages;
+
+	return count;
+}
+KSM_ATTR(max_pages_to_scan);
+
 static ssize_t run_show(struct kobject *kobj, struct kobj_attribute *attr,
 			char *buf)
 {
@@ -1933,6 +2160,29 @@ static ssize_t run_store(struct kobject *kobj, struct kobj_attribute *attr,
 }
 KSM_ATTR(run);
 
+static ssize_t use_zero_pages_show(struct kobject *kobj,
+				   struct kobj_attribute *attr, char *buf)
+{
+	return sprintf(buf, "%u\n", ksm_use_zero_pages);
+}
+
+static ssize_t use_zero_pages_store(struct kobject *kobj,
+				    struct kobj_attribute *attr,
+				    const char *buf, size_t count)
+{
+	int err;
+	unsigned long value;
+
+	err = strict_strtoul(buf, 10, &value);
+	if (err || value > 1)
+		return -EINVAL;
+
+	ksm_use_zero_pages = value;
+
+	return count;
+}
+KSM_ATTR(use_zero_pages);
+
 static ssize_t pages_shared_show(struct kobject *kobj,
 				 struct kobj_attribute *attr, char *buf)
 {
@@ -1978,15 +2228,28 @@ static ssize_t full_scans_show(struct kobject *kobj,
 }
 KSM_ATTR_RO(full_scans);
 
+static ssize_t zero_pages_merged_show(struct kobject *kobj,
+				      struct kobj_attribute *attr, char *buf)
+{
+	return sprintf(buf, "%lu\n", ksm_zero_pages_merged);
+}
+KSM_ATTR_RO(zero_pages_merged);
+
 static struct attribute *ksm_attrs[] = {
 	&sleep_millisecs_attr.attr,
 	&pages_to_scan_attr.attr,
+	&adaptive_scan_attr.attr,
+	&max_cpu_percent_attr.attr,
+	&min_pages_to_scan_attr.attr,
+	&max_pages_to_scan_attr.attr,
 	&run_attr.attr,
+	&use_zero_pages_attr.attr,
 	&pages_shared_attr.attr,
 	&pages_sharing_attr.attr,
 	&pages_unshared_attr.attr,
 	&pages_volatile_attr.attr,
 	&full_scans_attr.attr,
+	&zero_pages_merged_attr.attr,
 	NULL,
 };
 
@@ -2001,6 +2264,8 @@ static int __init ksm_init(void)
 	struct task_struct *ksm_thread;
 	int err;
 
+	zero_checksum = calc_checksum(ZERO_PAGE(0));
+
 	err = ksm_slab_init();
 	if (err)
 		goto out;
@@ -3473,11 +3473,18 @@ int handle_mm_fault(struct mm_struct *mm, struct vm_area_struct *vma,
 		pmd_t orig_pmd = *pmd;
 		barrier();
 		if (pmd_trans_huge(orig_pmd)) {
-			if (flags & FAULT_FLAG_WRITE &&
-			    !pmd_write(orig_pmd) &&
+			int dirty = flags & FAULT_FLAG_WRITE;
+
+			if (dirty && !pmd_write(orig_pmd) &&
 			    !pmd_trans_splitting(orig_pmd))
 				return do_huge_pmd_wp_page(mm, vma, address,
 							   pmd, orig_pmd);
+			/*
+			 * Architectures without a hardware-managed access
+			 * flag fault on old huge pmds: mark them young.
+			 */
+			huge_pmd_set_accessed(mm, vma, address, pmd,
+					      orig_pmd, dirty);
 			return 0;
 		}
 	}
@@ -3503,6 +3510,256 @@ int handle_mm_fault(struct mm_struct *mm, struct vm_area_struct *vma,
 	return handle_pte_fault(mm, vma, address, pte, pmd, flags);
 }
 
+#ifdef CONFIG_SPECULATIVE_PAGE_FAULT
+/*
+ * Speculative page faults.
+ *
+ * Faults on a pte that is still empty in an anonymous vma, and read
+ * faults on such a pte in a page-cache backed vma whose page is cached
+ * and up to date, are tried without mmap_sem first.
+ *
+ * A speculative fault runs with preemption disabled and never sleeps.
+ * It is accounted in mm->spf_count for its whole duration.  spf_block()
+ * drives the count negative and waits for the faults in flight, so the
+ * vma rbtree, and the vmas and page tables reachable from it, can only
+ * change or go away while no speculative fault is looking at them: it is
+ * taken around every rbtree update and around mremap's page table moves.
+ *
+ * The vma fields may change without going through spf_block().  Those
+ * changes are bracketed by vm_write_begin()/vm_write_end(), and the fault
+ * works on a snapshot of the vma which is revalidated against
+ * vma->vm_sequence under the pte lock, right before the pte is set.
+ *
+ * Anything unusual makes the fault fall back to handle_mm_fault() under
+ * mmap_sem, which also takes care of reporting errors.
+ */
+#define SPF_BLOCK_BIAS	(1 << 20)
+
+/* Never dip into the reserves, and let the regular path do the reclaim. */
+#define SPF_GFP		((GFP_HIGHUSER_MOVABLE & ~__GFP_WAIT) | \
+			 __GFP_NOMEMALLOC | __GFP_NOWARN)
+
+#define SPF_BAD_VM_FLAGS (VM_HUGETLB | VM_LOCKED | VM_NONLINEAR | \
+			  VM_PFNMAP | VM_MIXEDMAP | VM_IO)
+
+/*
+ * Called with mmap_sem held for write.  Only the holder of mmap_sem can
+ * leave spf_count negative, so a negative count means we are nested.
+ */
+void spf_block(struct mm_struct *mm)
+{
+	int nested = atomic_read(&mm->spf_count) < 0;
+
+	atomic_sub(SPF_BLOCK_BIAS, &mm->spf_count);
+	if (nested)
+		return;
+	while (atomic_read(&mm->spf_count) > -SPF_BLOCK_BIAS)
+		cpu_relax();
+	smp_mb();
+}
+
+void spf_unblock(struct mm_struct *mm)
+{
+	smp_mb();
+	atomic_add(SPF_BLOCK_BIAS, &mm->spf_count);
+}
+
+static inline int spf_enter(struct mm_struct *mm)
+{
+	preempt_disable();
+	if (likely(atomic_inc_return(&mm->spf_count) > 0))
+		return 1;
+	atomic_dec(&mm->spf_count);
+	preempt_enable();
+	return 0;
+}
+
+static inline void spf_exit(struct mm_struct *mm)
+{
+	smp_mb__before_atomic_dec();
+	atomic_dec(&mm->spf_count);
+	preempt_enable();
+}
+
+/*
+ * find_vma() without the mmap_cache.  The tree cannot change under us,
+ * but the bounds of the vmas in it can: a wrong turn just makes us miss.
+ */
+static struct vm_area_struct *spf_find_vma(struct mm_struct *mm,
+					   unsigned long addr)
+{
+	struct rb_node *rb_node = mm->mm_rb.rb_node;
+
+	while (rb_node) {
+		struct vm_area_struct *vma;
+
+		vma = rb_entry(rb_node, struct vm_area_struct, vm_rb);
+		if (addr < vma->vm_start)
+			rb_node = rb_node->rb_left;
+		else if (addr >= vma->vm_end)
+			rb_node = rb_node->rb_right;
+		else
+			return vma;
+	}
+	return NULL;
+}
+
+/**
+ * handle_speculative_fault - try to handle a user fault without mmap_sem
+ * @mm:		mm_struct of the faulting task
+ * @address:	faulting address
+ * @flags:	FAULT_FLAG_xxx flags
+ * @vm_access:	the fault is only handled if the vma has one of these flags
+ *
+ * Returns 0 if the fault was handled, or VM_FAULT_RETRY if the caller
+ * must go through handle_mm_fault() with mmap_sem held.
+ */
+int handle_speculative_fault(struct mm_struct *mm, unsigned long address,
+			     unsigned int flags, unsigned long vm_access)
+{
+	struct vm_area_struct *vma, snap;
+	struct page *page = NULL;
+	unsigned int seq;
+	pgd_t *pgd;
+	pud_t *pud;
+	pmd_t *pmd, pmdval;
+	pte_t *pte, entry;
+	spinlock_t *ptl;
+	int charged = 0;
+
+	address &= PAGE_MASK;
+
+	if (!spf_enter(mm))
+		goto abort;
+
+	vma = spf_find_vma(mm, address);
+	if (!vma)
+		goto out;
+
+	seq = ACCESS_ONCE(vma->vm_sequence.sequence);
+	if (seq & 1)
+		goto out;
+	smp_rmb();
+	snap = *vma;
+	if (read_seqcount_retry(&vma->vm_sequence, seq))
+		goto out;
+
+	if (address < snap.vm_start || address >= snap.vm_end)
+		goto out;
+	if (!(snap.vm_flags & vm_access) || (snap.vm_flags & SPF_BAD_VM_FLAGS))
+		goto out;
+	/* Leave the stack guard page to check_stack_guard_page() */
+	if ((snap.vm_flags & VM_GROWSDOWN) && address == snap.vm_start)
+		goto out;
+	if (snap.vm_ops) {
+		if (snap.vm_ops->fault != filemap_fault ||
+		    (flags & FAULT_FLAG_WRITE))
+			goto out;
+	} else if ((flags & FAULT_FLAG_WRITE) && !snap.anon_vma)
+		goto out;
+
+	/* Only fill in page tables that already exist */
+	pgd = pgd_offset(mm, address);
+	if (pgd_none(*pgd) || unlikely(pgd_bad(*pgd)))
+		goto out;
+	pud = pud_offset(pgd, address);
+	if (pud_none(*pud) || unlikely(pud_bad(*pud)))
+		goto out;
+	pmd = pmd_offset(pud, address);
+	pmdval = *pmd;
+	barrier();
+	if (pmd_none(pmdval) || pmd_trans_huge(pmdval) || pmd_bad(pmdval))
+		goto out;
+
+	if (!snap.vm_ops) {
+		if (!(flags & FAULT_FLAG_WRITE)) {
+			entry = pte_mkspecial(pfn_pte(my_zero_pfn(address),
+						      snap.vm_page_prot));
+		} else {
+			page = alloc_page_vma(SPF_GFP, &snap, address);
+			if (!page)
+				goto out;
+			clear_user_highpage(page, address);
+			__SetPageUptodate(page);
+			if (mem_cgroup_newpage_charge(page, mm, SPF_GFP))
+				goto out_page;
+			charged = 1;
+
+			entry = mk_pte(page, snap.vm_page_prot);
+			if (snap.vm_flags & VM_WRITE)
+				entry = pte_mkwrite(pte_mkdirty(entry));
+		}
+	} else {
+		struct file *file = snap.vm_file;
+		struct address_space *mapping = file->f_mapping;
+		pgoff_t pgoff, size;
+
+		pgoff = ((address - snap.vm_start) >> PAGE_SHIFT) +
+			snap.vm_pgoff;
+		page = find_get_page(mapping, pgoff);
+		if (!page)
+			goto out;
+		/* Readahead has to be kicked off from filemap_fault() */
+		if (PageReadahead(page) || !trylock_page(page))
+			goto out_page;
+		size = (i_size_read(mapping->host) + PAGE_CACHE_SIZE - 1) >>
+			PAGE_CACHE_SHIFT;
+		if (unlikely(page->mapping != mapping || pgoff >= size ||
+			     !PageUptodate(page) || PageHWPoison(page))) {
+			unlock_page(page);
+			goto out_page;
+		}
+		if (!(snap.vm_flags & VM_RAND_READ) && file->f_ra.mmap_miss > 0)
+			file->f_ra.mmap_miss--;
+		readahead_page_used(mapping, page, false);
+
+		entry = mk_pte(page, snap.vm_page_prot);
+	}
+
+	pte = pte_offset_map_lock(mm, pmd, address, &ptl);
+	if (!pte_none(*pte) || read_seqcount_retry(&vma->vm_sequence, seq)) {
+		pte_unmap_unlock(pte, ptl);
+		if (snap.vm_ops)
+			unlock_page(page);
+		goto out_page;
+	}
+
+	if (!snap.vm_ops) {
+		if (page) {
+			inc_mm_counter_fast(mm, MM_ANONPAGES);
+			page_add_new_anon_rmap(page, &snap, address);
+		}
+	} else {
+		flush_icache_page(vma, page);
+		inc_mm_counter_fast(mm, MM_FILEPAGES);
+		page_add_file_rmap(page);
+	}
+	set_pte_at(mm, address, pte, entry);
+
+	/* No need to invalidate - it was non-present before */
+	update_mmu_cache(vma, address, pte);
+	pte_unmap_unlock(pte, ptl);
+	if (snap.vm_ops)
+		unlock_page(page);
+	spf_exit(mm);
+
+	count_vm_event(PGFAULT);
+	count_vm_event(SPECULATIVE_PGFAULT);
+	mem_cgroup_count_vm_event(mm, PGFAULT);
+	return 0;
+
+out_page:
+	if (charged)
+		mem_cgroup_uncharge_page(page);
+	page_cache_release(page);
+out:
+	spf_exit(mm);
+abort:
+	count_vm_event(SPECULATIVE_PGFAULT_ABORT);
+	return VM_FAULT_RETRY;
+}
+#endif /* CONFIG_SPECULATIVE_PAGE_FAULT */
+
 #ifndef __PAGETABLE_PUD_FOLDED
 /*
  * Allocate page upper directory.
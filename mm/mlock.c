@@ -248,7 +248,9 @@ long mlock_vma_pages_range(struct vm_area_struct *vma,
 	make_pages_present(start, end);
 
 no_mlock:
+	vm_write_begin(vma);
 	vma->vm_flags &= ~VM_LOCKED;	/* and don't come back! */
+	vm_write_end(vma);
 	return nr_pages;		/* error or pages NOT mlocked */
 }
 
@@ -276,7 +278,9 @@ void munlock_vma_pages_range(struct vm_area_struct *vma,
 	unsigned long addr;
 
 	lru_add_drain();
+	vm_write_begin(vma);
 	vma->vm_flags &= ~VM_LOCKED;
+	vm_write_end(vma);
 
 	for (addr = start; addr < end; addr += PAGE_SIZE) {
 		struct page *page;
@@ -362,9 +366,11 @@ success:
 	 * set VM_LOCKED, __mlock_vma_pages_range will bring it back.
 	 */
 
-	if (lock)
+	if (lock) {
+		vm_write_begin(vma);
 		vma->vm_flags = newflags;
-	else
+		vm_write_end(vma);
+	} else
 		munlock_vma_pages_range(vma, start, end);
 
 out:
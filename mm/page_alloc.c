@@ -615,6 +615,7 @@ static inline int free_pages_check(struct page *page)
 	}
 	if (page->flags & PAGE_FLAGS_CHECK_AT_PREP)
 		page->flags &= ~PAGE_FLAGS_CHECK_AT_PREP;
+	__clear_page_lru_gen(page);
 	return 0;
 }
 
@@ -1205,25 +1206,16 @@ void mark_free_pages(struct zone *zone)
 #endif /* CONFIG_PM */
 
 /*
- * Free a 0-order page
- * cold == 1 ? free a cold page : free a hot page
+ * Put a 0-order page, prepared by free_pages_prepare() and with its
+ * migratetype in page_private, on this cpu's free lists.  Interrupts
+ * must be disabled.
  */
-void free_hot_cold_page(struct page *page, int cold)
+static void free_pcp_page(struct page *page, int cold)
 {
 	struct zone *zone = page_zone(page);
 	struct per_cpu_pages *pcp;
-	unsigned long flags;
-	int migratetype;
-	int wasMlocked = __TestClearPageMlocked(page);
-
-	if (!free_pages_prepare(page, 0))
-		return;
+	int migratetype = page_private(page);
 
-	migratetype = get_pageblock_migratetype(page);
-	set_page_private(page, migratetype);
-	local_irq_save(flags);
-	if (unlikely(wasMlocked))
-		free_page_mlock(page);
 	__count_vm_event(PGFREE);
 
 	/*
@@ -1236,7 +1228,7 @@ void free_hot_cold_page(struct page *page, int cold)
 	if (migratetype >= MIGRATE_PCPTYPES) {
 		if (unlikely(migratetype == MIGRATE_ISOLATE)) {
 			free_one_page(zone, page, 0, migratetype);
-			goto out;
+			return;
 		}
 		migratetype = MIGRATE_MOVABLE;
 	}
@@ -1251,24 +1243,83 @@ void free_hot_cold_page(struct page *page, int cold)
 		free_pcppages_bulk(zone, pcp->batch, pcp);
 		pcp->count -= pcp->batch;
 	}
+}
 
-out:
+/*
+ * Free a 0-order page
+ * cold == 1 ? free a cold page : free a hot page
+ */
+void free_hot_cold_page(struct page *page, int cold)
+{
+	unsigned long flags;
+	int wasMlocked = __TestClearPageMlocked(page);
+
+	if (!free_pages_prepare(page, 0))
+		return;
+
+	set_page_private(page, get_pageblock_migratetype(page));
+	local_irq_save(flags);
+	if (unlikely(wasMlocked))
+		free_page_mlock(page);
+	free_pcp_page(page, cold);
 	local_irq_restore(flags);
 }
 
 /*
- * Free a list of 0-order pages
+ * Free a list of 0-order pages, disabling interrupts only once for all
+ * of them.
  */
 void free_hot_cold_page_list(struct list_head *list, int cold)
 {
 	struct page *page, *next;
+	unsigned long flags;
 
 	list_for_each_entry_safe(page, next, list, lru) {
 		trace_mm_page_free_batched(page, cold);
-		free_hot_cold_page(page, cold);
+		if (unlikely(PageMlocked(page))) {
+			/* needs its own accounting: free it on its own */
+			list_del(&page->lru);
+			free_hot_cold_page(page, cold);
+		} else if (!free_pages_prepare(page, 0)) {
+			list_del(&page->lru);
+		} else {
+			set_page_private(page,
+					 get_pageblock_migratetype(page));
+		}
 	}
+
+	local_irq_save(flags);
+	list_for_each_entry_safe(page, next, list, lru)
+		free_pcp_page(page, cold);
+	local_irq_restore(flags);
 }
 
+/**
+ * free_pages_bulk - drop a reference to each of an array of 0-order pages
+ * @nr_pages: the number of entries in @page_array
+ * @page_array: the pages; NULL entries are skipped
+ *
+ * The pages whose last reference this was are freed as one batch, like
+ * free_hot_cold_page_list() does.  The counterpart of alloc_pages_bulk():
+ * pages on the LRU must be released with release_pages() instead.
+ */
+void free_pages_bulk(unsigned long nr_pages, struct page **page_array)
+{
+	LIST_HEAD(pages);
+	unsigned long i;
+
+	for (i = 0; i < nr_pages; i++) {
+		struct page *page = page_array[i];
+
+		if (!page || !put_page_testzero(page))
+			continue;
+		VM_BUG_ON(PageCompound(page));
+		list_add(&page->lru, &pages);
+	}
+	free_hot_cold_page_list(&pages, 0);
+}
+EXPORT_SYMBOL(free_pages_bulk);
+
 /*
  * split_page takes a non-compound higher-order page, and splits it into
  * n (1<<order) sub-pages: page[0..n]
@@ -2423,6 +2474,151 @@ __alloc_pages_nodemask(gfp_t gfp_mask, unsigned int order,
 }
 EXPORT_SYMBOL(__alloc_pages_nodemask);
 
+/**
+ * alloc_pages_bulk - allocate a batch of 0-order pages
+ * @gfp_mask: GFP flags for the allocation
+ * @nr_pages: the number of entries in @page_array
+ * @page_array: the array to fill; only its NULL entries are filled
+ *
+ * Takes pages from this cpu's free lists for the first zone which is
+ * above its low watermark by the whole batch, refilling the lists from
+ * the buddy allocator as needed, with interrupts disabled only once.
+ * When no zone qualifies, or the free lists cannot be refilled, a single
+ * page is left to alloc_pages(), which can reclaim and retry.
+ *
+ * Returns the number of entries of @page_array holding a page: callers
+ * must cope with fewer than @nr_pages.  The NULL entries are filled in
+ * order without leaving any behind, so an array passed in all NULL
+ * comes back with exactly its first entries populated.
+ */
+unsigned long alloc_pages_bulk(gfp_t gfp_mask, unsigned long nr_pages,
+			       struct page **page_array)
+{
+	enum zone_type high_zoneidx = gfp_zone(gfp_mask);
+	int migratetype = allocflags_to_migratetype(gfp_mask);
+	int cold = !!(gfp_mask & __GFP_COLD);
+	struct zonelist *zonelist;
+	struct zone *preferred_zone, *zone;
+	struct zoneref *z;
+	struct per_cpu_pages *pcp;
+	struct list_head *list;
+	struct page *page;
+	unsigned long nr_populated = 0, nr_taken = 0;
+	unsigned long flags, i;
+
+	for (i = 0; i < nr_pages; i++)
+		if (page_array[i])
+			nr_populated++;
+	if (nr_populated == nr_pages)
+		return nr_populated;
+
+	/* A single page is no batch */
+	if (nr_pages - nr_populated == 1)
+		goto failed;
+#ifdef CONFIG_NUMA
+	/* Memory policies are for alloc_pages() to apply */
+	if (current->mempolicy)
+		goto failed;
+#endif
+
+	gfp_mask &= gfp_allowed_mask;
+	lockdep_trace_alloc(gfp_mask);
+	might_sleep_if(gfp_mask & __GFP_WAIT);
+
+	if (should_fail_alloc_page(gfp_mask, 0))
+		goto failed;
+
+	zonelist = node_zonelist(numa_node_id(), gfp_mask);
+	if (unlikely(!zonelist->_zonerefs->zone))
+		goto failed;
+
+	get_mems_allowed();
+	first_zones_zonelist(zonelist, high_zoneidx,
+				&cpuset_current_mems_allowed, &preferred_zone);
+	if (!preferred_zone) {
+		put_mems_allowed();
+		goto failed;
+	}
+
+	for_each_zone_zonelist_nodemask(zone, z, zonelist, high_zoneidx,
+					&cpuset_current_mems_allowed) {
+		unsigned long mark;
+
+		if (!cpuset_zone_allowed_softwall(zone,
+						  gfp_mask | __GFP_HARDWALL))
+			continue;
+		if ((gfp_mask & __GFP_WRITE) && !zone_dirty_ok(zone))
+			continue;
+
+		mark = low_wmark_pages(zone) + nr_pages - nr_populated;
+		if (zone_watermark_ok(zone, 0, mark,
+				      zone_idx(preferred_zone), 0))
+			break;
+	}
+	if (!zone) {
+		put_mems_allowed();
+		goto failed;
+	}
+
+	local_irq_save(flags);
+	pcp = &this_cpu_ptr(zone->pageset)->pcp;
+	list = &pcp->lists[migratetype];
+	for (i = 0; i < nr_pages; i++) {
+		if (page_array[i])
+			continue;
+retry:
+		if (list_empty(list)) {
+			pcp->count += rmqueue_bulk(zone, 0,
+					pcp->batch, list,
+					migratetype, cold);
+			if (unlikely(list_empty(list)))
+				break;
+		}
+
+		if (cold)
+			page = list_entry(list->prev, struct page, lru);
+		else
+			page = list_entry(list->next, struct page, lru);
+
+		list_del(&page->lru);
+		pcp->count--;
+		nr_taken++;
+		zone_statistics(preferred_zone, zone, gfp_mask);
+
+		VM_BUG_ON(bad_range(zone, page));
+		/*
+		 * A bad page is left alone, as in buffered_rmqueue(), and
+		 * the next one tried for this entry
+		 */
+		if (prep_new_page(page, 0, gfp_mask))
+			goto retry;
+
+		trace_mm_page_alloc(page, 0, gfp_mask, migratetype);
+		page_array[i] = page;
+		nr_populated++;
+	}
+	__count_zone_vm_events(PGALLOC, zone, nr_taken);
+	local_irq_restore(flags);
+	put_mems_allowed();
+
+	if (nr_taken)
+		return nr_populated;
+
+failed:
+	for (i = 0; i < nr_pages; i++) {
+		if (page_array[i])
+			continue;
+		page = alloc_pages(gfp_mask, 0);
+		if (page) {
+			page_array[i] = page;
+			nr_populated++;
+		}
+		break;
+	}
+	return nr_populated;
+}
+EXPORT_SYMBOL(alloc_pages_bulk);
+
 /*
  * Common helper functions.
  */
@@ -4257,6 +4453,9 @@ static void __paginginit free_area_init_core(struct pglist_data *pgdat,
 	pgdat->nr_zones = 0;
 	init_waitqueue_head(&pgdat->kswapd_wait);
 	pgdat->kswapd_max_order = 0;
+#ifdef CONFIG_COMPACTION
+	init_waitqueue_head(&pgdat->kcompactd_wait);
+#endif
 	pgdat_page_cgroup_init(pgdat);
 	
 	for (j = 0; j < MAX_NR_ZONES; j++) {
@@ -5581,6 +5780,7 @@ static struct trace_print_flags pageflag_names[] = {
 	{1UL << PG_reclaim,		"reclaim"	},
 	{1UL << PG_swapbacked,		"swapbacked"	},
 	{1UL << PG_unevictable,		"unevictable"	},
+	{1UL << PG_readahead_unused,	"readahead_unused"},
 #ifdef CONFIG_MMU
 	{1UL << PG_mlocked,		"mlocked"	},
 #endif
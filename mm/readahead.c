@@ -18,6 +18,9 @@
 #include <linux/pagevec.h>
 #include <linux/pagemap.h>
 
+#define CREATE_TRACE_POINTS
+#include <trace/events/readahead.h>
+
 /*
  * Initialise a struct file's readahead state.  Assumes that the caller has
  * memset *ra to zero.
@@ -139,12 +142,19 @@ out:
 	return ret;
 }
 
+/* Pages allocated at once by __do_page_cache_readahead() */
+#define RA_ALLOC_BATCH	16
+
 /*
  * __do_page_cache_readahead() actually reads a chunk of disk.  It allocates all
  * the pages first, then submits them all for I/O. This avoids the very bad
  * behaviour which would occur if page allocations are causing VM writeback.
  * We really don't want to intermingle reads and writes like that.
  *
+ * The pages are allocated RA_ALLOC_BATCH at a time; those which turn out
+ * not to be needed, because the pages they were for are cached, are freed
+ * at the end.
+ *
  * Returns the number of pages requested, or the maximum amount of I/O allowed.
  */
 static int
@@ -156,6 +166,8 @@ __do_page_cache_readahead(struct address_space *mapping, struct file *filp,
 	struct page *page;
 	unsigned long end_index;	/* The last page we want to read */
 	LIST_HEAD(page_pool);
+	struct page *alloced[RA_ALLOC_BATCH] = { NULL, };
+	unsigned long nr_alloced = 0;
 	int page_idx;
 	int ret = 0;
 	loff_t isize = i_size_read(inode);
@@ -177,26 +189,40 @@ __do_page_cache_readahead(struct address_space *mapping, struct file *filp,
 		rcu_read_lock();
 		page = radix_tree_lookup(&mapping->page_tree, page_offset);
 		rcu_read_unlock();
-		if (page)
+		if (page && !radix_tree_exceptional_entry(page))
 			continue;
 
-		page = page_cache_alloc_readahead(mapping);
-		if (!page)
-			break;
+		if (!nr_alloced) {
+			unsigned long nr = min_t(unsigned long, RA_ALLOC_BATCH,
+					nr_to_read - page_idx);
+
+			nr = min_t(unsigned long, nr,
+				   end_index - page_offset + 1);
+			nr_alloced = page_cache_alloc_readahead_bulk(mapping,
+					nr, alloced);
+			if (!nr_alloced)
+				break;
+		}
+		page = alloced[--nr_alloced];
+		alloced[nr_alloced] = NULL;
 		page->index = page_offset;
+		__SetPageReadaheadUnused(page);
 		list_add(&page->lru, &page_pool);
 		if (page_idx == nr_to_read - lookahead_size)
 			SetPageReadahead(page);
 		ret++;
 	}
+	free_pages_bulk(nr_alloced, alloced);
 
 	/*
 	 * Now start the IO.  We ignore I/O errors - if the page is not
 	 * uptodate then the caller will launch readpage again, and
 	 * will then handle the error.
 	 */
-	if (ret)
+	if (ret) {
+		add_bdi_stat(mapping->backing_dev_info, BDI_READAHEAD, ret);
 		read_pages(mapping, filp, &page_pool, ret);
+	}
 	BUG_ON(!list_empty(&page_pool));
 out:
 	return ret;
@@ -259,6 +285,106 @@ unsigned long ra_submit(struct file_ra_state *ra,
 	return actual;
 }
 
+/*
+ * Every page brought in by readahead is marked PG_readahead_unused until
+ * somebody looks it up: the first reader counts it as used, and if it
+ * is still marked when it leaves the page cache it was read for nothing.
+ * A reader that has to wait for the page to come uptodate counts as a
+ * stall: the readahead did not run far enough ahead of it.
+ */
+void __readahead_page_used(struct address_space *mapping, struct page *page,
+			   bool stalled)
+{
+	struct backing_dev_info *bdi = mapping->backing_dev_info;
+
+	if (!TestClearPageReadaheadUnused(page))
+		return;
+	inc_bdi_stat(bdi, BDI_READAHEAD_USED);
+	if (stalled)
+		inc_bdi_stat(bdi, BDI_READAHEAD_STALL);
+}
+
+/*
+ * Called under mapping->tree_lock, with interrupts disabled.
+ */
+void readahead_page_wasted(struct address_space *mapping, struct page *page)
+{
+	if (TestClearPageReadaheadUnused(page))
+		__inc_bdi_stat(mapping->backing_dev_info, BDI_READAHEAD_WASTED);
+}
+
+#define RA_ADAPT_INTERVAL	(HZ / 2)
+#define RA_ADAPT_MIN_SAMPLES	32
+
+/*
+ * Adaptive readahead: every RA_ADAPT_INTERVAL, look at how the readahead
+ * pages of @bdi ended up since the last time.  If many of them were
+ * dropped unused, the window is too large for the way the device is
+ * being read (or for the memory available to hold it), so shrink it.  If
+ * nearly all of them were used but readers still had to wait for them,
+ * the readers consume pages faster than we read ahead: grow the window,
+ * up to the rate at which they consumed pages, and at most 4 times the
+ * configured read_ahead_kb.
+ */
+static void bdi_update_ra_adapt(struct backing_dev_info *bdi)
+{
+	unsigned long stamp = bdi->ra_stamp;
+	unsigned long elapsed = jiffies - stamp;
+	unsigned long used, wasted, stall, total;
+	unsigned long cur, min_pages, max_pages, rate;
+
+	if (elapsed < RA_ADAPT_INTERVAL)
+		return;
+
+	used = bdi_stat(bdi, BDI_READAHEAD_USED) - bdi->ra_used_stamp;
+	wasted = bdi_stat(bdi, BDI_READAHEAD_WASTED) - bdi->ra_wasted_stamp;
+	total = used + wasted;
+	if (total < RA_ADAPT_MIN_SAMPLES)
+		return;
+
+	/* only one reader updates the window */
+	if (cmpxchg(&bdi->ra_stamp, stamp, jiffies) != stamp)
+		return;
+
+	stall = bdi_stat(bdi, BDI_READAHEAD_STALL) - bdi->ra_stall_stamp;
+	bdi->ra_used_stamp += used;
+	bdi->ra_wasted_stamp += wasted;
+	bdi->ra_stall_stamp += stall;
+
+	cur = bdi->ra_adapt_pages ? bdi->ra_adapt_pages : bdi->ra_pages;
+	min_pages = min(bdi->ra_pages,
+			VM_MIN_READAHEAD * 1024UL / PAGE_CACHE_SIZE);
+
+	if (used * 2 < total) {
+		cur /= 2;
+	} else if (used * 4 < total * 3) {
+		cur -= cur / 4;
+	} else if (stall) {
+		rate = used * HZ / elapsed;
+		max_pages = min(4 * bdi->ra_pages, max(bdi->ra_pages, rate));
+		cur = min(cur * 2, max_pages);
+	}
+
+	bdi->ra_adapt_pages = max(cur, min_pages);
+}
+
+/*
+ * The largest readahead window for @ra.  Files whose readahead size was
+ * tuned by fadvise() keep it; the others follow the adaptive size of
+ * their device, when enabled.
+ */
+static unsigned long ra_max_pages(struct backing_dev_info *bdi,
+				  struct file_ra_state *ra)
+{
+	if (!bdi->ra_adaptive || ra->ra_pages != bdi->ra_pages)
+		return ra->ra_pages;
+
+	bdi_update_ra_adapt(bdi);
+	if (!bdi->ra_adapt_pages)
+		return ra->ra_pages;
+	return min(bdi->ra_adapt_pages, 4 * bdi->ra_pages);
+}
+
 /*
  * Set the initial window size, round to next power of 2 and square
  * for small size, x 4 for medium, and x 2 for large
@@ -349,7 +475,7 @@ static pgoff_t count_history_pages(struct address_space *mapping,
 	pgoff_t head;
 
 	rcu_read_lock();
-	head = radix_tree_prev_hole(&mapping->page_tree, offset - 1, max);
+	head = page_cache_prev_hole(mapping, offset - 1, max);
 	rcu_read_unlock();
 
 	return offset - 1 - head;
@@ -398,7 +524,11 @@ ondemand_readahead(struct address_space *mapping,
 		   bool hit_readahead_marker, pgoff_t offset,
 		   unsigned long req_size)
 {
-	unsigned long max = max_sane_readahead(ra->ra_pages);
+	unsigned long max;
+	int pattern = RA_PATTERN_INITIAL;
+	int actual;
+
+	max = max_sane_readahead(ra_max_pages(mapping->backing_dev_info, ra));
 
 	/*
 	 * start of file
@@ -415,6 +545,7 @@ ondemand_readahead(struct address_space *mapping,
 		ra->start += ra->size;
 		ra->size = get_next_ra_size(ra, max);
 		ra->async_size = ra->size;
+		pattern = RA_PATTERN_SEQUENTIAL;
 		goto readit;
 	}
 
@@ -428,7 +559,7 @@ ondemand_readahead(struct address_space *mapping,
 		pgoff_t start;
 
 		rcu_read_lock();
-		start = radix_tree_next_hole(&mapping->page_tree, offset+1,max);
+		start = page_cache_next_hole(mapping, offset + 1, max);
 		rcu_read_unlock();
 
 		if (!start || start - offset > max)
@@ -439,6 +570,7 @@ ondemand_readahead(struct address_space *mapping,
 		ra->size += req_size;
 		ra->size = get_next_ra_size(ra, max);
 		ra->async_size = ra->size;
+		pattern = RA_PATTERN_MARKER;
 		goto readit;
 	}
 
@@ -458,14 +590,19 @@ ondemand_readahead(struct address_space *mapping,
 	 * Query the page cache and look for the traces(cached history pages)
 	 * that a sequential stream would leave behind.
 	 */
-	if (try_context_readahead(mapping, ra, offset, req_size, max))
+	if (try_context_readahead(mapping, ra, offset, req_size, max)) {
+		pattern = RA_PATTERN_CONTEXT;
 		goto readit;
+	}
 
 	/*
 	 * standalone, small random read
 	 * Read as is, and do not pollute the readahead state.
 	 */
-	return __do_page_cache_readahead(mapping, filp, offset, req_size, 0);
+	actual = __do_page_cache_readahead(mapping, filp, offset, req_size, 0);
+	trace_mm_readahead(mapping, offset, req_size, RA_PATTERN_RANDOM,
+			   offset, req_size, 0, actual);
+	return actual;
 
 initial_readahead:
 	ra->start = offset;
@@ -483,7 +620,10 @@ readit:
 		ra->size += ra->async_size;
 	}
 
-	return ra_submit(ra, mapping, filp);
+	actual = ra_submit(ra, mapping, filp);
+	trace_mm_readahead(mapping, offset, req_size, pattern,
+			   ra->start, ra->size, ra->async_size, actual);
+	return actual;
 }
 
 /**
@@ -3721,6 +3721,58 @@ void *kmem_cache_alloc(struct kmem_cache *cachep, gfp_t flags)
 }
 EXPORT_SYMBOL(kmem_cache_alloc);
 
+/**
+ * kmem_cache_alloc_bulk - allocate a batch of objects from a cache
+ * @cachep: the cache to allocate from
+ * @flags: GFP flags for the allocation
+ * @size: the number of objects to allocate
+ * @p: array to store the objects in
+ *
+ * The objects are taken from the array cache with interrupts disabled
+ * once for the batch.  Returns @size on success; on failure no object is
+ * left allocated and 0 is returned.
+ */
+int kmem_cache_alloc_bulk(struct kmem_cache *cachep, gfp_t flags, size_t size,
+			  void **p)
+{
+	size_t i, nr;
+
+	flags &= gfp_allowed_mask;
+
+	lockdep_trace_alloc(flags);
+
+	if (slab_should_failslab(cachep, flags))
+		return 0;
+
+	cache_alloc_debugcheck_before(cachep, flags);
+	local_irq_disable();
+	for (nr = 0; nr < size; nr++) {
+		p[nr] = __do_cache_alloc(cachep, flags);
+		if (unlikely(!p[nr]))
+			break;
+	}
+	local_irq_enable();
+
+	for (i = 0; i < nr; i++) {
+		p[i] = cache_alloc_debugcheck_after(cachep, flags, p[i],
+					__builtin_return_address(0));
+		kmemleak_alloc_recursive(p[i], obj_size(cachep), 1,
+					 cachep->flags, flags);
+		kmemcheck_slab_alloc(cachep, flags, p[i], obj_size(cachep));
+		if (unlikely(flags & __GFP_ZERO))
+			memset(p[i], 0, obj_size(cachep));
+		trace_kmem_cache_alloc(_RET_IP_, p[i], obj_size(cachep),
+				       cachep->buffer_size, flags);
+	}
+
+	if (unlikely(nr < size)) {
+		kmem_cache_free_bulk(cachep, nr, p);
+		return 0;
+	}
+	return size;
+}
+EXPORT_SYMBOL(kmem_cache_alloc_bulk);
+
 #ifdef CONFIG_TRACING
 void *
 kmem_cache_alloc_trace(size_t size, struct kmem_cache *cachep, gfp_t flags)
@@ -3875,6 +3927,31 @@ void kmem_cache_free(struct kmem_cache *cachep, void *objp)
 }
 EXPORT_SYMBOL(kmem_cache_free);
 
+/**
+ * kmem_cache_free_bulk - free a batch of objects to a cache
+ * @cachep: the cache the objects belong to
+ * @size: the number of objects
+ * @p: the objects
+ *
+ * Interrupts are disabled once for the whole batch.
+ */
+void kmem_cache_free_bulk(struct kmem_cache *cachep, size_t size, void **p)
+{
+	unsigned long flags;
+	size_t i;
+
+	local_irq_save(flags);
+	for (i = 0; i < size; i++) {
+		debug_check_no_locks_freed(p[i], obj_size(cachep));
+		if (!(cachep->flags & SLAB_DEBUG_OBJECTS))
+			debug_check_no_obj_freed(p[i], obj_size(cachep));
+		__cache_free(cachep, p[i], __builtin_return_address(0));
+		trace_kmem_cache_free(_RET_IP_, p[i]);
+	}
+	local_irq_restore(flags);
+}
+EXPORT_SYMBOL(kmem_cache_free_bulk);
+
 /**
  * kfree - free previously allocated memory
  * @objp: pointer returned by kmalloc.
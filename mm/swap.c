@@ -365,8 +365,13 @@ void mark_page_accessed(struct page *page)
 			PageReferenced(page) && PageLRU(page)) {
 		activate_page(page);
 		ClearPageReferenced(page);
+		if (page_is_file_cache(page))
+			workingset_activation(page);
+		lru_gen_mark_page(page);
 	} else if (!PageReferenced(page)) {
 		SetPageReferenced(page);
+	} else if (PageActive(page)) {
+		lru_gen_mark_page(page);
 	}
 }
 EXPORT_SYMBOL(mark_page_accessed);
@@ -710,6 +715,7 @@ static void __pagevec_lru_add_fn(struct page *page, void *arg)
 	SetPageLRU(page);
 	if (active)
 		SetPageActive(page);
+	lru_gen_add_page(page, file);
 	update_page_reclaim_stat(zone, page, file, active);
 	add_page_to_lru_list(zone, page, lru);
 }
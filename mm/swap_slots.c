@@ -0,0 +1,204 @@
+/*
+ * mm/swap_slots.c
+ *
+ * Per-cpu caches of swap slots.
+ *
+ * Every allocation and every release of a swap slot used to take
+ * swap_lock on its own.  Each cpu now keeps a batch of slots
+ * allocated ahead of time by get_swap_pages(), and a batch of freed
+ * slots that swapcache_free_entries() gives back in one go; both refill
+ * and flush take swap_lock once per SWAP_SLOTS_CACHE_SIZE slots.
+ *
+ * Slots held by a cache are SWAP_HAS_CACHE in the swap_map without any
+ * user, so nobody else can allocate them meanwhile.  The caches are
+ * turned off and drained when swap runs low, so that they do not hoard
+ * the last free slots, and turned back on once swap frees up again.
+ */
+
+#include <linux/mm.h>
+#include <linux/swap.h>
+#include <linux/swapops.h>
+#include <linux/percpu.h>
+#include <linux/mutex.h>
+#include <linux/spinlock.h>
+#include <linux/cpu.h>
+#include <linux/init.h>
+
+struct swap_slots_cache {
+	struct mutex	alloc_lock;	/* may sleep in get_swap_pages() */
+	int		nr;		/* slots left in slots[] */
+	int		cur;		/* next slot to hand out */
+	swp_entry_t	slots[SWAP_SLOTS_CACHE_SIZE];
+
+	spinlock_t	free_lock;	/* taken under the pte lock */
+	int		n_ret;		/* freed slots in slots_ret[] */
+	swp_entry_t	slots_ret[SWAP_SLOTS_CACHE_SIZE];
+};
+
+static DEFINE_PER_CPU(struct swap_slots_cache, swp_slots);
+static bool swap_slots_cache_ready __read_mostly;
+
+/* Whether the caches may take slots, changed under swap_slots_cache_mutex */
+static bool swap_slots_cache_enabled;
+static DEFINE_MUTEX(swap_slots_cache_mutex);
+
+/*
+ * Only cache slots while there are plenty of them: the cpus could
+ * otherwise hold the last free ones between them.  The caches turn off
+ * below the low mark and back on above the high one, so that swap
+ * hovering around one mark doesn't drain them over and over.
+ */
+#define SWAP_SLOTS_CACHE_LOW	\
+	((long)num_online_cpus() * SWAP_SLOTS_CACHE_SIZE * 2)
+#define SWAP_SLOTS_CACHE_HIGH	\
+	((long)num_online_cpus() * SWAP_SLOTS_CACHE_SIZE * 5)
+
+static void drain_slots_cache_cpu(unsigned int cpu);
+
+/*
+ * Turn the caches on or off as free swap crosses the marks.  Turning
+ * them off gives every cpu's cached slots back, including the freed
+ * ones, which would otherwise stay unusable until the next free on that
+ * cpu.  Called from get_swap_page(), which may sleep.
+ */
+static bool swap_slots_cache_check_active(void)
+{
+	bool active = ACCESS_ONCE(swap_slots_cache_enabled);
+	unsigned int cpu;
+
+	if (active ? nr_swap_pages >= SWAP_SLOTS_CACHE_LOW :
+		     nr_swap_pages <= SWAP_SLOTS_CACHE_HIGH)
+		return active;
+
+	mutex_lock(&swap_slots_cache_mutex);
+	if (swap_slots_cache_enabled == active) {
+		swap_slots_cache_enabled = !active;
+		if (active) {
+			/* free_swap_slot() rechecks under the free_lock */
+			for_each_possible_cpu(cpu)
+				drain_slots_cache_cpu(cpu);
+		}
+	}
+	active = swap_slots_cache_enabled;
+	mutex_unlock(&swap_slots_cache_mutex);
+	return active;
+}
+
+swp_entry_t get_swap_page(void)
+{
+	struct swap_slots_cache *cache;
+	swp_entry_t entry;
+
+	entry.val = 0;
+	if (swap_slots_cache_ready && swap_slots_cache_check_active()) {
+		/* We may migrate: alloc_lock protects whichever cache we got */
+		cache = __this_cpu_ptr(&swp_slots);
+
+		mutex_lock(&cache->alloc_lock);
+		/* The drain takes alloc_lock after turning the caches off */
+		if (!cache->nr && ACCESS_ONCE(swap_slots_cache_enabled)) {
+			cache->cur = 0;
+			cache->nr = get_swap_pages(SWAP_SLOTS_CACHE_SIZE,
+						   cache->slots);
+		}
+		if (cache->nr) {
+			entry = cache->slots[cache->cur++];
+			cache->nr--;
+		}
+		mutex_unlock(&cache->alloc_lock);
+		if (entry.val)
+			return entry;
+	}
+
+	get_swap_pages(1, &entry);
+	return entry;
+}
+
+/*
+ * Give back a slot that swap_entry_free() left without users.
+ */
+void free_swap_slot(swp_entry_t entry)
+{
+	struct swap_slots_cache *cache;
+
+	if (!swap_slots_cache_ready || !ACCESS_ONCE(swap_slots_cache_enabled))
+		goto direct_free;
+
+	cache = &get_cpu_var(swp_slots);
+	spin_lock(&cache->free_lock);
+	/* The caches may have been turned off and drained meanwhile */
+	if (!ACCESS_ONCE(swap_slots_cache_enabled)) {
+		spin_unlock(&cache->free_lock);
+		put_cpu_var(swp_slots);
+		goto direct_free;
+	}
+	if (cache->n_ret >= SWAP_SLOTS_CACHE_SIZE) {
+		swapcache_free_entries(cache->slots_ret, cache->n_ret);
+		cache->n_ret = 0;
+	}
+	cache->slots_ret[cache->n_ret++] = entry;
+	spin_unlock(&cache->free_lock);
+	put_cpu_var(swp_slots);
+	return;
+
+direct_free:
+	swapcache_free_entries(&entry, 1);
+}
+
+static void drain_slots_cache_cpu(unsigned int cpu)
+{
+	struct swap_slots_cache *cache = &per_cpu(swp_slots, cpu);
+
+	mutex_lock(&cache->alloc_lock);
+	if (cache->nr) {
+		swapcache_free_entries(cache->slots + cache->cur, cache->nr);
+		cache->nr = 0;
+	}
+	mutex_unlock(&cache->alloc_lock);
+
+	spin_lock(&cache->free_lock);
+	if (cache->n_ret) {
+		swapcache_free_entries(cache->slots_ret, cache->n_ret);
+		cache->n_ret = 0;
+	}
+	spin_unlock(&cache->free_lock);
+}
+
+/*
+ * Return all cached slots, for swapoff.  Slots cached after we looked
+ * at a cpu can only come from swap devices still in use.
+ */
+void drain_swap_slots_cache(void)
+{
+	unsigned int cpu;
+
+	if (!swap_slots_cache_ready)
+		return;
+
+	for_each_possible_cpu(cpu)
+		drain_slots_cache_cpu(cpu);
+}
+
+static int __cpuinit swap_slots_cpu_notify(struct notifier_block *self,
+					   unsigned long action, void *hcpu)
+{
+	if (action == CPU_DEAD || action == CPU_DEAD_FROZEN)
+		drain_slots_cache_cpu((unsigned long)hcpu);
+	return NOTIFY_OK;
+}
+
+static int __init swap_slots_cache_init(void)
+{
+	unsigned int cpu;
+
+	for_each_possible_cpu(cpu) {
+		struct swap_slots_cache *cache = &per_cpu(swp_slots, cpu);
+
+		mutex_init(&cache->alloc_lock);
+		spin_lock_init(&cache->free_lock);
+	}
+	hotcpu_notifier(swap_slots_cpu_notify, 0);
+	swap_slots_cache_ready = true;
+	return 0;
+}
+subsys_initcall(swap_slots_cache_init);
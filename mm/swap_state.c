@@ -325,6 +325,13 @@ struct page *read_swap_cache_async(swp_entry_t entry, gfp_t gfp_mask,
 		err = swapcache_prepare(entry);
 		if (err == -EEXIST) {	/* seems racy */
 			radix_tree_preload_end();
+			/*
+			 * Without users the entry is either held by a swap
+			 * slot cache, or is being added to the swap cache
+			 * by whoever allocated it: don't spin on it.
+			 */
+			if (!__swap_count(entry))
+				break;
 			continue;
 		}
 		if (err) {		/* swp entry is obsolete ? */
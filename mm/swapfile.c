@@ -31,11 +31,13 @@
 #include <linux/memcontrol.h>
 #include <linux/poll.h>
 #include <linux/oom.h>
+#include <linux/export.h>
 
 #include <asm/pgtable.h>
 #include <asm/tlbflush.h>
 #include <linux/swapops.h>
 #include <linux/page_cgroup.h>
+#include <linux/frontswap.h>
 
 static bool swap_count_continued(struct swap_info_struct *, pgoff_t,
 				 unsigned char);
@@ -179,6 +181,105 @@ static int wait_for_discard(void *word)
 #define SWAPFILE_CLUSTER	256
 #define LATENCY_LIMIT		256
 
+/*
+ * Cluster accounting for SSD swap, under swap_lock.  A cluster is on
+ * si->free_clusters when none of its slots is in use; a cluster a cpu
+ * is allocating from has been taken off the list, whatever its count.
+ */
+static void inc_cluster_info_page(struct swap_info_struct *si,
+				  unsigned long offset)
+{
+	struct swap_cluster_info *ci;
+
+	if (!si->cluster_info)
+		return;
+	ci = &si->cluster_info[offset / SWAPFILE_CLUSTER];
+	if (!ci->count++)
+		list_del_init(&ci->list);
+	VM_BUG_ON(ci->count > SWAPFILE_CLUSTER);
+}
+
+static void dec_cluster_info_page(struct swap_info_struct *si,
+				  unsigned long offset)
+{
+	struct swap_cluster_info *ci;
+
+	if (!si->cluster_info)
+		return;
+	ci = &si->cluster_info[offset / SWAPFILE_CLUSTER];
+	VM_BUG_ON(!ci->count);
+	if (!--ci->count && list_empty(&ci->list))
+		list_add_tail(&ci->list, &si->free_clusters);
+}
+
+/*
+ * Pick the next free slot from this cpu's cluster, moving on to a free
+ * cluster when it is used up.  Returns 0 when there is no free cluster
+ * left, and the caller falls back to scanning the whole map.
+ */
+static int scan_swap_map_ssd_cluster(struct swap_info_struct *si,
+				     unsigned long *offset)
+{
+	struct swap_cluster_info *ci;
+	unsigned int *next;
+	unsigned long tmp, end;
+
+new_cluster:
+	next = this_cpu_ptr(si->cluster_next_cpu);
+	tmp = *next;
+	if (!tmp) {
+		if (list_empty(&si->free_clusters))
+			return 0;
+		if (si->flags & SWP_DISCARDING) {
+			spin_unlock(&swap_lock);
+			wait_on_bit(&si->flags, ilog2(SWP_DISCARDING),
+				wait_for_discard, TASK_UNINTERRUPTIBLE);
+			spin_lock(&swap_lock);
+			goto new_cluster;
+		}
+		ci = list_first_entry(&si->free_clusters,
+				      struct swap_cluster_info, list);
+		list_del_init(&ci->list);
+		tmp = (ci - si->cluster_info) * SWAPFILE_CLUSTER;
+
+		if (si->flags & SWP_DISCARDABLE) {
+			/*
+			 * Nobody else allocates from a cluster we took off
+			 * the free list, except by scanning when there are
+			 * no free clusters: those wait for SWP_DISCARDING.
+			 */
+			si->flags |= SWP_DISCARDING;
+			spin_unlock(&swap_lock);
+			discard_swap_cluster(si, tmp,
+				min_t(unsigned long, SWAPFILE_CLUSTER,
+				      si->max - tmp));
+			spin_lock(&swap_lock);
+			si->flags &= ~SWP_DISCARDING;
+			smp_mb();	/* wake_up_bit advises this */
+			wake_up_bit(&si->flags, ilog2(SWP_DISCARDING));
+
+			/* We may have moved cpu meanwhile */
+			next = this_cpu_ptr(si->cluster_next_cpu);
+			if (*next) {
+				if (!ci->count && list_empty(&ci->list))
+					list_add(&ci->list, &si->free_clusters);
+				goto new_cluster;
+			}
+		}
+	}
+
+	end = min_t(unsigned long, ALIGN(tmp + 1, SWAPFILE_CLUSTER), si->max);
+	while (tmp < end && si->swap_map[tmp])
+		tmp++;
+	if (tmp >= end) {
+		*next = 0;
+		goto new_cluster;
+	}
+	*offset = tmp;
+	*next = tmp + 1 < end ? tmp + 1 : 0;
+	return 1;
+}
+
 static unsigned long scan_swap_map(struct swap_info_struct *si,
 				   unsigned char usage)
 {
@@ -202,6 +303,12 @@ static unsigned long scan_swap_map(struct swap_info_struct *si,
 	si->flags += SWP_SCANNING;
 	scan_base = offset = si->cluster_next;
 
+	if (si->cluster_info) {
+		if (scan_swap_map_ssd_cluster(si, &offset))
+			scan_base = offset;
+		goto checks;
+	}
+
 	if (unlikely(!si->cluster_nr--)) {
 		if (si->pages - si->inuse_pages < SWAPFILE_CLUSTER) {
 			si->cluster_nr = SWAPFILE_CLUSTER - 1;
@@ -312,9 +419,21 @@ checks:
 		si->highest_bit = 0;
 	}
 	si->swap_map[offset] = usage;
+	inc_cluster_info_page(si, offset);
 	si->cluster_next = offset + 1;
 	si->flags -= SWP_SCANNING;
 
+	if (si->cluster_info && (si->flags & SWP_DISCARDING)) {
+		/*
+		 * Another cpu is discarding a cluster it just took: we
+		 * might have scanned our way into it.
+		 */
+		spin_unlock(&swap_lock);
+		wait_on_bit(&si->flags, ilog2(SWP_DISCARDING),
+			wait_for_discard, TASK_UNINTERRUPTIBLE);
+		spin_lock(&swap_lock);
+	}
+
 	if (si->lowest_alloc) {
 		/*
 		 * Only set when SWP_DISCARDABLE, and there's a scan
@@ -408,17 +527,24 @@ no_page:
 	return 0;
 }
 
-swp_entry_t get_swap_page(void)
+/*
+ * Allocate up to @n swap entries for the swap cache, all from the same
+ * swap device, taking swap_lock once.  Returns the number allocated.
+ */
+int get_swap_pages(int n, swp_entry_t *entries)
 {
 	struct swap_info_struct *si;
 	pgoff_t offset;
 	int type, next;
 	int wrapped = 0;
+	int nr = 0;
 
 	spin_lock(&swap_lock);
 	if (nr_swap_pages <= 0)
 		goto noswap;
-	nr_swap_pages--;
+	if (n > nr_swap_pages)
+		n = nr_swap_pages;
+	nr_swap_pages -= n;
 
 	for (type = swap_list.next; type >= 0 && wrapped < 2; type = next) {
 		si = swap_info[type];
@@ -436,18 +562,21 @@ swp_entry_t get_swap_page(void)
 
 		swap_list.next = next;
 		/* This is called for allocating swap entry for cache */
-		offset = scan_swap_map(si, SWAP_HAS_CACHE);
-		if (offset) {
-			spin_unlock(&swap_lock);
-			return swp_entry(type, offset);
+		while (nr < n) {
+			offset = scan_swap_map(si, SWAP_HAS_CACHE);
+			if (!offset)
+				break;
+			entries[nr++] = swp_entry(type, offset);
 		}
+		if (nr)
+			break;
 		next = swap_list.next;
 	}
 
-	nr_swap_pages++;
+	nr_swap_pages += n - nr;
 noswap:
 	spin_unlock(&swap_lock);
-	return (swp_entry_t) {0};
+	return nr;
 }
 
 /* The only caller of this function is now susupend routine */
@@ -508,6 +637,11 @@ out:
 	return NULL;
 }
 
+/*
+ * Drop a reference to a swap entry.  When the last one goes, the entry
+ * is left as SWAP_HAS_CACHE so that nobody can allocate it yet, and
+ * the caller hands it to free_swap_slot() once swap_lock is dropped.
+ */
 static unsigned char swap_entry_free(struct swap_info_struct *p,
 				     swp_entry_t entry, unsigned char usage)
 {
@@ -542,28 +676,59 @@ static unsigned char swap_entry_free(struct swap_info_struct *p,
 		mem_cgroup_uncharge_swap(entry);
 
 	usage = count | has_cache;
-	p->swap_map[offset] = usage;
-
-	/* free if no reference */
-	if (!usage) {
-		struct gendisk *disk = p->bdev->bd_disk;
-		if (offset < p->lowest_bit)
-			p->lowest_bit = offset;
-		if (offset > p->highest_bit)
-			p->highest_bit = offset;
-		if (swap_list.next >= 0 &&
-		    p->prio > swap_info[swap_list.next]->prio)
-			swap_list.next = p->type;
-		nr_swap_pages++;
-		p->inuse_pages--;
-		if ((p->flags & SWP_BLKDEV) &&
-				disk->fops->swap_slot_free_notify)
-			disk->fops->swap_slot_free_notify(p->bdev, offset);
-	}
+	p->swap_map[offset] = usage ? usage : SWAP_HAS_CACHE;
 
 	return usage;
 }
 
+/*
+ * Give back a swap entry that swap_entry_free() or get_swap_pages() left
+ * as SWAP_HAS_CACHE without users.  Called with swap_lock held.
+ */
+static void swap_entry_release(struct swap_info_struct *p,
+			       unsigned long offset)
+{
+	struct gendisk *disk = p->bdev->bd_disk;
+
+	VM_BUG_ON(p->swap_map[offset] != SWAP_HAS_CACHE);
+	p->swap_map[offset] = 0;
+	dec_cluster_info_page(p, offset);
+	frontswap_flush_page(p, offset);
+	if (offset < p->lowest_bit)
+		p->lowest_bit = offset;
+	if (offset > p->highest_bit)
+		p->highest_bit = offset;
+	if (swap_list.next >= 0 &&
+	    p->prio > swap_info[swap_list.next]->prio)
+		swap_list.next = p->type;
+	nr_swap_pages++;
+	p->inuse_pages--;
+	if ((p->flags & SWP_BLKDEV) &&
+			disk->fops->swap_slot_free_notify)
+		disk->fops->swap_slot_free_notify(p->bdev, offset);
+}
+
+void swapcache_free_entries(swp_entry_t *entries, int n)
+{
+	int i;
+
+	spin_lock(&swap_lock);
+	for (i = 0; i < n; i++)
+		swap_entry_release(swap_info[swp_type(entries[i])],
+				   swp_offset(entries[i]));
+	spin_unlock(&swap_lock);
+}
+
+/*
+ * The number of users of a swap entry, looked up without swap_lock.
+ */
+int __swap_count(swp_entry_t entry)
+{
+	struct swap_info_struct *p = swap_info[swp_type(entry)];
+
+	return swap_count(ACCESS_ONCE(p->swap_map[swp_offset(entry)]));
+}
+
 /*
  * Caller has made sure that the swapdevice corresponding to entry
  * is still around or has not been recycled.
@@ -572,10 +737,14 @@ void swap_free(swp_entry_t entry)
 {
 	struct swap_info_struct *p;
 
+	unsigned char usage;
+
 	p = swap_info_get(entry);
 	if (p) {
-		swap_entry_free(p, entry, 1);
+		usage = swap_entry_free(p, entry, 1);
 		spin_unlock(&swap_lock);
+		if (!usage)
+			free_swap_slot(entry);
 	}
 }
 
@@ -593,6 +762,8 @@ void swapcache_free(swp_entry_t entry, struct page *page)
 		if (page)
 			mem_cgroup_uncharge_swapcache(page, entry, count != 0);
 		spin_unlock(&swap_lock);
+		if (!count)
+			free_swap_slot(entry);
 	}
 }
 
@@ -692,7 +863,9 @@ int free_swap_and_cache(swp_entry_t entry)
 
 	p = swap_info_get(entry);
 	if (p) {
-		if (swap_entry_free(p, entry, 1) == SWAP_HAS_CACHE) {
+		unsigned char usage = swap_entry_free(p, entry, 1);
+
+		if (usage == SWAP_HAS_CACHE) {
 			page = find_get_page(&swapper_space, entry.val);
 			if (page && !trylock_page(page)) {
 				page_cache_release(page);
@@ -700,6 +873,8 @@ int free_swap_and_cache(swp_entry_t entry)
 			}
 		}
 		spin_unlock(&swap_lock);
+		if (!usage)
+			free_swap_slot(entry);
 	}
 	if (page) {
 		/*
@@ -1022,7 +1197,7 @@ static int unuse_mm(struct mm_struct *mm,
  * Recycle to start on reaching the end, returning 0 when empty.
  */
 static unsigned int find_next_to_unuse(struct swap_info_struct *si,
-					unsigned int prev)
+					unsigned int prev, bool frontswap)
 {
 	unsigned int max = si->max;
 	unsigned int i = prev;
@@ -1050,7 +1225,8 @@ static unsigned int find_next_to_unuse(struct swap_info_struct *si,
 		}
 		count = si->swap_map[i];
 		if (count && swap_count(count) != SWAP_MAP_BAD)
-			break;
+			if (!frontswap || frontswap_test(si, i))
+				break;
 	}
 	return i;
 }
@@ -1059,8 +1235,12 @@ static unsigned int find_next_to_unuse(struct swap_info_struct *si,
  * We completely avoid races by reading each swap page in advance,
  * and then search for the process using it.  All the necessary
  * page table adjustments can then be made atomically.
+ *
+ * If @frontswap is true, only the entries held by frontswap are brought
+ * back, and at most @pages_to_unuse of them if that is not zero.
  */
-static int try_to_unuse(unsigned int type)
+static int try_to_unuse(unsigned int type, bool frontswap,
+			unsigned long pages_to_unuse)
 {
 	struct swap_info_struct *si = swap_info[type];
 	struct mm_struct *start_mm;
@@ -1093,7 +1273,7 @@ static int try_to_unuse(unsigned int type)
 	 * one pass through swap_map is enough, but not necessarily:
 	 * there are races when an instance of an entry might be missed.
 	 */
-	while ((i = find_next_to_unuse(si, i)) != 0) {
+	while ((i = find_next_to_unuse(si, i, frontswap)) != 0) {
 		if (signal_pending(current)) {
 			retval = -EINTR;
 			break;
@@ -1117,6 +1297,16 @@ static int try_to_unuse(unsigned int type)
 			 */
 			if (!*swap_map)
 				continue;
+			/*
+			 * No users: the entry sits in a swap slot cache,
+			 * or is on its way into the swap cache.  Come back
+			 * to it on the next pass.
+			 */
+			if (*swap_map == SWAP_HAS_CACHE) {
+				drain_swap_slots_cache();
+				cond_resched();
+				continue;
+			}
 			retval = -ENOMEM;
 			break;
 		}
@@ -1260,6 +1450,10 @@ static int try_to_unuse(unsigned int type)
 		 * interactive performance.
 		 */
 		cond_resched();
+		if (frontswap && pages_to_unuse > 0) {
+			if (!--pages_to_unuse)
+				break;
+		}
 	}
 
 	mmput(start_mm);
@@ -1320,6 +1514,17 @@ static sector_t map_swap_entry(swp_entry_t entry, struct block_device **bdev)
 	}
 }
 
+/*
+ * Returns the swap device holding the specified page's swap entry.
+ */
+struct swap_info_struct *page_swap_info(struct page *page)
+{
+	swp_entry_t entry = { .val = page_private(page) };
+
+	BUG_ON(!PageSwapCache(page));
+	return swap_info[swp_type(entry)];
+}
+
 /*
  * Returns the page offset into bdev for the specified page's swap entry.
  */
@@ -1552,6 +1757,9 @@ SYSCALL_DEFINE1(swapoff, const char __user *, specialfile)
 {
 	struct swap_info_struct *p = NULL;
 	unsigned char *swap_map;
+	struct swap_cluster_info *cluster_info;
+	unsigned int __percpu *cluster_next_cpu;
+	unsigned long *frontswap_map;
 	struct file *swap_file, *victim;
 	struct address_space *mapping;
 	struct inode *inode;
@@ -1615,8 +1823,11 @@ SYSCALL_DEFINE1(swapoff, const char __user *, specialfile)
 	p->flags &= ~SWP_WRITEOK;
 	spin_unlock(&swap_lock);
 
+	/* Give back the entries the slot caches hold */
+	drain_swap_slots_cache();
+
 	oom_score_adj = test_set_oom_score_adj(OOM_SCORE_ADJ_MAX);
-	err = try_to_unuse(type);
+	err = try_to_unuse(type, false, 0);
 	compare_swap_oom_score_adj(OOM_SCORE_ADJ_MAX, oom_score_adj);
 
 	if (err) {
@@ -1634,6 +1845,7 @@ SYSCALL_DEFINE1(swapoff, const char __user *, specialfile)
 	destroy_swap_extents(p);
 	if (p->flags & SWP_CONTINUED)
 		free_swap_count_continuations(p);
+	frontswap_flush_area(p);
 
 	mutex_lock(&swapon_mutex);
 	spin_lock(&swap_lock);
@@ -1652,10 +1864,19 @@ SYSCALL_DEFINE1(swapoff, const char __user *, specialfile)
 	p->max = 0;
 	swap_map = p->swap_map;
 	p->swap_map = NULL;
+	cluster_info = p->cluster_info;
+	p->cluster_info = NULL;
+	cluster_next_cpu = p->cluster_next_cpu;
+	p->cluster_next_cpu = NULL;
+	frontswap_map = frontswap_map_get(p);
+	frontswap_map_set(p, NULL);
 	p->flags = 0;
 	spin_unlock(&swap_lock);
 	mutex_unlock(&swapon_mutex);
 	vfree(swap_map);
+	vfree(cluster_info);
+	free_percpu(cluster_next_cpu);
+	vfree(frontswap_map);
 	/* Destroy swap account informatin */
 	swap_cgroup_swapoff(type);
 
@@ -1680,6 +1901,72 @@ out:
 	return err;
 }
 
+#ifdef CONFIG_FRONTSWAP
+/**
+ * frontswap_curr_pages - count the swap pages held by frontswap
+ */
+unsigned long frontswap_curr_pages(void)
+{
+	unsigned long totalpages = 0;
+	int type;
+
+	spin_lock(&swap_lock);
+	for (type = swap_list.head; type >= 0; type = swap_info[type]->next)
+		totalpages += atomic_read(&swap_info[type]->frontswap_pages);
+	spin_unlock(&swap_lock);
+	return totalpages;
+}
+EXPORT_SYMBOL(frontswap_curr_pages);
+
+/**
+ * frontswap_shrink - bring swap pages back from frontswap into memory
+ * @target_pages: number of pages to leave in frontswap
+ *
+ * Works like a partial swapoff that only reads back the entries held
+ * by frontswap, from the first swap area that has enough of them and
+ * for which there is enough memory.  swapon_mutex keeps swapoff from
+ * tearing the area down meanwhile.
+ */
+void frontswap_shrink(unsigned long target_pages)
+{
+	struct swap_info_struct *si = NULL;
+	unsigned long total_pages = 0, pages, pages_to_unuse = 0;
+	int type;
+
+	mutex_lock(&swapon_mutex);
+	spin_lock(&swap_lock);
+	for (type = swap_list.head; type >= 0; type = swap_info[type]->next)
+		total_pages += atomic_read(&swap_info[type]->frontswap_pages);
+	if (total_pages <= target_pages) {
+		spin_unlock(&swap_lock);
+		goto out;
+	}
+	total_pages -= target_pages;
+
+	for (type = swap_list.head; type >= 0; type = si->next) {
+		si = swap_info[type];
+		pages = atomic_read(&si->frontswap_pages);
+		if (!pages)
+			continue;
+		if (total_pages < pages)
+			pages = pages_to_unuse = total_pages;
+		else
+			pages_to_unuse = 0;	/* all of them */
+		if (!security_vm_enough_memory_kern(pages)) {
+			vm_unacct_memory(pages);
+			break;
+		}
+	}
+	spin_unlock(&swap_lock);
+
+	if (type >= 0)
+		try_to_unuse(type, true, pages_to_unuse);
+out:
+	mutex_unlock(&swapon_mutex);
+}
+EXPORT_SYMBOL(frontswap_shrink);
+#endif /* CONFIG_FRONTSWAP */
+
 #ifdef CONFIG_PROC_FS
 static unsigned swaps_poll(struct file *file, poll_table *wait)
 {
@@ -2005,6 +2292,43 @@ static int setup_swap_map_and_extents(struct swap_info_struct *p,
 	return nr_extents;
 }
 
+/*
+ * Count the bad slots, and the slots past the end of the device, in each
+ * cluster and queue up the clusters that are entirely free, starting at
+ * a random one so that the whole device gets worn evenly.
+ */
+static int setup_swap_clusters(struct swap_info_struct *p,
+			       unsigned char *swap_map)
+{
+	unsigned long nr_clusters = DIV_ROUND_UP(p->max, SWAPFILE_CLUSTER);
+	unsigned long i, idx, start;
+
+	p->cluster_info = vzalloc(nr_clusters * sizeof(*p->cluster_info));
+	if (!p->cluster_info)
+		return -ENOMEM;
+	p->cluster_next_cpu = alloc_percpu(unsigned int);
+	if (!p->cluster_next_cpu) {
+		vfree(p->cluster_info);
+		p->cluster_info = NULL;
+		return -ENOMEM;
+	}
+
+	INIT_LIST_HEAD(&p->free_clusters);
+	for (i = 0; i < nr_clusters * SWAPFILE_CLUSTER; i++) {
+		if (i >= p->max || swap_map[i])
+			p->cluster_info[i / SWAPFILE_CLUSTER].count++;
+	}
+	start = random32() % nr_clusters;
+	for (i = 0; i < nr_clusters; i++) {
+		idx = (start + i) % nr_clusters;
+		INIT_LIST_HEAD(&p->cluster_info[idx].list);
+		if (!p->cluster_info[idx].count)
+			list_add_tail(&p->cluster_info[idx].list,
+				      &p->free_clusters);
+	}
+	return 0;
+}
+
 SYSCALL_DEFINE2(swapon, const char __user *, specialfile, int, swap_flags)
 {
 	struct swap_info_struct *p;
@@ -2019,6 +2343,7 @@ SYSCALL_DEFINE2(swapon, const char __user *, specialfile, int, swap_flags)
 	sector_t span;
 	unsigned long maxpages;
 	unsigned char *swap_map = NULL;
+	unsigned long *frontswap_map = NULL;
 	struct page *page = NULL;
 	struct inode *inode = NULL;
 
@@ -2104,24 +2429,34 @@ SYSCALL_DEFINE2(swapon, const char __user *, specialfile, int, swap_flags)
 		if (blk_queue_nonrot(bdev_get_queue(p->bdev))) {
 			p->flags |= SWP_SOLIDSTATE;
 			p->cluster_next = 1 + (random32() % p->highest_bit);
+			error = setup_swap_clusters(p, swap_map);
+			if (error)
+				goto bad_swap;
 		}
 		if (discard_swap(p) == 0 && (swap_flags & SWAP_FLAG_DISCARD))
 			p->flags |= SWP_DISCARDABLE;
 	}
 
+	/* frontswap simply stays off for this device if this fails */
+	if (frontswap_enabled)
+		frontswap_map = vzalloc(BITS_TO_LONGS(maxpages) * sizeof(long));
+
 	mutex_lock(&swapon_mutex);
 	prio = -1;
 	if (swap_flags & SWAP_FLAG_PREFER)
 		prio =
 		  (swap_flags & SWAP_FLAG_PRIO_MASK) >> SWAP_FLAG_PRIO_SHIFT;
+	frontswap_map_set(p, frontswap_map);
+	frontswap_init(p);
 	enable_swap_info(p, prio, swap_map);
 
 	printk(KERN_INFO "Adding %uk swap on %s.  "
-			"Priority:%d extents:%d across:%lluk %s%s\n",
+			"Priority:%d extents:%d across:%lluk %s%s%s\n",
 		p->pages<<(PAGE_SHIFT-10), name, p->prio,
 		nr_extents, (unsigned long long)span<<(PAGE_SHIFT-10),
 		(p->flags & SWP_SOLIDSTATE) ? "SS" : "",
-		(p->flags & SWP_DISCARDABLE) ? "D" : "");
+		(p->flags & SWP_DISCARDABLE) ? "D" : "",
+		frontswap_map_get(p) ? "FS" : "");
 
 	mutex_unlock(&swapon_mutex);
 	atomic_inc(&proc_poll_event);
@@ -2143,6 +2478,10 @@ bad_swap:
 	p->flags = 0;
 	spin_unlock(&swap_lock);
 	vfree(swap_map);
+	vfree(p->cluster_info);
+	p->cluster_info = NULL;
+	free_percpu(p->cluster_next_cpu);
+	p->cluster_next_cpu = NULL;
 	if (swap_file) {
 		if (inode && S_ISREG(inode->i_mode)) {
 			mutex_unlock(&inode->i_mutex);
@@ -22,6 +22,7 @@
 #include <linux/kallsyms.h>
 #include <linux/list.h>
 #include <linux/rbtree.h>
+#include <linux/llist.h>
 #include <linux/radix-tree.h>
 #include <linux/rcupdate.h>
 #include <linux/pfn.h>
@@ -255,7 +256,9 @@ struct vmap_area {
 	unsigned long flags;
 	struct rb_node rb_node;		/* address sorted rbtree */
 	struct list_head list;		/* address sorted list */
-	struct list_head purge_list;	/* "lazy purge" list */
+	struct llist_node purge_list;	/* "lazy purge" list */
+	unsigned long subtree_max_gap;	/* largest hole below an area of
+					 * this rbtree subtree */
 	struct vm_struct *vm;
 	struct rcu_head rcu_head;
 };
@@ -264,12 +267,6 @@ static DEFINE_SPINLOCK(vmap_area_lock);
 static LIST_HEAD(vmap_area_list);
 static struct rb_root vmap_area_root = RB_ROOT;
 
-/* The vmap cache globals are protected by vmap_area_lock */
-static struct rb_node *free_vmap_cache;
-static unsigned long cached_hole_size;
-static unsigned long cached_vstart;
-static unsigned long cached_align;
-
 static unsigned long vmap_area_pcpu_hole;
 
 static struct vmap_area *__find_vmap_area(unsigned long addr)
@@ -291,6 +288,52 @@ static struct vmap_area *__find_vmap_area(unsigned long addr)
 	return NULL;
 }
 
+/*
+ * The free kva is indexed by the busy areas themselves: each area knows
+ * the hole between itself and the area before it in address order, and
+ * the rbtree is augmented with the largest such hole in each subtree, so
+ * that alloc_vmap_area() can skip whole subtrees that have no hole large
+ * enough.
+ */
+static unsigned long va_hole_start(struct vmap_area *va)
+{
+	struct vmap_area *prev;
+
+	if (va->list.prev == &vmap_area_list)
+		return 0;
+	prev = list_entry(va->list.prev, struct vmap_area, list);
+	return prev->va_end;
+}
+
+static inline unsigned long subtree_max_gap(struct rb_node *n)
+{
+	return n ? rb_entry(n, struct vmap_area, rb_node)->subtree_max_gap : 0;
+}
+
+static void vmap_area_augment_cb(struct rb_node *n, void *unused)
+{
+	struct vmap_area *va;
+	unsigned long max_gap;
+
+	if (!n)
+		return;
+
+	va = rb_entry(n, struct vmap_area, rb_node);
+	max_gap = va->va_start - va_hole_start(va);
+	max_gap = max(max_gap, subtree_max_gap(n->rb_left));
+	max_gap = max(max_gap, subtree_max_gap(n->rb_right));
+	va->subtree_max_gap = max_gap;
+}
+
+/* The hole below @va changed size: fix up the gaps up to the root */
+static void vmap_area_augment_propagate(struct vmap_area *va)
+{
+	struct rb_node *n;
+
+	for (n = &va->rb_node; n; n = rb_parent(n))
+		vmap_area_augment_cb(n, NULL);
+}
+
 static void __insert_vmap_area(struct vmap_area *va)
 {
 	struct rb_node **p = &vmap_area_root.rb_node;
@@ -321,6 +364,88 @@ static void __insert_vmap_area(struct vmap_area *va)
 		list_add_rcu(&va->list, &prev->list);
 	} else
 		list_add_rcu(&va->list, &vmap_area_list);
+
+	/* the gap of va is known now that it is on the list */
+	rb_augment_insert(&va->rb_node, vmap_area_augment_cb, NULL);
+
+	/* va has split the hole below the next area */
+	if (va->list.next != &vmap_area_list)
+		vmap_area_augment_propagate(list_entry(va->list.next,
+						       struct vmap_area, list));
+}
+
+/*
+ * The lowest address at or above @vstart where @size bytes aligned to
+ * @align fit into the hole below @va, or 0 if they do not fit.
+ */
+static unsigned long va_hole_fit(struct vmap_area *va, unsigned long size,
+				 unsigned long align, unsigned long vstart,
+				 unsigned long vend)
+{
+	unsigned long addr = ALIGN(max(va_hole_start(va), vstart), align);
+
+	if (addr + size - 1 < addr)
+		return 0;
+	if (addr + size > va->va_start || addr + size > vend)
+		return 0;
+	return addr;
+}
+
+/*
+ * Find the lowest hole of at least @size bytes in [@vstart, @vend):
+ * walk the areas in address order, but only descend into subtrees whose
+ * largest hole is big enough.  Returns the address, or 0 if there is no
+ * such hole below an existing area; the space above the last area is
+ * left to the caller.  Called with vmap_area_lock held.
+ */
+static unsigned long find_vmap_lowest_match(unsigned long size,
+					    unsigned long align,
+					    unsigned long vstart,
+					    unsigned long vend)
+{
+	struct rb_node *n = vmap_area_root.rb_node;
+	struct vmap_area *va;
+	unsigned long addr;
+
+	if (!n || subtree_max_gap(n) < size)
+		return 0;
+
+	for (;;) {
+		va = rb_entry(n, struct vmap_area, rb_node);
+
+		/* areas to our left end below vstart + size: no fit there */
+		if (va->va_start > vstart + size &&
+		    subtree_max_gap(n->rb_left) >= size) {
+			n = n->rb_left;
+			continue;
+		}
+check:
+		addr = va_hole_fit(va, size, align, vstart, vend);
+		if (addr)
+			return addr;
+		/* holes further right only start higher */
+		if (va_hole_start(va) >= vend)
+			return 0;
+
+		if (subtree_max_gap(n->rb_right) >= size) {
+			n = n->rb_right;
+			continue;
+		}
+
+		/* climb to the next area in address order we have not seen */
+		for (;;) {
+			struct rb_node *parent = rb_parent(n);
+
+			if (!parent)
+				return 0;
+			if (n == parent->rb_left) {
+				n = parent;
+				va = rb_entry(n, struct vmap_area, rb_node);
+				goto check;
+			}
+			n = parent;
+		}
+	}
 }
 
 static void purge_vmap_area_lazy(void);
@@ -338,7 +463,6 @@ static struct vmap_area *alloc_vmap_area(unsigned long size,
 	struct rb_node *n;
 	unsigned long addr;
 	int purged = 0;
-	struct vmap_area *first;
 
 	BUG_ON(!size);
 	BUG_ON(size & ~PAGE_MASK);
@@ -351,84 +475,25 @@ static struct vmap_area *alloc_vmap_area(unsigned long size,
 
 retry:
 	spin_lock(&vmap_area_lock);
-	/*
-	 * Invalidate cache if we have more permissive parameters.
-	 * cached_hole_size notes the largest hole noticed _below_
-	 * the vmap_area cached in free_vmap_cache: if size fits
-	 * into that hole, we want to scan from vstart to reuse
-	 * the hole instead of allocating above free_vmap_cache.
-	 * Note that __free_vmap_area may update free_vmap_cache
-	 * without updating cached_hole_size or cached_align.
-	 */
-	if (!free_vmap_cache ||
-			size < cached_hole_size ||
-			vstart < cached_vstart ||
-			align < cached_align) {
-nocache:
-		cached_hole_size = 0;
-		free_vmap_cache = NULL;
-	}
-	/* record if we encounter less permissive parameters */
-	cached_vstart = vstart;
-	cached_align = align;
-
-	/* find starting point for our search */
-	if (free_vmap_cache) {
-		first = rb_entry(free_vmap_cache, struct vmap_area, rb_node);
-		addr = ALIGN(first->va_end, align);
-		if (addr < vstart)
-			goto nocache;
-		if (addr + size - 1 < addr)
-			goto overflow;
-
-	} else {
-		addr = ALIGN(vstart, align);
+	addr = find_vmap_lowest_match(size, align, vstart, vend);
+	if (!addr) {
+		/* no hole below an area: try the space above the last one */
+		addr = vstart;
+		n = rb_last(&vmap_area_root);
+		if (n)
+			addr = max(addr,
+				   rb_entry(n, struct vmap_area, rb_node)->va_end);
+		addr = ALIGN(addr, align);
 		if (addr + size - 1 < addr)
 			goto overflow;
-
-		n = vmap_area_root.rb_node;
-		first = NULL;
-
-		while (n) {
-			struct vmap_area *tmp;
-			tmp = rb_entry(n, struct vmap_area, rb_node);
-			if (tmp->va_end >= addr) {
-				first = tmp;
-				if (tmp->va_start <= addr)
-					break;
-				n = n->rb_left;
-			} else
-				n = n->rb_right;
-		}
-
-		if (!first)
-			goto found;
-	}
-
-	/* from the starting point, walk areas until a suitable hole is found */
-	while (addr + size > first->va_start && addr + size <= vend) {
-		if (addr + cached_hole_size < first->va_start)
-			cached_hole_size = first->va_start - addr;
-		addr = ALIGN(first->va_end, align);
-		if (addr + size - 1 < addr)
+		if (addr + size > vend)
 			goto overflow;
-
-		n = rb_next(&first->rb_node);
-		if (n)
-			first = rb_entry(n, struct vmap_area, rb_node);
-		else
-			goto found;
 	}
 
-found:
-	if (addr + size > vend)
-		goto overflow;
-
 	va->va_start = addr;
 	va->va_end = addr + size;
 	va->flags = 0;
 	__insert_vmap_area(va);
-	free_vmap_cache = &va->rb_node;
 	spin_unlock(&vmap_area_lock);
 
 	BUG_ON(va->va_start & (align-1));
@@ -454,26 +519,23 @@ overflow:
 
 static void __free_vmap_area(struct vmap_area *va)
 {
+	struct vmap_area *next = NULL;
+	struct rb_node *deepest;
+
 	BUG_ON(RB_EMPTY_NODE(&va->rb_node));
 
-	if (free_vmap_cache) {
-		if (va->va_end < cached_vstart) {
-			free_vmap_cache = NULL;
-		} else {
-			struct vmap_area *cache;
-			cache = rb_entry(free_vmap_cache, struct vmap_area, rb_node);
-			if (va->va_start <= cache->va_start) {
-				free_vmap_cache = rb_prev(&va->rb_node);
-				/*
-				 * We don't try to update cached_hole_size or
-				 * cached_align, but it won't go very wrong.
-				 */
-			}
-		}
-	}
+	if (va->list.next != &vmap_area_list)
+		next = list_entry(va->list.next, struct vmap_area, list);
+
+	deepest = rb_augment_erase_begin(&va->rb_node);
 	rb_erase(&va->rb_node, &vmap_area_root);
 	RB_CLEAR_NODE(&va->rb_node);
 	list_del_rcu(&va->list);
+	rb_augment_erase_end(deepest, vmap_area_augment_cb, NULL);
+
+	/* the hole below the next area now extends over va */
+	if (next)
+		vmap_area_augment_propagate(next);
 
 	/*
 	 * Track the highest possible candidate for pcpu area
@@ -553,6 +615,13 @@ static unsigned long lazy_max_pages(void)
 
 static atomic_t vmap_lazy_nr = ATOMIC_INIT(0);
 
+/*
+ * Lazily freed areas wait on a list of the cpu that freed them, so that
+ * frees do not all hit the same cacheline and a purge only looks at the
+ * lazily freed areas rather than walking every vmap area.
+ */
+static DEFINE_PER_CPU(struct llist_head, vmap_purge_list);
+
 /* for per-CPU blocks */
 static void purge_fragmented_blocks_allcpus(void);
 
@@ -579,10 +648,11 @@ static void __purge_vmap_area_lazy(unsigned long *start, unsigned long *end,
 					int sync, int force_flush)
 {
 	static DEFINE_SPINLOCK(purge_lock);
-	LIST_HEAD(valist);
+	struct llist_node *valist = NULL;
+	struct llist_node *node;
 	struct vmap_area *va;
-	struct vmap_area *n_va;
 	int nr = 0;
+	int cpu;
 
 	/*
 	 * If sync is 0 but force_flush is 1, we'll go sync anyway but callers
@@ -598,20 +668,23 @@ static void __purge_vmap_area_lazy(unsigned long *start, unsigned long *end,
 	if (sync)
 		purge_fragmented_blocks_allcpus();
 
-	rcu_read_lock();
-	list_for_each_entry_rcu(va, &vmap_area_list, list) {
-		if (va->flags & VM_LAZY_FREE) {
+	for_each_possible_cpu(cpu) {
+		node = llist_del_all(&per_cpu(vmap_purge_list, cpu));
+		while (node) {
+			va = llist_entry(node, struct vmap_area, purge_list);
+			node = llist_next(node);
+
 			if (va->va_start < *start)
 				*start = va->va_start;
 			if (va->va_end > *end)
 				*end = va->va_end;
 			nr += (va->va_end - va->va_start) >> PAGE_SHIFT;
-			list_add_tail(&va->purge_list, &valist);
 			va->flags |= VM_LAZY_FREEING;
 			va->flags &= ~VM_LAZY_FREE;
+			va->purge_list.next = valist;
+			valist = &va->purge_list;
 		}
 	}
-	rcu_read_unlock();
 
 	if (nr)
 		atomic_sub(nr, &vmap_lazy_nr);
@@ -621,8 +694,11 @@ static void __purge_vmap_area_lazy(unsigned long *start, unsigned long *end,
 
 	if (nr) {
 		spin_lock(&vmap_area_lock);
-		list_for_each_entry_safe(va, n_va, &valist, purge_list)
+		while (valist) {
+			va = llist_entry(valist, struct vmap_area, purge_list);
+			valist = llist_next(valist);
 			__free_vmap_area(va);
+		}
 		spin_unlock(&vmap_area_lock);
 	}
 	spin_unlock(&purge_lock);
@@ -656,9 +732,17 @@ static void purge_vmap_area_lazy(void)
  */
 static void free_vmap_area_noflush(struct vmap_area *va)
 {
+	int nr_lazy;
+
 	va->flags |= VM_LAZY_FREE;
-	atomic_add((va->va_end - va->va_start) >> PAGE_SHIFT, &vmap_lazy_nr);
-	if (unlikely(atomic_read(&vmap_lazy_nr) > lazy_max_pages()))
+	nr_lazy = atomic_add_return((va->va_end - va->va_start) >> PAGE_SHIFT,
+				    &vmap_lazy_nr);
+
+	/* After this point, a purge may free va at any time */
+	llist_add(&va->purge_list, &get_cpu_var(vmap_purge_list));
+	put_cpu_var(vmap_purge_list);
+
+	if (unlikely(nr_lazy > lazy_max_pages()))
 		try_purge_vmap_area_lazy();
 }
 
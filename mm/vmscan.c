@@ -43,6 +43,7 @@
 #include <linux/sysctl.h>
 #include <linux/oom.h>
 #include <linux/prefetch.h>
+#include <linux/hugetlb.h>
 
 #include <asm/tlbflush.h>
 #include <asm/div64.h>
@@ -535,9 +536,11 @@ static pageout_t pageout(struct page *page, struct address_space *mapping,
 
 /*
  * Same as remove_mapping, but if the page is removed from the mapping, it
- * gets returned with a refcount of 0.
+ * gets returned with a refcount of 0.  If @reclaimed, a file page leaves
+ * a shadow entry behind for refault detection.
  */
-static int __remove_mapping(struct address_space *mapping, struct page *page)
+static int __remove_mapping(struct address_space *mapping, struct page *page,
+			    bool reclaimed)
 {
 	BUG_ON(!PageLocked(page));
 	BUG_ON(mapping != page_mapping(page));
@@ -583,10 +586,18 @@ static int __remove_mapping(struct address_space *mapping, struct page *page)
 		swapcache_free(swap, page);
 	} else {
 		void (*freepage)(struct page *);
+		void *shadow = NULL;
 
 		freepage = mapping->a_ops->freepage;
 
-		__delete_from_page_cache(page);
+		/*
+		 * Remember when the page was evicted.  Truncation clears
+		 * shadow entries once the last page is gone, and it cannot
+		 * get there while we hold the page lock.
+		 */
+		if (reclaimed && page_is_file_cache(page))
+			shadow = workingset_eviction(mapping, page);
+		__delete_from_page_cache(page, shadow);
 		spin_unlock_irq(&mapping->tree_lock);
 		mem_cgroup_uncharge_cache_page(page);
 
@@ -609,7 +620,7 @@ cannot_free:
  */
 int remove_mapping(struct address_space *mapping, struct page *page)
 {
-	if (__remove_mapping(mapping, page)) {
+	if (__remove_mapping(mapping, page, false)) {
 		/*
 		 * Unfreezing the refcount with 1 rather than 2 effectively
 		 * drops the pagecache ref for us without requiring another
@@ -694,6 +705,199 @@ redo:
 	put_page(page);		/* drop ref from isolate */
 }
 
+#ifdef CONFIG_LRU_GEN
+/*
+ * Multi-generation LRU
+ *
+ * Instead of sampling the referenced bits of every page it rotates
+ * through the rmap, reclaim can sort pages into generations.  kswapd
+ * periodically ages memory: it opens a new generation by bumping
+ * lru_gen_max_seq and walks the page tables of every process, moving
+ * each page whose accessed bit is set into that generation.  Walking
+ * page tables touches many ptes per cache line and never chases anon_vma
+ * or i_mmap chains, which is far cheaper than the rmap walk.
+ *
+ * The active and inactive lists stay as they are, so isolation, memcg
+ * accounting and putback are unchanged.  The generation only decides
+ * what happens to a page once reclaim looks at it: active pages that
+ * were accessed in one of the last MIN_NR_GENS generations stay active
+ * and inactive pages from those generations are activated, in both cases
+ * without an rmap walk.  Everything else goes through the classic logic,
+ * which is also used until aging has run, when the policy is switched
+ * off in /sys/kernel/mm/lru_gen/enabled, and when reclaim is struggling.
+ */
+#ifdef CONFIG_LRU_GEN_ENABLED
+int lru_gen_enable __read_mostly = 1;
+#else
+int lru_gen_enable __read_mostly;
+#endif
+unsigned long lru_gen_max_seq;
+
+static unsigned int lru_gen_min_interval_ms __read_mostly = 1000;
+static unsigned long lru_gen_last_walk;
+static DEFINE_MUTEX(lru_gen_walk_mutex);
+
+static int lru_gen_pte_range(pmd_t *pmd, unsigned long addr,
+			     unsigned long end, struct mm_walk *walk)
+{
+	struct vm_area_struct *vma = walk->private;
+	unsigned long gen = lru_gen_from_seq(lru_gen_max_seq);
+	unsigned long nr_young = 0;
+	pte_t *pte, ptent;
+	spinlock_t *ptl;
+	struct page *page;
+
+	/* Age a huge page through its pmd rather than splitting it */
+	spin_lock(&walk->mm->page_table_lock);
+	if (pmd_trans_huge(*pmd)) {
+		if (pmd_trans_splitting(*pmd)) {
+			spin_unlock(&walk->mm->page_table_lock);
+			wait_split_huge_page(vma->anon_vma, pmd);
+		} else {
+			if (pmdp_test_and_clear_young(vma, addr, pmd)) {
+				set_page_lru_gen(pmd_page(*pmd), gen);
+				count_vm_events(LRU_GEN_YOUNG, HPAGE_PMD_NR);
+			}
+			spin_unlock(&walk->mm->page_table_lock);
+			return 0;
+		}
+	} else {
+		spin_unlock(&walk->mm->page_table_lock);
+	}
+	if (pmd_none_or_clear_bad(pmd))
+		return 0;
+
+	pte = pte_offset_map_lock(walk->mm, pmd, addr, &ptl);
+	for (; addr != end; pte++, addr += PAGE_SIZE) {
+		ptent = *pte;
+		if (!pte_present(ptent) || !pte_young(ptent))
+			continue;
+
+		page = vm_normal_page(vma, addr, ptent);
+		if (!page)
+			continue;
+
+		if (ptep_test_and_clear_young(vma, addr, pte)) {
+			set_page_lru_gen(page, gen);
+			nr_young++;
+		}
+	}
+	pte_unmap_unlock(pte - 1, ptl);
+	count_vm_events(LRU_GEN_YOUNG, nr_young);
+	cond_resched();
+	return 0;
+}
+
+static void lru_gen_walk_mm(struct mm_struct *mm)
+{
+	struct vm_area_struct *vma;
+	struct mm_walk lru_gen_walk = {
+		.pmd_entry = lru_gen_pte_range,
+		.mm = mm,
+	};
+
+	/* Never wait for a writer, the next aging pass will catch up */
+	if (!down_read_trylock(&mm->mmap_sem))
+		return;
+	for (vma = mm->mmap; vma; vma = vma->vm_next) {
+		if (is_vm_hugetlb_page(vma))
+			continue;
+		if (vma->vm_flags & (VM_IO | VM_PFNMAP | VM_LOCKED))
+			continue;
+		lru_gen_walk.private = vma;
+		walk_page_range(vma->vm_start, vma->vm_end, &lru_gen_walk);
+	}
+	flush_tlb_mm(mm);
+	up_read(&mm->mmap_sem);
+}
+
+/*
+ * Open a new generation and move everything accessed since the last
+ * one into it.  Only one task ages at a time, at most once every
+ * lru_gen_min_interval_ms.
+ */
+static void lru_gen_age(void)
+{
+	unsigned long interval = msecs_to_jiffies(lru_gen_min_interval_ms);
+	struct task_struct *p;
+
+	if (!lru_gen_enable)
+		return;
+	if (lru_gen_max_seq &&
+	    time_before(jiffies, lru_gen_last_walk + interval))
+		return;
+	if (!mutex_trylock(&lru_gen_walk_mutex))
+		return;
+	if (lru_gen_max_seq &&
+	    time_before(jiffies, lru_gen_last_walk + interval))
+		goto out;
+
+	lru_gen_max_seq++;
+	count_vm_event(LRU_GEN_WALK);
+
+	rcu_read_lock();
+	for_each_process(p) {
+		struct mm_struct *mm;
+		int alive;
+
+		if (p->flags & PF_KTHREAD)
+			continue;
+		mm = get_task_mm(p);
+		if (!mm)
+			continue;
+		get_task_struct(p);
+		rcu_read_unlock();
+
+		lru_gen_walk_mm(mm);
+		mmput(mm);
+
+		rcu_read_lock();
+		/* An unhashed task can no longer lead us to the next one */
+		alive = pid_alive(p);
+		put_task_struct(p);
+		if (!alive)
+			break;
+	}
+	rcu_read_unlock();
+
+	lru_gen_last_walk = jiffies;
+out:
+	mutex_unlock(&lru_gen_walk_mutex);
+}
+
+/*
+ * Trust the generations while reclaim makes progress; once it has to
+ * dig deep, sample every page again as the classic LRU does.
+ */
+static bool lru_gen_reclaim(int priority)
+{
+	return lru_gen_enabled() && priority >= DEF_PRIORITY - 2;
+}
+
+/*
+ * Aging clears the accessed bits it finds, so once reclaim samples them
+ * again, a page that aging saw accessed recently counts as referenced.
+ */
+static bool lru_gen_referenced(struct page *page)
+{
+	return lru_gen_enabled() && page_lru_gen_young(page);
+}
+#else
+static inline void lru_gen_age(void)
+{
+}
+
+static inline bool lru_gen_reclaim(int priority)
+{
+	return false;
+}
+
+static inline bool lru_gen_referenced(struct page *page)
+{
+	return false;
+}
+#endif /* CONFIG_LRU_GEN */
+
 enum page_references {
 	PAGEREF_RECLAIM,
 	PAGEREF_RECLAIM_CLEAN,
@@ -703,12 +907,26 @@ enum page_references {
 
 static enum page_references page_check_references(struct page *page,
 						  struct mem_cgroup_zone *mz,
-						  struct scan_control *sc)
+						  struct scan_control *sc,
+						  int priority)
 {
 	int referenced_ptes, referenced_page;
 	unsigned long vm_flags;
 
+	if (lru_gen_reclaim(priority) &&
+	    !(sc->reclaim_mode & RECLAIM_MODE_LUMPYRECLAIM)) {
+		if (page_lru_gen_young(page)) {
+#ifdef CONFIG_LRU_GEN
+			count_vm_event(LRU_GEN_ACTIVATED);
+#endif
+			return PAGEREF_ACTIVATE;
+		}
+		lru_gen_clear_page(page);
+	}
+
 	referenced_ptes = page_referenced(page, 1, mz->mem_cgroup, &vm_flags);
+	if (!referenced_ptes && lru_gen_referenced(page))
+		referenced_ptes = 1;
 	referenced_page = TestClearPageReferenced(page);
 
 	/* Lumpy reclaim - ignore references */
@@ -829,7 +1047,7 @@ static unsigned long shrink_page_list(struct list_head *page_list,
 			}
 		}
 
-		references = page_check_references(page, mz, sc);
+		references = page_check_references(page, mz, sc, priority);
 		switch (references) {
 		case PAGEREF_ACTIVATE:
 			goto activate_locked;
@@ -969,7 +1187,7 @@ static unsigned long shrink_page_list(struct list_head *page_list,
 			}
 		}
 
-		if (!mapping || !__remove_mapping(mapping, page))
+		if (!mapping || !__remove_mapping(mapping, page, true))
 			goto keep_locked;
 
 		/*
@@ -1700,6 +1918,8 @@ static void shrink_active_list(unsigned long nr_to_scan,
 	struct page *page;
 	struct zone_reclaim_stat *reclaim_stat = get_reclaim_stat(mz);
 	unsigned long nr_rotated = 0;
+	unsigned long nr_protected = 0;
+	bool use_gen = lru_gen_reclaim(priority);
 	isolate_mode_t reclaim_mode = ISOLATE_ACTIVE;
 	struct zone *zone = mz->zone;
 
@@ -1738,7 +1958,17 @@ static void shrink_active_list(unsigned long nr_to_scan,
 			continue;
 		}
 
-		if (page_referenced(page, 0, mz->mem_cgroup, &vm_flags)) {
+		if (use_gen) {
+			/* Recently accessed, no need to ask the rmap */
+			if (page_lru_gen_young(page)) {
+				nr_rotated += hpage_nr_pages(page);
+				nr_protected++;
+				list_add(&page->lru, &l_active);
+				continue;
+			}
+			lru_gen_clear_page(page);
+		} else if (page_referenced(page, 0, mz->mem_cgroup, &vm_flags) ||
+			   lru_gen_referenced(page)) {
 			nr_rotated += hpage_nr_pages(page);
 			/*
 			 * Identify referenced, file-backed active pages and
@@ -1770,6 +2000,9 @@ static void shrink_active_list(unsigned long nr_to_scan,
 	 * get_scan_ratio.
 	 */
 	reclaim_stat->recent_rotated[file] += nr_rotated;
+#ifdef CONFIG_LRU_GEN
+	__count_vm_events(LRU_GEN_PROTECTED, nr_protected);
+#endif
 
 	move_active_pages_to_lru(zone, &l_active, &l_hold,
 						LRU_ACTIVE + file * LRU_FILE);
@@ -2144,6 +2377,9 @@ static void shrink_zone(int priority, struct zone *zone,
 	};
 	struct mem_cgroup *memcg;
 
+	if (current_is_kswapd())
+		lru_gen_age();
+
 	memcg = mem_cgroup_iter(root, NULL, &reclaim);
 	do {
 		struct mem_cgroup_zone mz = {
@@ -2970,6 +3206,13 @@ static void kswapd_try_to_sleep(pg_data_t *pgdat, int order, int classzone_idx)
 		 * them before going back to sleep.
 		 */
 		set_pgdat_percpu_threshold(pgdat, calculate_normal_threshold);
+
+		/*
+		 * Reclaim for a high-order request is done: let kcompactd
+		 * turn the freed pages into blocks of that order.
+		 */
+		wakeup_kcompactd(pgdat, order, classzone_idx);
+
 		schedule();
 		set_pgdat_percpu_threshold(pgdat, calculate_pressure_threshold);
 	} else {
@@ -3259,6 +3502,88 @@ static int __init kswapd_init(void)
 
 module_init(kswapd_init)
 
+#if defined(CONFIG_LRU_GEN) && defined(CONFIG_SYSFS)
+#define LRU_GEN_ATTR_RO(_name) \
+	static struct kobj_attribute _name##_attr = __ATTR_RO(_name)
+#define LRU_GEN_ATTR(_name) \
+	static struct kobj_attribute _name##_attr = \
+		__ATTR(_name, 0644, _name##_show, _name##_store)
+
+static ssize_t enabled_show(struct kobject *kobj,
+			    struct kobj_attribute *attr, char *buf)
+{
+	return sprintf(buf, "%d\n", lru_gen_enable);
+}
+
+static ssize_t enabled_store(struct kobject *kobj,
+			     struct kobj_attribute *attr,
+			     const char *buf, size_t count)
+{
+	unsigned long enable;
+	int err;
+
+	err = strict_strtoul(buf, 10, &enable);
+	if (err || enable > 1)
+		return -EINVAL;
+
+	lru_gen_enable = enable;
+	return count;
+}
+LRU_GEN_ATTR(enabled);
+
+static ssize_t min_interval_ms_show(struct kobject *kobj,
+				    struct kobj_attribute *attr, char *buf)
+{
+	return sprintf(buf, "%u\n", lru_gen_min_interval_ms);
+}
+
+static ssize_t min_interval_ms_store(struct kobject *kobj,
+				     struct kobj_attribute *attr,
+				     const char *buf, size_t count)
+{
+	unsigned long msecs;
+	int err;
+
+	err = strict_strtoul(buf, 10, &msecs);
+	if (err || msecs > UINT_MAX)
+		return -EINVAL;
+
+	lru_gen_min_interval_ms = msecs;
+	return count;
+}
+LRU_GEN_ATTR(min_interval_ms);
+
+static ssize_t max_seq_show(struct kobject *kobj,
+			    struct kobj_attribute *attr, char *buf)
+{
+	return sprintf(buf, "%lu\n", lru_gen_max_seq);
+}
+LRU_GEN_ATTR_RO(max_seq);
+
+static struct attribute *lru_gen_attrs[] = {
+	&enabled_attr.attr,
+	&min_interval_ms_attr.attr,
+	&max_seq_attr.attr,
+	NULL,
+};
+
+static struct attribute_group lru_gen_attr_group = {
+	.attrs = lru_gen_attrs,
+	.name = "lru_gen",
+};
+
+static int __init lru_gen_init(void)
+{
+	int err;
+
+	err = sysfs_create_group(mm_kobj, &lru_gen_attr_group);
+	if (err)
+		printk(KERN_ERR "lru_gen: register sysfs failed\n");
+	return err;
+}
+module_init(lru_gen_init)
+#endif /* CONFIG_LRU_GEN && CONFIG_SYSFS */
+
 #ifdef CONFIG_NUMA
 /*
  * Zone reclaim mode
@@ -0,0 +1,145 @@
+/*
+ * mm/workingset.c - workingset detection
+ *
+ * Tell apart page cache that is thrashing from page cache that is
+ * merely used once, by remembering when pages were evicted.
+ */
+
+#include <linux/kernel.h>
+#include <linux/mm.h>
+#include <linux/fs.h>
+#include <linux/swap.h>
+#include <linux/pagemap.h>
+#include <linux/radix-tree.h>
+#include <linux/atomic.h>
+#include <linux/vmstat.h>
+
+/*
+ * File pages start out on the inactive list and are only activated
+ * when they are accessed again while still on it.  The inactive list
+ * does not grow at the expense of the active list, so if the set of
+ * pages that is accessed repeatedly is bigger than the inactive list but
+ * fits into memory, those pages are evicted before their second access
+ * and read back in over and over again, while the active list holds on
+ * to pages that are no longer used.
+ *
+ * To notice this, every zone counts the evictions and activations on
+ * its inactive file list in zone->inactive_age.  When a page is evicted
+ * the current value is stored in a shadow entry, an exceptional entry
+ * left in the page's slot of the page cache radix tree.  When the page
+ * is faulted back in, the difference between the counter and the value
+ * in the shadow entry tells how many pages the inactive list would have
+ * needed in addition to keep the page around until its refault: the
+ * refault distance.
+ *
+ * Making room for the page on the inactive list could only have come
+ * from the active list.  So if the refault distance is not larger than
+ * the active file list, the page had a fair chance to be activated had
+ * the lists been balanced differently, and it is activated right away
+ * to compete with the active pages.  If the active pages are still in
+ * use they stay resident, otherwise they are deactivated and evicted in
+ * favour of the pages that are being thrashed.
+ *
+ * Shadow entries are left behind by reclaim only.  They are removed when
+ * a page is added at their index, when the file is truncated, and when
+ * the inode is evicted.  Until then they pin radix tree nodes, so a file
+ * that is streamed through the page cache once would keep accumulating
+ * them.  But a shadow entry is only ever acted upon if fewer pages than
+ * the active file list were evicted from its zone after it, so once a
+ * mapping holds more shadow entries than there are active file pages in
+ * all zones together, its oldest ones are useless.  Reclaim does not add
+ * shadow entries to a mapping beyond that number.
+ */
+
+#define EVICTION_SHIFT	(RADIX_TREE_EXCEPTIONAL_SHIFT + \
+			 ZONES_SHIFT + NODES_SHIFT)
+#define EVICTION_MASK	(~0UL >> EVICTION_SHIFT)
+
+static void *pack_shadow(unsigned long eviction, struct zone *zone)
+{
+	eviction = (eviction << NODES_SHIFT) | zone_to_nid(zone);
+	eviction = (eviction << ZONES_SHIFT) | zone_idx(zone);
+	eviction = (eviction << RADIX_TREE_EXCEPTIONAL_SHIFT);
+
+	return (void *)(eviction | RADIX_TREE_EXCEPTIONAL_ENTRY);
+}
+
+static void unpack_shadow(void *shadow, struct zone **zone,
+			  unsigned long *distance)
+{
+	unsigned long entry = (unsigned long)shadow;
+	unsigned long eviction;
+	unsigned long refault;
+	int zid, nid;
+
+	entry >>= RADIX_TREE_EXCEPTIONAL_SHIFT;
+	zid = entry & ((1UL << ZONES_SHIFT) - 1);
+	entry >>= ZONES_SHIFT;
+	nid = entry & ((1UL << NODES_SHIFT) - 1);
+	entry >>= NODES_SHIFT;
+	eviction = entry;
+
+	*zone = NODE_DATA(nid)->node_zones + zid;
+
+	/*
+	 * The counter wraps in the bits left over in the shadow entry;
+	 * as long as the distance is smaller than that, the masked
+	 * difference is still correct.
+	 */
+	refault = atomic_long_read(&(*zone)->inactive_age);
+	*distance = (refault - eviction) & EVICTION_MASK;
+}
+
+/**
+ * workingset_eviction - note the eviction of a page from memory
+ * @mapping: address space the page was backing
+ * @page: the page being evicted
+ *
+ * Returns a shadow entry to be stored in @mapping->page_tree in place
+ * of the evicted @page so that a later refault can be detected, or NULL
+ * if @mapping already holds as many shadow entries as can be of use.
+ * The caller holds @mapping->tree_lock.
+ */
+void *workingset_eviction(struct address_space *mapping, struct page *page)
+{
+	struct zone *zone = page_zone(page);
+	unsigned long eviction;
+
+	eviction = atomic_long_inc_return(&zone->inactive_age);
+	if (mapping->nrshadows >= global_page_state(NR_ACTIVE_FILE))
+		return NULL;
+	return pack_shadow(eviction, zone);
+}
+
+/**
+ * workingset_refault - evaluate the refault of a previously evicted page
+ * @shadow: shadow entry of the evicted page
+ *
+ * Calculates and evaluates the refault distance of the previously
+ * evicted page in the context of the zone it was allocated in.
+ *
+ * Returns %true if the page should be activated, %false otherwise.
+ */
+bool workingset_refault(void *shadow)
+{
+	unsigned long refault_distance;
+	struct zone *zone;
+
+	unpack_shadow(shadow, &zone, &refault_distance);
+	inc_zone_state(zone, WORKINGSET_REFAULT);
+
+	if (refault_distance <= zone_page_state(zone, NR_ACTIVE_FILE)) {
+		inc_zone_state(zone, WORKINGSET_ACTIVATE);
+		return true;
+	}
+	return false;
+}
+
+/**
+ * workingset_activation - note a page activation
+ * @page: page that is being activated
+ */
+void workingset_activation(struct page *page)
+{
+	atomic_long_inc(&page_zone(page)->inactive_age);
+}
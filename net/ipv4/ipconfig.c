@@ -1349,6 +1349,9 @@ static int __init wait_for_devices(void)
 {
 	int i;
 
+	/* Network drivers may be probed asynchronously */
+	wait_for_device_probe();
+
 	for (i = 0; i < DEVICE_WAIT_MAX; i++) {
 		struct net_device *dev;
 		int found = 0;
@@ -25,7 +25,9 @@
 
 #
 # This script turns a dmesg output into a SVG graphic that shows which
-# functions take how much time. You can view SVG graphics with various
+# functions and device probes take how much time. Probes run from the async
+# domain show up on the row of the thread running them. You can view SVG
+# graphics with various
 # programs, including Inkscape, The Gimp and Firefox.
 #
 #
@@ -87,6 +89,26 @@ while (<>) {
 		$count = $count + 1;
 	}
 
+	if ($line =~ /([0-9\.]+)\] probing ([^ ]+) with ([^ ]+) @ ([0-9]+)/) {
+		my $func = "probe:" . $2;
+		if ($done == 0) {
+			$start{$func} = $1;
+			$type{$func} = 2;
+			if ($1 < $firsttime) {
+				$firsttime = $1;
+			}
+		}
+		$pids{$func} = $4;
+		$count = $count + 1;
+	}
+
+	if ($line =~ /([0-9\.]+)\] probe of ([^ ]+) returned/) {
+		if ($done == 0) {
+			$end{"probe:" . $2} = $1;
+			$maxtime = $1;
+		}
+	}
+
 	if ($line =~ /([0-9\.]+)\] initcall ([a-zA-Z0-9\_\.]+)\+.*returned/) {
 		if ($done == 0) {
 			$end{$2} = $1;
@@ -137,6 +159,7 @@ $styles[10] = "fill:rgb(255,128,255);fill-opacity:0.5;stroke-width:1;stroke:rgb(
 $styles[11] = "fill:rgb(128,255,255);fill-opacity:0.5;stroke-width:1;stroke:rgb(0,0,0)";
 
 my $style_wait = "fill:rgb(128,128,128);fill-opacity:0.5;stroke-width:0;stroke:rgb(0,0,0)";
+my $style_probe = "fill:rgb(255,128,0);fill-opacity:0.7;stroke-width:1;stroke:rgb(0,0,0)";
 
 my $mult = 1950.0 / ($maxtime - $firsttime);
 my $threshold2 = ($maxtime - $firsttime) / 120.0;
@@ -175,6 +198,13 @@ foreach my $key (@initcalls) {
 		if ($type{$key} == 1) {
 			$y = $y + 15;
 			print "<rect x=\"$s\" width=\"$w\" y=\"$y\" height=\"115\" style=\"$style_wait\"/>\n";
+		} elsif ($type{$key} == 2) {
+			# probes nest inside the initcall registering the driver
+			$y = $y + 30;
+			$s2 = $s + 1;
+			$y2 = $y + 4;
+			print "<rect x=\"$s\" width=\"$w\" y=\"$y\" height=\"85\" style=\"$style_probe\"/>\n";
+			print "<text transform=\"translate($s2,$y2) rotate(90)\" font-size=\"3pt\">$key</text>\n";
 		} else {
 			print "<rect x=\"$s\" width=\"$w\" y=\"$y\" height=\"145\" style=\"$style\"/>\n";
 			if ($duration >= $threshold2) {
@@ -0,0 +1,288 @@
+/*
+ * semop() scalability microbenchmark
+ *
+ * Licensed under the terms of the GNU GPL License version 2
+ *
+ * Forks 1, 2, 4, ... workers up to the number of online cpus. Each worker
+ * is pinned to its own cpu and repeatedly decrements and increments its own
+ * semaphore of one shared semaphore set, so the operations never block and
+ * never conflict. With per-semaphore locking the throughput should scale
+ * with the number of workers; with a single array lock it does not.
+ *
+ * Every round checks that all workers succeeded, that each semaphore is
+ * back at its initial value and that sem_otime was updated.  Before the
+ * rounds, all workers hammer one shared semaphore to check that no update
+ * is lost under concurrent simple semops.  The exit status is non-zero
+ * if any check fails.
+ *
+ * Usage: semop_bench [-s seconds] [-n nsems] [-c]
+ *   -s  runtime of each round (default 1)
+ *   -n  semaphores in the set (default 256)
+ *   -c  also queue a sleeping complex operation, which forces every
+ *       semop() back onto the array lock (for comparison)
+ */
+
+#define _GNU_SOURCE
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <signal.h>
+#include <sys/ipc.h>
+#include <sys/sem.h>
+#include <sys/mman.h>
+#include <sys/time.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <time.h>
+
+/* Up and down pairs per worker in the shared semaphore check */
+#define SHARED_LOOPS	100000
+
+union semun {
+	int val;
+	struct semid_ds *buf;
+	unsigned short *array;
+};
+
+struct shared {
+	volatile int start;
+	volatile int stop;
+	unsigned long ops[0];
+};
+
+static void pin(int cpu)
+{
+	cpu_set_t set;
+
+	CPU_ZERO(&set);
+	CPU_SET(cpu, &set);
+	sched_setaffinity(0, sizeof(set), &set);
+}
+
+static void worker(int semid, int idx, int cpu, struct shared *sh)
+{
+	struct sembuf down = { .sem_num = idx, .sem_op = -1, .sem_flg = 0 };
+	struct sembuf up = { .sem_num = idx, .sem_op = 1, .sem_flg = 0 };
+	unsigned long ops = 0;
+
+	pin(cpu);
+	while (!sh->start)
+		;
+	while (!sh->stop) {
+		if (semop(semid, &down, 1) || semop(semid, &up, 1)) {
+			perror("semop");
+			exit(1);
+		}
+		ops += 2;
+	}
+	sh->ops[idx] = ops;
+	_exit(0);
+}
+
+/* Reap @n children, returning the number that failed */
+static int wait_workers(int n)
+{
+	int status, failed = 0;
+
+	while (n--) {
+		if (wait(&status) < 0 ||
+		    !WIFEXITED(status) || WEXITSTATUS(status))
+			failed++;
+	}
+	return failed;
+}
+
+/*
+ * All workers increment and decrement one semaphore, then leave one
+ * increment each behind.  A lost update shows up in the final value.
+ */
+static int check_shared(int nworkers)
+{
+	struct sembuf up = { .sem_num = 0, .sem_op = 1, .sem_flg = 0 };
+	struct sembuf down = { .sem_num = 0, .sem_op = -1, .sem_flg = 0 };
+	union semun arg;
+	int semid, i, j, val, failed;
+
+	semid = semget(IPC_PRIVATE, 1, IPC_CREAT | 0600);
+	if (semid < 0) {
+		perror("semget");
+		return 1;
+	}
+	arg.val = 0;
+	semctl(semid, 0, SETVAL, arg);
+
+	for (i = 0; i < nworkers; i++) {
+		if (fork() == 0) {
+			pin(i);
+			for (j = 0; j < SHARED_LOOPS; j++) {
+				if (semop(semid, &up, 1) ||
+				    semop(semid, &down, 1))
+					_exit(1);
+			}
+			_exit(semop(semid, &up, 1) ? 1 : 0);
+		}
+	}
+
+	failed = wait_workers(nworkers);
+	val = semctl(semid, 0, GETVAL);
+	semctl(semid, 0, IPC_RMID);
+
+	if (failed || val != nworkers) {
+		printf("shared semaphore: %d workers failed, value %d, "
+		       "expected %d: FAIL\n", failed, val, nworkers);
+		return 1;
+	}
+	printf("shared semaphore: %d workers, value %d: ok\n",
+	       nworkers, val);
+	return 0;
+}
+
+/* A child that sleeps on a two-sop operation until the set is removed */
+static pid_t start_complex_sleeper(int semid, int nsems)
+{
+	struct sembuf sops[2] = {
+		{ .sem_num = nsems - 2, .sem_op = -1, .sem_flg = 0 },
+		{ .sem_num = nsems - 1, .sem_op = -1, .sem_flg = 0 },
+	};
+	pid_t pid = fork();
+
+	if (pid == 0) {
+		semop(semid, sops, 2);
+		_exit(0);
+	}
+	return pid;
+}
+
+static double run_round(int nworkers, int nsems, int seconds, int complex,
+			int ncpus, int *failures)
+{
+	struct shared *sh;
+	union semun arg;
+	struct semid_ds ds;
+	unsigned long total = 0;
+	pid_t sleeper = 0;
+	time_t start;
+	int semid, i, failed;
+
+	sh = mmap(NULL, sizeof(*sh) + nsems * sizeof(unsigned long),
+		  PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+	if (sh == MAP_FAILED) {
+		perror("mmap");
+		exit(1);
+	}
+
+	semid = semget(IPC_PRIVATE, nsems, IPC_CREAT | 0600);
+	if (semid < 0) {
+		perror("semget");
+		exit(1);
+	}
+	for (i = 0; i < nworkers; i++) {
+		arg.val = 1;
+		if (semctl(semid, i, SETVAL, arg) < 0) {
+			perror("semctl");
+			exit(1);
+		}
+	}
+
+	if (complex) {
+		sleeper = start_complex_sleeper(semid, nsems);
+		/* give it time to go to sleep */
+		usleep(100000);
+	}
+
+	for (i = 0; i < nworkers; i++) {
+		if (fork() == 0)
+			worker(semid, i, i % ncpus, sh);
+	}
+
+	start = time(NULL);
+	sh->start = 1;
+	sleep(seconds);
+	sh->stop = 1;
+
+	failed = wait_workers(nworkers);
+	for (i = 0; i < nworkers; i++) {
+		if (semctl(semid, i, GETVAL) != 1)
+			failed++;
+	}
+	arg.buf = &ds;
+	if (semctl(semid, 0, IPC_STAT, arg) < 0 || ds.sem_otime < start)
+		failed++;
+	if (failed) {
+		printf("%d workers: %d checks failed\n", nworkers, failed);
+		*failures += failed;
+	}
+
+	semctl(semid, 0, IPC_RMID);
+	if (sleeper)
+		waitpid(sleeper, NULL, 0);
+
+	for (i = 0; i < nworkers; i++)
+		total += sh->ops[i];
+
+	munmap(sh, sizeof(*sh) + nsems * sizeof(unsigned long));
+
+	return (double)total / seconds;
+}
+
+int main(int argc, char **argv)
+{
+	int seconds = 1, nsems = 256, complex = 0;
+	int ncpus, n, opt, failures = 0;
+	double base = 0;
+
+	while ((opt = getopt(argc, argv, "s:n:c")) != -1) {
+		switch (opt) {
+		case 's':
+			seconds = atoi(optarg);
+			break;
+		case 'n':
+			nsems = atoi(optarg);
+			break;
+		case 'c':
+			complex = 1;
+			break;
+		default:
+			fprintf(stderr, "usage: %s [-s seconds] [-n nsems] [-c]\n",
+				argv[0]);
+			return 1;
+		}
+	}
+
+	ncpus = sysconf(_SC_NPROCESSORS_ONLN);
+	if (ncpus < 1)
+		ncpus = 1;
+	if (nsems < ncpus + 2) {
+		fprintf(stderr, "need at least %d semaphores\n", ncpus + 2);
+		return 1;
+	}
+
+	failures += check_shared(ncpus);
+
+	printf("semop bench: %d semaphores, %ds per round%s\n", nsems, seconds,
+	       complex ? ", complex op pending" : "");
+	printf("%8s %16s %10s\n", "workers", "ops/s", "scaling");
+
+	fflush(stdout);
+
+	for (n = 1; n <= ncpus; n *= 2) {
+		double rate = run_round(n, nsems, seconds, complex, ncpus,
+					&failures);
+
+		if (n == 1)
+			base = rate;
+		printf("%8d %16.0f %9.2fx\n", n, rate, base ? rate / base : 0);
+		fflush(stdout);
+		if (n < ncpus && n * 2 > ncpus)
+			n = ncpus / 2;
+	}
+
+	if (failures) {
+		printf("semop bench: %d checks failed\n", failures);
+		return 1;
+	}
+	return 0;
+}